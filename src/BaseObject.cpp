@@ -444,21 +444,26 @@ void BaseObject::OnReady()
     o->OnReady();
 }
 
-void BaseObject::RunCommandByName(const std::string &event_name)
-{
-  auto it = commands_.find(event_name);
-  if (it != commands_.end())
-    RunCommand(it->second);
-}
+/* @brief Single command with resolved function and pre-parsed arguments. */
+struct CommandOp
+{
+  const CommandFnMap *fnmap;
+  const CommandFn *fn;
+  std::string name;
+  std::string value;
+  CommandArgs args;
+};
 
-void BaseObject::RunCommand(std::string command)
+struct CompiledCommand
 {
-  // @warn
-  // RunCommand parameter must be passed by value, not by reference
-  // since original command string might be destroyed while processing command
-  // e.g. command 'flush' clears event early and it destroys original command.
+  std::vector<CommandOp> ops;
+};
 
-  if (command.empty()) return;
+/* @brief Compile "cmd:value;cmd:value" string.
+ * Unknown commands are dropped, as they are never executed. */
+static void CompileCommand(const CommandFnMap &fnmap, const std::string &command,
+                           CompiledCommand &out)
+{
   size_t ia = 0, ib = 0;
   std::string cmd_type, value;
   while (ib <= command.size())
@@ -466,44 +471,114 @@ void BaseObject::RunCommand(std::string command)
     if (command[ib] == ';' || command[ib] == 0)
     {
       Split(command.substr(ia, ib - ia), ':', cmd_type, value);
-      RunCommand(cmd_type, value);
+      auto it = fnmap.find(cmd_type);
+      if (it != fnmap.end())
+      {
+        out.ops.emplace_back();
+        CommandOp &op = out.ops.back();
+        op.fnmap = &fnmap;
+        op.fn = &it->second;
+        op.name = cmd_type;
+        op.value = value;
+        op.args.Parse(value);
+      }
       ia = ib = ib + 1;
     }
     else ++ib;
   }
 }
 
+void BaseObject::RunCommandByName(const std::string &event_name)
+{
+  RunCommandByID(EventManager::GetEventID(event_name));
+}
+
+void BaseObject::RunCommandByID(int event_id)
+{
+  auto it = commands_.find(event_id);
+  if (it != commands_.end() && it->second.compiled)
+  {
+    // hold reference, as command might be replaced while processing
+    // (e.g. command 'flush' clears event early)
+    std::shared_ptr<const CompiledCommand> cmd = it->second.compiled;
+    RunCommand(*cmd);
+  }
+}
+
+void BaseObject::RunCommand(std::string command)
+{
+  // @warn
+  // RunCommand parameter must be passed by value, not by reference
+  // since original command string might be destroyed while processing command
+  // e.g. command 'flush' clears event early and it destroys original command.
+
+  if (command.empty()) return;
+  CompiledCommand cmd;
+  CompileCommand(GetCommandFnMap(), command, cmd);
+  RunCommand(cmd);
+}
+
+void BaseObject::RunCommand(const CompiledCommand &command)
+{
+  for (auto &op : command.ops)
+    RunCommandOp(op);
+}
+
 void BaseObject::RunCommand(const std::string &command, const std::string& value)
 {
   auto &fnmap = GetCommandFnMap();
   auto it = fnmap.find(command);
   if (it == fnmap.end())
     return;
-  else
+
+  CommandOp op;
+  op.fnmap = &fnmap;
+  op.fn = &it->second;
+  op.name = command;
+  op.value = value;
+  op.args.Parse(value);
+  RunCommandOp(op);
+}
+
+void BaseObject::RunCommandOp(const CommandOp &op)
+{
+  const CommandFn *fn = op.fn;
+
+  // resolve function again only if object uses different command map.
+  auto &fnmap = GetCommandFnMap();
+  if (&fnmap != op.fnmap)
   {
-    try
-    {
-      CommandArgs args(value);
-      it->second(this, args, value);
-    }
-    catch (std::out_of_range&)
-    {
-      std::cerr << "Error: Command parameter is not enough to execute " << command << std::endl;
-    }
+    auto it = fnmap.find(op.name);
+    if (it == fnmap.end())
+      return;
+    fn = &it->second;
+  }
+
+  try
+  {
+    // arguments are not modified by command function.
+    (*fn)(this, const_cast<CommandArgs&>(op.args), op.value);
+  }
+  catch (std::out_of_range&)
+  {
+    std::cerr << "Error: Command parameter is not enough to execute " << op.name << std::endl;
   }
   if (propagate_event_)
   {
     for (auto *obj : children_)
-      obj->RunCommand(command, value);
+      obj->RunCommandOp(op);
   }
 }
 
 /* just clear out command, without event unregister. */
 void BaseObject::ClearCommand(const std::string &name)
 {
-  auto it = commands_.find(name);
+  auto it = commands_.find(EventManager::GetEventID(name));
   if (it != commands_.end())
-    commands_[name].clear();
+  {
+    it->second.command.clear();
+    it->second.compiled.reset();
+  }
 }
 
 void BaseObject::DeleteAllCommand()
@@ -529,21 +604,33 @@ void BaseObject::QueueCommand(const std::string &command)
 void BaseObject::AddCommand(const std::string &name, const std::string &command)
 {
   // Append command if already exist.
-  auto it = commands_.find(name);
+  int event_id = EventManager::GetEventID(name);
+  auto it = commands_.find(event_id);
   if (it == commands_.end())
   {
-    commands_[name] = command;
+    it = commands_.insert({ event_id, CommandEntry() }).first;
+    it->second.command = command;
 
     // add event handler if not registered
-    SubscribeTo(name);
+    SubscribeTo(event_id);
   }
   else
   {
-    if (it->second.empty())
-      it->second = command;
+    if (it->second.command.empty())
+      it->second.command = command;
     else
-      it->second += ";" + command;
+      it->second.command += ";" + command;
   }
+
+  // compile command here only once, not every time event is fired.
+  // only appended command is compiled, so adding many commands is linear.
+  // make a copy if previous one might be running now (referenced by runner).
+  auto &compiled = it->second.compiled;
+  if (!compiled)
+    compiled = std::make_shared<CompiledCommand>();
+  else if (compiled.use_count() > 1)
+    compiled = std::make_shared<CompiledCommand>(*compiled);
+  CompileCommand(GetCommandFnMap(), command, *compiled);
 }
 
 /* @warn Load() methods automatically calls LoadCommand(). */
@@ -585,7 +672,7 @@ void BaseObject::HurryTween()
 
 bool BaseObject::OnEvent(const EventMessage& msg)
 {
-  RunCommandByName(msg.GetEventName());
+  RunCommandByID(msg.GetEventID());
   return true;
 }
 
@@ -1411,7 +1498,7 @@ std::string BaseObject::toString() const
     ss << "events:" << std::endl;
     for (auto &i : commands_)
     {
-      ss << " - " << i.first << " : " << i.second << std::endl;
+      ss << " - " << EventManager::GetEventName(i.first) << " : " << i.second.command << std::endl;
     }
   }
   ss << "pos (rect) : " << frame_.pos.x << "," << frame_.pos.y << "," << frame_.pos.w << "," << frame_.pos.z << std::endl;
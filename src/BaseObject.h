@@ -50,6 +50,10 @@ typedef std::function<void(void*, CommandArgs&, const std::string&)> CommandFn;
 /** @brief Command mapping for object. */
 typedef std::map<std::string, CommandFn> CommandFnMap;
 
+/** @brief Command string compiled into functions with pre-parsed arguments. */
+struct CommandOp;
+struct CompiledCommand;
+
 /** @brief Tweens' ease type */
 enum EaseTypes
 {
@@ -175,6 +179,7 @@ public:
    * So, commands has more limitation than metric property.
    */
   void RunCommandByName(const std::string &name);
+  void RunCommandByID(int event_id);
   void RunCommand(std::string command);
   void ClearCommand(const std::string &name);
   void DeleteAllCommand();
@@ -193,6 +198,9 @@ public:
    */
   void RunCommand(const std::string &commandname, const std::string& value);
 
+  /* @brief Run command compiled by AddCommand(), without parsing. */
+  void RunCommand(const CompiledCommand &command);
+
   /* @brief Inherited from EventReceiver */
   virtual bool OnEvent(const EventMessage& msg);
 
@@ -363,7 +371,12 @@ protected:
   Vector4 bg_color_;
 
   // commands to be called
-  std::map<std::string, std::string> commands_;
+  struct CommandEntry
+  {
+    std::string command;
+    std::shared_ptr<CompiledCommand> compiled;
+  };
+  std::map<int, CommandEntry> commands_;  /* indexed by event id */
 
   // information for debugging
   std::string debug_;
@@ -375,6 +388,7 @@ protected:
   virtual void doRenderAfter();
 
   virtual const CommandFnMap& GetCommandFnMap();
+  void RunCommandOp(const CommandOp &op);
 };
 
 }
\ No newline at end of file
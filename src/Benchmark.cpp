@@ -0,0 +1,1237 @@
+#include "Benchmark.h"
+#include "ResourceManager.h"
+#include "TaskPool.h"
+#include "Image.h"
+#include "Sound.h"
+#include "Song.h"
+#include "Game.h"
+#include "PlaySession.h"
+#include "Player.h"
+#include "BaseObject.h"
+#include "Event.h"
+#include "Timer.h"
+#include "Logger.h"
+#include "Util.h"
+#include <FreeImage.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+# include <direct.h>
+# include <windows.h>
+# include <psapi.h>
+# if defined(_MSC_VER)
+#  pragma comment(lib, "psapi.lib")
+# endif
+#else
+# include <unistd.h>
+# include <sys/resource.h>
+#endif
+
+namespace rhythmus
+{
+
+static double GetBenchmarkTime()
+{
+  using namespace std::chrono;
+  return duration<double, std::milli>(
+    steady_clock::now().time_since_epoch()).count();
+}
+
+/* @brief peak resident memory of this process, in bytes. */
+static size_t GetPeakMemory()
+{
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS pmc;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+    return 0;
+  return pmc.PeakWorkingSetSize;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+# if defined(__APPLE__)
+  return (size_t)usage.ru_maxrss;
+# else
+  return (size_t)usage.ru_maxrss * 1024;
+# endif
+#endif
+}
+
+// ------------------------------------------------------------------ resource
+
+/* synthetic chart resource in memory */
+struct BenchmarkResource
+{
+  std::string name;
+  std::string data;
+  bool is_sound;
+};
+
+/* 16bit stereo PCM wave, like a short keysound. */
+static void MakeWaveFile(std::string &out, unsigned samples, double freq)
+{
+  const uint32_t data_size = samples * 4;
+  const uint32_t header[] = {
+    0x46464952 /* RIFF */, 36 + data_size, 0x45564157 /* WAVE */,
+    0x20746d66 /* fmt */, 16, (2u << 16) | 1u /* PCM, stereo */,
+    44100, 44100 * 4, (16u << 16) | 4u /* align 4, 16bit */,
+    0x61746164 /* data */, data_size
+  };
+  out.assign((const char*)header, sizeof(header));
+  out.resize(sizeof(header) + data_size);
+  int16_t *p = (int16_t*)&out[sizeof(header)];
+  for (unsigned i = 0; i < samples; ++i)
+  {
+    int16_t v = (int16_t)(sin(i * freq * 2 * 3.14159265 / 44100) * 12000);
+    p[i * 2] = p[i * 2 + 1] = v;
+  }
+}
+
+/* 24/32bit PNG image, like a BGA frame. */
+static void MakePngFile(std::string &out, unsigned size, unsigned seed,
+                        unsigned bpp)
+{
+  FIBITMAP *bitmap = FreeImage_Allocate(size, size, bpp);
+  const unsigned pitch = FreeImage_GetPitch(bitmap);
+  const unsigned pixel_size = bpp / 8;
+  uint8_t *bits = FreeImage_GetBits(bitmap);
+  unsigned rnd = seed * 2654435761u + 1;
+  for (unsigned y = 0; y < size; ++y)
+  {
+    for (unsigned x = 0; x < size; ++x)
+    {
+      // gradient with some noise, so it's not compressed too well.
+      uint8_t *p = bits + y * pitch + x * pixel_size;
+      rnd = rnd * 1103515245u + 12345u;
+      p[0] = (uint8_t)(x + (rnd >> 28));
+      p[1] = (uint8_t)(y + (rnd >> 24));
+      p[2] = (uint8_t)(seed * 16);
+      if (pixel_size == 4) p[3] = 255;
+    }
+  }
+  FIMEMORY *mem = FreeImage_OpenMemory();
+  FreeImage_SaveToMemory(FIF_PNG, bitmap, mem, 0);
+  BYTE *data;
+  DWORD len;
+  FreeImage_AcquireMemory(mem, &data, &len);
+  out.assign((const char*)data, len);
+  FreeImage_CloseMemory(mem);
+  FreeImage_Unload(bitmap);
+}
+
+/**
+ * Decode keysounds / BGA images of a synthetic chart,
+ * first one by one in this thread (as it was done with global resource lock),
+ * then through LoadAsync() as SongPlayer::LoadResourceFromChart() does.
+ */
+static void BenchmarkResourceLoad()
+{
+  const unsigned kSoundCount = 512;
+  const unsigned kImageCount = 64;
+  const unsigned kRepeat = 3;
+  std::vector<BenchmarkResource> res;
+  size_t total_bytes = 0;
+
+  for (unsigned i = 0; i < kSoundCount; ++i)
+  {
+    BenchmarkResource r;
+    r.name = format_string("%03u.wav", i);
+    r.is_sound = true;
+    MakeWaveFile(r.data, 22050, 220.0 + i);
+    total_bytes += r.data.size();
+    res.push_back(std::move(r));
+  }
+  for (unsigned i = 0; i < kImageCount; ++i)
+  {
+    BenchmarkResource r;
+    r.name = format_string("bga%02u.png", i);
+    r.is_sound = false;
+    MakePngFile(r.data, 256, i, 32);
+    total_bytes += r.data.size();
+    res.push_back(std::move(r));
+  }
+
+  double serial_time = 0, parallel_time = 0;
+  for (unsigned n = 0; n < kRepeat; ++n)
+  {
+    double t = GetBenchmarkTime();
+    for (auto &r : res)
+    {
+      if (r.is_sound) {
+        SoundData s;
+        s.Load(r.data.c_str(), r.data.size(), r.name.c_str());
+      }
+      else {
+        Image img;
+        img.Load(r.data.c_str(), r.data.size(), r.name.c_str());
+      }
+    }
+    t = GetBenchmarkTime() - t;
+    if (n == 0 || t < serial_time) serial_time = t;
+
+    // resource name is changed for each run not to hit the cache.
+    std::vector<std::string> names;
+    for (auto &r : res)
+      names.push_back(format_string("benchmark%u/%s", n, r.name.c_str()));
+    std::vector<SoundData*> sounds;
+    std::vector<Image*> images;
+    std::vector<TaskFuture> futures;
+
+    t = GetBenchmarkTime();
+    for (size_t i = 0; i < res.size(); ++i)
+    {
+      auto &r = res[i];
+      if (r.is_sound) {
+        auto *s = SOUNDMAN->LoadAsync(
+          r.data.c_str(), r.data.size(), names[i].c_str(), nullptr);
+        if (!s) continue;
+        sounds.push_back(s);
+        futures.push_back(s->get_load_future());
+      }
+      else {
+        auto *img = IMAGEMAN->LoadAsync(
+          r.data.c_str(), r.data.size(), names[i].c_str(), nullptr);
+        if (!img) continue;
+        images.push_back(img);
+        futures.push_back(img->get_load_future());
+      }
+    }
+    TaskFuture::when_all(futures).wait();
+    t = GetBenchmarkTime() - t;
+    if (n == 0 || t < parallel_time) parallel_time = t;
+
+    for (auto *s : sounds) SOUNDMAN->Unload(s);
+    for (auto *img : images) IMAGEMAN->Unload(img);
+  }
+
+  Logger::Info("Benchmark resource: %u sounds, %u images (%.1lf MB)",
+    kSoundCount, kImageCount, total_bytes / 1048576.0);
+  Logger::Info("  serial %.1lf ms, parallel %.1lf ms (x%.2lf with %u workers)",
+    serial_time, parallel_time, serial_time / parallel_time,
+    (unsigned)TASKMAN->GetPoolSize());
+}
+
+/**
+ * Decode keysounds / BGA images of a synthetic chart through LoadAsync(),
+ * and keep them loaded until all are done as a song does before playing.
+ * Half of images are 24bit, which are converted into staging buffers;
+ * others are 32bit, which are used without conversion.
+ * Reports decode throughput and peak memory (staging buffers / process).
+ */
+static void BenchmarkDecode()
+{
+  const unsigned kSoundCount = 512;
+  const unsigned kImageCount = 128;
+  const unsigned kImageSize = 512;
+  std::vector<BenchmarkResource> res;
+  size_t total_bytes = 0;
+
+  for (unsigned i = 0; i < kSoundCount; ++i)
+  {
+    BenchmarkResource r;
+    r.name = format_string("benchmark_decode/%03u.wav", i);
+    r.is_sound = true;
+    MakeWaveFile(r.data, 22050, 220.0 + i);
+    total_bytes += r.data.size();
+    res.push_back(std::move(r));
+  }
+  for (unsigned i = 0; i < kImageCount; ++i)
+  {
+    BenchmarkResource r;
+    r.name = format_string("benchmark_decode/bga%03u.png", i);
+    r.is_sound = false;
+    MakePngFile(r.data, kImageSize, i, i % 2 ? 24 : 32);
+    total_bytes += r.data.size();
+    res.push_back(std::move(r));
+  }
+
+  std::vector<SoundData*> sounds;
+  std::vector<Image*> images;
+  std::vector<TaskFuture> futures;
+  const size_t peak_before = GetPeakMemory();
+  const ImageDecodeStat stat_before = Image::GetDecodeStat();
+
+  double t = GetBenchmarkTime();
+  for (auto &r : res)
+  {
+    if (r.is_sound) {
+      auto *s = SOUNDMAN->LoadAsync(
+        r.data.c_str(), r.data.size(), r.name.c_str(), nullptr);
+      if (!s) continue;
+      sounds.push_back(s);
+      futures.push_back(s->get_load_future());
+    }
+    else {
+      auto *img = IMAGEMAN->LoadAsync(
+        r.data.c_str(), r.data.size(), r.name.c_str(), nullptr);
+      if (!img) continue;
+      images.push_back(img);
+      futures.push_back(img->get_load_future());
+    }
+  }
+  TaskFuture::when_all(futures).wait();
+  t = GetBenchmarkTime() - t;
+
+  const size_t peak = GetPeakMemory();
+  const ImageDecodeStat stat = Image::GetDecodeStat();
+  size_t pending_bytes = 0;
+  for (auto *img : images)
+    pending_bytes += img->get_upload_size();
+  for (auto *s : sounds) SOUNDMAN->Unload(s);
+  for (auto *img : images) IMAGEMAN->Unload(img);
+
+  const double decode_time = stat.decode_time - stat_before.decode_time;
+  const size_t decoded_bytes = stat.decoded_bytes - stat_before.decoded_bytes;
+  Logger::Info("Benchmark decode: %u sounds, %u images (%.1lf MB in file)",
+    kSoundCount, kImageCount, total_bytes / 1048576.0);
+  Logger::Info("  loaded in %.1lf ms, image decode %.1lf ms for %.1lf MB "
+               "(%.1lf MB/s per thread)",
+    t, decode_time, decoded_bytes / 1048576.0,
+    decode_time > 0 ? decoded_bytes / 1048576.0 / (decode_time / 1000.0) : 0.0);
+  Logger::Info("  bitmaps pending upload %.1lf MB, staging peak %.1lf MB, "
+               "%u buffers reused",
+    pending_bytes / 1048576.0, stat.staging_peak_bytes / 1048576.0,
+    stat.staging_reused - stat_before.staging_reused);
+  Logger::Info("  peak RSS %.1lf MB (%.1lf MB before loading)",
+    peak / 1048576.0, peak_before / 1048576.0);
+}
+
+// ---------------------------------------------------------------- chart scan
+
+static void AddBmsChannel(std::string &bms, int measure, const char *channel,
+                          const std::string &objs)
+{
+  bms += format_string("#%03d%s:%s\n", measure, channel, objs.c_str());
+}
+
+static void AddBmsHeader(std::string &bms, const char *title, int bpm, int level)
+{
+  bms += "#PLAYER 1\n#GENRE Benchmark\n#ARTIST rhythmus\n"
+         "#SUBARTIST obj:synthetic\n#RANK 2\n#WAV01 01.wav\n";
+  bms += format_string("#TITLE Scan Check [%s]\n#BPM %d\n", title, bpm);
+  if (level > 0)
+    bms += format_string("#PLAYLEVEL %d\n", level);
+}
+
+/* objects of a measure, from note bits of each division. */
+static std::string MakeBmsObjects(unsigned bits, unsigned division, const char *obj)
+{
+  std::string r;
+  for (unsigned i = 0; i < division; ++i)
+    r += (bits >> i) & 1 ? obj : "00";
+  return r;
+}
+
+/**
+ * Sample charts covering what metadata scanner reads by itself:
+ * bpm/stop/measure length changes, longnotes, lanes of each key mode,
+ * text encoding (UTF-8 with BOM / Shift_JIS)
+ * and #RANDOM blocks (scanner reads "#IF 1" only, so random charts
+ * are written to give same metadata in any branch, or to have one branch).
+ */
+static void MakeScanCheckCharts(std::vector<BenchmarkResource> &out)
+{
+  static const char *kLanes7[] = { "11", "12", "13", "14", "15", "18", "19", "16" };
+  static const char *kLanes14[] = { "21", "22", "23", "24", "25", "28", "29", "26" };
+  unsigned rnd = 1;
+  auto next_bits = [&rnd]() { rnd = rnd * 1103515245u + 12345u; return rnd >> 16; };
+  BenchmarkResource r;
+  r.is_sound = false;
+
+  // SP 7key: tempo changes, stop, measure length and LNOBJ
+  r.name = "plain.bme";
+  r.data.clear();
+  AddBmsHeader(r.data, "plain", 150, 9);
+  r.data += "#DIFFICULTY 3\n#LNOBJ ZZ\n#BPM01 187.5\n#STOP01 96\n";
+  AddBmsChannel(r.data, 8, "03", "00C8");
+  AddBmsChannel(r.data, 12, "08", "0001");
+  AddBmsChannel(r.data, 16, "09", "01");
+  AddBmsChannel(r.data, 20, "02", "0.75");
+  for (int m = 1; m <= 32; ++m)
+    for (auto *lane : kLanes7)
+      AddBmsChannel(r.data, m, lane, MakeBmsObjects(next_bits(), 16, "01"));
+  AddBmsChannel(r.data, 33, "11", "0100ZZ00");
+  AddBmsChannel(r.data, 34, "01", "01");
+  out.push_back(r);
+
+  // DP 14key: longnote channels
+  r.name = "double.bme";
+  r.data.clear();
+  AddBmsHeader(r.data, "double", 175, 11);
+  r.data += "#DIFFICULTY 4\n";
+  for (int m = 1; m <= 24; ++m)
+  {
+    for (auto *lane : kLanes7)
+      AddBmsChannel(r.data, m, lane, MakeBmsObjects(next_bits() & 0x5555, 16, "01"));
+    for (auto *lane : kLanes14)
+      AddBmsChannel(r.data, m, lane, MakeBmsObjects(next_bits() & 0x5555, 16, "01"));
+  }
+  AddBmsChannel(r.data, 25, "51", "01000100");
+  AddBmsChannel(r.data, 25, "62", "01000100");
+  out.push_back(r);
+
+  // #RANDOM 2: branches differ in lanes only, so any branch gives same metadata.
+  r.name = "random.bms";
+  r.data.clear();
+  AddBmsHeader(r.data, "random", 140, 5);
+  for (int m = 1; m <= 8; ++m)
+    AddBmsChannel(r.data, m, "11", MakeBmsObjects(next_bits(), 8, "01"));
+  r.data += "#RANDOM 2\n#IF 1\n";
+  AddBmsChannel(r.data, 9, "12", "01010101");
+  AddBmsChannel(r.data, 10, "13", "00010001");
+  r.data += "#ENDIF\n#IF 2\n";
+  AddBmsChannel(r.data, 9, "14", "01010101");
+  AddBmsChannel(r.data, 10, "15", "00010001");
+  r.data += "#ENDIF\n";
+  out.push_back(r);
+
+  // #RANDOM 1: header and notes in the only branch, other branch is never taken.
+  r.name = "random_header.bms";
+  r.data.clear();
+  AddBmsHeader(r.data, "random header", 120, 0);
+  r.data += "#RANDOM 1\n#IF 1\n#PLAYLEVEL 7\n#BPM 160\n";
+  AddBmsChannel(r.data, 4, "11", "01010101");
+  r.data += "#ENDIF\n#IF 2\n#PLAYLEVEL 12\n#BPM 90\n";
+  AddBmsChannel(r.data, 6, "12", "0101010101010101");
+  r.data += "#ENDIF\n";
+  for (int m = 1; m <= 3; ++m)
+    AddBmsChannel(r.data, m, "13", MakeBmsObjects(next_bits(), 8, "01"));
+  out.push_back(r);
+
+  // UTF-8 with BOM, and last line without newline.
+  r.name = "utf8.bms";
+  r.data = "\xEF\xBB\xBF";
+  r.data += "#PLAYER 1\n#TITLE \xE3\x83\x86\xE3\x82\xB9\xE3\x83\x88 [utf8]\n"
+            "#ARTIST \xE2\x98\x86rhythmus\n#GENRE \xC3\x89lectro\n#BPM 128\n";
+  for (int m = 1; m <= 4; ++m)
+    AddBmsChannel(r.data, m, "14", MakeBmsObjects(next_bits(), 8, "01"));
+  r.data += "#PLAYLEVEL 10";
+  out.push_back(r);
+
+  // Shift_JIS (title "tesuto" in katakana)
+  r.name = "sjis.bms";
+  r.data.clear();
+  AddBmsHeader(r.data, "sjis", 132, 3);
+  r.data += "#SUBTITLE \x83\x65\x83\x58\x83\x67\n";
+  for (int m = 1; m <= 4; ++m)
+    AddBmsChannel(r.data, m, "15", MakeBmsObjects(next_bits(), 8, "01"));
+  out.push_back(r);
+}
+
+static bool MakeDirectory(const std::string &path)
+{
+#if defined(_WIN32)
+  return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+  return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+static void RemoveDirectory(const std::string &path)
+{
+#if defined(_WIN32)
+  _rmdir(path.c_str());
+#else
+  rmdir(path.c_str());
+#endif
+}
+
+static double ParseSongTime(const std::string &path, bool is_fast_scan)
+{
+  std::vector<ChartMetaData*> charts;
+  double t = GetBenchmarkTime();
+  SongMetaData *song = SONGLIST->ParseSong(path, is_fast_scan, charts);
+  t = GetBenchmarkTime() - t;
+  for (auto *c : charts) SONGLIST->DeleteChart(c);
+  if (song) SONGLIST->DeleteSong(song);
+  return t;
+}
+
+/**
+ * Check chart id and metadata from fast scan (BmsMetaScanner, own MD5)
+ * are same with those from rparser, then compare parse time.
+ * Mismatch is logged as error.
+ */
+static void BenchmarkChartScan()
+{
+  const std::string dir = "./system/benchmark_scan";
+  const unsigned kRepeat = 20;
+  std::vector<BenchmarkResource> files;
+  unsigned mismatch = 0;
+
+  MakeScanCheckCharts(files);
+  if (!MakeDirectory(dir))
+  {
+    Logger::Error("Benchmark scan: cannot create %s", dir.c_str());
+    return;
+  }
+  for (auto &f : files)
+  {
+    FILE *fp = fopen((dir + "/" + f.name).c_str(), "wb");
+    if (!fp) continue;
+    fwrite(f.data.c_str(), 1, f.data.size(), fp);
+    fclose(fp);
+  }
+
+  std::vector<ChartMetaData*> fast, full;
+  SongMetaData *fast_song = SONGLIST->ParseSong(dir, true, fast);
+  SongMetaData *full_song = SONGLIST->ParseSong(dir, false, full);
+  if (full.size() != files.size() || fast.size() != files.size())
+  {
+    Logger::Error("Benchmark scan: chart count differs (file %u, fast %u, full %u)",
+      files.size(), fast.size(), full.size());
+    mismatch++;
+  }
+
+  for (auto *c : full)
+  {
+    const ChartMetaData *f = nullptr;
+    for (auto *c2 : fast)
+      if (c2->chartpath == c->chartpath) f = c2;
+    if (!f)
+    {
+      Logger::Error("Benchmark scan: %s is not read by fast scan", c->chartpath.c_str());
+      mismatch++;
+      continue;
+    }
+    auto check_str = [&](const char *field, const std::string &a, const std::string &b) {
+      if (a == b) return;
+      Logger::Error("Benchmark scan: %s %s differs (fast %s, full %s)",
+        c->chartpath.c_str(), field, a.c_str(), b.c_str());
+      mismatch++;
+    };
+    auto check_int = [&](const char *field, int a, int b, int tolerance) {
+      if (abs(a - b) <= tolerance) return;
+      Logger::Error("Benchmark scan: %s %s differs (fast %d, full %d)",
+        c->chartpath.c_str(), field, a, b);
+      mismatch++;
+    };
+    check_str("id", f->id, c->id);
+    check_str("title", f->title, c->title);
+    check_str("subtitle", f->subtitle, c->subtitle);
+    check_str("artist", f->artist, c->artist);
+    check_str("subartist", f->subartist, c->subartist);
+    check_str("genre", f->genre, c->genre);
+    check_int("type", f->type, c->type, 0);
+    check_int("key", f->key, c->key, 0);
+    check_int("difficulty", f->difficulty, c->difficulty, 0);
+    check_int("level", f->level, c->level, 0);
+    check_int("notecount", f->notecount, c->notecount, 0);
+    // length is truncated to ms after float calculation
+    check_int("length", f->length_ms, c->length_ms, 1);
+    check_int("longnote", f->is_longnote, c->is_longnote, 0);
+    check_int("bpm_max", f->bpm_max, c->bpm_max, 0);
+    check_int("bpm_min", f->bpm_min, c->bpm_min, 0);
+  }
+  for (auto *c : fast) SONGLIST->DeleteChart(c);
+  for (auto *c : full) SONGLIST->DeleteChart(c);
+  if (fast_song) SONGLIST->DeleteSong(fast_song);
+  if (full_song) SONGLIST->DeleteSong(full_song);
+
+  double fast_time = 0, full_time = 0;
+  for (unsigned n = 0; n < kRepeat; ++n)
+  {
+    fast_time += ParseSongTime(dir, true);
+    full_time += ParseSongTime(dir, false);
+  }
+
+  for (auto &f : files)
+    remove((dir + "/" + f.name).c_str());
+  RemoveDirectory(dir);
+
+  if (mismatch > 0)
+    Logger::Error("Benchmark scan: %u mismatch(es) between fast scan and rparser.", mismatch);
+  else
+    Logger::Info("Benchmark scan: fast scan matches rparser for %u charts.", files.size());
+  Logger::Info("  fast %.2lf ms, full %.2lf ms per song (x%.2lf)",
+    fast_time / kRepeat, full_time / kRepeat, full_time / fast_time);
+}
+
+// ----------------------------------------------------------------- song list
+
+static void RemoveDatabaseFile(const std::string &path)
+{
+  remove(path.c_str());
+  remove((path + "-wal").c_str());
+  remove((path + "-shm").c_str());
+}
+
+/* @brief metadata of j-th synthetic chart of a song (serial: chart index). */
+static void MakeSyntheticChart(ChartMetaData *c, const std::string &songpath,
+                               const std::string &songname, unsigned serial,
+                               unsigned j, unsigned &rnd)
+{
+  rnd = rnd * 1103515245u + 12345u;
+  c->id = format_string("%08x%08x%016x", serial, rnd, j);
+  c->songpath = songpath;
+  c->chartpath = format_string("%s_%u.bme", songname.c_str(), j);
+  c->title = "Synthetic " + songname;
+  c->subtitle = format_string("[%u]", j);
+  c->artist = SONGLIST->InternString(format_string("artist%u", rnd % 2000));
+  c->subartist = SONGLIST->InternString("");
+  c->genre = SONGLIST->InternString(format_string("genre%u", rnd % 100));
+  c->type = Gamemode::kGamemodeIIDX;
+  c->key = 7;
+  c->level = (int)(rnd >> 8) % 12 + 1;
+  c->difficulty = (int)j + Difficulty::kDifficultyBeginner;
+  c->judgediff = 2;
+  c->notecount = 500 + (int)(rnd >> 12) % 1500;
+  c->length_ms = 120000;
+  c->bpm_max = c->bpm_min = 150;
+  c->is_longnote = c->is_backspin = 0;
+}
+
+/**
+ * Synthetic library of 100k charts (20k song folders, 5 charts each):
+ * time to load it from database and to reconcile it with library folder,
+ * which are done at every startup.
+ * @warn song list is left empty (game exits after benchmark).
+ */
+static void BenchmarkSongList()
+{
+  const std::string dir = "./system/benchmark_songs";
+  const std::string db = "./system/benchmark_song.db";
+  const unsigned kSongCount = 20000;
+  const unsigned kChartPerSong = 5;
+  std::vector<DirItem> items;
+  std::vector<std::string> chart_ids;
+
+  if (!MakeDirectory(dir))
+  {
+    Logger::Error("Benchmark songlist: cannot create %s", dir.c_str());
+    return;
+  }
+  for (unsigned i = 0; i < kSongCount; ++i)
+    MakeDirectory(format_string("%s/song%05u", dir.c_str(), i));
+  GetDirectoryItems(dir, items);
+
+  SONGLIST->SetSongDirectory(dir, db);
+  SONGLIST->Clear();
+  RemoveDatabaseFile(db);
+
+  // songs with modified time of its folder, so all of them are valid.
+  double t = GetBenchmarkTime();
+  unsigned rnd = 1;
+  for (auto &d : items)
+  {
+    if (d.is_file || d.filename == "." || d.filename == "..") continue;
+    SongMetaData *song = SONGLIST->NewSong();
+    std::vector<ChartMetaData*> charts;
+    song->path = dir + "/" + d.filename;
+    song->modified_time = d.timestamp_modified;
+    for (unsigned j = 0; j < kChartPerSong; ++j)
+    {
+      ChartMetaData *c = SONGLIST->NewChart();
+      MakeSyntheticChart(c, song->path, d.filename,
+        (unsigned)chart_ids.size(), j, rnd);
+      c->modified_date = (int)d.timestamp_modified;
+      c->modified_time = d.timestamp_modified;
+      chart_ids.push_back(c->id);
+      charts.push_back(c);
+    }
+    SONGLIST->AddSong(song, charts);
+  }
+  SONGLIST->Save();
+  double save_time = GetBenchmarkTime() - t;
+
+  SONGLIST->Clear();
+  t = GetBenchmarkTime();
+  SONGLIST->LoadFromDatabase(db);
+  double load_time = GetBenchmarkTime() - t;
+
+  t = GetBenchmarkTime();
+  SONGLIST->Update();
+  double update_time = GetBenchmarkTime() - t;
+
+  t = GetBenchmarkTime();
+  size_t found = 0;
+  for (auto &id : chart_ids)
+    found += SONGLIST->FindChart(id) != nullptr;
+  double find_time = GetBenchmarkTime() - t;
+
+  Logger::Info("Benchmark songlist: song %u, chart %u (found %u)",
+    SONGLIST->song_count(), SONGLIST->chart_count(), found);
+  Logger::Info("  build+save %.1lf ms, load %.1lf ms, update %.1lf ms, "
+               "find %.1lf ms (%.3lf us per chart)",
+    save_time, load_time, update_time, find_time,
+    find_time * 1000.0 / (chart_ids.empty() ? 1 : chart_ids.size()));
+  if (SONGLIST->chart_count() != chart_ids.size() || found != chart_ids.size())
+    Logger::Error("Benchmark songlist: synthetic charts are missing after reload.");
+
+  SONGLIST->Clear();
+  RemoveDatabaseFile(db);
+  for (auto &d : items)
+    if (!d.is_file) RemoveDirectory(dir + "/" + d.filename);
+  RemoveDirectory(dir);
+}
+
+// ------------------------------------------------------------------ search
+
+static double GetSortedPercentile(const std::vector<double> &sorted, double p)
+{
+  if (sorted.empty()) return 0;
+  return sorted[std::min(sorted.size() - 1, (size_t)(sorted.size() * p))];
+}
+
+/**
+ * Text search on the synthetic library of song list benchmark (100k charts):
+ * latency of queries searched from scratch (broad and narrow ones),
+ * and of a query typed incrementally into song select.
+ */
+static void BenchmarkSearch()
+{
+  const unsigned kSongCount = 20000;
+  const unsigned kChartPerSong = 5;
+  const unsigned kRepeat = 20;
+  const char *queries[] = {
+    "s", "sy", "syn", "synthetic", "synthetic song", "thetic son",
+    "song1", "song12345", "artist12", "genre5", "[3]", "zzzz"
+  };
+  const std::string typed = "synthetic song12345";
+  std::vector<ChartMetaData*> charts;
+  std::vector<double> times, typing_times;
+  SongSearchIndex index;
+  SongSearchIndex::Query state;
+  unsigned rnd = 1;
+
+  for (unsigned i = 0; i < kSongCount; ++i)
+  {
+    std::string name = format_string("song%05u", i);
+    for (unsigned j = 0; j < kChartPerSong; ++j)
+    {
+      ChartMetaData *c = SONGLIST->NewChart();
+      MakeSyntheticChart(c, "./system/benchmark_songs/" + name, name,
+        (unsigned)charts.size(), j, rnd);
+      charts.push_back(c);
+    }
+  }
+
+  double t = GetBenchmarkTime();
+  for (size_t i = 0; i < charts.size(); ++i)
+    index.AddChart((uint32_t)i, charts[i]);
+  index.Build();
+  double build_time = GetBenchmarkTime() - t;
+  Logger::Info("Benchmark search: chart %u, document %u (build %.1lf ms)",
+    charts.size(), index.doc_count(), build_time);
+
+  // warm up search state, as song select keeps it while searching
+  for (auto *q : queries)
+    index.Search(q, state);
+
+  for (auto *q : queries)
+  {
+    std::vector<double> q_times;
+    size_t found = 0;
+    for (unsigned r = 0; r < kRepeat; ++r)
+    {
+      // clear previous query, so it is searched from scratch
+      state.text.clear();
+      t = GetBenchmarkTime();
+      found = index.Search(q, state).size();
+      q_times.push_back(GetBenchmarkTime() - t);
+    }
+    times.insert(times.end(), q_times.begin(), q_times.end());
+    std::sort(q_times.begin(), q_times.end());
+    Logger::Info("  \"%s\": %u found, p50 %.3lf ms, max %.3lf ms",
+      q, found, GetSortedPercentile(q_times, 0.5), q_times.back());
+  }
+
+  for (unsigned r = 0; r < kRepeat; ++r)
+  {
+    state.text.clear();
+    for (size_t n = 1; n <= typed.size(); ++n)
+    {
+      t = GetBenchmarkTime();
+      index.Search(typed.substr(0, n), state);
+      typing_times.push_back(GetBenchmarkTime() - t);
+    }
+  }
+
+  std::sort(times.begin(), times.end());
+  std::sort(typing_times.begin(), typing_times.end());
+  Logger::Info("  query: p50 %.3lf ms, p99 %.3lf ms, max %.3lf ms",
+    GetSortedPercentile(times, 0.5), GetSortedPercentile(times, 0.99), times.back());
+  Logger::Info("  typing \"%s\": p50 %.3lf ms, p99 %.3lf ms, max %.3lf ms",
+    typed.c_str(), GetSortedPercentile(typing_times, 0.5),
+    GetSortedPercentile(typing_times, 0.99), typing_times.back());
+
+  for (auto *c : charts)
+    SONGLIST->DeleteChart(c);
+}
+
+// --------------------------------------------------------------------- judge
+
+struct JudgeReplayPress
+{
+  double time;
+  size_t track;
+  size_t target;  /* note index which the press intended to hit */
+};
+
+/* previous judge model: only the front note of a lane can be judged. */
+struct FrontNoteTrack
+{
+  std::vector<double> time;
+  std::vector<uint8_t> status;
+  size_t index;
+
+  size_t Judge(double t)
+  {
+    if (index >= time.size() ||
+        status[index] == NoteStatus::kNoteStatusJudged ||
+        std::abs(time[index] - t) > kJudgeWindowBD)
+      return time.size();
+    status[index] = NoteStatus::kNoteStatusJudged;
+    return index;
+  }
+
+  void Update(double songtime)
+  {
+    while (index < time.size())
+    {
+      if (status[index] == NoteStatus::kNoteStatusNone && time[index] < songtime)
+        status[index] = NoteStatus::kNoteStatusJudgelinePassed;
+      if (status[index] == NoteStatus::kNoteStatusJudgelinePassed &&
+          time[index] + kJudgeWindowBD < songtime)
+        status[index] = NoteStatus::kNoteStatusJudged;
+      if (status[index] != NoteStatus::kNoteStatusJudged) break;
+      index++;
+    }
+  }
+};
+
+struct JudgeReplayResult
+{
+  size_t correct, wrong, ignored;
+  double press_time;
+};
+
+/* replay presses frame by frame with given track type.
+ * presses are judged at the beginning of the frame they belong to. */
+template <typename T, typename JudgeFn, typename UpdateFn>
+static JudgeReplayResult ReplayJudge(std::vector<T> &tracks,
+  const std::vector<JudgeReplayPress> &presses, double end_time, double frame,
+  JudgeFn judge_fn, UpdateFn update_fn)
+{
+  JudgeReplayResult r = { 0, 0, 0, 0 };
+  size_t i = 0;
+  for (double songtime = 0; songtime < end_time; songtime += frame)
+  {
+    if (i < presses.size() && presses[i].time <= songtime)
+    {
+      double t = GetBenchmarkTime();
+      for (; i < presses.size() && presses[i].time <= songtime; ++i)
+      {
+        auto &p = presses[i];
+        size_t idx = judge_fn(tracks[p.track], p.time);
+        if (idx >= tracks[p.track].time.size()) r.ignored++;
+        else if (idx == p.target) r.correct++;
+        else r.wrong++;
+      }
+      r.press_time += GetBenchmarkTime() - t;
+    }
+    for (auto &track : tracks)
+      update_fn(track, songtime);
+  }
+  return r;
+}
+
+/**
+ * Replay of synthetic input on a dense 7-key chart (4,000 notes with chords,
+ * 75 ms stream): ratio of presses judged against other note than intended,
+ * and cost of judging a press.
+ * Presses are jittered (sd 25 ms) and 5% of notes are not pressed,
+ * and judged at 240 fps frame rate.
+ */
+static void BenchmarkJudge()
+{
+  const size_t kTrackCount = 7;
+  const size_t kNoteCount = 4000;
+  const double kStep = 75.0;
+  const double kFrame = 1000.0 / 240;
+  const unsigned kRepeat = 50;
+  std::mt19937 rnd(1);
+  std::vector<std::vector<double> > lanes(kTrackCount);
+  std::vector<JudgeReplayPress> presses;
+  size_t note_count = 0;
+  double end_time = 0;
+
+  for (double t = 1000.0; note_count < kNoteCount; t += kStep)
+  {
+    unsigned chord = 1 + rnd() % 3;
+    for (unsigned j = 0; j < chord && note_count < kNoteCount; ++j)
+    {
+      auto &lane = lanes[rnd() % kTrackCount];
+      if (!lane.empty() && lane.back() == t) continue;
+      lane.push_back(t);
+      note_count++;
+    }
+    end_time = t + kJudgeWindowBD + kFrame;
+  }
+
+  std::normal_distribution<double> jitter(0, 25.0);
+  for (size_t i = 0; i < kTrackCount; ++i)
+  {
+    for (size_t j = 0; j < lanes[i].size(); ++j)
+    {
+      if (rnd() % 20 == 0) continue;
+      presses.push_back({ lanes[i][j] + jitter(rnd), i, j });
+    }
+  }
+  std::sort(presses.begin(), presses.end(),
+    [](const JudgeReplayPress &a, const JudgeReplayPress &b) {
+      return a.time < b.time;
+    });
+
+  JudgeReplayResult front = { 0, 0, 0, 0 }, nearest = { 0, 0, 0, 0 };
+  double front_time = 0, nearest_time = 0;
+  for (unsigned r = 0; r < kRepeat; ++r)
+  {
+    std::vector<FrontNoteTrack> ft(kTrackCount);
+    std::vector<NoteTrack> nt(kTrackCount);
+    for (size_t i = 0; i < kTrackCount; ++i)
+    {
+      ft[i].time = lanes[i];
+      ft[i].status.resize(lanes[i].size(), NoteStatus::kNoteStatusNone);
+      ft[i].index = 0;
+      for (double t : lanes[i])
+        nt[i].AddNote(nullptr, t);
+    }
+
+    double t = GetBenchmarkTime();
+    front = ReplayJudge(ft, presses, end_time, kFrame,
+      [](FrontNoteTrack &track, double time) { return track.Judge(time); },
+      [](FrontNoteTrack &track, double songtime) { track.Update(songtime); });
+    front_time += GetBenchmarkTime() - t;
+
+    t = GetBenchmarkTime();
+    nearest = ReplayJudge(nt, presses, end_time, kFrame,
+      [](NoteTrack &track, double time) {
+        size_t idx = track.FindJudgeNote(time, kJudgeWindowBD);
+        if (idx < track.size())
+          track.SetJudge(idx, GetJudgeFromDelta(time - track.time[idx]), time);
+        return idx;
+      },
+      [](NoteTrack &track, double songtime) {
+        while (track.PassJudgeline(songtime) < track.size());
+        while (track.PassJudgeWindow(songtime, kJudgeWindowBD) < track.size());
+      });
+    nearest_time += GetBenchmarkTime() - t;
+  }
+
+  Logger::Info("Benchmark judge: note %u, press %u, frame %u",
+    note_count, presses.size(), (unsigned)(end_time / kFrame));
+  const char *names[] = { "front note", "nearest note" };
+  const JudgeReplayResult *results[] = { &front, &nearest };
+  const double times[] = { front_time, nearest_time };
+  for (size_t i = 0; i < 2; ++i)
+  {
+    const JudgeReplayResult &r = *results[i];
+    Logger::Info("  %s: misjudge %.2lf%% (wrong note %u, ignored %u), "
+                 "replay %.3lf ms, %.3lf us per press",
+      names[i], (r.wrong + r.ignored) * 100.0 / presses.size(),
+      r.wrong, r.ignored, times[i] / kRepeat,
+      r.press_time * 1000.0 / presses.size());
+  }
+}
+
+// -------------------------------------------------------------- playrecord
+
+static PlayRecord MakeBenchmarkPlay(Player &player, int clear_type,
+                                    int pg, int gr, int maxcombo)
+{
+  PlayRecord pr;
+  player.InitPlayRecord(pr);
+  pr.id = "benchmark_playrecord";
+  pr.chartname = "benchmark";
+  pr.total_note = 100;
+  pr.clear_type = clear_type;
+  pr.pg = pg;
+  pr.gr = gr;
+  pr.miss = pr.total_note - pg - gr;
+  pr.maxcombo = maxcombo;
+  pr.score = pg * 2 + gr;
+  return pr;
+}
+
+/**
+ * Check of merging playrecord: plays of the same chart in a row
+ * must keep best clear lamp and score, and count all plays.
+ * (guest player, so nothing is written to playrecord database)
+ */
+static void BenchmarkPlayRecord()
+{
+  Player player(PlayerTypes::kPlayerGuest, "benchmark");
+  unsigned mismatch = 0;
+
+  PlayRecord first = MakeBenchmarkPlay(player, ClearTypes::kClearHard, 80, 10, 60);
+  PlayRecord second = MakeBenchmarkPlay(player, ClearTypes::kClearFailed, 50, 20, 90);
+  player.PostPlayRecord(first);
+  player.PostPlayRecord(second);
+
+  const PlayRecord *pr = player.GetPlayRecord("benchmark_playrecord");
+  const PlayRecordSummary *summary = player.GetPlayRecordSummary("benchmark_playrecord");
+  auto check_int = [&](const char *field, int value, int expected) {
+    if (value == expected) return;
+    Logger::Error("Benchmark playrecord: %s is %d (expected %d)",
+      field, value, expected);
+    mismatch++;
+  };
+  if (!pr || !summary)
+  {
+    Logger::Error("Benchmark playrecord: record is not stored.");
+    return;
+  }
+  check_int("clear_type", pr->clear_type, ClearTypes::kClearHard);
+  check_int("exscore", pr->exscore(), first.exscore());
+  check_int("score", pr->score, first.score);
+  check_int("maxcombo", pr->maxcombo, second.maxcombo);
+  check_int("playcount", pr->playcount, 2);
+  check_int("clearcount", pr->clearcount, 1);
+  check_int("failcount", pr->failcount, 1);
+  check_int("summary clear_type", summary->clear_type, ClearTypes::kClearHard);
+  check_int("summary exscore", summary->exscore, first.exscore());
+
+  if (mismatch > 0)
+    Logger::Error("Benchmark playrecord: %u mismatch(es) in merged record.", mismatch);
+  else
+    Logger::Info("Benchmark playrecord: best record kept after %d plays.", pr->playcount);
+}
+
+// ----------------------------------------------------------------- command
+
+/**
+ * Event command dispatch of an object: parsing command string for each run
+ * (as it was done before commands are compiled) versus running command
+ * compiled by AddCommand(), and cost of adding many commands to an event.
+ */
+static void BenchmarkCommand()
+{
+  const std::string kCommand = "x:10;y:20;w:100;h:50;opacity:0.5;show";
+  const unsigned kRunCount = 200000;
+  const unsigned kAppendCount = 4000;
+  BaseObject obj;
+
+  obj.AddCommand("BenchmarkCommand", kCommand);
+
+  double t = GetBenchmarkTime();
+  for (unsigned i = 0; i < kRunCount; ++i)
+    obj.RunCommand(kCommand);
+  double string_time = GetBenchmarkTime() - t;
+
+  t = GetBenchmarkTime();
+  for (unsigned i = 0; i < kRunCount; ++i)
+    obj.RunCommandByName("BenchmarkCommand");
+  double compiled_time = GetBenchmarkTime() - t;
+
+  // appending to an event with many commands (e.g. LR2 timer commands).
+  double append_time[2] = { 0, 0 };
+  for (unsigned i = 0; i < kAppendCount; ++i)
+  {
+    t = GetBenchmarkTime();
+    obj.AddCommand("BenchmarkCommandAppend", format_string("x:%u", i));
+    append_time[i < kAppendCount / 2 ? 0 : 1] += GetBenchmarkTime() - t;
+  }
+  obj.DeleteAllCommand();
+
+  Logger::Info("Benchmark command: %u ops, %u runs",
+    (unsigned)std::count(kCommand.begin(), kCommand.end(), ';') + 1, kRunCount);
+  Logger::Info("  string %.1lf ns/run, compiled %.1lf ns/run (x%.2lf)",
+    string_time * 1e6 / kRunCount, compiled_time * 1e6 / kRunCount,
+    string_time / compiled_time);
+  Logger::Info("  append %u commands %.2lf ms (first half %.2lf ms, "
+               "second half %.2lf ms)",
+    kAppendCount, append_time[0] + append_time[1],
+    append_time[0], append_time[1]);
+}
+
+// ------------------------------------------------------------------- event
+
+/* receiver which only counts received events. */
+class BenchmarkEventReceiver : public EventReceiver
+{
+public:
+  BenchmarkEventReceiver() : count(0) {}
+  virtual bool OnEvent(const EventMessage& msg) { count++; return true; }
+  size_t count;
+};
+
+/* send and flush events to subscribers; returns elapsed time. */
+static double RunEventFlush(const std::vector<int> &event_ids,
+                            unsigned event_count, unsigned batch)
+{
+  double t = GetBenchmarkTime();
+  for (unsigned i = 0; i < event_count; )
+  {
+    for (unsigned j = 0; j < batch && i < event_count; ++j, ++i)
+      EVENTMAN->SendEvent(event_ids[i % event_ids.size()]);
+    EVENTMAN->Flush();
+  }
+  return GetBenchmarkTime() - t;
+}
+
+/**
+ * Event dispatch throughput: events sent to 16 event ids with 8 subscribers
+ * each, then flushed in batches as it's done for each frame.
+ * Dispatch is measured again while another thread keeps subscribing
+ * (as objects loaded in loader thread does).
+ */
+static void BenchmarkEvent()
+{
+  const unsigned kEventIdCount = 16;
+  const unsigned kSubscriberCount = 8;
+  const unsigned kEventCount = 1000000;
+  const unsigned kBatch = 1000;
+  std::vector<int> event_ids;
+  std::vector<BenchmarkEventReceiver> receivers(kEventIdCount * kSubscriberCount);
+
+  for (unsigned i = 0; i < kEventIdCount; ++i)
+  {
+    event_ids.push_back(
+      EventManager::GetEventID(format_string("BenchmarkEvent%u", i)));
+    for (unsigned j = 0; j < kSubscriberCount; ++j)
+      receivers[i * kSubscriberCount + j].SubscribeTo(event_ids.back());
+  }
+
+  double flush_time = RunEventFlush(event_ids, kEventCount, kBatch);
+
+  // subscribe from other thread while flushing.
+  std::vector<BenchmarkEventReceiver> loader_receivers(4096);
+  std::thread loader([&] {
+    for (size_t i = 0; i < loader_receivers.size(); ++i)
+      loader_receivers[i].SubscribeTo(event_ids[i % event_ids.size()]);
+  });
+  double contended_time = RunEventFlush(event_ids, kEventCount, kBatch);
+  loader.join();
+
+  size_t received = 0;
+  for (auto &r : receivers)
+    received += r.count;
+  for (auto &r : receivers)
+    r.UnsubscribeAll();
+  for (auto &r : loader_receivers)
+    r.UnsubscribeAll();
+  EVENTMAN->Flush();
+
+  Logger::Info("Benchmark event: %u events, %u ids x %u subscribers "
+               "(%u dispatched)",
+    kEventCount, kEventIdCount, kSubscriberCount, (unsigned)received);
+  Logger::Info("  flush %.1lf ms (%.0lf events/sec), with subscribing thread "
+               "%.1lf ms (%.0lf events/sec)",
+    flush_time, kEventCount / (flush_time / 1000.0),
+    contended_time, kEventCount / (contended_time / 1000.0));
+}
+
+// ------------------------------------------------------------------- input
+
+/* receiver which records latency from input timestamp to dispatch. */
+class BenchmarkInputReceiver : public InputEventReceiver
+{
+public:
+  BenchmarkInputReceiver() : stat() {}
+  virtual void OnInputEvent(const InputEvent &e)
+  {
+    if (e.type() == InputEvents::kOnKeyDown && e.KeyCode() == RI_KEY_0)
+      stat.Add(Timer::GetUncachedSystemTime() - e.time());
+  }
+  InputLatencyStat stat;
+};
+
+/**
+ * Input-to-dispatch latency: synthetic key events are timestamped and queued
+ * from another thread (as evdev input thread does) at random interval,
+ * and dispatched by InputEventManager::Flush() in 240 fps frame loop.
+ */
+static void BenchmarkInput()
+{
+  const unsigned kEventCount = 2000;
+  const double kFrame = 1.0 / 240;
+  BenchmarkInputReceiver receiver;
+  std::atomic<bool> is_done(false);
+
+  std::thread input([&] {
+    std::mt19937 rnd(1);
+    std::uniform_int_distribution<int> interval(500, 4000);  /* us */
+    for (unsigned i = 0; i < kEventCount; ++i)
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(interval(rnd)));
+      InputEvent e(InputEvents::kOnKeyDown);
+      e.SetKeyCode(RI_KEY_0);
+      InputEventManager::QueueEvent(e);
+    }
+    is_done = true;
+  });
+
+  double next_frame = Timer::GetUncachedSystemTime();
+  unsigned frame_count = 0;
+  while (!is_done)
+  {
+    next_frame += kFrame;
+    double wait = next_frame - Timer::GetUncachedSystemTime();
+    if (wait > 0)
+      std::this_thread::sleep_for(std::chrono::microseconds((int)(wait * 1e6)));
+    InputEventManager::Flush();
+    frame_count++;
+  }
+  input.join();
+  InputEventManager::Flush();
+
+  const InputLatencyStat &lat = receiver.stat;
+  Logger::Info("Benchmark input: %u events in %u frames (240 fps), "
+               "%u dispatched", kEventCount, frame_count, (unsigned)lat.count);
+  if (lat.count == 0) return;
+  Logger::Info("  input to dispatch: avg %.2lf ms, p50 %.1lf ms, "
+               "p99 %.1lf ms, max %.2lf ms",
+    lat.total * 1000 / lat.count, lat.GetPercentile(0.5) * 1000,
+    lat.GetPercentile(0.99) * 1000, lat.max * 1000);
+}
+
+// --------------------------------------------------------------------- run
+
+typedef void (*BenchmarkFn)();
+
+static const struct {
+  const char *name;
+  BenchmarkFn fn;
+} kBenchmarks[] = {
+  { "resource", &BenchmarkResourceLoad },
+  { "decode", &BenchmarkDecode },
+  { "scan", &BenchmarkChartScan },
+  { "songlist", &BenchmarkSongList },
+  { "search", &BenchmarkSearch },
+  { "judge", &BenchmarkJudge },
+  { "playrecord", &BenchmarkPlayRecord },
+  { "command", &BenchmarkCommand },
+  { "event", &BenchmarkEvent },
+  { "input", &BenchmarkInput },
+};
+
+void Benchmark::Run(const std::string &names)
+{
+  std::vector<std::string> v;
+  Split(names, ',', v);
+
+  for (auto &name : v)
+  {
+    bool found = false;
+    for (auto &b : kBenchmarks)
+    {
+      if (name != "all" && name != b.name) continue;
+      Logger::Info("Benchmark %s started.", b.name);
+      b.fn();
+      found = true;
+    }
+    if (!found)
+      Logger::Warn("Benchmark %s not found.", name.c_str());
+  }
+}
+
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+namespace rhythmus
+{
+
+/**
+ * @brief
+ * Benchmarks of engine modules, which run with synthetic data.
+ * Selected by --benchmark=name[,name...] boot option (or "all"),
+ * and game exits after results are logged.
+ * Run with --headless to measure without window / vsync.
+ */
+class Benchmark
+{
+public:
+  /* @brief run benchmarks separated by comma. */
+  static void Run(const std::string &names);
+};
+
+}
@@ -10,29 +10,128 @@
 #endif
 
 #include <mutex>
+#include <atomic>
+#include <deque>
+#include <algorithm>
+#include <thread>
 #include <GLFW/glfw3.h>
+#if defined(__linux__)
+# include <linux/input.h>
+# include <sys/ioctl.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <poll.h>
+# include <dirent.h>
+# include <time.h>
+#endif
 
 namespace rhythmus
 {
 
-// ------------------------ Input event related
+// ------------------------ Event queue
+
+/**
+ * @brief
+ * Bounded lock-free multi-producer / single-consumer queue.
+ * Storage is pre-allocated, and each slot has sequence number
+ * which tells whether the slot is ready to be written or read.
+ * Producers (input / worker threads) never block; if queue is full,
+ * event is dropped and counted.
+ * Only rendering thread should call Pop().
+ */
+template <typename T, size_t N>
+class EventQueue
+{
+public:
+  static_assert((N & (N - 1)) == 0, "EventQueue size must be power of 2");
+
+  EventQueue() : enqueue_pos_(0), dequeue_pos_(0), dropped_(0)
+  {
+    for (size_t i = 0; i < N; ++i)
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  template <typename U>
+  bool Push(U&& v)
+  {
+    Cell *cell;
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      cell = &cells_[pos & (N - 1)];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+      if (dif == 0)
+      {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+            std::memory_order_relaxed))
+          break;
+      }
+      else if (dif < 0)
+      {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      else pos = enqueue_pos_.load(std::memory_order_relaxed);
+    }
+    cell->data = std::forward<U>(v);
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool Pop(T &out)
+  {
+    Cell &cell = cells_[dequeue_pos_ & (N - 1)];
+    size_t seq = cell.seq.load(std::memory_order_acquire);
+    if (seq != dequeue_pos_ + 1)
+      return false;
+    out = std::move(cell.data);
+    cell.seq.store(dequeue_pos_ + N, std::memory_order_release);
+    ++dequeue_pos_;
+    return true;
+  }
+
+  /* approximate count of queued items (consumer side only) */
+  size_t size() const
+  {
+    return enqueue_pos_.load(std::memory_order_acquire) - dequeue_pos_;
+  }
+
+  /* returns dropped event count since last call */
+  size_t TakeDropped()
+  {
+    return dropped_.exchange(0, std::memory_order_relaxed);
+  }
+
+private:
+  struct Cell
+  {
+    std::atomic<size_t> seq;
+    T data;
+  };
+  Cell cells_[N];
+  alignas(64) std::atomic<size_t> enqueue_pos_;
+  alignas(64) size_t dequeue_pos_;
+  std::atomic<size_t> dropped_;
+};
 
-/* Size of pre-reserved for event cache (to improve performance) */
-constexpr int kPreCacheEventCount = 64;
+// ------------------------ Input event related
 
-// lock used when using cached_events_
+// lock used when registering input event receivers
 std::mutex input_evt_lock;
 
 // lock used when subscribe/unsubscribe event
 std::mutex gSubscribeLock;
 
 // cached events.
-// stored from input thread, flushed in rendering thread.
-std::vector<InputEvent> input_evt_messages_;
+// stored from input / worker thread, flushed in rendering thread.
+EventQueue<InputEvent, 1024> input_evt_messages_;
 std::vector<InputEventReceiver*> input_evt_receivers_;
 
-std::mutex game_evt_lock;
-std::vector<EventMessage> game_evt_messages_;
+EventQueue<EventMessage, 4096> game_evt_messages_;
+
+// is game window focused? (evdev input is only used while focused)
+std::atomic<bool> window_focused_(true);
 int window_x, window_y;
 double cursor_x, cursor_y;
 
@@ -65,6 +164,7 @@ InputEvent::InputEvent(int type) : type_(type)
 int InputEvent::type() const { return type_; }
 double InputEvent::time() const { return time_; }
 
+void InputEvent::SetTime(double time) { time_ = time; }
 void InputEvent::SetKeyCode(int v) { argv_[0] = v; }
 void InputEvent::SetPosition(int x, int y) { argv_[0] = x; argv_[1] = y; }
 void InputEvent::SetButton(int button) { argv_[2] = button; }
@@ -78,6 +178,10 @@ uint32_t InputEvent::Codepoint() const { return *(uint32_t*)argv_; }
 
 void on_keyevent(GLFWwindow *w, int key, int scancode, int action, int mode)
 {
+  // key events are generated by input thread with more accurate timestamp.
+  if (InputEventManager::IsInputThreadRunning() && window_focused_)
+    return;
+
   int eventid = 0;
   if (action == GLFW_PRESS)
     eventid = InputEvents::kOnKeyDown;
@@ -88,14 +192,14 @@ void on_keyevent(GLFWwindow *w, int key, int scancode, int action, int mode)
 
   InputEvent msg(eventid);
   msg.SetKeyCode(key);
-  input_evt_messages_.push_back(msg);
+  input_evt_messages_.Push(msg);
 }
 
 void on_text(GLFWwindow *w, uint32_t codepoint)
 {
   InputEvent msg(InputEvents::kOnText);
   msg.SetCodepoint(codepoint);
-  input_evt_messages_.push_back(msg);
+  input_evt_messages_.Push(msg);
 }
 
 void on_cursormove(GLFWwindow *w, double xpos, double ypos)
@@ -109,7 +213,7 @@ void on_cursormove(GLFWwindow *w, double xpos, double ypos)
     cursor_y = cursor_y / GRAPHIC->height() * window_y;
   }
   msg.SetPosition((int)(cursor_x + 0.5), (int)(cursor_y + 0.5));
-  input_evt_messages_.push_back(msg);
+  input_evt_messages_.Push(msg);
 }
 
 void on_cursorbutton(GLFWwindow *w, int button, int action, int mods)
@@ -119,7 +223,7 @@ void on_cursorbutton(GLFWwindow *w, int button, int action, int mods)
   );
   msg.SetButton(button);
   msg.SetPosition((int)(cursor_x + 0.5), (int)(cursor_y + 0.5));
-  input_evt_messages_.push_back(msg);
+  input_evt_messages_.Push(msg);
 }
 
 void on_joystick_conn(int jid, int event)
@@ -133,38 +237,380 @@ void on_window_resize(GLFWwindow *w, int width, int height)
   window_y = height;
 }
 
+void on_window_focus(GLFWwindow *w, int focused)
+{
+  window_focused_ = focused != 0;
+}
+
+void InputEventManager::QueueEvent(const InputEvent &e)
+{
+  input_evt_messages_.Push(e);
+}
+
 void InputEventManager::Flush()
 {
-  std::vector<InputEvent> events;
-  events.reserve(kPreCacheEventCount);
+  InputEvent e;
+  while (input_evt_messages_.Pop(e))
   {
-    std::lock_guard<std::mutex> lock(input_evt_lock);
-    events.swap(input_evt_messages_);
+    for (auto *subscriber : input_evt_receivers_)
+      subscriber->OnInputEvent(e);
   }
 
-  for (auto &e : events)
+  size_t dropped = input_evt_messages_.TakeDropped();
+  if (dropped > 0)
+    Logger::Warn("Input event queue is full: %zu events dropped", dropped);
+}
+
+
+// ------------------------ Input thread (evdev)
+
+#if defined(__linux__)
+/* convert linux key code into RI_KEY code. */
+static int ConvertEvdevKeycode(int code)
+{
+  static int keymap[KEY_CNT];
+  static bool is_initialized = false;
+  if (!is_initialized)
   {
-    for (auto *subscriber : input_evt_receivers_)
-      subscriber->OnInputEvent(e);
+    static const int alpha[] = {
+      KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F, KEY_G, KEY_H, KEY_I,
+      KEY_J, KEY_K, KEY_L, KEY_M, KEY_N, KEY_O, KEY_P, KEY_Q, KEY_R,
+      KEY_S, KEY_T, KEY_U, KEY_V, KEY_W, KEY_X, KEY_Y, KEY_Z
+    };
+    static const int digit[] = {
+      KEY_0, KEY_1, KEY_2, KEY_3, KEY_4, KEY_5, KEY_6, KEY_7, KEY_8, KEY_9
+    };
+    static const int keypad[] = {
+      KEY_KP0, KEY_KP1, KEY_KP2, KEY_KP3, KEY_KP4,
+      KEY_KP5, KEY_KP6, KEY_KP7, KEY_KP8, KEY_KP9
+    };
+    static const int fkey[] = {
+      KEY_F1, KEY_F2, KEY_F3, KEY_F4, KEY_F5, KEY_F6,
+      KEY_F7, KEY_F8, KEY_F9, KEY_F10, KEY_F11, KEY_F12
+    };
+    static const int joystick[] = {
+      RI_JOYSTICK_1, RI_JOYSTICK_2, RI_JOYSTICK_3, RI_JOYSTICK_4,
+      RI_JOYSTICK_5, RI_JOYSTICK_6, RI_JOYSTICK_7, RI_JOYSTICK_8,
+      RI_JOYSTICK_9, RI_JOYSTICK_10, RI_JOYSTICK_11, RI_JOYSTICK_12,
+      RI_JOYSTICK_13, RI_JOYSTICK_14, RI_JOYSTICK_15, RI_JOYSTICK_16
+    };
+    static const int others[][2] = {
+      { KEY_SPACE, RI_KEY_SPACE }, { KEY_APOSTROPHE, RI_KEY_APOSTROPHE },
+      { KEY_COMMA, RI_KEY_COMMA }, { KEY_MINUS, RI_KEY_MINUS },
+      { KEY_DOT, RI_KEY_PERIOD }, { KEY_SLASH, RI_KEY_SLASH },
+      { KEY_SEMICOLON, RI_KEY_SEMICOLON }, { KEY_EQUAL, RI_KEY_EQUAL },
+      { KEY_LEFTBRACE, RI_KEY_LEFT_BRACKET }, { KEY_BACKSLASH, RI_KEY_BACKSLASH },
+      { KEY_RIGHTBRACE, RI_KEY_RIGHT_BRACKET }, { KEY_GRAVE, RI_KEY_GRAVE_ACCENT },
+      { KEY_ESC, RI_KEY_ESCAPE }, { KEY_ENTER, RI_KEY_ENTER },
+      { KEY_TAB, RI_KEY_TAB }, { KEY_BACKSPACE, RI_KEY_BACKSPACE },
+      { KEY_INSERT, RI_KEY_INSERT }, { KEY_DELETE, RI_KEY_DELETE },
+      { KEY_RIGHT, RI_KEY_RIGHT }, { KEY_LEFT, RI_KEY_LEFT },
+      { KEY_DOWN, RI_KEY_DOWN }, { KEY_UP, RI_KEY_UP },
+      { KEY_PAGEUP, RI_KEY_PAGE_UP }, { KEY_PAGEDOWN, RI_KEY_PAGE_DOWN },
+      { KEY_HOME, RI_KEY_HOME }, { KEY_END, RI_KEY_END },
+      { KEY_CAPSLOCK, RI_KEY_CAPS_LOCK }, { KEY_SCROLLLOCK, RI_KEY_SCROLL_LOCK },
+      { KEY_NUMLOCK, RI_KEY_NUM_LOCK }, { KEY_SYSRQ, RI_KEY_PRINT_SCREEN },
+      { KEY_PAUSE, RI_KEY_PAUSE }, { KEY_KPDOT, RI_KEY_KP_DECIMAL },
+      { KEY_KPSLASH, RI_KEY_KP_DIVIDE }, { KEY_KPASTERISK, RI_KEY_KP_MULTIPLY },
+      { KEY_KPMINUS, RI_KEY_KP_SUBTRACT }, { KEY_KPPLUS, RI_KEY_KP_ADD },
+      { KEY_KPENTER, RI_KEY_KP_ENTER }, { KEY_KPEQUAL, RI_KEY_KP_EQUAL },
+      { KEY_LEFTSHIFT, RI_KEY_LEFT_SHIFT }, { KEY_LEFTCTRL, RI_KEY_LEFT_CONTROL },
+      { KEY_LEFTALT, RI_KEY_LEFT_ALT }, { KEY_LEFTMETA, RI_KEY_LEFT_SUPER },
+      { KEY_RIGHTSHIFT, RI_KEY_RIGHT_SHIFT }, { KEY_RIGHTCTRL, RI_KEY_RIGHT_CONTROL },
+      { KEY_RIGHTALT, RI_KEY_RIGHT_ALT }, { KEY_RIGHTMETA, RI_KEY_RIGHT_SUPER },
+      { KEY_MENU, RI_KEY_MENU },
+    };
+    memset(keymap, 0, sizeof(keymap));
+    for (int i = 0; i < 26; ++i) keymap[alpha[i]] = RI_KEY_A + i;
+    for (int i = 0; i < 10; ++i) keymap[digit[i]] = RI_KEY_0 + i;
+    for (int i = 0; i < 10; ++i) keymap[keypad[i]] = RI_KEY_KP_0 + i;
+    for (int i = 0; i < 12; ++i) keymap[fkey[i]] = RI_KEY_F1 + i;
+    for (int i = 0; i < 16; ++i) keymap[BTN_JOYSTICK + i] = joystick[i];
+    for (auto &k : others) keymap[k[0]] = k[1];
+    is_initialized = true;
   }
+  if (code < 0 || code >= KEY_CNT) return 0;
+  return keymap[code];
+}
+
+class EvdevInputThread
+{
+public:
+  EvdevInputThread() : is_running_(false) {}
+  ~EvdevInputThread() { Stop(); }
+
+  bool Start()
+  {
+    if (is_running_) return true;
+    ConvertEvdevKeycode(0);  // initialize keymap before thread starts
+
+    for (auto &path : FindDevices())
+    {
+      int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+      if (fd < 0) continue;
+      // use monotonic clock for timestamp, which is same as glfw timer.
+      int clk = CLOCK_MONOTONIC;
+      unsigned long keybits[(KEY_CNT + 8 * sizeof(long) - 1) / (8 * sizeof(long))];
+      memset(keybits, 0, sizeof(keybits));
+      if (ioctl(fd, EVIOCSCLOCKID, &clk) != 0 ||
+          ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keybits)), keybits) < 0 ||
+          !HasMappedKey(keybits))
+      {
+        close(fd);
+        continue;
+      }
+      fds_.push_back(fd);
+    }
+    if (fds_.empty())
+    {
+      Logger::Warn("Input thread: no readable evdev device (permission?)");
+      return false;
+    }
+    Logger::Info("Input thread: reading %zu evdev device(s)", fds_.size());
+
+    is_running_ = true;
+    thread_ = std::thread([this] { Run(); });
+    return true;
+  }
+
+  void Stop()
+  {
+    if (!is_running_) return;
+    is_running_ = false;
+    thread_.join();
+    for (int fd : fds_) close(fd);
+    fds_.clear();
+  }
+
+  bool is_running() const { return is_running_; }
+
+private:
+  std::atomic<bool> is_running_;
+  std::thread thread_;
+  std::vector<int> fds_;
+
+  static std::vector<std::string> FindDevices()
+  {
+    std::vector<std::string> r;
+    DIR *dir = opendir("/dev/input");
+    if (!dir) return r;
+    while (struct dirent *ent = readdir(dir))
+    {
+      if (strncmp(ent->d_name, "event", 5) == 0)
+        r.push_back(std::string("/dev/input/") + ent->d_name);
+    }
+    closedir(dir);
+    return r;
+  }
+
+  static bool HasMappedKey(const unsigned long *keybits)
+  {
+    constexpr size_t kBits = 8 * sizeof(long);
+    for (int code = 0; code < KEY_CNT; ++code)
+    {
+      if ((keybits[code / kBits] >> (code % kBits)) & 1 && ConvertEvdevKeycode(code))
+        return true;
+    }
+    return false;
+  }
+
+  void Run()
+  {
+    std::vector<struct pollfd> pfds;
+    for (int fd : fds_)
+      pfds.push_back({ fd, POLLIN, 0 });
+
+    struct input_event evs[64];
+    while (is_running_)
+    {
+      // timeout to check exit condition.
+      if (poll(pfds.data(), pfds.size(), 100) <= 0)
+        continue;
+
+      for (auto &pfd : pfds)
+      {
+        if (!(pfd.revents & POLLIN)) continue;
+        ssize_t len = read(pfd.fd, evs, sizeof(evs));
+        if (len <= 0) continue;
+
+        // devices are read regardless of window focus,
+        // so drop events while focus is lost (GLFW events are used then).
+        if (!window_focused_) continue;
+
+        // kernel timestamp into glfw timer, by current offset of clocks.
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double now_mono = now.tv_sec + now.tv_nsec / 1e9;
+        double now_timer = Timer::GetUncachedSystemTime();
+
+        for (size_t i = 0; i < len / sizeof(struct input_event); ++i)
+        {
+          const auto &ev = evs[i];
+          if (ev.type != EV_KEY) continue;
+          int key = ConvertEvdevKeycode(ev.code);
+          if (key == 0) continue;
+          InputEvent msg(ev.value == 0 ? InputEvents::kOnKeyUp :
+                         ev.value == 1 ? InputEvents::kOnKeyDown :
+                                         InputEvents::kOnKeyPress);
+          double ev_mono = ev.input_event_sec + ev.input_event_usec / 1e6;
+          msg.SetTime(now_timer - (now_mono - ev_mono));
+          msg.SetKeyCode(key);
+          input_evt_messages_.Push(msg);
+        }
+      }
+    }
+  }
+};
+
+static EvdevInputThread input_thread_;
+#endif
+
+bool InputEventManager::StartInputThread()
+{
+#if defined(__linux__)
+  return input_thread_.Start();
+#else
+  // no raw input reader for this platform;
+  // GLFW key events (timestamped when polled) are used instead.
+  Logger::Info("Input thread: not supported on this platform, "
+               "using window key events.");
+  return false;
+#endif
+}
+
+void InputEventManager::StopInputThread()
+{
+#if defined(__linux__)
+  input_thread_.Stop();
+#endif
+}
+
+bool InputEventManager::IsInputThreadRunning()
+{
+#if defined(__linux__)
+  return input_thread_.is_running();
+#else
+  return false;
+#endif
+}
+
+// ------------------------ Input latency
+
+static InputLatencyStat latency_stat_;
+
+double InputLatencyStat::GetPercentile(double p) const
+{
+  size_t target = (size_t)(count * p);
+  size_t sum = 0;
+  for (int i = 0; i < kBucketCount; ++i)
+  {
+    sum += bucket[i];
+    if (sum > target)
+      return (i + 1) * kBucketSize;
+  }
+  return kBucketCount * kBucketSize;
+}
+
+void InputLatencyStat::Add(double latency)
+{
+  if (latency < 0) latency = 0;
+  int idx = (int)(latency / kBucketSize);
+  if (idx >= kBucketCount)
+    idx = kBucketCount - 1;
+  bucket[idx]++;
+  count++;
+  total += latency;
+  if (max < latency)
+    max = latency;
+}
+
+void InputEventManager::RecordLatency(const InputEvent &e)
+{
+  latency_stat_.Add(Timer::GetUncachedSystemTime() - e.time());
+}
+
+const InputLatencyStat &InputEventManager::GetLatencyStat()
+{
+  return latency_stat_;
+}
+
+
+// ------------------------- Event ID
+
+/**
+ * Interned event names.
+ * Names are stored in deque, so reference of name is kept valid
+ * while new name is registered.
+ */
+struct EventIdTable
+{
+  std::mutex lock;
+  std::unordered_map<std::string, int> ids;
+  std::deque<std::string> names;
+
+  EventIdTable()
+  {
+    // id 0 is reserved for empty event.
+    ids[""] = 0;
+    names.emplace_back();
+  }
+};
+
+static EventIdTable &GetEventIdTable()
+{
+  static EventIdTable table;
+  return table;
+}
+
+int EventManager::GetEventID(const std::string &name)
+{
+  auto &table = GetEventIdTable();
+  std::lock_guard<std::mutex> lock(table.lock);
+  auto it = table.ids.find(name);
+  if (it != table.ids.end())
+    return it->second;
+  int id = (int)table.names.size();
+  table.names.push_back(name);
+  table.ids[name] = id;
+  return id;
+}
+
+const std::string &EventManager::GetEventName(int event_id)
+{
+  auto &table = GetEventIdTable();
+  std::lock_guard<std::mutex> lock(table.lock);
+  if (event_id < 0 || event_id >= (int)table.names.size())
+    return table.names[0];
+  return table.names[event_id];
 }
 
 
 // ------------------------- class EventMessage
 
+EventMessage::EventMessage() : id_(0) {}
+
+EventMessage::EventMessage(int event_id) : id_(event_id) {}
+
+EventMessage::EventMessage(int event_id, const std::string& content)
+  : id_(event_id), content_(content)
+{
+}
+
 EventMessage::EventMessage(const std::string& name)
-  : name_(name)
+  : id_(EventManager::GetEventID(name))
 {
 }
 
 EventMessage::EventMessage(const std::string& name, const std::string& content)
-  : name_(name), content_(content)
+  : id_(EventManager::GetEventID(name)), content_(content)
 {
 }
 
-void EventMessage::SetEventName(const std::string &name) { name_ = name; }
+void EventMessage::SetEventID(int event_id) { id_ = event_id; }
+void EventMessage::SetEventName(const std::string &name) { id_ = EventManager::GetEventID(name); }
 void EventMessage::SetContent(const std::string& content) { content_ = content; }
-const std::string& EventMessage::GetEventName() const { return name_; }
+int EventMessage::GetEventID() const { return id_; }
+const std::string& EventMessage::GetEventName() const { return EventManager::GetEventName(id_); }
 const std::string& EventMessage::content() const { return content_; }
 
 
@@ -175,11 +621,22 @@ EventReceiver::~EventReceiver()
   UnsubscribeAll();
 }
 
-void EventReceiver::SubscribeTo(const std::string &name)
+void EventReceiver::SubscribeTo(int event_id)
 {
   std::lock_guard<std::mutex> l(gSubscribeLock);
-  subscription_.push_back(name);
-  EVENTMAN->event_subscribers_[name].insert(this);
+  auto &subs = EVENTMAN->event_subscribers_;
+  if ((int)subs.size() <= event_id)
+    subs.resize(event_id + 1);
+  auto &sublist = subs[event_id];
+  if (std::find(sublist.begin(), sublist.end(), this) != sublist.end())
+    return;
+  subscription_.push_back(event_id);
+  sublist.push_back(this);
+}
+
+void EventReceiver::SubscribeTo(const std::string &name)
+{
+  SubscribeTo(EventManager::GetEventID(name));
 }
 
 void EventReceiver::UnsubscribeAll()
@@ -187,10 +644,16 @@ void EventReceiver::UnsubscribeAll()
   std::lock_guard<std::mutex> l(gSubscribeLock);
   for (auto eid : subscription_)
   {
+    // just leave empty slot, as list might be iterated in Flush() now.
     auto& sublist = EVENTMAN->event_subscribers_[eid];
-    if (sublist.find(this) != sublist.end())
-      sublist.erase(this);
+    auto it = std::find(sublist.begin(), sublist.end(), this);
+    if (it != sublist.end())
+    {
+      *it = nullptr;
+      EVENTMAN->dirty_events_.push_back(eid);
+    }
   }
+  subscription_.clear();
 }
 
 bool EventReceiver::OnEvent(const EventMessage& msg)
@@ -205,11 +668,13 @@ EventReceiverMap::~EventReceiverMap() {}
 
 void EventReceiverMap::AddEvent(const std::string &event_name, const std::function<void (const EventMessage&)> &func)
 {
-  auto i = eventFnMap_.find(event_name);
-  eventFnMap_[event_name] = func;
+  int event_id = EventManager::GetEventID(event_name);
+  auto i = eventFnMap_.find(event_id);
   if (i == eventFnMap_.end()) {
-    SubscribeTo(event_name);
+    eventFnMap_[event_id] = func;
+    SubscribeTo(event_id);
   }
+  else i->second = func;
 }
 
 void EventReceiverMap::Clear()
@@ -220,7 +685,7 @@ void EventReceiverMap::Clear()
 
 bool EventReceiverMap::OnEvent(const EventMessage& msg)
 {
-  auto i = eventFnMap_.find(msg.GetEventName());
+  auto i = eventFnMap_.find(msg.GetEventID());
   R_ASSERT(i != eventFnMap_.end());
   i->second(msg);
   return true;
@@ -252,19 +717,17 @@ const char* kEventNames[Events::kEventLast] = {
 };
 #endif
 
-EventManager::EventManager()
+EventManager::EventManager() : flush_event_count_(0), flush_time_(0)
 {
 }
 
 EventManager::~EventManager()
 {
   // clear all subscriber.
-  // use game event lock to prevent call Flush() method while cleanup.
-  std::lock_guard<std::mutex> lock(game_evt_lock);
-  for (auto i : event_subscribers_)
+  for (auto &i : event_subscribers_)
   {
-    for (auto *e : i.second)
-      e->subscription_.clear();
+    for (auto *e : i)
+      if (e) e->subscription_.clear();
   }
   event_subscribers_.clear();
 }
@@ -281,8 +744,17 @@ void EventManager::Unsubscribe(EventReceiver& e)
 
 bool EventManager::IsSubscribed(EventReceiver& e, const std::string &name)
 {
-  auto& evtlist = event_subscribers_[name];
-  return evtlist.find(&e) != evtlist.end();
+  int event_id = GetEventID(name);
+  std::lock_guard<std::mutex> l(gSubscribeLock);
+  if (event_id >= (int)event_subscribers_.size())
+    return false;
+  auto& evtlist = event_subscribers_[event_id];
+  return std::find(evtlist.begin(), evtlist.end(), &e) != evtlist.end();
+}
+
+void EventManager::SendEvent(int event_id)
+{
+  SendEvent(EventMessage(event_id));
 }
 
 void EventManager::SendEvent(const std::string& event_name)
@@ -292,14 +764,12 @@ void EventManager::SendEvent(const std::string& event_name)
 
 void EventManager::SendEvent(const EventMessage &msg)
 {
-  std::lock_guard<std::mutex> lock(game_evt_lock);
-  game_evt_messages_.push_back(msg);
+  game_evt_messages_.Push(msg);
 }
 
 void EventManager::SendEvent(EventMessage &&msg)
 {
-  std::lock_guard<std::mutex> lock(game_evt_lock);
-  game_evt_messages_.emplace_back(msg);
+  game_evt_messages_.Push(std::move(msg));
 }
 
 #if USE_LR2_FEATURE == 1
@@ -376,44 +846,51 @@ public:
       sprintf(l, "slider%u", i);
       slider[i] = KEYPOOL->GetFloat(l);
     }
+    for (unsigned i = 0; i < 100; ++i)
+    {
+      sprintf(l, "LR%u", i);
+      LR[i] = EventManager::GetEventID(l);
+      sprintf(l, "LR%uOff", i);
+      LROff[i] = EventManager::GetEventID(l);
+    }
 
 
     /* flag initialization */
-    *F[0] = 1;
+    F[0].set(1);
     // XXX: by default ...? or in select scene start?
-    *F[50] = 1;   // OFFLINE
-    *F[52] = 1;   // EXTRA MODE OFF
+    F[50].set(1);   // OFFLINE
+    F[52].set(1);   // EXTRA MODE OFF
 
 
     /* create EventMap */
     fnmap.AddEvent("Load", [this](const EventMessage&) {
-      EVENTMAN->SendEvent("LR0");
+      EVENTMAN->SendEvent(LR[0]);
     });
 
     /* Events for SelectScene */
     fnmap.AddEvent("SelectSceneLoad", [this](const EventMessage&) {
       /* Panel state clear */
-      *F[20] = 1;
-      *F[21] = 0;
-      *F[22] = 0;
-      *F[23] = 0;
-      *F[24] = 0;
-      *F[25] = 0;
-      *F[26] = 0;
-      *F[27] = 0;
-      *F[28] = 0;
-      *F[29] = 0;
-      EVENTMAN->SendEvent("LR21Off");
-      EVENTMAN->SendEvent("LR22Off");
-      EVENTMAN->SendEvent("LR23Off");
-      EVENTMAN->SendEvent("LR24Off");
-      EVENTMAN->SendEvent("LR25Off");
-      EVENTMAN->SendEvent("LR26Off");
-      EVENTMAN->SendEvent("LR27Off");
-      EVENTMAN->SendEvent("LR28Off");
-      EVENTMAN->SendEvent("LR29Off");
-      *F[46] = 0;
-      *F[47] = 1;
+      F[20].set(1);
+      F[21].set(0);
+      F[22].set(0);
+      F[23].set(0);
+      F[24].set(0);
+      F[25].set(0);
+      F[26].set(0);
+      F[27].set(0);
+      F[28].set(0);
+      F[29].set(0);
+      EVENTMAN->SendEvent(LROff[21]);
+      EVENTMAN->SendEvent(LROff[22]);
+      EVENTMAN->SendEvent(LROff[23]);
+      EVENTMAN->SendEvent(LROff[24]);
+      EVENTMAN->SendEvent(LROff[25]);
+      EVENTMAN->SendEvent(LROff[26]);
+      EVENTMAN->SendEvent(LROff[27]);
+      EVENTMAN->SendEvent(LROff[28]);
+      EVENTMAN->SendEvent(LROff[29]);
+      F[46].set(0);
+      F[47].set(1);
     });
 
     fnmap.AddEvent("SongFilterChanged", [this](const EventMessage&) {
@@ -430,17 +907,17 @@ public:
       static const int sort_filter[4] = { 0, 1, 2, 4 };
 
       for (int i = 0; i < 7; ++i) if (difficulty <= difficulty_filter[i]) {
-        *F[46] = (i != 0);
-        *F[47] = (i == 0);
-        *button[10] = i;
+        F[46].set(i != 0);
+        F[47].set(i == 0);
+        button[10].set(i);
         break;
       }
       for (int i = 0; i < 6; ++i) if (gamemode <= key_filter[i]) {
-        *button[11] = i;
+        button[11].set(i);
         break;
       }
       for (int i = 0; i < 4; ++i) if (sortmode == sort_filter[i]) {
-        *button[12] = i;
+        button[12].set(i);
         break;
       }
     });
@@ -471,88 +948,88 @@ public:
       };
 
       /* Flag for difficulty of current song. */
-      *S[10] = *info_title;
-      *S[11] = *info_subtitle;
-      *S[12] = *info_fulltitle;
-      *S[13] = *info_genre;
-      *S[14] = *info_artist;
+      S[10].set(*info_title);
+      S[11].set(*info_subtitle);
+      S[12].set(*info_fulltitle);
+      S[13].set(*info_genre);
+      S[14].set(*info_artist);
       /* BPM */
-      *N[90] = *info_bpmmax;
-      *N[91] = *info_bpmmin;
-      *F[176] = *info_bpmmax == *info_bpmmin;
-      *F[177] = *info_bpmmax != *info_bpmmin;
+      N[90].set(*info_bpmmax);
+      N[91].set(*info_bpmmin);
+      F[176].set(*info_bpmmax == *info_bpmmin);
+      F[177].set(*info_bpmmax != *info_bpmmin);
       /* IR */
-      *N[92] = 0;
-      *N[93] = 0;
-      *N[94] = 0;
+      N[92].set(0);
+      N[93].set(0);
+      N[94].set(0);
 
       for (size_t i = 0; i < 5; ++i)
       {
-        *F[500 + i] = diff_not_exist[i];
-        *F[505 + i] = diff_exist[i];
-        *F[510 + i] = *info_diff > 0;   // TODO: single
-        *F[515 + i] = 0;                // TODO: multiple
-        *N[45 + i] = *info_level;
-        *F[151 + i] = (*info_diff - 1 == i);
+        F[500 + i].set(diff_not_exist[i]);
+        F[505 + i].set(diff_exist[i]);
+        F[510 + i].set(*info_diff > 0);   // TODO: single
+        F[515 + i].set(0);                // TODO: multiple
+        N[45 + i].set(*info_level);
+        F[151 + i].set(*info_diff - 1 == i);
       }
-      *F[150] = *info_diff == 0;
+      F[150].set(*info_diff == 0);
 
       //for (size_t i = 1; i < 6; ++i)
       //  *F[i] = (*info_itemtype == i);  // Flag code?
 
       float rate = (float)(*info_exscore) / *info_totalnote / 2 * 100;
       int totalnote = *info_totalnote;
-      *N[70] = *info_score;
-      *N[71] = *info_exscore;
-      *N[72] = totalnote * 2;
-      *N[73] = (int)rate;
-      *N[74] = totalnote;
-      *N[75] = *info_maxcombo;
-      *N[76] = *info_bd + *info_pr;
-      *N[77] = *info_playcount;
-      *N[78] = *info_clearcount;
-      *N[79] = *info_failcount;
-      *N[80] = *info_pg;
-      *N[81] = *info_gr;
-      *N[82] = *info_gd;
-      *N[83] = *info_bd;
-      *N[84] = *info_pr;
-      *N[85] = static_cast<int>(*info_pg * 100.0f / totalnote);
-      *N[85] = static_cast<int>(*info_gr * 100.0f / totalnote);
-      *N[85] = static_cast<int>(*info_gd * 100.0f / totalnote);
-      *N[85] = static_cast<int>(*info_bd * 100.0f / totalnote);
-      *N[85] = static_cast<int>(*info_pr * 100.0f / totalnote);
+      N[70].set(*info_score);
+      N[71].set(*info_exscore);
+      N[72].set(totalnote * 2);
+      N[73].set((int)rate);
+      N[74].set(totalnote);
+      N[75].set(*info_maxcombo);
+      N[76].set(*info_bd + *info_pr);
+      N[77].set(*info_playcount);
+      N[78].set(*info_clearcount);
+      N[79].set(*info_failcount);
+      N[80].set(*info_pg);
+      N[81].set(*info_gr);
+      N[82].set(*info_gd);
+      N[83].set(*info_bd);
+      N[84].set(*info_pr);
+      N[85].set(static_cast<int>(*info_pg * 100.0f / totalnote));
+      N[85].set(static_cast<int>(*info_gr * 100.0f / totalnote));
+      N[85].set(static_cast<int>(*info_gd * 100.0f / totalnote));
+      N[85].set(static_cast<int>(*info_bd * 100.0f / totalnote));
+      N[85].set(static_cast<int>(*info_pr * 100.0f / totalnote));
 
       for (int i = 0; i <= 45; ++i)
-        *F[520 + i] = 0;
+        F[520 + i].set(0);
 
       if (*info_itemtype == 2 /* if song */)
       {
         int clridx = *info_cleartype;
         int diff = *info_diff;
-        *F[520 + diff * 10 + clridx] = 1;
+        F[520 + diff * 10 + clridx].set(1);
       }
 
-      *slider[1] = *info_musicwheelpos;
+      slider[1].set(*info_musicwheelpos);
 
-      EVENTMAN->SendEvent("LR10");
-      EVENTMAN->SendEvent("LR11");
-      EVENTMAN->SendEvent("LR14Off");
+      EVENTMAN->SendEvent(LR[10]);
+      EVENTMAN->SendEvent(LR[11]);
+      EVENTMAN->SendEvent(LROff[14]);
     });
 
-    fnmap.AddEvent("SongSelectChangeUp", [](const EventMessage&) {
-      EVENTMAN->SendEvent("LR12");
+    fnmap.AddEvent("SongSelectChangeUp", [this](const EventMessage&) {
+      EVENTMAN->SendEvent(LR[12]);
     });
 
-    fnmap.AddEvent("SongSelectChangeDown", [](const EventMessage&) {
-      EVENTMAN->SendEvent("LR13");
+    fnmap.AddEvent("SongSelectChangeDown", [this](const EventMessage&) {
+      EVENTMAN->SendEvent(LR[13]);
     });
 
-    fnmap.AddEvent("SongSelectChanged", [](const EventMessage&) {
-      EVENTMAN->SendEvent("LR10Off");
-      EVENTMAN->SendEvent("LR12Off");
-      EVENTMAN->SendEvent("LR13Off");
-      EVENTMAN->SendEvent("LR14");
+    fnmap.AddEvent("SongSelectChanged", [this](const EventMessage&) {
+      EVENTMAN->SendEvent(LROff[10]);
+      EVENTMAN->SendEvent(LROff[12]);
+      EVENTMAN->SendEvent(LROff[13]);
+      EVENTMAN->SendEvent(LR[14]);
     });
 
     /* Events for SelectScene Panel */
@@ -565,50 +1042,34 @@ public:
         "Panel1","Panel2","Panel3","Panel4","Panel5",
         "Panel6","Panel7","Panel8","Panel9",0
       };
-      const char* panelonop2[] = { 0,
-        "LR21","LR22","LR23","LR24","LR25",
-        "LR26","LR27","LR28","LR29",0
-      };
-      const char* paneloffop2[] = { 0,
-        "LR21Off","LR22Off","LR23Off","LR24Off","LR25Off",
-        "LR26Off","LR27Off","LR28Off","LR29Off",0
-      };
-      const char* paneloffop3[] = { 0,
-        "LR31","LR32","LR33","LR34","LR35",
-        "LR36","LR37","LR38","LR39",0
-      };
-      const char* panelonop3[] = { 0,
-        "LR31Off","LR32Off","LR33Off","LR34Off","LR35Off",
-        "LR36Off","LR37Off","LR38Off","LR39Off",0
-      };
       /* If my panel is on, then turn off my panel.
        * else, turn on my panel and turn off remaining panels. */
       if (*F[20 + panelidx] == 1)
       {
-        *F[20] = 1;
-        *F[20 + panelidx] = 0;
-        EVENTMAN->SendEvent(paneloffop2[panelidx]);
-        EVENTMAN->SendEvent(paneloffop3[panelidx]);
+        F[20].set(1);
+        F[20 + panelidx].set(0);
+        EVENTMAN->SendEvent(LROff[20 + panelidx]);
+        EVENTMAN->SendEvent(LR[30 + panelidx]);
         EVENTMAN->SendEvent(paneloffevents[panelidx]);
-        *button[panelidx] = 0;
+        button[panelidx].set(0);
       }
       else
       {
-        *F[20] = 0;
-        *F[20 + panelidx] = 1;
+        F[20].set(0);
+        F[20 + panelidx].set(1);
         EVENTMAN->SendEvent(panelonevents[panelidx]);
-        EVENTMAN->SendEvent(panelonop2[panelidx]);
-        EVENTMAN->SendEvent(panelonop3[panelidx]);
-        *button[panelidx] = 1;
+        EVENTMAN->SendEvent(LR[20 + panelidx]);
+        EVENTMAN->SendEvent(LROff[30 + panelidx]);
+        button[panelidx].set(1);
         for (int i = 1; i < 10; ++i)
         {
           if (panelidx != i && *F[20 + i] == 1)
           {
-            *F[20 + i] = 0;
-            EVENTMAN->SendEvent(paneloffop2[i]);
-            EVENTMAN->SendEvent(paneloffop3[i]);
+            F[20 + i].set(0);
+            EVENTMAN->SendEvent(LROff[20 + i]);
+            EVENTMAN->SendEvent(LR[30 + i]);
             EVENTMAN->SendEvent(paneloffevents[i]);
-            *button[i] = 0;
+            button[i].set(0);
           }
         }
       }
@@ -665,18 +1126,18 @@ public:
     });
     /* Events for PlayScene */
     fnmap.AddEvent("PlayLoading", [this](const EventMessage&) {
-      *F[80] = 1;   // Loading
-      *F[81] = 1;   // Loaded
-      EVENTMAN->SendEvent("LR40Off");     // READY
-      EVENTMAN->SendEvent("LR41Off");     // START
+      F[80].set(1);   // Loading
+      F[81].set(1);   // Loaded
+      EVENTMAN->SendEvent(LROff[40]);     // READY
+      EVENTMAN->SendEvent(LROff[41]);     // START
     });
     fnmap.AddEvent("PlayReady", [this](const EventMessage&) {
-      *F[80] = 0;   // Loading
-      *F[81] = 1;   // Loaded
-      EVENTMAN->SendEvent("LR40");        // READY
+      F[80].set(0);   // Loading
+      F[81].set(1);   // Loaded
+      EVENTMAN->SendEvent(LR[40]);        // READY
     });
     fnmap.AddEvent("PlayStart", [this](const EventMessage&) {
-      EVENTMAN->SendEvent("LR41");        // START
+      EVENTMAN->SendEvent(LR[41]);        // START
     });
   }
 
@@ -709,6 +1170,10 @@ public:
   // LR2 slider
   KeyData<float> slider[100];
 
+  // LR2 timer events (LRxx / LRxxOff)
+  int LR[100];
+  int LROff[100];
+
   // Game used KeyPools
   KeyData<std::string> info_title;
   KeyData<std::string> info_subtitle;
@@ -757,15 +1222,23 @@ void EventManager::Initialize()
 
 #if USE_GLFW
   GLFWwindow* window_ = (GLFWwindow*)GAME->handler();
-  R_ASSERT(window_);
-  glfwSetKeyCallback(window_, on_keyevent);
-  glfwSetCharCallback(window_, on_text);
-  glfwSetCursorPosCallback(window_, on_cursormove);
-  glfwSetMouseButtonCallback(window_, on_cursorbutton);
-  glfwSetJoystickCallback(on_joystick_conn);
-  glfwSetWindowSizeCallback(window_, on_window_resize);
+  R_ASSERT(window_ || GAME->is_headless());
+  if (window_)
+  {
+    glfwSetKeyCallback(window_, on_keyevent);
+    glfwSetCharCallback(window_, on_text);
+    glfwSetCursorPosCallback(window_, on_cursormove);
+    glfwSetMouseButtonCallback(window_, on_cursorbutton);
+    glfwSetJoystickCallback(on_joystick_conn);
+    glfwSetWindowSizeCallback(window_, on_window_resize);
+    glfwSetWindowFocusCallback(window_, on_window_focus);
+    window_focused_ = glfwGetWindowAttrib(window_, GLFW_FOCUSED) != 0;
+  }
 #endif
 
+  if (PrefValue<int>("evdevinput", 0).get())
+    InputEventManager::StartInputThread();
+
 #if USE_LR2_FEATURE
   // enable LR2 event hooking
   static LR2KeyPool lr2keypool;
@@ -775,6 +1248,24 @@ void EventManager::Initialize()
 
 void EventManager::Cleanup()
 {
+  InputEventManager::StopInputThread();
+
+  const InputLatencyStat &lat = InputEventManager::GetLatencyStat();
+  if (lat.count > 0)
+  {
+    Logger::Info("Input latency: %zu events, avg %.2lf ms, "
+      "p50 %.1lf ms, p99 %.1lf ms, max %.2lf ms",
+      lat.count, lat.total * 1000 / lat.count,
+      lat.GetPercentile(0.5) * 1000, lat.GetPercentile(0.99) * 1000,
+      lat.max * 1000);
+  }
+
+  if (EVENTMAN->flush_time_ > 0)
+  {
+    Logger::Info("Event: %zu events flushed in %.2lf ms (%.0lf events/sec)",
+      EVENTMAN->flush_event_count_, EVENTMAN->flush_time_ * 1000,
+      EVENTMAN->flush_event_count_ / EVENTMAN->flush_time_);
+  }
   delete EVENTMAN;
 }
 
@@ -783,7 +1274,8 @@ int EventManager::GetStatus(unsigned input_id) const
   if (input_id >= RI_MOUSE_BUTTON_1)
     return 0; /* not implemented */
 #if USE_GLFW
-  if (glfwGetKey((GLFWwindow*)GAME->handler(), input_id) == GLFW_PRESS)
+  if (GAME->handler() &&
+      glfwGetKey((GLFWwindow*)GAME->handler(), input_id) == GLFW_PRESS)
     return 1;
 #endif
   return 0;
@@ -792,40 +1284,72 @@ int EventManager::GetStatus(unsigned input_id) const
 void EventManager::Flush()
 {
   // process cached events until no remaining event to process.
-  // swap cache to prevent event lagging while ProcessEvent.
-  // Pre-reserve enough space for new event cache to improve performance.
   // @warn
   // In some case, infinite loop of event may caused.
   // By setting maximum event depth, infinite event loop is prevented.
   constexpr size_t kMaxEventDepth = 50;
   size_t event_depth = 0;
-  std::vector<EventMessage> evnt(kPreCacheEventCount);
-  while (!game_evt_messages_.empty())
+  EventMessage e;
+  double t = Timer::GetUncachedSystemTime();
+  while (game_evt_messages_.size() > 0)
   {
     if (event_depth > kMaxEventDepth)
     {
       Logger::Error("Event depth is too deep (over %d)", kMaxEventDepth);
       break;
     }
-    evnt.clear();
-    {
-      std::lock_guard<std::mutex> lock(game_evt_lock);
-      game_evt_messages_.swap(evnt);
-    }
 
-    for (const auto& e : evnt)
+    // process only events queued until now;
+    // events sent while processing are handled in next depth.
+    // (stop if producer is still writing the event; it's processed next frame)
+    size_t count = game_evt_messages_.size();
+    size_t ei = 0;
+    for (; ei < count && game_evt_messages_.Pop(e); ++ei)
     {
-      auto &evtlist = EVENTMAN->event_subscribers_[e.GetEventName()];
-      for (auto* recv : evtlist)
+      // subscriber list may grow or get empty slot while processing,
+      // so access it with index every time.
+      // it may also be resized by SubscribeTo() from loader thread,
+      // so read it under lock, but don't hold the lock while calling
+      // OnEvent() as handler may subscribe/unsubscribe.
+      int event_id = e.GetEventID();
+      flush_event_count_++;
+      for (size_t i = 0; ; ++i)
       {
-        if (!recv->OnEvent(e))
+        EventReceiver *recv;
+        {
+          std::lock_guard<std::mutex> l(gSubscribeLock);
+          if (event_id >= (int)event_subscribers_.size() ||
+              i >= event_subscribers_[event_id].size())
+            break;
+          recv = event_subscribers_[event_id][i];
+        }
+        if (recv && !recv->OnEvent(e))
           break;
       }
       // Depreciated: Send remain event to SceneManager.
       //SceneManager::getInstance().SendEvent(e);
     }
+    if (ei < count)
+      break;
     ++event_depth;
   }
+  flush_time_ += Timer::GetUncachedSystemTime() - t;
+
+  size_t dropped = game_evt_messages_.TakeDropped();
+  if (dropped > 0)
+    Logger::Warn("Event queue is full: %zu events dropped", dropped);
+
+  // remove unsubscribed slots.
+  {
+    std::lock_guard<std::mutex> l(gSubscribeLock);
+    for (auto eid : dirty_events_)
+    {
+      auto &sublist = event_subscribers_[eid];
+      sublist.erase(std::remove(sublist.begin(), sublist.end(), nullptr),
+                    sublist.end());
+    }
+    dirty_events_.clear();
+  }
 }
 
 
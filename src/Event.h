@@ -2,6 +2,7 @@
 
 #include <set>
 #include <map>
+#include <unordered_map>
 #include <string>
 #include <vector>
 #include <list>
@@ -215,10 +216,50 @@ enum InputEvents
   kInputEventLast    /* unused event; just for last index */
 };
 
+class InputEvent;
+
+/* @brief Histogram of latency from input timestamp to judge. */
+struct InputLatencyStat
+{
+  static constexpr int kBucketCount = 64;
+  static constexpr double kBucketSize = 0.0005;  /* 0.5ms per bucket */
+
+  size_t count;
+  double total;     /* in second */
+  double max;
+  size_t bucket[kBucketCount];  /* last bucket includes all overflow */
+
+  /* @brief add latency (in second) to histogram. */
+  void Add(double latency);
+
+  /* @brief latency in second of given percentile (0~1), by bucket. */
+  double GetPercentile(double p) const;
+};
+
 class InputEventManager
 {
 public:
   static void Flush();
+
+  /**
+   * @brief
+   * Start input thread which reads evdev devices directly (Linux only),
+   * so that key events are timestamped by kernel, not by frame.
+   * Its key events are dispatched only while game window is focused,
+   * and GLFW key events are used instead while focus is lost.
+   * On other platforms it returns false, and GLFW key events are used.
+   */
+  static bool StartInputThread();
+  static void StopInputThread();
+  static bool IsInputThreadRunning();
+
+  /* @brief queue input event from any thread (e.g. synthetic input).
+   * Its timestamp is kept, and it is dispatched at next Flush(). */
+  static void QueueEvent(const InputEvent &e);
+
+  /* @brief record latency of event which is processed (judged) now. */
+  static void RecordLatency(const InputEvent &e);
+  static const InputLatencyStat &GetLatencyStat();
 };
 
 /* @brief Only for Input related event */
@@ -234,6 +275,7 @@ public:
   /* time in second. unsynced from gametime (means exact time) */
   double time() const;
 
+  void SetTime(double time);
   void SetKeyCode(int v);
   void SetPosition(int x, int y);
   void SetButton(int button);
@@ -268,16 +310,21 @@ public:
 class EventMessage
 {
 public:
-  EventMessage() = default;
+  EventMessage();
+  EventMessage(int event_id);
+  EventMessage(int event_id, const std::string& content);
   EventMessage(const std::string& name);
   EventMessage(const std::string& name, const std::string& content);
+  void SetEventID(int event_id);
   void SetEventName(const std::string &name);
   void SetContent(const std::string& content);
+  int GetEventID() const;
   const std::string &GetEventName() const;
   const std::string& content() const;
 
 private:
-  std::string name_;
+  /* interned event name (by EventManager::GetEventID) */
+  int id_;
   std::string content_;
 };
 
@@ -287,6 +334,7 @@ class EventReceiver
 public:
   virtual ~EventReceiver();
 
+  void SubscribeTo(int event_id);
   void SubscribeTo(const std::string &name);
   void UnsubscribeAll();
 
@@ -295,10 +343,10 @@ public:
 
 private:
   /* to what events it subscribed. */
-  std::vector<std::string> subscription_;
+  std::vector<int> subscription_;
 };
 
-typedef std::map<std::string, std::function<void (const EventMessage&)> > EventFnMap;
+typedef std::unordered_map<int, std::function<void (const EventMessage&)> > EventFnMap;
 
 /* @brief EventReceiver with EventMap. */
 class EventReceiverMap : public EventReceiver
@@ -318,12 +366,21 @@ public:
   static void Initialize();
   static void Cleanup();
 
+  /**
+   * @brief
+   * Get dense integer id of event name, registering it if not exists.
+   * Id is never changed during runtime, so it is good to cache it.
+   * (0 is reserved for empty event)
+   */
+  static int GetEventID(const std::string &name);
+  static const std::string &GetEventName(int event_id);
+
   void Subscribe(EventReceiver& e, const std::string &name);
   void Unsubscribe(EventReceiver& e);
   bool IsSubscribed(EventReceiver& e, const std::string &name);
 
   /* broadcast event to whole subscriber of it. */
-  //static void SendEvent(int event_id);
+  void SendEvent(int event_id);
   void SendEvent(const std::string& event_name);
   void SendEvent(const EventMessage &msg);
   void SendEvent(EventMessage &&msg);
@@ -338,8 +395,17 @@ private:
   EventManager();
   ~EventManager();
 
-  /* subscribers are stored in it */
-  std::map<std::string, std::set<EventReceiver*> > event_subscribers_;
+  /**
+   * subscribers are stored in it, indexed by event id.
+   * unsubscribed slot is set as nullptr while flushing events,
+   * and removed after flush (dirty_events_).
+   */
+  std::vector<std::vector<EventReceiver*> > event_subscribers_;
+  std::vector<int> dirty_events_;
+
+  /* statistics for Flush() */
+  size_t flush_event_count_;
+  double flush_time_;
 
   friend class EventReceiver;
 };
@@ -104,12 +104,17 @@ FontBitmap::FontBitmap(uint32_t* bitmap, int w, int h)
 }
 
 // bitmap is copied into memory.
-FontBitmap::FontBitmap(const uint32_t* bitmap, int w, int h)
+// bottom-up bitmap is flipped while copying.
+FontBitmap::FontBitmap(const uint32_t* bitmap, int w, int h, bool bottom_up)
   : bitmap_(0), width_(w), height_(h), cur_x_(0), cur_y_(0),
     cur_line_height_(0), error_code_(0), error_msg_(0)
 {
   bitmap_ = (uint32_t*)malloc(width_ * height_ * sizeof(uint32_t));
-  memcpy(bitmap_, bitmap, width_ * height_ * sizeof(uint32_t));
+  if (!bottom_up)
+    memcpy(bitmap_, bitmap, width_ * height_ * sizeof(uint32_t));
+  else for (int y = 0; y < height_; ++y)
+    memcpy(bitmap_ + y * width_, bitmap + (height_ - y - 1) * width_,
+      width_ * sizeof(uint32_t));
 }
 
 FontBitmap::~FontBitmap()
@@ -353,6 +358,14 @@ bool Font::is_empty() const
   return ftface_[0] == 0 && glyph_.empty();
 }
 
+size_t Font::get_memory_size() const
+{
+  size_t s = glyph_.size() * sizeof(FontGlyph);
+  for (auto *b : fontbitmap_)
+    s += (size_t)b->width() * b->height() * 4;
+  return s;
+}
+
 void Font::LoadFreetypeFont(const std::string &path)
 {
   R_ASSERT(is_empty());
@@ -503,7 +516,8 @@ void Font::LoadLR2BitmapFont(const std::string &path)
         return;
       }
       FontBitmap *fbitmap = new FontBitmap(
-        (const uint32_t*)img->get_ptr(), img->get_width(), img->get_height()
+        (const uint32_t*)img->get_ptr(), img->get_width(), img->get_height(),
+        img->is_bottom_up()
       );
       fontbitmap_.push_back(fbitmap);
       CommitBitmap(fbitmap);
@@ -92,7 +92,7 @@ class FontBitmap
 public:
   FontBitmap(int w, int h);
   FontBitmap(uint32_t* bitmap, int w, int h);
-  FontBitmap(const uint32_t* bitmap, int w, int h);
+  FontBitmap(const uint32_t* bitmap, int w, int h, bool bottom_up = false);
   ~FontBitmap();
   void Write(uint32_t* bitmap, int w, int h, FontGlyph &glyph_out);
   bool Update();
@@ -140,6 +140,7 @@ public:
   void Update(float ms);
 
   bool is_empty() const;
+  virtual size_t get_memory_size() const;
 
   void PrepareText(const std::string& text_utf8);
   void PrepareGlyph(uint32_t *chrs, int count);
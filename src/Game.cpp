@@ -1,4 +1,5 @@
 #include "Game.h"
+#include "KeyPool.h"
 #include "Graphic.h"
 #include "Timer.h"
 #include "Logger.h"
@@ -10,6 +11,7 @@
 #include "Player.h"
 #include "ResourceManager.h"
 #include "SceneManager.h"
+#include "Benchmark.h"
 #include "LR2/LR2Flag.h"        // for updating LR2 flag
 #include "scene/OverlayScene.h" // for invoke MessageBox
 #include "common.h"
@@ -73,7 +75,8 @@ std::map<std::string, std::string> gPrefTemp;
 
 Game::Game()
   : handler_(nullptr), is_running_(false), is_paused_(false),
-    game_boot_mode_(GameBootMode::kBootNormal)
+    game_boot_mode_(GameBootMode::kBootNormal),
+    is_headless_(false), headless_frame_limit_(0), is_reload_song_(false)
 {
 }
 
@@ -137,6 +140,13 @@ void Game::Initialize()
   SongList::Initialize();
 
   GAME->is_running_ = true;
+
+  // run benchmarks instead of game loop.
+  if (GAME->game_boot_mode_ == GameBootMode::kBootBenchmark)
+  {
+    Benchmark::Run(GAME->benchmark_);
+    Exit();
+  }
 }
 
 void Game::Loop()
@@ -157,6 +167,7 @@ void Game::Loop()
       if (GRAPHIC->IsVsyncUpdatable()) {
         Timer::Update();
         InputEventManager::Flush();
+        SONGLIST->ProcessChanges();
         EVENTMAN->Flush();
 
         /* Song and movie won't be updated if paused. */
@@ -167,6 +178,9 @@ void Game::Loop()
           ResourceManager::Update(delta);
         }
 
+        /* Detect changed values before objects are updated */
+        KEYPOOL->Update();
+
         /* Scene update & rendering */
         SCENEMAN->Update();
         GRAPHIC->BeginFrame();
@@ -210,6 +224,7 @@ void Game::Cleanup()
   PlayerManager::Cleanup();
   SceneManager::Cleanup();
   TaskPool::Destroy();
+  ResourceManager::ClearCache();
   Graphic::DeleteGraphic();
   SoundDriver::getInstance().Destroy();
   Setting::Save();
@@ -233,7 +248,9 @@ void Game::Exit()
 
 void Game::PollEvent()
 {
-  glfwPollEvents();
+  // no window in headless mode
+  if (handler_)
+    glfwPollEvents();
 }
 
 void Game::InitializeHandler()
@@ -345,7 +362,22 @@ void Game::LoadArgument(const std::string& argv)
   else if (cmd == "--reset") {
   } // TODO
   else if (cmd == "--reloadsong") {
-  } // TODO
+    is_reload_song_ = true;
+  }
+  else if (cmd == "--headless") {
+    // --headless[=frame count to run]
+    is_headless_ = true;
+    headless_frame_limit_ = atoi(v.c_str());
+  }
+  else if (cmd == "--benchmark") {
+    // --benchmark=name[,name...] or --benchmark=all
+    game_boot_mode_ = GameBootMode::kBootBenchmark;
+    benchmark_ = v.empty() ? "all" : v;
+  }
+  else if (cmd == "--capture") {
+    // save last frame in headless mode (software rasterized)
+    capture_path_ = v;
+  }
   else if (cmd == "--play") {
     game_boot_mode_ = GameBootMode::kBootPlay;
     SongPlayer::getInstance().SetSongtoPlay(v, "");
@@ -412,6 +444,31 @@ GameBootMode Game::get_boot_mode() const
   return game_boot_mode_;
 }
 
+bool Game::is_headless() const
+{
+  return is_headless_;
+}
+
+int Game::get_headless_frame_limit() const
+{
+  return headless_frame_limit_;
+}
+
+const std::string &Game::get_capture_path() const
+{
+  return capture_path_;
+}
+
+bool Game::is_reload_song() const
+{
+  return is_reload_song_;
+}
+
+const std::string &Game::get_benchmark() const
+{
+  return benchmark_;
+}
+
 bool Game::is_main_thread()
 {
   return main_thread_id == std::this_thread::get_id();
@@ -25,6 +25,7 @@ enum GameBootMode
   kBootPlay, /* Only for play */
   kBootRefresh, /* Only for library refresh */
   kBootTest, /* hidden boot mode - only for test purpose */
+  kBootBenchmark, /* run benchmarks and exit */
 };
 
 enum Gamemode
@@ -77,6 +78,17 @@ public:
   bool IsPaused();
 
   GameBootMode get_boot_mode() const;
+
+  /* Running without display? (--headless) */
+  bool is_headless() const;
+  int get_headless_frame_limit() const;
+  const std::string &get_capture_path() const;
+
+  /* Ignore cached song database and scan whole library? (--reloadsong) */
+  bool is_reload_song() const;
+
+  /* Benchmarks to run (--benchmark) */
+  const std::string &get_benchmark() const;
   static const std::string &get_window_title();
   static bool is_main_thread();
 
@@ -98,6 +110,19 @@ private:
 
   // current game boot mode.
   GameBootMode game_boot_mode_;
+
+  // use headless graphic, and exit after given frames (0: no limit).
+  bool is_headless_;
+  int headless_frame_limit_;
+
+  // path to save last rendered frame in headless mode.
+  std::string capture_path_;
+
+  // rebuild song database from scratch.
+  bool is_reload_song_;
+
+  // benchmark names to run in benchmark boot mode.
+  std::string benchmark_;
 };
 
 extern Game *GAME;
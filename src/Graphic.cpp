@@ -9,6 +9,8 @@
 #include <iostream>
 #include <algorithm>
 #include <memory.h>
+#include <cmath>
+#include <FreeImage.h>
 
 #if USE_GLEW
   #if USE_GLFW == 0
@@ -26,6 +28,9 @@
 
 constexpr int kVertexMaxSize = 1024 * 4;
 
+/* maximum quads drawn in a single batch (indexed by 16bit) */
+constexpr unsigned kBatchMaxQuads = 4096;
+
 namespace rhythmus
 {
 
@@ -112,7 +117,11 @@ void StringSafeAssign(std::string &s, const void *p)
 void Graphic::CreateGraphic()
 {
   // TODO: selectable graphic engine from option.
-  GRAPHIC = new GraphicGLShader();
+  if (GAME->is_headless())
+    GRAPHIC = new GraphicHeadless(GAME->get_headless_frame_limit(),
+                                  GAME->get_capture_path());
+  else
+    GRAPHIC = new GraphicGLShader();
   GRAPHIC->Initialize();
   Logger::Info("Using graphic type: %s", GRAPHIC->name());
 }
@@ -128,6 +137,9 @@ Graphic::Graphic()
   : frame_delay_weight_avg_(1000.0f), next_render_time_(.0),
     last_render_time_(.0), is_game_running_(true)
 {
+  memset(&render_stat_, 0, sizeof(render_stat_));
+  memset(&last_render_stat_, 0, sizeof(last_render_stat_));
+  batch_.reserve(kBatchMaxQuads * 4);
   video_mode_.bpp = 32;
   video_mode_.width = 1280;
   video_mode_.height = 800;
@@ -414,9 +426,44 @@ void Graphic::DrawQuads(const VertexInfo *vi, unsigned count) {}
 
 void Graphic::DrawQuad(const VertexInfo *vi) { DrawQuads(vi, 4); }
 
+void Graphic::AddBatch(const VertexInfo *vi, unsigned count)
+{
+  R_ASSERT(count % 4 == 0);
+  render_stat_.quads += count / 4;
+  if (batch_.size() + count > kBatchMaxQuads * 4)
+    FlushBatch();
+
+  Matrix modelView = GetViewMatrix() * GetWorldMatrix();
+  for (unsigned i = 0; i < count; ++i)
+  {
+    VertexInfo v = vi[i];
+    v.p = Vector3(modelView * Vector4(vi[i].p, 1.0f));
+    batch_.push_back(v);
+  }
+}
+
+void Graphic::FlushBatch()
+{
+  if (batch_.empty()) return;
+  DrawBatch(batch_.data(), (unsigned)batch_.size());
+  render_stat_.draw_calls++;
+  batch_.clear();
+}
+
+void Graphic::OnStateChange()
+{
+  FlushBatch();
+  render_stat_.state_changes++;
+}
+
+void Graphic::DrawBatch(const VertexInfo *vi, unsigned count) {}
+
 // This method should be called every time to calculate FPS
 void Graphic::BeginFrame()
 {
+  last_render_stat_ = render_stat_;
+  memset(&render_stat_, 0, sizeof(render_stat_));
+
   frame_delay_weight_avg_ = frame_delay_weight_avg_ * 0.8f + (float)delta() * 1000.0f * 0.2f;
   last_render_time_ = Timer::GetUncachedSystemTime();
 
@@ -457,9 +504,11 @@ void Graphic::DrawRect(float x, float y, float w, float h, uint32_t argb)
 
 float Graphic::GetFPS() const { return 1000.0f / frame_delay_weight_avg_; }
 
+const RenderStat &Graphic::GetRenderStat() const { return last_render_stat_; }
+
 void Graphic::SignalWindowClose()
 {
-  is_game_running_ = true;
+  is_game_running_ = false;
 }
 
 bool Graphic::IsWindowShouldClose() const
@@ -474,6 +523,308 @@ double Graphic::delta() const
 
 const char* Graphic::name() { return "Base"; }
 
+// ------------------------------------------------------ class GraphicHeadless
+
+GraphicHeadless::GraphicHeadless(int frame_limit, const std::string &capture_path)
+  : texture_id_counter_(0), tex_id_(0), blendmode_(-1),
+    frame_limit_(frame_limit), capture_path_(capture_path), use_clip_(false),
+    frame_count_(0), texture_upload_count_(0), texture_upload_bytes_(0),
+    frame_time_(0), last_frame_time_(0)
+{
+  memset(&total_stat_, 0, sizeof(total_stat_));
+}
+
+GraphicHeadless::~GraphicHeadless() {}
+
+void GraphicHeadless::Initialize()
+{
+  const VideoModeParams &vp = GetVideoMode();
+  Logger::Info("Headless graphic: %dx%d, frame limit %d, capture %s",
+    vp.width, vp.height, frame_limit_,
+    capture_path_.empty() ? "(none)" : capture_path_.c_str());
+}
+
+void GraphicHeadless::Cleanup()
+{
+  if (frame_count_ > 0) {
+    Logger::Info("Headless: %u frames, %.2lf ms/frame, per frame "
+      "%.1lf draw calls, %.1lf state changes, %.1lf quads, "
+      "%u texture uploads (%.1lf MB)",
+      frame_count_, frame_time_ * 1000 / frame_count_,
+      total_stat_.draw_calls / (double)frame_count_,
+      total_stat_.state_changes / (double)frame_count_,
+      total_stat_.quads / (double)frame_count_,
+      texture_upload_count_, texture_upload_bytes_ / 1048576.0);
+  }
+  if (!capture_path_.empty() && !SaveFramebuffer(capture_path_))
+    Logger::Error("Failed to save headless capture: %s", capture_path_.c_str());
+  ClearAllTextures();
+}
+
+bool GraphicHeadless::TryVideoMode(VideoModeParams &p) { return true; }
+
+/* run frames as fast as possible to measure frame cost. */
+bool GraphicHeadless::IsVsyncUpdatable() const { return true; }
+
+unsigned GraphicHeadless::CreateTexture(const uint8_t *p, unsigned width, unsigned height)
+{
+  unsigned texid = ++texture_id_counter_;
+  Texture &tex = textures_[texid];
+  tex.width = width;
+  tex.height = height;
+  if (!capture_path_.empty())
+    tex.pixels.assign(p, p + (size_t)width * height * 4);
+  texture_upload_count_++;
+  texture_upload_bytes_ += (size_t)width * height * 4;
+  return texid;
+}
+
+void GraphicHeadless::UpdateTexture(unsigned tex_id, const uint8_t *p,
+  unsigned xoffset, unsigned yoffset, unsigned width, unsigned height)
+{
+  auto ii = textures_.find(tex_id);
+  if (ii == textures_.end()) return;
+  Texture &tex = ii->second;
+  if (!tex.pixels.empty()) {
+    for (unsigned y = 0; y < height && y + yoffset < tex.height; ++y) {
+      unsigned w = std::min(width, tex.width - xoffset);
+      memcpy(&tex.pixels[((y + yoffset) * tex.width + xoffset) * 4],
+        p + (size_t)y * width * 4, w * 4);
+    }
+  }
+  texture_upload_count_++;
+  texture_upload_bytes_ += (size_t)width * height * 4;
+}
+
+void GraphicHeadless::DeleteTexture(unsigned tex_id)
+{
+  textures_.erase(tex_id);
+}
+
+void GraphicHeadless::ClearAllTextures()
+{
+  textures_.clear();
+}
+
+unsigned GraphicHeadless::GetNumTextureUnits() { return 1; }
+
+Image *GraphicHeadless::CreateScreenShot() { return nullptr; }
+
+Image *GraphicHeadless::GetTexture(unsigned tex_id) { return nullptr; }
+
+void GraphicHeadless::SetBlendMode(int mode)
+{
+  if (blendmode_ != mode)
+  {
+    OnStateChange();
+    blendmode_ = mode;
+  }
+}
+
+void GraphicHeadless::SetTexture(unsigned texunit, unsigned tex_id)
+{
+  if (tex_id_ != tex_id)
+  {
+    OnStateChange();
+    tex_id_ = tex_id;
+  }
+}
+
+void GraphicHeadless::SetTextureMode(unsigned texunit, unsigned mode) {}
+
+void GraphicHeadless::SetTextureFiltering(unsigned texunit, unsigned do_filtering)
+{
+  FlushBatch();
+}
+
+void GraphicHeadless::SetZWrite(bool enable)
+{
+  FlushBatch();
+}
+
+void GraphicHeadless::DrawQuads(const VertexInfo *vi, unsigned count)
+{
+  if (count == 0) return;
+  R_ASSERT(count >= 4);
+
+  // same pre-process as GraphicGLShader
+  if (blendmode_ == 0)
+  {
+    std::vector<VertexInfo> vi_tmp(vi, vi + count);
+    for (auto &v : vi_tmp)
+      v.c.a = 1.0f;
+    AddBatch(vi_tmp.data(), count);
+  }
+  else AddBatch(vi, count);
+}
+
+void GraphicHeadless::BeginFrame()
+{
+  const VideoModeParams &vp = GetVideoMode();
+
+  Graphic::BeginFrame();
+
+  tex_id_ = 0;
+  SetDefaultRenderState();
+  CameraLoadPerspective(PERSPECTIVE_ANGLE,
+    (float)vp.width, (float)vp.height, vp.width / 2.0f, vp.height / 2.0f);
+
+  // clear to black (resized here as video mode may change after init)
+  if (!capture_path_.empty())
+    framebuffer_.resize((size_t)vp.width * vp.height * 4);
+  for (size_t i = 0; i < framebuffer_.size(); i += 4)
+    *(uint32_t*)&framebuffer_[i] = 0xFF000000;
+
+  if (last_frame_time_ == 0)
+    last_frame_time_ = Timer::GetUncachedSystemTime();
+}
+
+void GraphicHeadless::EndFrame()
+{
+  FlushBatch();
+  ResetMatrix();
+
+  const RenderStat &stat = render_stat_;
+  total_stat_.draw_calls += stat.draw_calls;
+  total_stat_.state_changes += stat.state_changes;
+  total_stat_.quads += stat.quads;
+  double t = Timer::GetUncachedSystemTime();
+  frame_time_ += t - last_frame_time_;
+  last_frame_time_ = t;
+
+  frame_count_++;
+  if (frame_limit_ > 0 && frame_count_ >= (unsigned)frame_limit_)
+    SignalWindowClose();
+}
+
+void GraphicHeadless::ClipViewArea(const Vector4 &area)
+{
+  FlushBatch();
+  use_clip_ = true;
+  clip_ = area;
+}
+
+void GraphicHeadless::ResetViewArea()
+{
+  FlushBatch();
+  use_clip_ = false;
+}
+
+void GraphicHeadless::DrawBatch(const VertexInfo *vi, unsigned count)
+{
+  if (framebuffer_.empty()) return;
+
+  // project view-space vertices into screen space.
+  const VideoModeParams &vp = GetVideoMode();
+  const Matrix &proj = GetProjectionMatrix();
+  for (unsigned i = 0; i + 3 < count; i += 4)
+  {
+    Vector2 s[4];
+    for (unsigned j = 0; j < 4; ++j)
+    {
+      Vector4 c = proj * Vector4(vi[i + j].p, 1.0f);
+      if (c.w == 0) c.w = 1.0f;
+      s[j].x = (c.x / c.w + 1.0f) * 0.5f * vp.width;
+      s[j].y = (1.0f - c.y / c.w) * 0.5f * vp.height;
+    }
+    const VertexInfo *t0[3] = { &vi[i], &vi[i + 1], &vi[i + 2] };
+    const Vector2 s0[3] = { s[0], s[1], s[2] };
+    const VertexInfo *t1[3] = { &vi[i], &vi[i + 2], &vi[i + 3] };
+    const Vector2 s1[3] = { s[0], s[2], s[3] };
+    RasterTriangle(t0, s0);
+    RasterTriangle(t1, s1);
+  }
+}
+
+/* @brief Simple rasterizer for capturing.
+ * Nearest texture sampling and affine interpolation, which is enough for
+ * comparing 2D scenes; not intended to be equal to the GPU output. */
+void GraphicHeadless::RasterTriangle(const VertexInfo *v[3], const Vector2 s[3])
+{
+  const VideoModeParams &vp = GetVideoMode();
+  float area = (s[1].x - s[0].x) * (s[2].y - s[0].y)
+             - (s[2].x - s[0].x) * (s[1].y - s[0].y);
+  if (area == 0) return;
+
+  int minx = (int)std::floor(std::min({ s[0].x, s[1].x, s[2].x }));
+  int maxx = (int)std::ceil(std::max({ s[0].x, s[1].x, s[2].x }));
+  int miny = (int)std::floor(std::min({ s[0].y, s[1].y, s[2].y }));
+  int maxy = (int)std::ceil(std::max({ s[0].y, s[1].y, s[2].y }));
+  minx = std::max(minx, use_clip_ ? (int)clip_.x : 0);
+  miny = std::max(miny, use_clip_ ? (int)clip_.y : 0);
+  maxx = std::min(maxx, use_clip_ ? (int)clip_.z : vp.width);
+  maxy = std::min(maxy, use_clip_ ? (int)clip_.w : vp.height);
+  maxx = std::min(maxx, vp.width);
+  maxy = std::min(maxy, vp.height);
+
+  const Texture *tex = nullptr;
+  auto ii = textures_.find(tex_id_);
+  if (ii != textures_.end() && !ii->second.pixels.empty())
+    tex = &ii->second;
+
+  for (int y = miny; y < maxy; ++y)
+  {
+    for (int x = minx; x < maxx; ++x)
+    {
+      float px = x + 0.5f, py = y + 0.5f;
+      float w0 = ((s[1].x - px) * (s[2].y - py) - (s[2].x - px) * (s[1].y - py)) / area;
+      float w1 = ((s[2].x - px) * (s[0].y - py) - (s[0].x - px) * (s[2].y - py)) / area;
+      float w2 = 1.0f - w0 - w1;
+      if (w0 < 0 || w1 < 0 || w2 < 0) continue;
+
+      Vector4 c = v[0]->c * w0 + v[1]->c * w1 + v[2]->c * w2;
+      if (tex)
+      {
+        Vector2 t = v[0]->t * w0 + v[1]->t * w1 + v[2]->t * w2;
+        int tx = std::min(std::max((int)(t.x * tex->width), 0), (int)tex->width - 1);
+        int ty = std::min(std::max((int)(t.y * tex->height), 0), (int)tex->height - 1);
+        const uint8_t *tp = &tex->pixels[((size_t)ty * tex->width + tx) * 4];
+        c.b *= tp[0] / 255.0f;
+        c.g *= tp[1] / 255.0f;
+        c.r *= tp[2] / 255.0f;
+        c.a *= tp[3] / 255.0f;
+      }
+
+      // blending (alpha or additive)
+      uint8_t *dp = &framebuffer_[((size_t)y * vp.width + x) * 4];
+      float dst_factor = blendmode_ == kBlendAdd ? 1.0f : 1.0f - c.a;
+      float rgb[3] = { c.b, c.g, c.r };
+      for (int k = 0; k < 3; ++k)
+      {
+        float d = rgb[k] * c.a * 255.0f + dp[k] * dst_factor;
+        dp[k] = (uint8_t)std::min(d, 255.0f);
+      }
+    }
+  }
+}
+
+const std::vector<uint8_t> &GraphicHeadless::GetFramebuffer() const
+{
+  return framebuffer_;
+}
+
+bool GraphicHeadless::SaveFramebuffer(const std::string &path) const
+{
+  if (framebuffer_.empty()) return false;
+  const VideoModeParams &vp = GetVideoMode();
+  FIBITMAP *bitmap = FreeImage_ConvertFromRawBits(
+    const_cast<uint8_t*>(framebuffer_.data()), vp.width, vp.height,
+    vp.width * 4, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK,
+    TRUE);
+  if (!bitmap) return false;
+  bool r = FreeImage_Save(FIF_PNG, bitmap, path.c_str()) != 0;
+  FreeImage_Unload(bitmap);
+  return r;
+}
+
+unsigned GraphicHeadless::get_frame_count() const { return frame_count_; }
+
+unsigned GraphicHeadless::get_texture_upload_count() const { return texture_upload_count_; }
+
+size_t GraphicHeadless::get_texture_upload_bytes() const { return texture_upload_bytes_; }
+
+const char* GraphicHeadless::name() { return "Headless"; }
+
 #if USE_GLEW == 1
 // ------------------------------------------------------------ class GraphicGL
 
@@ -749,6 +1100,7 @@ void GraphicGL::SetBlendMode(int blend_mode)
   // optimization: only call GL function if state is different
   if (blendmode_ != blend_mode)
   {
+    OnStateChange();
     blendmode_ = blend_mode;
     glBlendFunc(GL_SRC_ALPHA, glBlendmode);
   }
@@ -761,6 +1113,7 @@ void GraphicGL::SetTexture(unsigned texunit, unsigned tex_id)
 
   // @warn  This might cause bug... remove later
   if (tex_id_ != tex_id) {
+    OnStateChange();
     tex_id_ = tex_id;
     if (tex_id) {
       //glEnable(GL_TEXTURE_2D);
@@ -817,17 +1170,13 @@ void GraphicGL::DrawQuads(const VertexInfo *vi, unsigned count)
   
   // pre-process for special blendmode
   // - See SetBlendMode() function for detail.
-  VertexInfo vi_tmp[4];
+  std::vector<VertexInfo> vi_tmp;
   if (blendmode_ == 0)
   {
-    for (unsigned i = 0; i < count; ++i)
-    {
-      vi_tmp[i].c = vi[i].c;
-      vi_tmp[i].p = vi[i].p;
-      vi_tmp[i].t = vi[i].t;
-      vi_tmp[i].c.a = 1.0f;
-    }
-    vi = vi_tmp;
+    vi_tmp.assign(vi, vi + count);
+    for (auto &v : vi_tmp)
+      v.c.a = 1.0f;
+    vi = vi_tmp.data();
   }
 
   // set model matrix
@@ -837,19 +1186,17 @@ void GraphicGL::DrawQuads(const VertexInfo *vi, unsigned count)
 
   // TODO: set texture matrix
 
+  // all quads are drawn in a single glBegin/glEnd pair.
+  count -= count % 4;
+  render_stat_.quads += count / 4;
+  render_stat_.draw_calls++;
   glBegin(GL_QUADS);
-  glTexCoord2d(vi[0].t.x, vi[0].t.y);   // TL
-  glVertex3f(vi[0].p.x, vi[0].p.y, vi[0].p.z);
-  glColor4f(vi[0].c.r, vi[0].c.g, vi[0].c.b, vi[0].c.a);
-  glTexCoord2d(vi[1].t.x, vi[1].t.y);   // TR
-  glVertex3f(vi[1].p.x, vi[1].p.y, vi[1].p.z);
-  glColor4f(vi[1].c.r, vi[1].c.g, vi[1].c.b, vi[1].c.a);
-  glTexCoord2d(vi[2].t.x, vi[2].t.y);   // BR
-  glVertex3f(vi[2].p.x, vi[2].p.y, vi[2].p.z);
-  glColor4f(vi[2].c.r, vi[2].c.g, vi[2].c.b, vi[2].c.a);
-  glTexCoord2d(vi[3].t.x, vi[3].t.y);   // BL
-  glVertex3f(vi[3].p.x, vi[3].p.y, vi[3].p.z);
-  glColor4f(vi[3].c.r, vi[3].c.g, vi[3].c.b, vi[3].c.a);
+  for (unsigned i = 0; i < count; ++i)  // TL, TR, BR, BL per quad
+  {
+    glTexCoord2d(vi[i].t.x, vi[i].t.y);
+    glVertex3f(vi[i].p.x, vi[i].p.y, vi[i].p.z);
+    glColor4f(vi[i].c.r, vi[i].c.g, vi[i].c.b, vi[i].c.a);
+  }
   glEnd();
 }
 
@@ -930,7 +1277,8 @@ const char* GraphicGL::name() { return "GLBasic"; }
 // ------------------------------------------------------------ class GraphicGL
 
 GraphicGLShader::GraphicGLShader()
-  : shader_mat_Projection_(-1), shader_mat_ModelView_(-1), vi_idx_(0)
+  : shader_mat_Projection_(-1), shader_mat_ModelView_(-1),
+    quad_index_buffer_id_(0), vi_idx_(0)
 {
   vi_ = (VertexInfo*)malloc(kVertexMaxSize * sizeof(VertexInfo));
 }
@@ -1082,6 +1430,25 @@ bool GraphicGLShader::CompileDefaultShader()
   shader_mat_Projection_ = glGetUniformLocation(quad_shader_.prog_id, "projection");
   shader_mat_ModelView_ = glGetUniformLocation(quad_shader_.prog_id, "modelview");
 
+  // Index buffer for quads (two triangles per quad).
+  // It's bound to VAO, so prepared only once.
+  std::vector<uint16_t> indices(kBatchMaxQuads * 6);
+  for (unsigned i = 0; i < kBatchMaxQuads; ++i)
+  {
+    indices[i * 6 + 0] = (uint16_t)(i * 4 + 0);
+    indices[i * 6 + 1] = (uint16_t)(i * 4 + 1);
+    indices[i * 6 + 2] = (uint16_t)(i * 4 + 2);
+    indices[i * 6 + 3] = (uint16_t)(i * 4 + 0);
+    indices[i * 6 + 4] = (uint16_t)(i * 4 + 2);
+    indices[i * 6 + 5] = (uint16_t)(i * 4 + 3);
+  }
+  glBindVertexArray(quad_shader_.VAO_id);
+  glGenBuffers(1, &quad_index_buffer_id_);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quad_index_buffer_id_);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * indices.size(),
+    indices.data(), GL_STATIC_DRAW);
+  glBindVertexArray(0);
+
   return true;
 }
 
@@ -1106,16 +1473,54 @@ void GraphicGLShader::DrawQuads(const VertexInfo *vi, unsigned count)
     vi = vi_tmp;
   }
 
-  // set model matrix
-  Matrix modelView = GetViewMatrix() * GetWorldMatrix();
-  glUniformMatrix4fv(shader_mat_ModelView_, 1, GL_FALSE, &modelView[0][0]);
-
   // TODO: set texture matrix
 
+  // quads are drawn in batch when render state changes or frame ends.
+  AddBatch(vi, count);
+}
+
+void GraphicGLShader::DrawBatch(const VertexInfo *vi, unsigned count)
+{
   glBindBuffer(GL_ARRAY_BUFFER, quad_shader_.buffer_id);
   glBufferData(GL_ARRAY_BUFFER, sizeof(VertexInfo) * count, nullptr, GL_STREAM_DRAW);
   glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(VertexInfo) * count, vi);
-  glDrawArrays(GL_QUADS, 0, count);
+  glDrawElements(GL_TRIANGLES, count / 4 * 6, GL_UNSIGNED_SHORT, 0);
+}
+
+void GraphicGLShader::EndFrame()
+{
+  FlushBatch();
+  GraphicGL::EndFrame();
+}
+
+void GraphicGLShader::SetRenderTarget(unsigned id, bool preserveTexture)
+{
+  FlushBatch();
+  GraphicGL::SetRenderTarget(id, preserveTexture);
+}
+
+void GraphicGLShader::SetTextureFiltering(unsigned texunit, unsigned do_filtering)
+{
+  FlushBatch();
+  GraphicGL::SetTextureFiltering(texunit, do_filtering);
+}
+
+void GraphicGLShader::SetZWrite(bool enable)
+{
+  FlushBatch();
+  GraphicGL::SetZWrite(enable);
+}
+
+void GraphicGLShader::ClipViewArea(const Vector4 &area)
+{
+  FlushBatch();
+  GraphicGL::ClipViewArea(area);
+}
+
+void GraphicGLShader::ResetViewArea()
+{
+  FlushBatch();
+  GraphicGL::ResetViewArea();
 }
 
 void GraphicGLShader::BeginFrame()
@@ -1141,6 +1546,10 @@ void GraphicGLShader::BeginFrame()
     (float)vp.width, (float)vp.height, vp.width / 2.0f, vp.height / 2.0f);
   glUniformMatrix4fv(shader_mat_Projection_, 1, GL_FALSE, &GetProjectionMatrix()[0][0]);
 
+  // vertices are transformed in CPU while batching. (see AddBatch())
+  Matrix identity(1.0f);
+  glUniformMatrix4fv(shader_mat_ModelView_, 1, GL_FALSE, &identity[0][0]);
+
   glViewport(0, 0, vp.width, vp.height);
   glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
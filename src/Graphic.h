@@ -3,6 +3,7 @@
 #include <glm/glm.hpp>
 #include <string>
 #include <vector>
+#include <map>
 #include "Error.h"
 #include "config.h"
 
@@ -67,6 +68,19 @@ enum BlendMode {
   kBlendEnd,
 };
 
+/* @brief Rendering statistics of a frame. */
+struct RenderStat
+{
+  /* actual draw calls sent to device */
+  unsigned draw_calls;
+
+  /* texture / blend mode changes which break batch */
+  unsigned state_changes;
+
+  /* quads requested to draw */
+  unsigned quads;
+};
+
 /**
  * @brief
  * Video mode for current graphic.
@@ -112,7 +126,7 @@ public:
 
 
   /* This simulates vsync by checking last rendering time. */
-  bool IsVsyncUpdatable() const;
+  virtual bool IsVsyncUpdatable() const;
 
 
   int width() const;
@@ -182,6 +196,10 @@ public:
   virtual void DrawQuads(const VertexInfo *vi, unsigned count);
   void DrawQuad(const VertexInfo *vi);
 
+  /* @brief draw all batched quads now.
+   * Must be called before drawing without Graphic. (e.g. direct GL call) */
+  void FlushBatch();
+
   virtual void BeginFrame();
   virtual void EndFrame();
 
@@ -193,15 +211,38 @@ public:
 
   /* status */
   float GetFPS() const;
+
+  /* @brief statistics of the last rendered frame. */
+  const RenderStat &GetRenderStat() const;
   virtual void SignalWindowClose();
   virtual bool IsWindowShouldClose() const;
   double delta() const;
 
   virtual const char* name();
 
+protected:
+  /* @brief append quads to the batch.
+   * Vertices are transformed into view space on CPU,
+   * so quads with different world matrix are drawn with single call. */
+  void AddBatch(const VertexInfo *vi, unsigned count);
+
+  /* @brief must be called before render state (texture, blend mode) changes.
+   * Batched quads are drawn with the previous state. */
+  void OnStateChange();
+
+  /* @brief draw batched quads with current render state.
+   * Vertices are already in view space. */
+  virtual void DrawBatch(const VertexInfo *vi, unsigned count);
+
+  RenderStat render_stat_;
+
 private:
   VideoModeParams video_mode_;
 
+  /* quads waiting for drawing with same render state */
+  std::vector<VertexInfo> batch_;
+  RenderStat last_render_stat_;
+
   std::vector<Matrix> mat_world_;
   std::vector<Matrix> mat_tex_;
   std::vector<Matrix> mat_proj_;
@@ -215,6 +256,95 @@ private:
 
 }
 
+namespace rhythmus
+{
+
+/**
+ * @brief
+ * Graphic engine without display device (--headless).
+ * Records draw calls, state changes and texture uploads,
+ * so rendering can be run and measured in CI environment.
+ * If capture path is given, quads are also rasterized in software
+ * and the last frame is saved as an image (for golden-image test).
+ */
+class GraphicHeadless : public Graphic
+{
+public:
+  GraphicHeadless(int frame_limit, const std::string &capture_path);
+  virtual ~GraphicHeadless();
+
+  virtual void Initialize();
+  virtual void Cleanup();
+  virtual bool TryVideoMode(VideoModeParams &p);
+  virtual bool IsVsyncUpdatable() const;
+
+  virtual unsigned CreateTexture(const uint8_t *p, unsigned width, unsigned height);
+  virtual void UpdateTexture(unsigned tex_id, const uint8_t *p,
+    unsigned xoffset, unsigned yoffset, unsigned width, unsigned height);
+  virtual void DeleteTexture(unsigned tex_id);
+  virtual void ClearAllTextures();
+  virtual unsigned GetNumTextureUnits();
+  virtual Image *CreateScreenShot();
+  virtual Image *GetTexture(unsigned tex_id);
+
+  virtual void SetBlendMode(int mode);
+  virtual void SetTexture(unsigned texunit, unsigned tex_id);
+  virtual void SetTextureMode(unsigned texunit, unsigned mode);
+  virtual void SetTextureFiltering(unsigned texunit, unsigned do_filtering);
+  virtual void SetZWrite(bool enable);
+
+  virtual void DrawQuads(const VertexInfo *vi, unsigned count);
+  virtual void BeginFrame();
+  virtual void EndFrame();
+  virtual void ClipViewArea(const Vector4 &area);
+  virtual void ResetViewArea();
+
+  /* @brief software-rendered framebuffer (BGRA, top-down).
+   * empty if rasterization is disabled. */
+  const std::vector<uint8_t> &GetFramebuffer() const;
+  bool SaveFramebuffer(const std::string &path) const;
+
+  unsigned get_frame_count() const;
+  unsigned get_texture_upload_count() const;
+  size_t get_texture_upload_bytes() const;
+
+  virtual const char* name();
+
+protected:
+  virtual void DrawBatch(const VertexInfo *vi, unsigned count);
+
+private:
+  struct Texture
+  {
+    unsigned width, height;
+    std::vector<uint8_t> pixels;  /* only kept if rasterizing */
+  };
+
+  std::map<unsigned, Texture> textures_;
+  unsigned texture_id_counter_;
+  unsigned tex_id_;
+  int blendmode_;
+
+  /* exit after this frame count (0: no limit) */
+  int frame_limit_;
+  std::string capture_path_;
+  std::vector<uint8_t> framebuffer_;
+  bool use_clip_;
+  Vector4 clip_;
+
+  /* statistics accumulated for all frames */
+  unsigned frame_count_;
+  RenderStat total_stat_;
+  unsigned texture_upload_count_;
+  size_t texture_upload_bytes_;
+  double frame_time_;
+  double last_frame_time_;
+
+  void RasterTriangle(const VertexInfo *v[3], const Vector2 s[3]);
+};
+
+}
+
 #if USE_GLEW == 1
 namespace rhythmus
 {
@@ -301,6 +431,13 @@ public:
 
   virtual void DrawQuads(const VertexInfo *vi, unsigned count);
   virtual void BeginFrame();
+  virtual void EndFrame();
+
+  virtual void SetRenderTarget(unsigned id, bool preserveTexture);
+  virtual void SetTextureFiltering(unsigned texunit, unsigned do_filtering);
+  virtual void SetZWrite(bool enable);
+  virtual void ClipViewArea(const Vector4 &area);
+  virtual void ResetViewArea();
 
   // @DEPRECIATED
   VertexInfo* get_vertex_buffer();
@@ -315,10 +452,16 @@ private:
   /* shader */
   ShaderInfo quad_shader_;
 
+  /* static index buffer for drawing quads as triangles */
+  unsigned quad_index_buffer_id_;
+
   VertexInfo *vi_;
   int vi_idx_;
 
   bool CompileDefaultShader();
+
+protected:
+  virtual void DrawBatch(const VertexInfo *vi, unsigned count);
 };
 
 }
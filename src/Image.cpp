@@ -4,8 +4,15 @@
 #include "Setting.h"
 #include "Game.h"
 #include "Util.h"
+#include "Logger.h"
 #include "common.h"
 #include <FreeImage.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <map>
 
 /* ffmpeg */
 extern "C"
@@ -44,6 +51,8 @@ public:
   bool is_eof() { return is_eof_ && is_eof_packet_; }
   bool is_image() { return is_image_; }
   double get_duration() { return duration_; }
+  double get_time() { return time_ - time_offset_; }
+  int get_frame_no() { return frame_no_; }
   AVFrame* get_frame() { return frame; }
 
   int get_error_code() const { return error_code_; }
@@ -406,6 +415,260 @@ void FFmpegContext::Rewind()
   frame_no_ = 0;
 }
 
+/* @brief Decodes movie in its own thread.
+ * Decoded frames are converted into RGBA and stored in a small ring,
+ * so main thread only picks the frame for the current time and uploads it.
+ * Decoder skips frames by itself if it's behind the playback time. */
+class MovieDecoder
+{
+public:
+  MovieDecoder();
+  ~MovieDecoder();
+
+  bool Open(const std::string& path);
+  void Close();
+
+  /* @brief request rewinding. frames in the ring are cleared. */
+  void Rewind();
+
+  /* @brief get latest frame to be shown at given time.
+   * Older frames in the ring are dropped.
+   * @return frame bitmap, or nullptr if no frame to show.
+   * @warn must call PopFrame() after using the returned frame. */
+  const uint8_t *PeekFrame(double time);
+  void PopFrame();
+
+  /* @brief is all frames decoded and shown? */
+  bool is_eof();
+  bool is_image() { return ctx_.is_image(); }
+
+  int get_width() { return ctx_.get_width(); }
+  int get_height() { return ctx_.get_height(); }
+  MovieStat get_stat();
+  const char *get_error_msg() const { return ctx_.get_error_msg(); }
+
+private:
+  static constexpr int kFrameCount = 4;
+
+  struct Frame
+  {
+    uint8_t *data;
+    double time;
+  };
+
+  FFmpegContext ctx_;
+  SwsContext *sws_ctx_;
+  Frame frames_[kFrameCount];
+
+  /* ring index; frames_[head_] is the oldest frame. */
+  int head_, count_;
+
+  /* playback time which main thread requested last */
+  std::atomic<double> clock_;
+
+  std::atomic<bool> stop_;
+  std::atomic<bool> rewind_;
+  std::atomic<bool> eof_;
+  std::mutex lock_;
+  std::condition_variable cond_;
+  std::thread thread_;
+  MovieStat stat_;
+
+  void Run();
+  bool DecodeFrame(Frame &f, double last_time, int &skipped);
+};
+
+MovieDecoder::MovieDecoder()
+  : sws_ctx_(nullptr), head_(0), count_(0), clock_(0),
+    stop_(false), rewind_(false), eof_(false)
+{
+  memset(frames_, 0, sizeof(frames_));
+  memset(&stat_, 0, sizeof(stat_));
+}
+
+MovieDecoder::~MovieDecoder()
+{
+  Close();
+}
+
+bool MovieDecoder::Open(const std::string& path)
+{
+  if (!ctx_.Open(path))
+    return false;
+  size_t size = (size_t)ctx_.get_width() * ctx_.get_height() * 4;
+  for (int i = 0; i < kFrameCount; ++i)
+    frames_[i].data = (uint8_t*)malloc(size);
+  thread_ = std::thread(&MovieDecoder::Run, this);
+  return true;
+}
+
+void MovieDecoder::Close()
+{
+  if (thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      stop_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+  }
+  if (sws_ctx_) {
+    sws_freeContext(sws_ctx_);
+    sws_ctx_ = nullptr;
+  }
+  for (int i = 0; i < kFrameCount; ++i) {
+    free(frames_[i].data);
+    frames_[i].data = nullptr;
+  }
+  ctx_.Unload();
+}
+
+void MovieDecoder::Rewind()
+{
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    rewind_ = true;
+    eof_ = false;
+    clock_ = 0;
+  }
+  cond_.notify_all();
+}
+
+const uint8_t *MovieDecoder::PeekFrame(double time)
+{
+  std::lock_guard<std::mutex> lock(lock_);
+  clock_ = time;
+  if (rewind_) return nullptr;
+
+  // drop frames which are already passed.
+  while (count_ > 1 && frames_[(head_ + 1) % kFrameCount].time <= time) {
+    head_ = (head_ + 1) % kFrameCount;
+    count_--;
+    stat_.dropped++;
+  }
+  if (count_ == 0 || frames_[head_].time > time)
+    return nullptr;
+
+  // frame is late if it's shown more than 2 frames (60fps) after its time.
+  if (time - frames_[head_].time > 33.3)
+    stat_.late++;
+  return frames_[head_].data;
+}
+
+void MovieDecoder::PopFrame()
+{
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (count_ == 0) return;
+    head_ = (head_ + 1) % kFrameCount;
+    count_--;
+    stat_.presented++;
+  }
+  cond_.notify_all();
+}
+
+MovieStat MovieDecoder::get_stat()
+{
+  std::lock_guard<std::mutex> lock(lock_);
+  return stat_;
+}
+
+bool MovieDecoder::is_eof()
+{
+  std::lock_guard<std::mutex> lock(lock_);
+  return eof_ && count_ == 0 && !rewind_;
+}
+
+void MovieDecoder::Run()
+{
+  double last_time = -1;
+  while (true) {
+    int slot;
+    {
+      std::unique_lock<std::mutex> lock(lock_);
+      cond_.wait(lock, [this] {
+        return stop_ || rewind_ || (!eof_ && count_ < kFrameCount);
+      });
+      if (stop_) break;
+      if (rewind_) {
+        ctx_.Rewind();
+        head_ = count_ = 0;
+        last_time = -1;
+        rewind_ = false;
+        continue;
+      }
+      slot = (head_ + count_) % kFrameCount;
+    }
+
+    // slot is not touched by main thread until it's counted in the ring.
+    int skipped = 0;
+    bool decoded = DecodeFrame(frames_[slot], last_time, skipped);
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      stat_.dropped += skipped;
+      if (rewind_) continue;
+      if (!decoded) {
+        eof_ = true;
+        continue;
+      }
+      last_time = frames_[slot].time;
+      count_++;
+      stat_.decoded++;
+    }
+  }
+}
+
+bool MovieDecoder::DecodeFrame(Frame &f, double last_time, int &skipped)
+{
+  // decode next frame, or skip to the playback time if decoder is behind.
+  double target_time = std::max(last_time + 0.001, (double)clock_);
+  int frame_no = ctx_.get_frame_no();
+
+  // Decode first, Read later.
+  // If both failed, video stream is completely end. exit loop.
+  int ret = 0; /* ret of decoding */
+  while (!ctx_.is_eof())
+  {
+    // DecodePacket == 0 --> EOF or decoding failure.
+    // We read next packet in this case.
+    // If successfully decode packet, exit loop.
+    if ((ret = ctx_.DecodePacket((float)target_time)) != 0)
+      break;
+
+    // ReadPacket() might fail, But we can retry.
+    // If success, retry decoding. otherwise exit loop.
+    if (ctx_.ReadPacket() == 0) break;
+  }
+  if (ret != 1)
+    return false;
+
+  // frames decoded but skipped
+  if (ctx_.get_frame_no() - frame_no > 1)
+    skipped = ctx_.get_frame_no() - frame_no - 1;
+
+  // Convert decoded frame into RGBA bitmap.
+  int width = ctx_.get_width();
+  int height = ctx_.get_height();
+  AVFrame *frame = ctx_.get_frame();
+  uint8_t *dst_data[4];
+  int dst_linesize[4];
+  av_image_fill_arrays(dst_data, dst_linesize, f.data,
+    AV_PIX_FMT_RGBA, width, height, 1);
+
+  // XXX: SWS_FAST_BILINEAR for speed, SWS_BICUBIC for general purpose.
+  // context is reused unless frame format changes.
+  sws_ctx_ = sws_getCachedContext(sws_ctx_,
+    frame->width, frame->height, (AVPixelFormat)frame->format,
+    width, height, AV_PIX_FMT_BGRA,
+    SWS_FAST_BILINEAR, 0, 0, 0);
+  sws_scale(sws_ctx_, frame->data, frame->linesize, 0, frame->height,
+    dst_data, dst_linesize);
+  // XXX: need to flip but I don't know why. should check about this problem
+
+  f.time = ctx_.get_time();
+  return true;
+}
+
 /* check whether open file as movie or image */
 bool IsMovieFile(const std::string& path)
 {
@@ -423,9 +686,10 @@ const unsigned Texture::operator*() const { return id_; }
 // -------------------------------- class Image
 
 Image::Image()
-  : bitmap_ctx_(0), data_ptr_(nullptr), width_(0), height_(0),
-    ffmpeg_ctx_(0), video_time_(.0f), loop_movie_(true),
-    is_invalid_(true)
+  : bitmap_ctx_(0), data_ptr_(nullptr), is_pooled_(false),
+    is_bottom_up_(false), width_(0), height_(0),
+    movie_ctx_(0), video_time_(.0f), loop_movie_(true),
+    is_invalid_(true), upload_requested_(false)
 {
 }
 
@@ -439,23 +703,140 @@ std::string Image::get_path() const
   return path_;
 }
 
+/* @brief Pool of bitmap buffers used for staging texture upload.
+ * Bitmap is decoded directly into the buffer, and the buffer is returned
+ * to the pool after uploading, so it can be reused by the next image. */
+class ImageBufferPool
+{
+public:
+  uint8_t *Acquire(size_t size)
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto ii = free_.lower_bound(size);
+    uint8_t *p;
+    if (ii != free_.end()) {
+      p = ii->second;
+      size = ii->first;
+      free_bytes_ -= size;
+      free_.erase(ii);
+      stat_.staging_reused++;
+    }
+    else {
+      p = (uint8_t*)malloc(size);
+      R_ASSERT(p);
+    }
+    used_[p] = size;
+    stat_.staging_bytes += size;
+    if (stat_.staging_bytes > stat_.staging_peak_bytes)
+      stat_.staging_peak_bytes = stat_.staging_bytes;
+    return p;
+  }
+
+  void Release(uint8_t *p)
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto ii = used_.find(p);
+    R_ASSERT(ii != used_.end());
+    size_t size = ii->second;
+    used_.erase(ii);
+    stat_.staging_bytes -= size;
+    if (free_bytes_ + size > kMaxFreeBytes) {
+      free(p);
+      return;
+    }
+    free_.emplace(size, p);
+    free_bytes_ += size;
+  }
+
+  void AddDecodeStat(size_t bytes, double time)
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    stat_.decoded_count++;
+    stat_.decoded_bytes += bytes;
+    stat_.decode_time += time;
+  }
+
+  ImageDecodeStat GetStat()
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    return stat_;
+  }
+
+  ImageBufferPool() : free_bytes_(0) { memset(&stat_, 0, sizeof(stat_)); }
+
+  ~ImageBufferPool()
+  {
+    for (auto &ii : free_) free(ii.second);
+  }
+
+private:
+  /* maximum size of unused buffers kept in pool */
+  static constexpr size_t kMaxFreeBytes = 64 * 1024 * 1024;
+
+  std::multimap<size_t, uint8_t*> free_;
+  std::map<uint8_t*, size_t> used_;
+  size_t free_bytes_;
+  ImageDecodeStat stat_;
+  std::mutex lock_;
+};
+
+static ImageBufferPool gImageBufferPool;
+
+ImageDecodeStat Image::GetDecodeStat()
+{
+  return gImageBufferPool.GetStat();
+}
+
+void Image::LoadImageFromBitmap(void *fibitmap)
+{
+  FIBITMAP *bitmap = (FIBITMAP*)fibitmap;
+  if (!bitmap) return;
+
+  width_ = FreeImage_GetWidth(bitmap);
+  height_ = FreeImage_GetHeight(bitmap);
+
+  // FreeImage stores scanlines from the bottom;
+  // bitmap is uploaded as it is and flipped by texture coordinates.
+  // (see is_bottom_up())
+  is_bottom_up_ = true;
+
+  if (FreeImage_GetImageType(bitmap) == FIT_BITMAP
+      && FreeImage_GetBPP(bitmap) == 32
+      && FreeImage_GetPitch(bitmap) == width_ * 4u) {
+    // already in upload-ready form. use it without copy.
+    data_ptr_ = FreeImage_GetBits(bitmap);
+    bitmap_ctx_ = (void*)bitmap;
+  }
+  else if (FreeImage_GetImageType(bitmap) == FIT_BITMAP
+      && !(FreeImage_GetBPP(bitmap) <= 8 && FreeImage_IsTransparent(bitmap))) {
+    // convert scanlines directly into staging buffer.
+    data_ptr_ = gImageBufferPool.Acquire((size_t)width_ * height_ * 4);
+    is_pooled_ = true;
+    FreeImage_ConvertToRawBits(data_ptr_, bitmap, width_ * 4, 32,
+      FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK, FALSE);
+    FreeImage_Unload(bitmap);
+  }
+  else {
+    // XXX: palette transparency is only handled by FreeImage_ConvertTo32Bits.
+    FIBITMAP *temp = bitmap;
+    bitmap = FreeImage_ConvertTo32Bits(temp);
+    FreeImage_Unload(temp);
+    if (!bitmap) return;
+    data_ptr_ = FreeImage_GetBits(bitmap);
+    bitmap_ctx_ = (void*)bitmap;
+  }
+}
+
 void Image::LoadImageFromPath(const std::string& path)
 {
   FREE_IMAGE_FORMAT fmt = FreeImage_GetFileType(path.c_str());
   if (fmt == FREE_IMAGE_FORMAT::FIF_UNKNOWN)
     return;
 
-  FIBITMAP *bitmap, *temp;
-  temp = FreeImage_Load(fmt, path.c_str());
-  // I don't know why, but image need to be flipped
-  FreeImage_FlipVertical(temp);
-  bitmap = FreeImage_ConvertTo32Bits(temp);
-  FreeImage_Unload(temp);
-
-  width_ = FreeImage_GetWidth(bitmap);
-  height_ = FreeImage_GetHeight(bitmap);
-  data_ptr_ = FreeImage_GetBits(bitmap);
-  bitmap_ctx_ = (void*)bitmap;
+  double start_time = Timer::GetUncachedSystemTime();
+  LoadImageFromBitmap(FreeImage_Load(fmt, path.c_str()));
+  gImageBufferPool.AddDecodeStat((size_t)width_ * height_ * 4,
+    (Timer::GetUncachedSystemTime() - start_time) * 1000);
   path_ = path;
 }
 
@@ -470,17 +851,10 @@ bool Image::LoadImageFromMemory(const char* p, size_t len)
     return false;
   }
 
-  FIBITMAP *bitmap, *temp;
-  temp = FreeImage_LoadFromMemory(fmt, memstream);
-  // I don't know why, but image need to be flipped
-  FreeImage_FlipVertical(temp);
-  bitmap = FreeImage_ConvertTo32Bits(temp);
-  FreeImage_Unload(temp);
-
-  width_ = FreeImage_GetWidth(bitmap);
-  height_ = FreeImage_GetHeight(bitmap);
-  data_ptr_ = FreeImage_GetBits(bitmap);
-  bitmap_ctx_ = (void*)bitmap;
+  double start_time = Timer::GetUncachedSystemTime();
+  LoadImageFromBitmap(FreeImage_LoadFromMemory(fmt, memstream));
+  gImageBufferPool.AddDecodeStat((size_t)width_ * height_ * 4,
+    (Timer::GetUncachedSystemTime() - start_time) * 1000);
   path_ = "(memory)";
 
   FreeImage_CloseMemory(memstream);
@@ -489,32 +863,27 @@ bool Image::LoadImageFromMemory(const char* p, size_t len)
 
 void Image::LoadMovieFromPath(const std::string& path)
 {
-  if (ffmpeg_ctx_)
-  {
-    FFmpegContext *f = (FFmpegContext*)ffmpeg_ctx_;
-    delete f;
-  }
+  UnloadMovie();
 
-  FFmpegContext *ffmpeg_ctx = new FFmpegContext();
-  if (!ffmpeg_ctx->Open(path))
+  MovieDecoder *movie = new MovieDecoder();
+  if (!movie->Open(path))
   {
-    error_msg_buf_ = ffmpeg_ctx->get_error_msg();
+    error_msg_buf_ = movie->get_error_msg();
     error_msg_ = error_msg_buf_.c_str();
     error_code_ = -1;
 
-    delete ffmpeg_ctx;
-    ffmpeg_ctx = 0;
+    delete movie;
     return;
   }
-  ffmpeg_ctx_ = ffmpeg_ctx;
+  movie_ctx_ = movie;
 
-  width_ = ffmpeg_ctx->get_width();
-  height_ = ffmpeg_ctx->get_height();
+  width_ = movie->get_width();
+  height_ = movie->get_height();
   path_ = path;
 
   // create empty bitmap
-  data_ptr_ = (uint8_t*)malloc(width_ * height_ * 4);
-  R_ASSERT(data_ptr_);
+  data_ptr_ = gImageBufferPool.Acquire((size_t)width_ * height_ * 4);
+  is_pooled_ = true;
   for (int i = 0; i < width_ * height_ * 4; i += 4)
   {
     // all black bitmap with no transparency (alpha 0xff)
@@ -533,6 +902,7 @@ void Image::Load(const std::string& path)
   Unload();
   error_code_ = 0;
   error_msg_ = 0;
+  is_bottom_up_ = false;
 
   if (IsMovieFile(path))
     LoadMovieFromPath(path);
@@ -545,6 +915,7 @@ void Image::Load(const char* p, size_t len, const char *ext_hint_opt)
   Unload();
   error_code_ = 0;
   error_msg_ = 0;
+  is_bottom_up_ = false;
 
   if (ext_hint_opt) {
     bool is_image = false;
@@ -590,80 +961,36 @@ void Image::Commit()
     return;
   }
 
-  /* if movie type -- won't remove bitmap (need to update continously) */
-  if (ffmpeg_ctx_ == 0) {
-    UnloadBitmap();
-  }
+  /* movie frames are uploaded from decoder, so bitmap is not necessary. */
+  UnloadBitmap();
 }
 
 void Image::Update(double delta)
 {
-  /* upload texture first. */
-  if (data_ptr_ && is_invalid_) {
-    Commit();
-    is_invalid_ = false;
-  }
+  /* texture should be uploaded first. (see ImageManager::Update()) */
+  if (is_upload_pending())
+    return;
 
   /* update movie */
-  if (ffmpeg_ctx_)
+  if (movie_ctx_)
   {
-    FFmpegContext *fctx = (FFmpegContext*)ffmpeg_ctx_;
+    MovieDecoder *movie = (MovieDecoder*)movie_ctx_;
 
     // If EOF and not image, restart (if necessary)
-    if (loop_movie_ && !fctx->is_image() && fctx->is_eof())
+    if (loop_movie_ && !movie->is_image() && movie->is_eof())
     {
-      fctx->Rewind();
+      movie->Rewind();
       video_time_ = 0;
     }
     video_time_ += delta;
 
-    // Decode first, Read later.
-    // If both failed, video stream is completely end. exit loop.
-    int ret = 0; /* ret of decoding */
-    while (!fctx->is_eof())
-    {
-      // DecodePacket == 0 --> EOF or decoding failure.
-      // We read next packet in this case.
-      // If successfully decode packet, exit loop.
-      if (ret = fctx->DecodePacket((float)video_time_))
-        break;
-
-      // ReadPacket() might fail, But we can retry.
-      // If success, retry decoding. otherwise exit loop.
-      if (fctx->ReadPacket() == 0) break;
-    }
-
-    // Convert decoded image into image (if necessary)
-    if (ret == 1)
+    // Upload frame for current time, if it's decoded.
+    // (decoding is done by decoder thread)
+    const uint8_t *frame = movie->PeekFrame(video_time_);
+    if (frame)
     {
-      AVFrame *frame = fctx->get_frame();
-      AVFrame *frame_conv = av_frame_alloc();
-      R_ASSERT(frame->pict_type != AV_PICTURE_TYPE_NONE);
-#if FFMPEG_USE_DEPRECIATED
-      avpicture_fill((AVPicture*)frame_conv, data_ptr_, AV_PIX_FMT_RGBA, width_, height_);
-#else
-      av_image_fill_arrays(frame_conv->data, frame_conv->linesize, data_ptr_,
-        AV_PIX_FMT_RGBA, width_, height_, 1);
-#endif
-
-      // convert frame to RGB24
-      // XXX: SWS_FAST_BILINEAR for speed, SWS_BICUBIC for general purpose.
-      SwsContext* mod_ctx;
-      mod_ctx = sws_getContext(
-        frame->width, frame->height, (AVPixelFormat)frame->format,
-        width_, height_, AV_PIX_FMT_BGRA,
-        SWS_FAST_BILINEAR, 0, 0, 0);
-      sws_scale(mod_ctx, frame->data, frame->linesize, 0, frame->height,
-        frame_conv->data, frame_conv->linesize);
-      sws_freeContext(mod_ctx);
-
-      // XXX: need to flip but I don't know why. should check about this problem
-
-      // Upload texture
-      GRAPHIC->UpdateTexture(*tex_, data_ptr_, 0, 0, width_, height_);
-
-      // Free mem
-      av_frame_free(&frame_conv);
+      GRAPHIC->UpdateTexture(*tex_, frame, 0, 0, width_, height_);
+      movie->PopFrame();
     }
   }
 }
@@ -684,21 +1011,28 @@ void Image::UnloadBitmap()
     data_ptr_ = 0;
   }
 
-  /* only called when data is create by ffmpeg (when not using freeimage) */
+  /* staging buffer is returned to pool for reuse. */
   if (data_ptr_)
   {
-    free(data_ptr_);
+    if (is_pooled_)
+      gImageBufferPool.Release(data_ptr_);
     data_ptr_ = 0;
   }
+  is_pooled_ = false;
 }
 
 void Image::UnloadMovie()
 {
-  if (ffmpeg_ctx_)
+  if (movie_ctx_)
   {
-    FFmpegContext *f = (FFmpegContext*)ffmpeg_ctx_;
-    delete f;
-    ffmpeg_ctx_ = 0;
+    MovieDecoder *movie = (MovieDecoder*)movie_ctx_;
+    MovieStat stat = movie->get_stat();
+    if (stat.dropped > 0 || stat.late > 0) {
+      Logger::Info("Movie %s: %u frames shown, %u dropped, %u late.",
+        path_.c_str(), stat.presented, stat.dropped, stat.late);
+    }
+    delete movie;
+    movie_ctx_ = 0;
   }
 }
 
@@ -719,8 +1053,20 @@ bool Image::is_loaded() const
 
 void Image::RestartMovie()
 {
-  if (ffmpeg_ctx_)
-    static_cast<FFmpegContext*>(ffmpeg_ctx_)->Rewind();
+  if (movie_ctx_)
+  {
+    static_cast<MovieDecoder*>(movie_ctx_)->Rewind();
+    video_time_ = 0;
+  }
+}
+
+MovieStat Image::get_movie_stat() const
+{
+  MovieStat stat;
+  if (movie_ctx_)
+    return static_cast<MovieDecoder*>(movie_ctx_)->get_stat();
+  memset(&stat, 0, sizeof(stat));
+  return stat;
 }
 
 void Image::Invalidate()
@@ -728,6 +1074,34 @@ void Image::Invalidate()
   is_invalid_ = true;
 }
 
+bool Image::is_upload_pending() const
+{
+  return data_ptr_ && is_invalid_;
+}
+
+size_t Image::get_upload_size() const
+{
+  return (size_t)width_ * height_ * 4;
+}
+
+void Image::RequestUpload()
+{
+  upload_requested_ = true;
+}
+
+bool Image::is_upload_requested() const
+{
+  return upload_requested_;
+}
+
+void Image::Upload()
+{
+  if (!is_upload_pending()) return;
+  Commit();
+  is_invalid_ = false;
+  upload_requested_ = false;
+}
+
 unsigned Image::get_texture_ID() const
 {
   return *tex_;
@@ -753,6 +1127,19 @@ const uint8_t *Image::get_ptr() const
   return data_ptr_;
 }
 
+bool Image::is_bottom_up() const
+{
+  return is_bottom_up_;
+}
+
+size_t Image::get_memory_size() const
+{
+  size_t s = 0;
+  if (data_ptr_) s += (size_t)width_ * height_ * 4;
+  if (*tex_) s += (size_t)width_ * height_ * 4;
+  return s;
+}
+
 void Image::SetLoopMovie(bool loop)
 {
   loop_movie_ = loop;
@@ -18,6 +18,39 @@ enum ImageErrorCode
 
 class MetricGroup;
 
+/* @brief Statistics of image decoding and staging buffers. */
+struct ImageDecodeStat
+{
+  unsigned decoded_count;
+  size_t decoded_bytes;
+
+  /* accumulated decoding time (ms) */
+  double decode_time;
+
+  /* staging buffers currently in use, and its peak */
+  size_t staging_bytes;
+  size_t staging_peak_bytes;
+
+  /* count of staging buffers reused from pool */
+  unsigned staging_reused;
+};
+
+/* @brief Frame statistics of movie playback. */
+struct MovieStat
+{
+  /* frames converted into bitmap by decoder */
+  unsigned decoded;
+
+  /* frames uploaded to texture */
+  unsigned presented;
+
+  /* frames skipped without being shown (decoder or main thread was behind) */
+  unsigned dropped;
+
+  /* frames shown later than its time */
+  unsigned late;
+};
+
 /* @brief Contains texture id which is used for rendering. */
 class Texture
 {
@@ -54,24 +87,50 @@ public:
   uint16_t get_width() const;
   uint16_t get_height() const;
   const uint8_t *get_ptr() const;
+
+  /* @brief is bitmap (and texture) stored from bottom scanline?
+   * If so, texture coordinate should be flipped vertically. */
+  bool is_bottom_up() const;
+  virtual size_t get_memory_size() const;
   void SetLoopMovie(bool loop = true);
   void RestartMovie();
+  MovieStat get_movie_stat() const;
   void Invalidate();
+  static ImageDecodeStat GetDecodeStat();
+
+  /* @brief is bitmap ready but texture not uploaded yet? */
+  bool is_upload_pending() const;
+
+  /* @brief bitmap size to upload, in bytes. */
+  size_t get_upload_size() const;
+
+  /* @brief upload texture prior to others. (e.g. image in rendering) */
+  void RequestUpload();
+  bool is_upload_requested() const;
+
+  /* @brief upload bitmap to texture.
+   * Called by ImageManager within per-frame upload budget. */
+  void Upload();
 
 private:
   std::string path_;
 
   void* bitmap_ctx_;
   uint8_t *data_ptr_;
+
+  /* is data_ptr_ staging buffer from pool? */
+  bool is_pooled_;
+
+  bool is_bottom_up_;
   uint16_t width_, height_;
   Texture tex_;
   std::string error_msg_buf_;
 
   /*
-   * Context used for ffmpeg playing.
+   * Movie decoder, which decodes frames in its own thread.
    * Must call Update() method to update movie.
    */
-  void *ffmpeg_ctx_;
+  void *movie_ctx_;
 
   /* video target time */
   double video_time_;
@@ -82,10 +141,14 @@ private:
   /* is invalid? (should be committed?) */
   bool is_invalid_;
 
+  /* is texture upload requested in priority? */
+  bool upload_requested_;
+
   void Commit();
   void UnloadTexture();
   void UnloadBitmap();
   void UnloadMovie();
+  void LoadImageFromBitmap(void *fibitmap);
   void LoadImageFromPath(const std::string& path);
   void LoadMovieFromPath(const std::string& path);
   bool LoadImageFromMemory(const char* p, size_t len);
@@ -7,48 +7,49 @@ namespace rhythmus
 
 KeyPool::KeyPool()
 {
-  *GetInt("true") = 1;
-  *GetInt("false") = 0;
+  GetInt("true").set(1);
+  GetInt("false").set(0);
 }
 
 
 KeyData<int> KeyPool::GetInt(const std::string &name)
 {
   R_ASSERT(intpool_.size() < 100000);
-  auto ii = intpool_.find(name);
-  if (ii == intpool_.end())
-  {
-    intpool_[name] = 0;
-    ii = intpool_.find(name);
-  }
-  return KeyData<int>(&ii->first, &ii->second);
+  size_t id = intpool_.Register(name);
+  return KeyData<int>(intpool_.name(id), intpool_.get(id), id, &intpool_);
 }
 
 KeyData<float> KeyPool::GetFloat(const std::string &name)
 {
   R_ASSERT(floatpool_.size() < 100000);
-  auto ii = floatpool_.find(name);
-  if (ii == floatpool_.end())
-  {
-    floatpool_[name] = 0;
-    ii = floatpool_.find(name);
-  }
-  return KeyData<float>(&ii->first, &ii->second);
+  size_t id = floatpool_.Register(name);
+  return KeyData<float>(floatpool_.name(id), floatpool_.get(id), id, &floatpool_);
 }
 
 KeyData<std::string> KeyPool::GetString(const std::string &name)
 {
   R_ASSERT(strpool_.size() < 100000);
-  auto ii = strpool_.find(name);
-  if (ii == strpool_.end())
-  {
-    strpool_[name] = std::string();
-    ii = strpool_.find(name);
-  }
-  return KeyData<std::string>(&ii->first, &ii->second);
+  size_t id = strpool_.Register(name);
+  return KeyData<std::string>(strpool_.name(id), strpool_.get(id), id, &strpool_);
+}
+
+bool KeyPool::IsIntChanged(size_t id) const { return intpool_.is_dirty(id); }
+bool KeyPool::IsFloatChanged(size_t id) const { return floatpool_.is_dirty(id); }
+bool KeyPool::IsStringChanged(size_t id) const { return strpool_.is_dirty(id); }
+
+void KeyPool::SetString(size_t id, const std::string &v)
+{
+  KeyData<std::string>(nullptr, strpool_.get(id), id, &strpool_).set(v);
+}
+
+void KeyPool::Update()
+{
+  intpool_.UpdateDirty();
+  floatpool_.UpdateDirty();
+  strpool_.UpdateDirty();
 }
 
 KeyPool _KEYPOOL;
 KeyPool *KEYPOOL = &_KEYPOOL;
 
-}
\ No newline at end of file
+}
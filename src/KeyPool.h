@@ -1,29 +1,134 @@
 #pragma once
 
-#include <map>
 #include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
 #include <stddef.h>
+#include <stdint.h>
 
 namespace rhythmus
 {
 
+template <typename T>
+class KeyArena;
+
 template <typename T>
 class KeyData
 {
 public:
-  KeyData() : name_(nullptr), v_(nullptr) {}
-  KeyData(const std::string *name, T* v) : name_(name), v_(v) {}
+  KeyData() : name_(nullptr), v_(nullptr), id_(0), arena_(nullptr) {}
+  KeyData(const std::string *name, T* v, size_t id, KeyArena<T> *arena)
+    : name_(name), v_(v), id_(id), arena_(arena) {}
   const T& get() const { return *v_; }
-  T& get() { return *v_; }
-  void set(const T& v) { *v_ = v; }
+  /* @brief set value. marked as changed if value is different. */
+  void set(const T& v);
   const std::string &name() { return *name_; }
-  T& operator*() { return *v_; }
+  size_t id() const { return id_; }
   const T& operator*() const { return *v_; }
 private:
   const std::string *name_;
   T *v_;
+  size_t id_;
+  KeyArena<T> *arena_;
+};
+
+/**
+ * @brief
+ * Flat storage of KeyPool values, addressed by id given at registration.
+ * Values are allocated in fixed-size blocks, so pointer to value
+ * is never invalidated by registering new key.
+ * KeyData::set() flags changed slot, and flags are published
+ * once per frame (UpdateDirty) to be checked by is_dirty().
+ * Keys may be registered from any thread (e.g. scene loading task);
+ * blocks never move, so access by id needs no lock.
+ */
+template <typename T>
+class KeyArena
+{
+public:
+  KeyArena() : size_(0) {}
+
+  size_t Register(const std::string &name)
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto ii = index_.find(name);
+    if (ii != index_.end())
+      return ii->second;
+
+    size_t id = size_;
+    if (id % kBlockSize == 0)
+      blocks_[id / kBlockSize].reset(new Block());
+    names_.push_back(name);
+    index_[name] = id;
+    size_ = id + 1;
+    return id;
+  }
+
+  T *get(size_t id) { return &blocks_[id / kBlockSize]->values[id % kBlockSize]; }
+  const std::string *name(size_t id)
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    return &names_[id];
+  }
+  size_t size() const { return size_; }
+
+  void MarkDirty(size_t id)
+  {
+    Block &b = *blocks_[id / kBlockSize];
+    b.changed[(id % kBlockSize) / 64].fetch_or(1ull << (id % 64));
+  }
+
+  void UpdateDirty()
+  {
+    const size_t count = (size_ + kBlockSize - 1) / kBlockSize;
+    for (size_t i = 0; i < count; ++i)
+    {
+      Block &b = *blocks_[i];
+      for (size_t j = 0; j < kBlockSize / 64; ++j)
+        b.dirty[j] = b.changed[j].exchange(0);
+    }
+  }
+
+  bool is_dirty(size_t id) const
+  {
+    const Block &b = *blocks_[id / kBlockSize];
+    return (b.dirty[(id % kBlockSize) / 64] >> (id % 64)) & 1;
+  }
+
+private:
+  static constexpr size_t kBlockSize = 1024;
+  static constexpr size_t kMaxSize = 131072;
+  struct Block
+  {
+    T values[kBlockSize];
+    // flags set after last UpdateDirty(), and flags of last frame.
+    std::atomic<uint64_t> changed[kBlockSize / 64];
+    uint64_t dirty[kBlockSize / 64];
+    Block() : values()
+    {
+      for (size_t i = 0; i < kBlockSize / 64; ++i)
+        changed[i] = dirty[i] = 0;
+    }
+  };
+  std::unique_ptr<Block> blocks_[kMaxSize / kBlockSize];
+  std::atomic<size_t> size_;
+  std::mutex lock_;
+  std::deque<std::string> names_;
+  std::unordered_map<std::string, size_t> index_;
 };
 
+template <typename T>
+void KeyData<T>::set(const T& v)
+{
+  if (*v_ == v) return;
+  *v_ = v;
+  arena_->MarkDirty(id_);
+}
+
 /**
  * @brief
  * Fast and convinent key-value pool
@@ -37,13 +142,24 @@ public:
   KeyData<float> GetFloat(const std::string &name);
   KeyData<std::string> GetString(const std::string &name);
 
+  /* @brief Is value changed in this frame? (use KeyData::id()) */
+  bool IsIntChanged(size_t id) const;
+  bool IsFloatChanged(size_t id) const;
+  bool IsStringChanged(size_t id) const;
+
+  /* @brief Set string value by id (for objects holding key id only) */
+  void SetString(size_t id, const std::string &v);
+
+  /* @brief Update changed flags. Called once per frame. */
+  void Update();
+
 private:
-  std::map<std::string, int> intpool_;
-  std::map<std::string, std::string> strpool_;
-  std::map<std::string, float> floatpool_;
+  KeyArena<int> intpool_;
+  KeyArena<std::string> strpool_;
+  KeyArena<float> floatpool_;
 };
 
 // Initialized when program starts, so safe to use.
 extern KeyPool *KEYPOOL;
 
-}
\ No newline at end of file
+}
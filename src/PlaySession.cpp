@@ -3,10 +3,21 @@
 #include "Player.h"
 #include "Event.h"
 #include <algorithm>
+#include <cmath>
 
 namespace rhythmus
 {
 
+int GetJudgeFromDelta(double delta)
+{
+  delta = std::abs(delta);
+  if (delta <= kJudgeWindowPG) return JudgeTypes::kJudgePG;
+  else if (delta <= kJudgeWindowGR) return JudgeTypes::kJudgeGR;
+  else if (delta <= kJudgeWindowGD) return JudgeTypes::kJudgeGD;
+  else if (delta <= kJudgeWindowBD) return JudgeTypes::kJudgeBD;
+  return JudgeTypes::kJudgeNone;
+}
+
 // --------------------------------- PlayRecord
 
 double PlayRecord::rate() const
@@ -19,13 +30,89 @@ int PlayRecord::exscore() const
   return pg * 2 + gr * 1;
 }
 
+// ---------------------------------- NoteTrack
+
+NoteTrack::NoteTrack() : index(0), judge_index(0) {}
+
+size_t NoteTrack::size() const { return time.size(); }
+bool NoteTrack::is_finished() const { return time.size() <= index; }
+
+void NoteTrack::AddNote(rparser::NoteElement *ne, double t)
+{
+  note.push_back(ne);
+  time.push_back(t);
+  judgetime.push_back(0);
+  status.push_back(NoteStatus::kNoteStatusNone);
+  judge.push_back(JudgeTypes::kJudgeNone);
+}
+
+void NoteTrack::SetJudge(size_t i, int j, double t)
+{
+  status[i] = NoteStatus::kNoteStatusJudged;
+  judge[i] = (uint8_t)j;
+  judgetime[i] = t;
+}
+
+size_t NoteTrack::FindJudgeNote(double t, double window) const
+{
+  // notes before judge_index are all judged, so search from it.
+  size_t i = std::lower_bound(time.begin() + judge_index, time.end(),
+                              t - window) - time.begin();
+  size_t found = time.size();
+  double found_delta = window;
+
+  for (; i < time.size() && time[i] <= t + window; ++i)
+  {
+    if (status[i] == NoteStatus::kNoteStatusJudged)
+      continue;
+    double delta = std::abs(time[i] - t);
+    if (found == time.size() || delta < found_delta)
+    {
+      found = i;
+      found_delta = delta;
+    }
+    else if (time[i] > t) break; /* getting farther */
+  }
+  return found;
+}
+
+size_t NoteTrack::PassJudgeline(double t)
+{
+  while (index < time.size() && time[index] < t)
+  {
+    size_t i = index++;
+    if (status[i] != NoteStatus::kNoteStatusNone)
+      continue; /* already judged by something - like touch event */
+    status[i] = NoteStatus::kNoteStatusJudgelinePassed;
+    return i;
+  }
+  return time.size();
+}
+
+size_t NoteTrack::PassJudgeWindow(double t, double window)
+{
+  while (judge_index < index)
+  {
+    size_t i = judge_index;
+    if (status[i] != NoteStatus::kNoteStatusJudged)
+    {
+      if (time[i] + window >= t) break;
+      judge_index++;
+      return i;
+    }
+    judge_index++;
+  }
+  return time.size();
+}
+
 // -------------------------- class PlaySession
 
 PlaySession::PlaySession(unsigned session, Player *player, rparser::Chart &c)
   : player_(player), timing_seg_data_(nullptr), metadata_(nullptr),
     session_(session), songtime_(0), measure_(0), beat_(0), track_count_(0),
     is_alive_(0), health_(0.), combo_(0), running_combo_(0), passed_note_(0),
-    last_judge_type_(JudgeTypes::kJudgeNone), is_autoplay_(true), is_play_bgm_(true)
+    note_deltatime_(kJudgeWindowBD), last_judge_type_(JudgeTypes::kJudgeNone),
+    is_autoplay_(true), is_play_bgm_(true)
 {
   if (player)
     LoadFromPlayer(*player);
@@ -54,27 +141,23 @@ void PlaySession::LoadFromChart(rparser::Chart &c)
   timing_seg_data_ = &c.GetTimingSegmentData();
   metadata_ = &c.GetMetaData();
 
+  /* playrecord is stored by chart hash */
+  playrecord_.id = c.GetHash();
+  playrecord_.chartname = c.GetFilename();
+
   /* load general note data.
    * TODO: change longnote data form in rparser */
   {
     auto &nd = c.GetNoteData();
     track_count_ = nd.get_track_count();
+    playrecord_.total_note = 0;
     size_t i = 0;
     for (; i < track_count_; ++i)
     {
-      Note n;
+      auto &track = track_[i];
       for (auto &ne : nd.get_track(i))
-      {
-        n.note = &ne;
-        n.time = ne.time();
-        n.measure = ne.measure();
-        n.channel = ne.get_value_u();
-        n.status = NoteStatus::kNoteStatusNone;
-        n.judge = JudgeTypes::kJudgeNone;
-        n.judgetime = 0;
-        track_[i].notes.push_back(n);
-      }
-      track_[i].index = 0;
+        track.AddNote(&ne, ne.time());
+      playrecord_.total_note += (int)track.size();
     }
   }
 
@@ -96,6 +179,7 @@ void PlaySession::LoadFromChart(rparser::Chart &c)
     }
     std::sort(bgm_track_.v.begin(), bgm_track_.v.end(),
       [](BgmNote &a, BgmNote &b) { return a.time < b.time; });
+    bgm_track_.i = 0;
   }
 
   /* load bga data
@@ -124,6 +208,7 @@ void PlaySession::LoadFromChart(rparser::Chart &c)
     }
     std::sort(bga_track_.v.begin(), bga_track_.v.end(),
       [](BgaNote &a, BgaNote &b) { return a.time < b.time; });
+    bga_track_.i = 0;
   }
 
   /* TODO: load mine / invisible notes. */
@@ -211,7 +296,7 @@ bool PlaySession::is_finished() const
   if (!is_alive()) return true;
   for (size_t i = 0; i < kMaxLaneCount; ++i)
   {
-    if (track_[i].notes.size() > track_[i].index)
+    if (!track_[i].is_finished())
       return false;
   }
   return true;
@@ -224,6 +309,10 @@ void PlaySession::ProcessInputEvent(const InputEvent& e)
   if (is_autoplay_ || !player_)
     return;
 
+  // TODO: trigger for OnNoteUp
+  if (e.type() != InputEvents::kOnKeyDown)
+    return;
+
   // get track from keycode setting
   int track_no = player_->GetTrackFromKeycode(e.KeyCode());
 
@@ -233,16 +322,19 @@ void PlaySession::ProcessInputEvent(const InputEvent& e)
   // sound first before judgement
   SongPlayer::getInstance().PlaySound(track_no, session_);
 
-  // check if note is in range of judgement. if so, trigger event.
-  // TODO: trigger for OnNoteUp
-  if (!track_[track_no].is_finished())
+  // judge nearest note in range of judgement. if exists, trigger event.
+  auto &track = track_[track_no];
+  double time =
+    (e.time() - Timer::SystemTimer().GetTime()) * 1000 + songtime_;
+  size_t idx = track.FindJudgeNote(time, note_deltatime_);
+  if (idx < track.size())
   {
-    auto &obj = *track_[track_no].current_note();
-    double delta =
-      (e.time() - Timer::SystemTimer().GetTime()) * 1000 + songtime_;
-    obj.judgetime = delta;
-    OnNoteDown(obj);
+    int judge = GetJudgeFromDelta(time - track.time[idx]);
+    JudgeNote(track_no, idx, judge, time);
+    OnNoteDown(track_no, idx);
   }
+
+  InputEventManager::RecordLatency(e);
 }
 
 void PlaySession::Update(float delta)
@@ -256,28 +348,22 @@ void PlaySession::Update(float delta)
 
   // 1. update index of track and send event
   //    for time-passing note
+  //    each note is visited once by each index.
   for (size_t i = 0; i < track_count_ /* XXX: get & set lane count? */; ++i)
   {
-    while (!track_[i].is_finished())
+    auto &track = track_[i];
+    const size_t size = track.size();
+    size_t idx;
+    while ((idx = track.PassJudgeline(songtime_)) < size)
     {
-      auto &n = *track_[i].current_note();
-      if (n.status == NoteStatus::kNoteStatusNone && n.time < songtime_)
-      {
-        OnNoteAutoplay(n);
-        n.status = NoteStatus::kNoteStatusJudgelinePassed;
-      }
-      else if (n.status == NoteStatus::kNoteStatusJudgelinePassed && n.time + note_deltatime_ < songtime_)
-      {
-        OnNotePassed(n);
-        n.judge = JudgeTypes::kJudgeMiss;
-        n.status = NoteStatus::kNoteStatusJudged;
-        track_[i].index++;
-      }
-      else /* note is already judged by something - like touch event */
-      {
-        track_[i].index++;
-      }
-      if (n.status != NoteStatus::kNoteStatusJudged) break;
+      if (is_autoplay_)
+        JudgeNote(i, idx, JudgeTypes::kJudgePG, track.time[idx]);
+      OnNoteAutoplay(i, idx);
+    }
+    while ((idx = track.PassJudgeWindow(songtime_, note_deltatime_)) < size)
+    {
+      JudgeNote(i, idx, JudgeTypes::kJudgeMiss, songtime_);
+      OnNotePassed(i, idx);
     }
   }
 
@@ -291,12 +377,14 @@ void PlaySession::Update(float delta)
     auto &n = bga_track_.v[bga_track_.i];
     if (n.time > songtime_) break;
     SongPlayer::getInstance().SetImage(n.channel, session_, n.layer);
+    bga_track_.i++;
   }
   while (bgm_track_.i < bgm_track_.v.size())
   {
     auto &n = bgm_track_.v[bgm_track_.i];
     if (n.time > songtime_) break;
     SongPlayer::getInstance().PlaySound(n.channel, session_);
+    bgm_track_.i++;
   }
 
   // 4. trigger OnNoteDrag event
@@ -316,8 +404,29 @@ PlayRecord &PlaySession::GetPlayRecord()
   return playrecord_;
 }
 
-bool PlaySession::Track::is_finished() const { return notes.size() <= index; }
-Note* PlaySession::Track::current_note() { return &notes[index]; }
+void PlaySession::JudgeNote(size_t track, size_t index, int judge, double judgetime)
+{
+  track_[track].SetJudge(index, judge, judgetime);
+
+  switch (judge)
+  {
+  case JudgeTypes::kJudgePG: playrecord_.pg++; break;
+  case JudgeTypes::kJudgeGR: playrecord_.gr++; break;
+  case JudgeTypes::kJudgeGD: playrecord_.gd++; break;
+  case JudgeTypes::kJudgeBD: playrecord_.bd++; break;
+  case JudgeTypes::kJudgePR: playrecord_.pr++; break;
+  case JudgeTypes::kJudgeMiss: playrecord_.miss++; break;
+  }
+
+  if (judge >= JudgeTypes::kJudgeGD)
+    combo_++;
+  else
+    combo_ = 0;
+  running_combo_ = combo_;
+  playrecord_.maxcombo = std::max(playrecord_.maxcombo, combo_);
+  passed_note_++;
+  last_judge_type_ = judge;
+}
 
 void PlaySession::OnSongStart()
 {
@@ -340,24 +449,24 @@ void PlaySession::OnCourseEnd()
 {
 }
 
-void PlaySession::OnNoteAutoplay(Note &n)
+void PlaySession::OnNoteAutoplay(size_t track, size_t index)
 {
 }
 
 /* missing note goes here. */
-void PlaySession::OnNotePassed(Note &n)
+void PlaySession::OnNotePassed(size_t track, size_t index)
 {
 }
 
-void PlaySession::OnNoteDown(Note &n)
+void PlaySession::OnNoteDown(size_t track, size_t index)
 {
 }
 
-void PlaySession::OnNoteUp(Note &n)
+void PlaySession::OnNoteUp(size_t track, size_t index)
 {
 }
 
-void PlaySession::OnNoteDrag(Note &n)
+void PlaySession::OnNoteDrag(size_t track, size_t index)
 {
 }
 
@@ -68,31 +68,63 @@ enum NoteStatus
   kNoteStatusJudged
 };
 
+/* judge timing window (ms) */
+constexpr double kJudgeWindowPG = 20.0;
+constexpr double kJudgeWindowGR = 60.0;
+constexpr double kJudgeWindowGD = 150.0;
+constexpr double kJudgeWindowBD = 220.0;
+
+/* @brief judgement (JudgeTypes) of a press by time delta (ms) from note. */
+int GetJudgeFromDelta(double delta);
+
 /**
- * @brief Note data
+ * @brief Notes of a lane for judgement.
+ * Note attributes are stored in separated arrays (sorted by time),
+ * so scanning time/status of notes won't touch other attributes.
+ * Other attributes (measure, channel) are read from original note object,
+ * which may be null for synthetic notes (e.g. benchmark replay).
  */
-struct Note
+struct NoteTrack
 {
   /* pointer to original note objects */
-  rparser::NoteElement *note;
+  std::vector<rparser::NoteElement*> note;
 
   /* event time */
-  double time;
+  std::vector<double> time;
 
-  /* measure position */
-  double measure;
+  /* judgement delta time for a note event */
+  std::vector<double> judgetime;
 
-  /* channel */
-  unsigned channel;
+  /* a status for a note (NoteStatus) */
+  std::vector<uint8_t> status;
 
-  /* a status for a note (is processed or going to be processed) */
-  int status;
+  /* judgement for a note (JudgeTypes) */
+  std::vector<uint8_t> judge;
 
-  /* judgement for a note */
-  int judge;
+  /* first note which is not passed judgeline yet */
+  size_t index;
 
-  /* judgement delta time for a note event */
-  double judgetime;
+  /* first note which is not judged yet (beginning of judge window) */
+  size_t judge_index;
+
+  NoteTrack();
+  size_t size() const;
+  bool is_finished() const;
+  void AddNote(rparser::NoteElement *ne, double time);
+  void SetJudge(size_t index, int judge, double judgetime);
+
+  /* @brief find nearest unjudged note in [t - window, t + window].
+   * returns size() if there is no such note. */
+  size_t FindJudgeNote(double t, double window) const;
+
+  /* @brief next unjudged note which passed judgeline by time t.
+   * each note is visited once. returns size() if there is no such note. */
+  size_t PassJudgeline(double t);
+
+  /* @brief next note which is not judged until its judge window is over.
+   * only notes passed judgeline can be missed.
+   * returns size() if there is no such note. */
+  size_t PassJudgeWindow(double t, double window);
 };
 
 /**
@@ -199,29 +231,29 @@ public:
    * @brief called when a note just passed a judgeline(time),
    * which might be assisted or not.
    */
-  virtual void OnNoteAutoplay(Note &n);
+  virtual void OnNoteAutoplay(size_t track, size_t index);
 
   /**
    * @brief called when a note is not tapped(missed).
    */
-  virtual void OnNotePassed(Note &n);
+  virtual void OnNotePassed(size_t track, size_t index);
 
   /**
    * @brief called when a note is pressed.
    */
-  virtual void OnNoteDown(Note &n);
+  virtual void OnNoteDown(size_t track, size_t index);
 
   /**
    * @brief called when a note is released.
    */
-  virtual void OnNoteUp(Note &n);
+  virtual void OnNoteUp(size_t track, size_t index);
 
   /**
    * @brief called when a note is dragged.
    * \warn  delta time is not updated when this method is called.
    * \info  Hell charge note also need to be processed using this method.
    */
-  virtual void OnNoteDrag(Note &n);
+  virtual void OnNoteDrag(size_t track, size_t index);
 
   /**
    * @brief called when Bga note passed.
@@ -240,13 +272,7 @@ private:
   unsigned session_;
 
   /* Track context */
-  struct Track
-  {
-    std::vector<Note> notes;
-    size_t index;
-    bool is_finished() const;
-    Note *current_note();
-  } track_[kMaxLaneCount];
+  NoteTrack track_[kMaxLaneCount];
   size_t track_count_;
 
   /* Bgm */
@@ -289,6 +315,9 @@ private:
   void LoadFromPlayer(Player &player);
   void LoadReplay(const std::string &replay_path);
   void SaveReplay(const std::string &replay_path);
+
+  /* set judgement of a note and update play status */
+  void JudgeNote(size_t track, size_t index, int judge, double judgetime);
 };
 
 /**
@@ -7,6 +7,10 @@
 #include "common.h"
 
 #include "sqlite3.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 
 namespace rhythmus
 {
@@ -14,6 +18,128 @@ namespace rhythmus
 static Player *players_[kMaxPlaySession];
 static int player_count;
 
+// ----------------------- class PlayRecordWriter
+
+/**
+ * @brief
+ * Write-behind queue of playrecord database.
+ * Records are written by a background thread with prepared statement,
+ * and records posted closely together are committed in a transaction.
+ */
+class PlayRecordWriter
+{
+public:
+  PlayRecordWriter(sqlite3 *db) : db_(db), stmt_(nullptr), is_running_(true)
+  {
+    int rc = sqlite3_prepare_v2(db_,
+      "INSERT OR REPLACE INTO record("
+      "id, name, gamemode, timestamp, seed, speed, speed_type, "
+      "clear_type, health_type, option, assist, total_note, "
+      "miss, pr, bd, gd, gr, pg, maxcombo, score, "
+      "playcount, clearcount, failcount) VALUES "
+      "(?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?);",
+      -1, &stmt_, nullptr);
+    if (rc != SQLITE_OK)
+      Logger::Error("Failed to prepare playrecord statement (%s)", sqlite3_errmsg(db_));
+    thread_ = std::thread(&PlayRecordWriter::Run, this);
+  }
+
+  /* @brief write all queued records and stop. */
+  ~PlayRecordWriter()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      is_running_ = false;
+    }
+    cond_.notify_one();
+    if (thread_.joinable())
+      thread_.join();
+    sqlite3_finalize(stmt_);
+  }
+
+  void Push(const PlayRecord &pr)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(pr);
+    cond_.notify_one();
+  }
+
+private:
+  sqlite3 *db_;
+  sqlite3_stmt *stmt_;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<PlayRecord> queue_;
+  bool is_running_;
+
+  static constexpr int kBatchDelayMs = 100;
+
+  void Run()
+  {
+    std::vector<PlayRecord> batch;
+    while (true)
+    {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this] { return !is_running_ || !queue_.empty(); });
+        if (queue_.empty())
+          break;
+        // wait shortly for records of other players / course stages
+        cond_.wait_for(lock, std::chrono::milliseconds(kBatchDelayMs),
+          [this] { return !is_running_; });
+        batch.swap(queue_);
+      }
+      Write(batch);
+      batch.clear();
+    }
+  }
+
+  void Write(const std::vector<PlayRecord> &batch)
+  {
+    char *errmsg = nullptr;
+    int rc;
+
+    if (!stmt_) return;
+    if (sqlite3_exec(db_, "BEGIN;", nullptr, nullptr, &errmsg) != SQLITE_OK)
+    {
+      Logger::Error("Error while saving playrecord (%s)", errmsg);
+      sqlite3_free(errmsg);
+      return;
+    }
+
+    for (const auto &pr : batch)
+    {
+      const int values[] = {
+        pr.gamemode, pr.timestamp, pr.seed, pr.speed, pr.speed_type,
+        pr.clear_type, pr.health_type, pr.option, pr.assist, pr.total_note,
+        pr.miss, pr.pr, pr.bd, pr.gd, pr.gr, pr.pg, pr.maxcombo, pr.score,
+        pr.playcount, pr.clearcount, pr.failcount
+      };
+      sqlite3_bind_text(stmt_, 1, pr.id.c_str(), -1, SQLITE_STATIC);
+      sqlite3_bind_text(stmt_, 2, pr.chartname.c_str(), -1, SQLITE_STATIC);
+      for (int i = 0; i < (int)(sizeof(values) / sizeof(int)); ++i)
+        sqlite3_bind_int(stmt_, i + 3, values[i]);
+      rc = sqlite3_step(stmt_);
+      sqlite3_reset(stmt_);
+      if (rc != SQLITE_DONE)
+      {
+        Logger::Error("Error while saving playrecord %s (%s)",
+          pr.id.c_str(), sqlite3_errmsg(db_));
+        sqlite3_exec(db_, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return;
+      }
+    }
+
+    if (sqlite3_exec(db_, "COMMIT;", nullptr, nullptr, &errmsg) != SQLITE_OK)
+    {
+      Logger::Error("Error while saving playrecord (%s)", errmsg);
+      sqlite3_free(errmsg);
+      sqlite3_exec(db_, "ROLLBACK;", nullptr, nullptr, nullptr);
+    }
+  }
+};
+
 
 // ------------------------------- class Player
 
@@ -76,93 +202,101 @@ void Player::Load()
 void Player::LoadPlayRecords()
 {
   std::string filepath = playrecord_name_ + ".db";
-  int rc = sqlite3_open(filepath.c_str(), &pr_db_);
+  sqlite3_stmt *stmt = nullptr;
+  char *errmsg = nullptr;
+  int rc;
+
+  playrecords_.clear();
+  playrecord_summary_.clear();
+  playrecord_index_.clear();
+
+  rc = sqlite3_open(filepath.c_str(), &pr_db_);
   if (rc) {
     Logger::Warn("Cannot save playrecord database.");
     ClosePlayRecords();
+    return;
   }
-  else
-  {
-    char *errmsg;
-
-    // create player record schema
-    rc = sqlite3_exec(pr_db_,
-      "CREATE TABLE IF NOT EXISTS record("
-      "id CHAR(128) PRIMARY KEY,"
-      "name CHAR(512) NOT NULL,"
-      "gamemode INT,"
-      "timestamp INT,"
-      "seed INT,"
-      "speed INT,"
-      "speed_type INT,"
-      "clear_type INT,"
-      "health_type INT,"
-      "option INT,"
-      "assist INT,"
-      "total_note INT,"
-      "miss INT, pr INT, bd INT, gd INT, gr INT, pg INT,"
-      "maxcombo INT, score INT,"
-      "playcount INT, clearcount INT, failcount INT"
-      ");",
-      &Player::CreateSchemaCallbackFunc, this, &errmsg);
 
-    if (rc != SQLITE_OK)
-      Logger::Error("Failed to create playrecord database (%s)", errmsg);
-
-    // load all records
-    rc = sqlite3_exec(pr_db_,
-      "SELECT id, name, gamemode, timestamp, seed, speed, speed_type, "
-      "clear_type, health_type, option, assist, total_note, "
-      "miss, pr, bd, gd, gr, pg, playcount, clearcount, failcount "
-      "from record;",
-      &Player::PRQueryCallbackFunc, this, &errmsg);
+  // create player record schema
+  rc = sqlite3_exec(pr_db_,
+    "PRAGMA journal_mode=WAL;"
+    "PRAGMA synchronous=NORMAL;"
+    "CREATE TABLE IF NOT EXISTS record("
+    "id CHAR(128) PRIMARY KEY,"
+    "name CHAR(512) NOT NULL,"
+    "gamemode INT,"
+    "timestamp INT,"
+    "seed INT,"
+    "speed INT,"
+    "speed_type INT,"
+    "clear_type INT,"
+    "health_type INT,"
+    "option INT,"
+    "assist INT,"
+    "total_note INT,"
+    "miss INT, pr INT, bd INT, gd INT, gr INT, pg INT,"
+    "maxcombo INT, score INT,"
+    "playcount INT, clearcount INT, failcount INT"
+    ");",
+    nullptr, nullptr, &errmsg);
 
-    if (rc != SQLITE_OK)
-    {
-      Logger::Error("Failed to query playrecord database, maybe corrupted? (%s)", errmsg);
-      ClosePlayRecords();
-      return;
-    }
+  if (rc != SQLITE_OK)
+  {
+    Logger::Error("Failed to create playrecord database (%s)", errmsg);
+    sqlite3_free(errmsg);
   }
-}
 
-int Player::CreateSchemaCallbackFunc(void*, int argc, char **argv, char **colnames)
-{
-  return 0;
-}
+  // load all records
+  rc = sqlite3_prepare_v2(pr_db_,
+    "SELECT id, name, gamemode, timestamp, seed, speed, speed_type, "
+    "clear_type, health_type, option, assist, total_note, "
+    "miss, pr, bd, gd, gr, pg, maxcombo, score, "
+    "playcount, clearcount, failcount "
+    "from record;", -1, &stmt, nullptr);
+  while (rc == SQLITE_OK && (rc = sqlite3_step(stmt)) == SQLITE_ROW)
+  {
+    rc = SQLITE_OK;
+    const char *id = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+    const char *name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+    PlayRecord pr;
+    pr.id = id ? id : "";
+    pr.chartname = name ? name : "";
+    pr.gamemode = sqlite3_column_int(stmt, 2);
+    pr.timestamp = sqlite3_column_int(stmt, 3);
+    pr.seed = sqlite3_column_int(stmt, 4);
+    pr.speed = sqlite3_column_int(stmt, 5);
+    pr.speed_type = sqlite3_column_int(stmt, 6);
+    pr.clear_type = sqlite3_column_int(stmt, 7);
+    pr.health_type = sqlite3_column_int(stmt, 8);
+    pr.option = sqlite3_column_int(stmt, 9);
+    pr.option_dp = 0;
+    pr.assist = sqlite3_column_int(stmt, 10);
+    pr.total_note = sqlite3_column_int(stmt, 11);
+    pr.miss = sqlite3_column_int(stmt, 12);
+    pr.pr = sqlite3_column_int(stmt, 13);
+    pr.bd = sqlite3_column_int(stmt, 14);
+    pr.gd = sqlite3_column_int(stmt, 15);
+    pr.gr = sqlite3_column_int(stmt, 16);
+    pr.pg = sqlite3_column_int(stmt, 17);
+    pr.maxcombo = sqlite3_column_int(stmt, 18);
+    pr.score = sqlite3_column_int(stmt, 19);
+    pr.playcount = sqlite3_column_int(stmt, 20);
+    pr.clearcount = sqlite3_column_int(stmt, 21);
+    pr.failcount = sqlite3_column_int(stmt, 22);
+    SetPlayRecord(pr);
+  }
+  sqlite3_finalize(stmt);
 
-int Player::PRQueryCallbackFunc(void* _self, int argc, char **argv, char **colnames)
-{
-  Player *p = static_cast<Player*>(_self);
-  PlayRecord pr;
-  for (int i = 0; i < argc; ++i)
+  if (rc != SQLITE_DONE)
   {
-    pr.id = argv[0];
-    pr.chartname = argv[1];
-    pr.gamemode = atoi(argv[2]);
-    pr.timestamp = atoi(argv[3]);
-    pr.seed = atoi(argv[4]);
-    pr.speed = atoi(argv[5]);
-    pr.speed_type = atoi(argv[6]);
-    pr.clear_type = atoi(argv[7]);
-    pr.health_type = atoi(argv[8]);
-    pr.option = atoi(argv[9]);
-    pr.assist = atoi(argv[10]);
-    pr.total_note = atoi(argv[11]);
-    pr.miss = atoi(argv[12]);
-    pr.pr = atoi(argv[13]);
-    pr.bd = atoi(argv[14]);
-    pr.gd = atoi(argv[15]);
-    pr.gr = atoi(argv[16]);
-    pr.pg = atoi(argv[17]);
-    pr.maxcombo = atoi(argv[18]);
-    pr.score = atoi(argv[19]);
-    pr.playcount = atoi(argv[20]);
-    pr.clearcount = atoi(argv[21]);
-    pr.failcount = atoi(argv[22]);
-    p->playrecords_.push_back(pr);
+    Logger::Error("Failed to query playrecord database, maybe corrupted? (%s)",
+      sqlite3_errmsg(pr_db_));
+    ClosePlayRecords();
+    return;
   }
-  return 0;
+
+  // database is only accessed by writer thread from now.
+  pr_writer_.reset(new PlayRecordWriter(pr_db_));
 }
 
 void Player::Save()
@@ -197,40 +331,35 @@ void Player::Save()
 
 void Player::UpdatePlayRecord(const PlayRecord &pr)
 {
-  if (!pr_db_)
+  if (!pr_writer_)
     return;
+  pr_writer_->Push(pr);
+}
 
-  int rc;
-  char *errmsg;
-  std::string sql;
-  sql = format_string(
-    "INSERT OR REPLACE INTO record VALUES ("
-    "'%s', '%s', %d, %d, %d, %d, %d, %d, %d, %d, "
-    "%d, %d, %d, %d, %d, %d, %d, %d, %d, %d, "
-    "%d, %d, %d"
-    ");", pr.id.c_str(), pr.chartname.c_str(), pr.gamemode, pr.timestamp, pr.seed,
-    pr.speed, pr.speed_type, pr.clear_type, pr.health_type, pr.option,
-    pr.assist, pr.total_note, pr.miss, pr.pr, pr.bd,
-    pr.gd, pr.gr, pr.pg, pr.maxcombo, pr.score,
-    pr.playcount, pr.clearcount, pr.failcount);
-
-  rc = sqlite3_exec(pr_db_, sql.c_str(),
-    &Player::PRUpdateCallbackFunc, this, &errmsg);
+void Player::SetPlayRecord(const PlayRecord &pr)
+{
+  PlayRecordSummary summary;
+  summary.clear_type = pr.clear_type;
+  summary.exscore = pr.exscore();
+  summary.rate = pr.total_note > 0 ? (float)pr.rate() : 0.0f;
 
-  if (rc != SQLITE_OK)
+  auto ii = playrecord_index_.find(pr.id);
+  if (ii != playrecord_index_.end())
   {
-    Logger::Error("Error while saving playrecord %s (%s)", pr.id.c_str(), errmsg);
+    playrecords_[ii->second] = pr;
+    playrecord_summary_[ii->second] = summary;
     return;
   }
-}
-
-int Player::PRUpdateCallbackFunc(void*, int argc, char **argv, char **colnames)
-{
-  return 0;
+  playrecord_index_[pr.id] = playrecords_.size();
+  playrecords_.push_back(pr);
+  playrecord_summary_.push_back(summary);
 }
 
 void Player::ClosePlayRecords()
 {
+  // flush records not written yet
+  pr_writer_.reset();
+
   if (!pr_db_)
     return;
 
@@ -249,13 +378,20 @@ int Player::player_type() const
   return player_type_;
 }
 
-/* XXX: unsafe if playrecords is modified */
-const PlayRecord *Player::GetPlayRecord(const std::string &chartname) const
+const PlayRecord *Player::GetPlayRecord(const std::string &chartid) const
 {
-  for (auto &r : playrecords_)
-    if (r.chartname == chartname)
-      return &r;
-  return nullptr;
+  auto ii = playrecord_index_.find(chartid);
+  if (ii == playrecord_index_.end())
+    return nullptr;
+  return &playrecords_[ii->second];
+}
+
+const PlayRecordSummary *Player::GetPlayRecordSummary(const std::string &chartid) const
+{
+  auto ii = playrecord_index_.find(chartid);
+  if (ii == playrecord_index_.end())
+    return nullptr;
+  return &playrecord_summary_[ii->second];
 }
 
 void Player::GetReplayList(const std::vector<std::string> &replay_names)
@@ -270,38 +406,74 @@ void Player::SetCurrentPlay(const PlayRecord &playrecord)
 
 void Player::InitPlayRecord(PlayRecord &pr)
 {
-  memset(&playrecord_, 0, sizeof(playrecord_));
-  playrecord_.timestamp = 0;  // TODO: get system timestamp from Util
-  playrecord_.seed = 0;   // TODO
-  playrecord_.speed = (int)(option_.speed * 100);
-  playrecord_.speed_type = option_.speed_type;
-  playrecord_.health_type = option_.health_type;
-  playrecord_.score = 0;
-  playrecord_.total_note = 0; // TODO: use song class?
-  playrecord_.option = option_.option_chart;
-  playrecord_.option_dp = option_.option_chart_dp;
-  playrecord_.assist = option_.assist;
+  pr = PlayRecord();
+  pr.timestamp = 0;  // TODO: get system timestamp from Util
+  pr.seed = 0;   // TODO
+  pr.speed = (int)(option_.speed * 100);
+  pr.speed_type = option_.speed_type;
+  pr.health_type = option_.health_type;
+  pr.score = 0;
+  pr.total_note = 0; // TODO: use song class?
+  pr.option = option_.option_chart;
+  pr.option_dp = option_.option_chart_dp;
+  pr.assist = option_.assist;
   running_combo_ = 0; /* TODO: in case of courseplay? */
 }
 
+/**
+ * @brief merge a play into the best record of the chart.
+ * judge counts (and play option) are kept from the play with best exscore,
+ * clear lamp / score / maxcombo are kept as maximum of all plays.
+ */
+static void MergePlayRecord(PlayRecord &best, const PlayRecord &pr)
+{
+  if (best.playcount == 0 || pr.exscore() > best.exscore())
+  {
+    best.seed = pr.seed;
+    best.speed = pr.speed;
+    best.speed_type = pr.speed_type;
+    best.health_type = pr.health_type;
+    best.option = pr.option;
+    best.option_dp = pr.option_dp;
+    best.assist = pr.assist;
+    best.miss = pr.miss;
+    best.pr = pr.pr;
+    best.bd = pr.bd;
+    best.gd = pr.gd;
+    best.gr = pr.gr;
+    best.pg = pr.pg;
+  }
+  best.chartname = pr.chartname;
+  best.gamemode = pr.gamemode;
+  best.timestamp = pr.timestamp;
+  best.total_note = pr.total_note;
+  best.clear_type = std::max(best.clear_type, pr.clear_type);
+  best.score = std::max(best.score, pr.score);
+  best.maxcombo = std::max(best.maxcombo, pr.maxcombo);
+  best.playcount++;
+  if (pr.clear_type > ClearTypes::kClearFailed)
+    best.clearcount++;
+  else
+    best.failcount++;
+}
+
 /* @brief store given playrecord. */
 void Player::PostPlayRecord(PlayRecord &pr)
 {
   // TODO: only store replaydata of current player.
 
 
-  if (playrecord_.chartname.empty()) return;
-  for (size_t i = 0; i < playrecords_.size(); ++i)
-  {
-    if (playrecords_[i].chartname == playrecord_.chartname)
-    {
-      playrecords_[i] = playrecord_;
-      return;
-    }
-  }
+  if (pr.id.empty()) return;
   // TODO: save replay file as data, or as hash64 in db?
-  // TODO: use SQL insert using SQLwrapper
-  playrecords_.push_back(playrecord_);
+  const PlayRecord *prev = GetPlayRecord(pr.id);
+  PlayRecord best = prev ? *prev : PlayRecord();
+  best.id = pr.id;
+  MergePlayRecord(best, pr);
+  SetPlayRecord(best);
+  UpdatePlayRecord(best);
+
+  // notify record change of the chart (e.g. song list sorted by clear lamp)
+  EVENTMAN->SendEvent(EventMessage("PlayRecordChanged", best.id));
 }
 
 /* @brief store given replay data. */
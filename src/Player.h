@@ -8,6 +8,9 @@
 #include "Image.h"
 #include <string>
 #include <list>
+#include <deque>
+#include <memory>
+#include <unordered_map>
 
 #include "rparser.h"
 
@@ -16,6 +19,8 @@ struct sqlite3;
 namespace rhythmus
 {
 
+class PlayRecordWriter;
+
 enum PlayerTypes
 {
   kPlayerNone,
@@ -26,6 +31,14 @@ enum PlayerTypes
   kPlayerNetwork,
 };
 
+/* @brief clear lamp and score of a chart, for displaying in song list. */
+struct PlayRecordSummary
+{
+  int clear_type;
+  int exscore;
+  float rate;
+};
+
 class Player
 {
 public:
@@ -36,7 +49,12 @@ public:
   void Sync();
   int player_type() const;
 
-  const PlayRecord *GetPlayRecord(const std::string &chartname) const;
+  /* @brief find playrecord by chart hash. nullptr if not played. */
+  const PlayRecord *GetPlayRecord(const std::string &chartid) const;
+
+  /* @brief find clear lamp and score by chart hash. nullptr if not played.
+   * @warn  pointer is valid until next PostPlayRecord() call. */
+  const PlayRecordSummary *GetPlayRecordSummary(const std::string &chartid) const;
   void GetReplayList(const std::vector<std::string> &replay_names);
   void SetRunningCombo(int combo);
   int GetRunningCombo() const;
@@ -48,7 +66,9 @@ public:
   /* @brief Initialize playrecord with current player option. */
   void InitPlayRecord(PlayRecord &pr);
 
-  /* @brief store given playrecord. */
+  /* @brief store given playrecord, merged into best record of the chart.
+   * clear lamp, score and maxcombo are kept as best one,
+   * and play/clear/fail count is increased. */
   void PostPlayRecord(PlayRecord &pr);
 
   /* @brief store given replay data. */
@@ -89,8 +109,11 @@ private:
   } option_;
   KeySetting keysetting_;
 
-  /* PlayRecord of this player. */
-  std::vector<PlayRecord> playrecords_;
+  /* PlayRecord of this player, indexed by chart hash.
+   * record and summary of the same index are for the same chart. */
+  std::deque<PlayRecord> playrecords_;
+  std::vector<PlayRecordSummary> playrecord_summary_;
+  std::unordered_map<std::string, size_t> playrecord_index_;
 
   /* ReplayData of this player. */
   std::vector<ReplayData> replaydata_;
@@ -98,6 +121,9 @@ private:
   /* PlayRecord DB */
   sqlite3 *pr_db_;
 
+  /* Writes PlayRecord into DB in background */
+  std::unique_ptr<PlayRecordWriter> pr_writer_;
+
   /* Accumulated PlayRecord. Updated in SavePlayRecord() method.
    * Used for courseplay recording. */
   PlayRecord playrecord_;
@@ -106,9 +132,7 @@ private:
   void LoadPlayRecords();
   void UpdatePlayRecord(const PlayRecord &pr);
   void ClosePlayRecords();
-  static int CreateSchemaCallbackFunc(void*, int argc, char **argv, char **colnames);
-  static int PRQueryCallbackFunc(void*, int argc, char **argv, char **colnames);
-  static int PRUpdateCallbackFunc(void*, int argc, char **argv, char **colnames);
+  void SetPlayRecord(const PlayRecord &pr);
 };
 
 class PlayerManager
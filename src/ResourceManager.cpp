@@ -4,23 +4,22 @@
 #include "Font.h"
 #include "Sound.h"
 #include "Timer.h"
+#include "Setting.h"
 #include "Logger.h"
 #include "Util.h"
 #include "common.h"
 #include <FreeImage.h>
+#include <algorithm>
+#include <string.h>
 
 namespace rhythmus
 {
 
-/*
- * @brief
- * Global lock for object loading from ResourceManager.
- * Must used when object is being removed to cancel loading task
- * before it started.
- */
-std::mutex gResourceLoadLock;
-
-/* @brief Loader thread. */
+/* @brief Loader thread.
+ * Objects are loaded without any global lock, so multiple loader tasks
+ * can decode resources concurrently. Only the handshake between loader
+ * and the one dropping the object is done by ResourceElement::load_state_.
+ * If the object is dropped while loading, the loader deletes it. */
 template <typename T>
 class ResourceLoaderTask : public Task
 {
@@ -52,36 +51,46 @@ public:
 
   virtual void run()
   {
-    std::lock_guard<std::mutex> resource_lock(gResourceLoadLock);
-
-    if (obj_) {
-      if (p_ != nullptr && len_ > 0)
-        obj_->Load(p_, len_,
-          filename_.empty() ? nullptr : filename_.c_str());
-      else if (filename_.empty())
-        obj_->Load(metric_);
-      else
-        obj_->Load(filename_);
-      obj_->set_parent_task(nullptr);
-      if (obj_->get_error_code() != 0) {
-        Logger::Error("Cannot read image %s: %s (%d)",
-            filename_.c_str(), obj_->get_error_msg(),
-          obj_->get_error_code());
-        obj_->clear_error();
-      }
+    // run() and abort() may both be called for a task,
+    // so whoever takes the object first handles it.
+    T *obj = obj_.exchange(nullptr);
+    if (!obj) return;
+
+    if (!obj->begin_load()) {
+      // dropped before loading started.
+      delete obj;
+      return;
+    }
+
+    if (p_ != nullptr && len_ > 0)
+      obj->Load(p_, len_,
+        filename_.empty() ? nullptr : filename_.c_str());
+    else if (filename_.empty())
+      obj->Load(metric_);
+    else
+      obj->Load(filename_);
+    if (obj->get_error_code() != 0) {
+      Logger::Error("Cannot load resource %s: %s (%d)",
+          filename_.c_str(), obj->get_error_msg(),
+        obj->get_error_code());
+      obj->clear_error();
+    }
+
+    if (!obj->end_load()) {
+      // dropped while loading.
+      delete obj;
     }
   }
 
   virtual void abort()
   {
-    std::lock_guard<std::mutex> resource_lock(gResourceLoadLock);
-    if (obj_)
-      obj_->set_parent_task(nullptr);
-    obj_ = nullptr;
+    T *obj = obj_.exchange(nullptr);
+    if (obj && !obj->abort_load())
+      delete obj;
   }
 
 private:
-  T *obj_;
+  std::atomic<T*> obj_;
   const char *p_;
   size_t len_;
   std::string filename_;
@@ -90,7 +99,8 @@ private:
 
 
 ResourceElement::ResourceElement()
-  : parent_task_(0), ref_count_(1), error_msg_(0), error_code_(0) {}
+  : ref_count_(1), is_cached_(false), cached_size_(0),
+    load_state_(kResourceIdle), error_msg_(0), error_code_(0) {}
 
 ResourceElement::~ResourceElement() {}
 
@@ -104,17 +114,58 @@ const std::string &ResourceElement::get_name() const
   return name_;
 }
 
-void ResourceElement::set_parent_task(Task *task)
+ResourceElement *ResourceElement::clone() const
 {
-  parent_task_ = task;
+  ref_count_++;
+  return const_cast<ResourceElement*>(this);
 }
 
-Task *ResourceElement::get_parent_task() { return parent_task_; }
+size_t ResourceElement::get_memory_size() const
+{
+  return 0;
+}
 
-ResourceElement *ResourceElement::clone() const
+void ResourceElement::set_load_pending()
 {
-  ref_count_++;
-  return const_cast<ResourceElement*>(this);
+  load_state_ = kResourceLoadPending;
+}
+
+bool ResourceElement::begin_load()
+{
+  int s = kResourceLoadPending;
+  return load_state_.compare_exchange_strong(s, kResourceLoading);
+}
+
+bool ResourceElement::end_load()
+{
+  int s = kResourceLoading;
+  return load_state_.compare_exchange_strong(s, kResourceIdle);
+}
+
+bool ResourceElement::abort_load()
+{
+  int s = kResourceLoadPending;
+  return load_state_.compare_exchange_strong(s, kResourceIdle);
+}
+
+bool ResourceElement::cancel_load()
+{
+  int s = load_state_.load();
+  while (s != kResourceIdle) {
+    if (load_state_.compare_exchange_weak(s, kResourceLoadCancelled))
+      return false;
+  }
+  return true;
+}
+
+bool ResourceElement::is_loading() const
+{
+  return load_state_ != kResourceIdle;
+}
+
+TaskFuture ResourceElement::get_load_future() const
+{
+  return load_future_;
 }
 
 const char *ResourceElement::get_error_msg() const
@@ -133,40 +184,106 @@ void ResourceElement::clear_error()
   error_code_ = 0;
 }
 
+ResourceContainer::ResourceContainer() : cache_size_(0), cache_budget_(0) {}
+
+ResourceContainer::~ResourceContainer()
+{
+  ClearCache();
+}
+
 void ResourceContainer::AddResource(ResourceElement *elem)
 {
   std::lock_guard<std::mutex> l(lock_);
-  elems_.push_back(elem);
+  elem->container_it_ = elems_.insert(elems_.end(), elem);
+  if (!elem->name_.empty())
+    index_.emplace(elem->name_, elem);
 }
 
 ResourceElement* ResourceContainer::SearchResource(const std::string &name)
 {
+  if (name.empty()) return nullptr;
   std::lock_guard<std::mutex> l(lock_);
-  if (!name.empty())
-  {
-    for (auto *e : elems_)
-    {
-      if (e->name_ == name)
-      {
-        e->ref_count_++;
-        return e;
-      }
-    }
+  auto ii = index_.find(name);
+  if (ii == index_.end()) return nullptr;
+  ResourceElement *e = ii->second;
+  if (e->is_cached_) {
+    // revive from cache.
+    cache_.erase(e->container_it_);
+    cache_size_ -= e->cached_size_;
+    e->is_cached_ = false;
+    e->container_it_ = elems_.insert(elems_.end(), e);
   }
-  return nullptr;
+  e->ref_count_++;
+  return e;
 }
 
 void ResourceContainer::DropResource(ResourceElement *elem)
 {
   std::lock_guard<std::mutex> l(lock_);
-  auto ii = std::find(elems_.begin(), elems_.end(), elem);
-  R_ASSERT(ii != elems_.end());
-  if (--elem->ref_count_ == 0)
-  {
-    elems_.erase(ii);
-    auto *t = elem->get_parent_task();
-    if (t) t->abort();
+  R_ASSERT(!elem->is_cached_);
+  if (--elem->ref_count_ > 0)
+    return;
+  elems_.erase(elem->container_it_);
+
+  // keep it in cache if it's reusable.
+  // (object being loaded is not cached, as its size is not determined yet)
+  if (cache_budget_ > 0 && !elem->name_.empty() && !elem->is_loading()
+      && elem->get_error_code() == 0) {
+    auto ii = index_.find(elem->name_);
+    if (ii != index_.end() && ii->second == elem) {
+      elem->cached_size_ = elem->get_memory_size();
+      elem->container_it_ = cache_.insert(cache_.end(), elem);
+      elem->is_cached_ = true;
+      cache_size_ += elem->cached_size_;
+      EvictCache();
+      return;
+    }
+  }
+
+  RemoveIndex(elem);
+  // if loader task is working with this object, it'll delete object.
+  if (elem->cancel_load())
     delete elem;
+}
+
+void ResourceContainer::SetCacheBudget(size_t bytes)
+{
+  std::lock_guard<std::mutex> l(lock_);
+  cache_budget_ = bytes;
+  EvictCache();
+}
+
+size_t ResourceContainer::GetCacheSize() const
+{
+  return cache_size_;
+}
+
+void ResourceContainer::ClearCache()
+{
+  std::lock_guard<std::mutex> l(lock_);
+  size_t budget = cache_budget_;
+  cache_budget_ = 0;
+  EvictCache();
+  cache_budget_ = budget;
+}
+
+void ResourceContainer::RemoveIndex(ResourceElement *elem)
+{
+  if (elem->name_.empty()) return;
+  auto ii = index_.find(elem->name_);
+  if (ii != index_.end() && ii->second == elem)
+    index_.erase(ii);
+}
+
+/* @warn must be called with lock. */
+void ResourceContainer::EvictCache()
+{
+  while (cache_size_ > cache_budget_ || (cache_budget_ == 0 && !cache_.empty())) {
+    ResourceElement *e = cache_.front();
+    cache_.pop_front();
+    cache_size_ -= e->cached_size_;
+    RemoveIndex(e);
+    delete e;
   }
 }
 
@@ -177,7 +294,11 @@ bool ResourceContainer::is_empty() const { return elems_.empty(); }
 
 // --------------------------------------------------------- class ImageManager
 
-ImageManager::ImageManager() {}
+ImageManager::ImageManager()
+  : upload_budget_time_(2.0), upload_budget_bytes_(8 * 1024 * 1024)
+{
+  memset(&upload_stat_, 0, sizeof(upload_stat_));
+}
 
 ImageManager::~ImageManager()
 {
@@ -211,7 +332,7 @@ Image* ImageManager::Load(const FilePath& path)
     else {
       auto* task = new ResourceLoaderTask<Image>(r);
       task->SetFilename(newpath);
-      r->set_parent_task(task);
+      r->set_load_pending();
       TASKMAN->Await(task);
     }
 #endif
@@ -239,7 +360,7 @@ Image* ImageManager::Load(const char *p, size_t len, const char *name_opt)
     }
     else {
       auto* task = new ResourceLoaderTask<Image>(r);
-      r->set_parent_task(task);
+      r->set_load_pending();
       task->SetData(p, len, name_opt);
       TASKMAN->Await(task);
     }
@@ -264,8 +385,9 @@ Image* ImageManager::LoadAsync(const FilePath& path, ITaskCallback *callback)
     auto* task = new ResourceLoaderTask<Image>(r);
     task->set_callback(callback);
     task->SetFilename(path.get());
-    r->set_parent_task(task);
-    TASKMAN->Await(task);
+    r->set_load_pending();
+    r->load_future_ = task->get_future();
+    TASKMAN->EnqueueTask(task);
   }
   else {
     // already loaded or being loaded.
@@ -291,8 +413,9 @@ Image* ImageManager::LoadAsync(const char* p, size_t len, const char* name_opt,
     auto* task = new ResourceLoaderTask<Image>(r);
     task->set_callback(callback);
     task->SetData(p, len, name_opt);
-    r->set_parent_task(task);
-    TASKMAN->Await(task);
+    r->set_load_pending();
+    r->load_future_ = task->get_future();
+    TASKMAN->EnqueueTask(task);
   }
   else {
     // already loaded or being loaded.
@@ -313,14 +436,77 @@ void ImageManager::Update(double ms)
 {
   /* update images; e.g. Refresh movie bitmap or uploading texture */
   /* WARN: must be called at main thread */
+  upload_queue_.clear();
   for (auto *e : *this) {
-    ((Image*)e)->Update(ms);
+    // bitmap is not ready while loader task is working.
+    if (e->is_loading()) continue;
+    Image *img = (Image*)e;
+    if (img->is_upload_pending())
+      upload_queue_.push_back(img);
+    else
+      img->Update(ms);
     if (e->get_error_code()) {
       Logger::Error("Image object error: %s (%d)",
         e->get_error_msg(), e->get_error_code());
       e->clear_error();
     }
   }
+
+  UploadTextures();
+}
+
+void ImageManager::UploadTextures()
+{
+  ImageUploadStat &stat = upload_stat_;
+  size_t prev_queued_count = stat.queued_count;
+  stat.queued_count = stat.queued_bytes = 0;
+  stat.uploaded_count = stat.uploaded_bytes = 0;
+  stat.upload_time = 0;
+  if (upload_queue_.empty()) return;
+
+  // requested images (e.g. currently rendered) first.
+  std::stable_partition(upload_queue_.begin(), upload_queue_.end(),
+    [](const Image *img) { return img->is_upload_requested(); });
+
+  double start_time = Timer::GetUncachedSystemTime();
+  for (auto *img : upload_queue_) {
+    size_t bytes = img->get_upload_size();
+    if (stat.uploaded_count > 0 &&
+        (stat.uploaded_bytes + bytes > upload_budget_bytes_ ||
+         stat.upload_time >= upload_budget_time_)) {
+      stat.queued_count++;
+      stat.queued_bytes += bytes;
+      continue;
+    }
+    img->Upload();
+    if (img->get_error_code()) {
+      Logger::Error("Image object error: %s (%d)",
+        img->get_error_msg(), img->get_error_code());
+      img->clear_error();
+    }
+    stat.uploaded_count++;
+    stat.uploaded_bytes += bytes;
+    stat.upload_time = (Timer::GetUncachedSystemTime() - start_time) * 1000;
+  }
+
+  stat.total_uploaded_count += stat.uploaded_count;
+  stat.total_uploaded_bytes += stat.uploaded_bytes;
+  stat.total_upload_time += stat.upload_time;
+  if (stat.queued_count > 0 && prev_queued_count == 0) {
+    Logger::Info("Texture upload deferred: %u images (%u KB) queued.",
+      (unsigned)stat.queued_count, (unsigned)(stat.queued_bytes / 1024));
+  }
+}
+
+void ImageManager::SetUploadBudget(double ms, size_t bytes)
+{
+  upload_budget_time_ = ms;
+  upload_budget_bytes_ = bytes;
+}
+
+const ImageUploadStat &ImageManager::GetUploadStat() const
+{
+  return upload_stat_;
 }
 
 
@@ -353,7 +539,8 @@ SoundData* SoundManager::Load(const FilePath& path)
     // Sound is always loaded as async.
     auto *task = new ResourceLoaderTask<SoundData>(r);
     task->SetFilename(path.get());
-    r->set_parent_task(task);
+    r->set_load_pending();
+    r->load_future_ = task->get_future();
     TASKMAN->EnqueueTask(task);
   }
   lock_.unlock();
@@ -375,7 +562,8 @@ SoundData* SoundManager::Load(const char *p, size_t len, const char *name_opt)
     // Sound is always loaded as async.
     auto* task = new ResourceLoaderTask<SoundData>(r);
     task->SetData(p, len, name_opt);
-    r->set_parent_task(task);
+    r->set_load_pending();
+    r->load_future_ = task->get_future();
     TASKMAN->EnqueueTask(task);
   }
   lock_.unlock();
@@ -397,8 +585,9 @@ SoundData* SoundManager::LoadAsync(const FilePath& path, ITaskCallback* callback
     auto* task = new ResourceLoaderTask<SoundData>(r);
     task->set_callback(callback);
     task->SetFilename(path.get());
-    r->set_parent_task(task);
-    TASKMAN->Await(task);
+    r->set_load_pending();
+    r->load_future_ = task->get_future();
+    TASKMAN->EnqueueTask(task);
   }
   else {
     // already loaded or being loaded.
@@ -424,8 +613,9 @@ SoundData* SoundManager::LoadAsync(const char* p, size_t len, const char* name_o
     auto* task = new ResourceLoaderTask<SoundData>(r);
     task->set_callback(callback);
     task->SetData(p, len, name_opt);
-    r->set_parent_task(task);
-    TASKMAN->Await(task);
+    r->set_load_pending();
+    r->load_future_ = task->get_future();
+    TASKMAN->EnqueueTask(task);
   }
   else {
     // already loaded or being loaded.
@@ -477,7 +667,7 @@ Font* FontManager::Load(const FilePath& path)
     else {
       auto* task = new ResourceLoaderTask<Font>(r);
       task->SetFilename(newpath);
-      r->set_parent_task(task);
+      r->set_load_pending();
       TASKMAN->Await(task);
     }
 #endif
@@ -507,7 +697,7 @@ Font* FontManager::Load(const char *p, size_t len, const char *name_opt)
     else {
       auto* task = new ResourceLoaderTask<Font>(r);
       task->SetData(p, len, name_opt);
-      r->set_parent_task(task);
+      r->set_load_pending();
       TASKMAN->Await(task);
     }
 #endif
@@ -539,7 +729,7 @@ Font* FontManager::Load(const MetricGroup &metrics)
     else {
       auto* task = new ResourceLoaderTask<Font>(r);
       task->SetMetric(metrics);
-      r->set_parent_task(task);
+      r->set_load_pending();
       TASKMAN->Await(task);
     }
 #endif
@@ -595,10 +785,23 @@ void ResourceManager::Initialize()
   IMAGEMAN = new ImageManager();
   SOUNDMAN = new SoundManager();
   FONTMAN = new FontManager();
+
+  // cache budget of unused resources (MB)
+  IMAGEMAN->SetCacheBudget(PrefValue<int>("imagecachesize", 256).get() * 1024 * 1024u);
+  SOUNDMAN->SetCacheBudget(PrefValue<int>("soundcachesize", 128).get() * 1024 * 1024u);
+  FONTMAN->SetCacheBudget(PrefValue<int>("fontcachesize", 32).get() * 1024 * 1024u);
 }
 
 void ResourceManager::Cleanup()
 {
+  ImageDecodeStat stat = Image::GetDecodeStat();
+  if (stat.decoded_count > 0) {
+    Logger::Info("Image decoded: %u images, %.1lf MB in %.0lf ms "
+      "(staging peak %.1lf MB, %u buffers reused).",
+      stat.decoded_count, stat.decoded_bytes / 1048576.0, stat.decode_time,
+      stat.staging_peak_bytes / 1048576.0, stat.staging_reused);
+  }
+
   delete IMAGEMAN;
   delete SOUNDMAN;
   delete FONTMAN;
@@ -616,6 +819,13 @@ void ResourceManager::Update(double ms)
   FONTMAN->Update(ms);
 }
 
+void ResourceManager::ClearCache()
+{
+  if (IMAGEMAN) IMAGEMAN->ClearCache();
+  if (SOUNDMAN) SOUNDMAN->ClearCache();
+  if (FONTMAN) FONTMAN->ClearCache();
+}
+
 
 ImageManager *IMAGEMAN = nullptr;
 SoundManager *SOUNDMAN = nullptr;
@@ -6,8 +6,10 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <list>
 #include <mutex>
+#include <atomic>
 
 namespace rhythmus
 {
@@ -18,6 +20,15 @@ class Image;
 class Font;
 class SoundData;
 
+/* @brief Async loading state of ResourceElement. */
+enum ResourceLoadState
+{
+  kResourceIdle,          /* not loading (loaded or never requested) */
+  kResourceLoadPending,   /* loader task is queued */
+  kResourceLoading,       /* loader task is running */
+  kResourceLoadCancelled, /* dropped while loading; loader task deletes it */
+};
+
 /* @brief All resource objects, which is async-loadable. */
 class ResourceElement
 {
@@ -26,10 +37,38 @@ public:
   virtual ~ResourceElement();
   void set_name(const std::string &name);
   const std::string &get_name() const;
-  void set_parent_task(Task *task);
-  Task *get_parent_task();
   ResourceElement *clone() const;
 
+  /* @brief approximated memory size of this object, in bytes.
+   * Used for cache budget of ResourceContainer. */
+  virtual size_t get_memory_size() const;
+
+  /* @brief mark as loader task is queued for this object. */
+  void set_load_pending();
+
+  /* @brief loader task is about to load this object.
+   * @return false if loading is cancelled before it started. */
+  bool begin_load();
+
+  /* @brief loader task finished loading this object.
+   * @return false if object is cancelled while loading. */
+  bool end_load();
+
+  /* @brief loader task is aborted before it started.
+   * @return false if object is already cancelled. */
+  bool abort_load();
+
+  /* @brief cancel loading of this object.
+   * @return true if object can be deleted instantly,
+   *         false if loader task takes ownership of this object. */
+  bool cancel_load();
+
+  bool is_loading() const;
+
+  /* @brief future of the loader task.
+   * invalid (always ready) if object is not loaded in async. */
+  TaskFuture get_load_future() const;
+
   const char *get_error_msg() const;
   int get_error_code() const;
   void clear_error();
@@ -40,34 +79,96 @@ public:
   friend class SoundManager;
 
 private:
-  Task *parent_task_;
   std::string name_;
-  mutable int ref_count_;
+  mutable std::atomic<int> ref_count_;
+
+  /* position in ResourceContainer list (in-use or cache list) */
+  std::list<ResourceElement*>::iterator container_it_;
+
+  /* is unused but kept in cache? */
+  bool is_cached_;
+
+  /* memory size when it is cached */
+  size_t cached_size_;
+
+  /* @brief load state (ResourceLoadState).
+   * Only this value is shared with loader task,
+   * so object loading itself runs without any lock. */
+  std::atomic<int> load_state_;
+
+  /* future of the loader task (set before the task is enqueued) */
+  TaskFuture load_future_;
 
 protected:
   const char* error_msg_;
   int error_code_;
 };
 
-/* @brief Base container for ResourceElement. */
+/* @brief Base container for ResourceElement.
+ * Resources are indexed by name. Unused resources are kept in LRU cache
+ * within memory budget, so they can be reused without reloading.
+ * @warn name is the cache key, so resource loaded from memory must be
+ *       named uniquely (e.g. full path of the file), not with filename only. */
 class ResourceContainer
 {
 public:
+  ResourceContainer();
+  virtual ~ResourceContainer();
   void AddResource(ResourceElement *elem);
   ResourceElement* SearchResource(const std::string &name);
   void DropResource(ResourceElement *elem);
 
+  /* @brief set memory budget of unused resources, in bytes.
+   * 0 means unused resources are released instantly. */
+  void SetCacheBudget(size_t bytes);
+  size_t GetCacheSize() const;
+  void ClearCache();
+
+  /* iterates resources in use (not cached ones) */
   typedef std::list<ResourceElement*>::iterator iterator;
   iterator begin();
   iterator end();
   bool is_empty() const;
   
 private:
+  /* resources in use */
   std::list<ResourceElement*> elems_;
+
+  /* unused resources; least recently used one comes first. */
+  std::list<ResourceElement*> cache_;
+
+  /* name index of resources (both in use and cached) */
+  std::unordered_map<std::string, ResourceElement*> index_;
+
+  size_t cache_size_;
+  size_t cache_budget_;
   std::mutex lock_;
+
+  void RemoveIndex(ResourceElement *elem);
+  void EvictCache();
 };
 
-/* @brief Image object manager. */
+/* @brief Texture upload statistics of ImageManager. */
+struct ImageUploadStat
+{
+  /* images / bytes waiting for upload after this frame */
+  size_t queued_count;
+  size_t queued_bytes;
+
+  /* images / bytes / time(ms) uploaded in this frame */
+  size_t uploaded_count;
+  size_t uploaded_bytes;
+  double upload_time;
+
+  /* accumulated since started */
+  size_t total_uploaded_count;
+  size_t total_uploaded_bytes;
+  double total_upload_time;
+};
+
+/* @brief Image object manager.
+ * Texture upload of decoded images is limited by per-frame budget,
+ * so many images finished decoding at once won't hitch a frame. */
 class ImageManager : public ResourceContainer
 {
 public:
@@ -80,8 +181,21 @@ public:
   Image* LoadAsync(const char* p, size_t len, const char* name_opt, ITaskCallback* callback);
   void Unload(Image *image);
   void Update(double ms);
+
+  /* @brief set texture upload budget per frame.
+   * At least one image is uploaded per frame regardless of budget. */
+  void SetUploadBudget(double ms, size_t bytes);
+  const ImageUploadStat &GetUploadStat() const;
   
 private:
+  /* images to upload in this frame (reused to avoid allocation) */
+  std::vector<Image*> upload_queue_;
+  double upload_budget_time_;
+  size_t upload_budget_bytes_;
+  ImageUploadStat upload_stat_;
+
+  void UploadTextures();
+
   std::mutex lock_;
 };
 
@@ -99,6 +213,10 @@ public:
   SoundData* LoadAsync(const char* p, size_t len, const char* name_opt, ITaskCallback* callback);
   void Unload(SoundData *sound);
 
+  using ResourceContainer::SetCacheBudget;
+  using ResourceContainer::GetCacheSize;
+  using ResourceContainer::ClearCache;
+
 private:
   std::mutex lock_;
 };
@@ -119,6 +237,10 @@ public:
   static void SetSystemFont();
   static Font* GetSystemFont();
 
+  using ResourceContainer::SetCacheBudget;
+  using ResourceContainer::GetCacheSize;
+  using ResourceContainer::ClearCache;
+
 private:
   std::mutex lock_;
 };
@@ -145,6 +267,13 @@ public:
    */
   static void Update(double ms);
 
+  /**
+   * @brief
+   * Release all cached (unused) resources.
+   * Must be called before graphic / sound device is destroyed.
+   */
+  static void ClearCache();
+
 private:
   ResourceManager() {};
 };
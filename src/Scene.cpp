@@ -126,7 +126,7 @@ Scene::Scene()
   : fade_time_(0), fade_duration_(0),
     fade_in_time_(0), fade_out_time_(0),
     is_input_available_(true), begin_input_time_(0), next_scene_time_(0),
-    do_sort_objects_(false), enable_caching_(false), scene_loading_task_(nullptr)
+    do_sort_objects_(false), enable_caching_(false)
 {
 }
 
@@ -186,12 +186,13 @@ private:
 
 void Scene::LoadScene()
 {
-  if (scene_loading_task_ || IsLoading()) {
+  if (scene_loading_.valid()) {
     Logger::Warn("Task is already in loading, or loaded.");
     return;
   }
-  scene_loading_task_ = new SceneLoadTask(this);
-  TASKMAN->EnqueueTask(scene_loading_task_);
+  Task *task = new SceneLoadTask(this);
+  scene_loading_ = task->get_future();
+  TASKMAN->EnqueueTask(task);
 }
 
 void Scene::StartScene()
@@ -239,7 +240,7 @@ void Scene::StartScene()
 
 bool Scene::IsLoading() const
 {
-  return TASKMAN->IsRunning(scene_loading_task_);
+  return scene_loading_.valid() && !scene_loading_.is_ready();
 }
 
 void Scene::RegisterPredefObject(BaseObject *obj)
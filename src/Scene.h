@@ -5,6 +5,7 @@
 #include "BaseObject.h"
 #include "ResourceManager.h"
 #include "Event.h"
+#include "TaskPool.h"
 #include <string>
 #include <vector>
 
@@ -100,8 +101,8 @@ protected:
 
   std::string prev_scene_, next_scene_;
 
-  // Task ID for checking scene loading
-  Task* scene_loading_task_;
+  // Future for checking scene loading
+  TaskFuture scene_loading_;
 private:
   // fade in/out specified time
   // fade_duration with positive: fade-in
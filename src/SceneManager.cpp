@@ -86,6 +86,9 @@ void SceneManager::Initialize()
   case GameBootMode::kBootPlay:
     SCENEMAN->ChangeScene("PlayScene");
     break;
+  case GameBootMode::kBootBenchmark:
+    /* no scene; game exits after benchmark. */
+    break;
   default:
     R_ASSERT(0);
   }
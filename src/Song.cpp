@@ -4,10 +4,32 @@
 #include "Event.h"
 #include "Logger.h"
 #include "Util.h"
+#include "Timer.h"
 #include "common.h"
 #include "rparser.h"
 
 #include <sqlite3.h>
+#include <unordered_set>
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+# include <sys/inotify.h>
+# include <poll.h>
+# include <unistd.h>
+#elif defined(_WIN32)
+# ifndef NOMINMAX
+#  define NOMINMAX
+# endif
+# include <Windows.h>
+#endif
 
 
 namespace rhythmus
@@ -15,6 +37,9 @@ namespace rhythmus
 
 using SongAuto = std::shared_ptr<rparser::Song>;
 
+/* @brief increase when table schema is changed; database is recreated. */
+constexpr int kSongDatabaseVersion = 1;
+
 struct SongInvalidateData
 {
   std::string songpath;
@@ -80,188 +105,1165 @@ int StringToSorttype(const char* s)
   return Sorttype::kNoSort;
 }
 
-// ------------------- class SongListUpdateTask
+// ------------------------- class SongScanQueue
+
+/* @brief Blocking bounded queue for scan pipeline stages. */
+template <typename T>
+class SongScanQueue
+{
+public:
+  SongScanQueue(size_t capacity) : capacity_(capacity), is_closed_(false) {}
+
+  /* @brief push item. blocks while queue is full. false if closed. */
+  bool Push(T &&v)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this] { return is_closed_ || q_.size() < capacity_; });
+    if (is_closed_) return false;
+    q_.push_back(std::move(v));
+    not_empty_.notify_one();
+    return true;
+  }
+
+  /* @brief pop item. blocks while queue is empty. false if closed. */
+  bool Pop(T &v)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return is_closed_ || !q_.empty(); });
+    if (q_.empty()) return false;
+    v = std::move(q_.front());
+    q_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  /* @brief pop item without blocking. */
+  bool TryPop(T &v)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (q_.empty()) return false;
+    v = std::move(q_.front());
+    q_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  void Close()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    is_closed_ = true;
+    q_.clear();
+    not_full_.notify_all();
+    not_empty_.notify_all();
+  }
+
+private:
+  size_t capacity_;
+  bool is_closed_;
+  std::deque<T> q_;
+  std::mutex mutex_;
+  std::condition_variable not_full_, not_empty_;
+};
+
+// ----------------------- class SongScanPipeline
+
+/* @brief song path to scan. "songpath|chartname" for a single chart. */
+struct SongScanRequest
+{
+  std::string path;
+  int64_t modified_time;
+};
+
+/* @brief parsed song metadata, not committed to songlist yet. */
+struct SongScanResult
+{
+  SongMetaData *song = nullptr;
+  std::vector<ChartMetaData*> charts;
+  size_t bytes = 0;
+};
+
+/**
+ * @brief
+ * Library scan pipeline, with stages connected by bounded queues:
+ *   feeder (enumerate requested songs)
+ *   -> parse tasks (read, parse, hash charts into metadata)
+ *   -> committer (push batch into songlist, save database incrementally)
+ * Parsing runs as kTaskBackground tasks on TASKMAN, so it shares workers
+ * with resource loading and never delays interactive tasks.
+ * Songs in parse or waiting for commit are limited (kMaxInFlight),
+ * so they never pile up whatever the size of library is.
+ */
+class SongScanPipeline
+{
+public:
+  SongScanPipeline();
+  ~SongScanPipeline();
+
+  /* @brief add songs to scan. never blocks. */
+  void Add(std::vector<SongScanRequest> &&reqs);
+
+  /* @brief read, parse, hash charts of a song into metadata. */
+  static void ParseSong(const SongScanRequest &req, SongScanResult &out,
+                        bool is_fast_scan);
+
+  friend class SongParseTask;
+
+private:
+  static constexpr size_t kCommitBatchSize = 128;
+  static constexpr size_t kSaveInterval = 1024;
+  static constexpr size_t kMaxInFlight = kCommitBatchSize * 2;
+
+  std::vector<std::thread> threads_;
+  std::atomic<bool> is_running_;
+
+  // feeder stage input (unbounded; only paths)
+  std::deque<SongScanRequest> pending_;
+  std::mutex pending_mutex_;
+  std::condition_variable pending_cond_;
+
+  // songs enqueued to parse but not popped by committer yet,
+  // and parse tasks not finished yet.
+  size_t in_flight_;
+  size_t task_count_;
+  std::condition_variable in_flight_cond_;
+
+  SongScanQueue<SongScanResult> commit_queue_;
+
+  // throughput counters of current scan
+  std::atomic<size_t> stat_songs_, stat_charts_, stat_bytes_;
+  double stat_start_time_;
+
+  void RunFeeder();
+  void RunParser(const SongScanRequest &req);
+  void RunCommitter();
+  void FinishParse(bool is_committed);
+};
+
+/* @brief parse stage of a single song, enqueued by feeder. */
+class SongParseTask : public Task
+{
+public:
+  SongParseTask(SongScanPipeline *p, SongScanRequest &&req)
+    : p_(p), req_(std::move(req)) {}
+  virtual void run() { p_->RunParser(req_); }
+  virtual void abort() { p_->FinishParse(false); }
+
+private:
+  SongScanPipeline *p_;
+  SongScanRequest req_;
+};
+
+SongScanPipeline::SongScanPipeline()
+  : is_running_(true), in_flight_(0), task_count_(0),
+    commit_queue_(kMaxInFlight),
+    stat_songs_(0), stat_charts_(0), stat_bytes_(0), stat_start_time_(0)
+{
+  threads_.emplace_back([this] { RunFeeder(); });
+  threads_.emplace_back([this] { RunCommitter(); });
+}
+
+SongScanPipeline::~SongScanPipeline()
+{
+  {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    is_running_ = false;
+    pending_.clear();
+  }
+  pending_cond_.notify_all();
+  in_flight_cond_.notify_all();
+  commit_queue_.Close();
+  for (auto &t : threads_)
+    t.join();
+
+  // parse tasks refer this pipeline, so wait for them.
+  std::unique_lock<std::mutex> lock(pending_mutex_);
+  in_flight_cond_.wait(lock, [this] { return task_count_ == 0; });
+}
+
+void SongScanPipeline::Add(std::vector<SongScanRequest> &&reqs)
+{
+  std::lock_guard<std::mutex> lock(pending_mutex_);
+  for (auto &r : reqs)
+    pending_.push_back(std::move(r));
+  pending_cond_.notify_one();
+}
+
+void SongScanPipeline::RunFeeder()
+{
+  while (is_running_)
+  {
+    SongScanRequest req;
+    {
+      std::unique_lock<std::mutex> lock(pending_mutex_);
+      pending_cond_.wait(lock, [this] { return !is_running_ || !pending_.empty(); });
+      in_flight_cond_.wait(lock, [this] { return !is_running_ || in_flight_ < kMaxInFlight; });
+      if (!is_running_) break;
+      req = std::move(pending_.front());
+      pending_.pop_front();
+      in_flight_++;
+      task_count_++;
+    }
+    TASKMAN->EnqueueTask(new SongParseTask(this, std::move(req)), kTaskBackground);
+  }
+}
+
+void SongScanPipeline::RunParser(const SongScanRequest &req)
+{
+  if (!is_running_)
+  {
+    FinishParse(false);
+    return;
+  }
+
+  static const bool is_fast_scan = PrefValue<int>("fastscan", 1).get() != 0;
+  SongScanResult result;
+  ParseSong(req, result, is_fast_scan);
+  // never blocks, as commit queue can hold all songs in flight.
+  if (!commit_queue_.Push(std::move(result)))
+  {
+    // pipeline is stopped
+    if (result.song) SONGLIST->DeleteSong(result.song);
+    for (auto *c : result.charts) SONGLIST->DeleteChart(c);
+  }
+  FinishParse(true);
+}
+
+/* @brief called when parse task is done or aborted.
+ * in-flight count of committed song is decreased by committer. */
+void SongScanPipeline::FinishParse(bool is_committed)
+{
+  {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    if (!is_committed) in_flight_--;
+    task_count_--;
+  }
+  in_flight_cond_.notify_all();
+}
+
+void SongScanPipeline::RunCommitter()
+{
+  std::vector<SongScanResult> batch;
+  size_t uncommitted = 0;
+  SongScanResult result;
+
+  while (commit_queue_.Pop(result))
+  {
+    if (stat_songs_ == 0)
+      stat_start_time_ = Timer::GetUncachedSystemTime();
+
+    // commit as many as ready at once, to reduce locking.
+    batch.push_back(std::move(result));
+    while (batch.size() < kCommitBatchSize && commit_queue_.TryPop(result))
+      batch.push_back(std::move(result));
+    {
+      std::lock_guard<std::mutex> lock(pending_mutex_);
+      in_flight_ -= batch.size();
+    }
+    in_flight_cond_.notify_all();
+
+    for (auto &r : batch) {
+      stat_songs_++;
+      stat_charts_ += r.charts.size();
+      stat_bytes_ += r.bytes;
+    }
+    uncommitted += batch.size();
+    bool is_finished = SONGLIST->CommitSongs(batch);
+    batch.clear();
+
+    // save progress into database occasionally,
+    // so scan need not to be started over if program is closed.
+    if (is_finished || uncommitted >= kSaveInterval)
+    {
+      uncommitted = 0;
+      SONGLIST->Save();
+    }
+
+    if (is_finished)
+    {
+      double elapsed = Timer::GetUncachedSystemTime() - stat_start_time_;
+      if (elapsed <= 0) elapsed = 0.001;
+      Logger::Info("Song scan finished: song %u, chart %u, %.1lf MB in %.2lf s "
+                   "(%.0lf charts/s, %.1lf MB/s)",
+        (size_t)stat_songs_, (size_t)stat_charts_, stat_bytes_ / 1048576.0, elapsed,
+        stat_charts_ / elapsed, stat_bytes_ / 1048576.0 / elapsed);
+      stat_songs_ = stat_charts_ = stat_bytes_ = 0;
+      EVENTMAN->SendEvent("SongListLoaded");
+    }
+  }
+}
+
+/* @brief chart information read by scanner, before converted to metadata. */
+struct ChartScanInfo
+{
+  std::string filename;
+  std::string hash;
+  std::string title, subtitle, artist, subartist, genre;
+  rparser::CHARTTYPE charttype = rparser::CHARTTYPE::None;
+  int keycount = 0;
+  int difficulty = 0;
+  int level = 0;
+  int notecount = 0;
+  int length_ms = 0;
+  int is_longnote = 0;
+  int bpm_max = 0;
+  int bpm_min = 0;
+};
+
+static void ReadChartScanInfo(rparser::Chart *c, ChartScanInfo &info)
+{
+  c->Update();
+  auto &meta = c->GetMetaData();
+  info.filename = c->GetFilename();
+  info.hash = c->GetHash();
+  info.title = meta.title;
+  info.subtitle = meta.subtitle;
+  info.artist = meta.artist;
+  info.subartist = meta.subartist;
+  info.genre = meta.genre;
+  info.charttype = c->GetChartType();
+  info.keycount = c->GetKeycount();
+  info.difficulty = meta.difficulty;
+  info.level = meta.level;
+  info.notecount = static_cast<int>(c->GetScoreableNoteCount());
+  info.length_ms = static_cast<int>(c->GetSongLastObjectTime() * 1000);
+  info.is_longnote = c->HasLongnote();
+  info.bpm_max = (int)c->GetTimingSegmentData().GetMaxBpm();
+  info.bpm_min = (int)c->GetTimingSegmentData().GetMinBpm();
+}
 
-class SongListUpdateTask : public Task
+static ChartMetaData *CreateChartMetaData(const ChartScanInfo &info,
+                                          SongMetaData *sdat, int64_t modified_time)
+{
+  int type, difficulty;
+  ChartMetaData *cdat = SONGLIST->NewChart();
+  cdat->songpath = sdat->path;
+  cdat->chartpath = info.filename;
+  cdat->id = info.hash;
+  // TODO: automatically extract subtitle from title
+  cdat->title = info.title;
+  cdat->subtitle = info.subtitle;
+  cdat->artist = SONGLIST->InternString(info.artist);
+  cdat->subartist = SONGLIST->InternString(info.subartist);
+  cdat->genre = SONGLIST->InternString(info.genre);
+  switch (info.charttype)
+  {
+  case rparser::CHARTTYPE::IIDXSP:
+  case rparser::CHARTTYPE::IIDXDP:
+    type = Gamemode::kGamemodeIIDX;
+    break;
+  case rparser::CHARTTYPE::Popn:
+    type = Gamemode::kGamemodePopn;
+    break;
+  default:
+    type = Gamemode::kGamemodeNone;
+  }
+  switch (info.difficulty)
+  {
+  case 2:
+    difficulty = Difficulty::kDifficultyNormal;
+    break;
+  case 3:
+    difficulty = Difficulty::kDifficultyHard;
+    break;
+  case 4:
+    difficulty = Difficulty::kDifficultyEx;
+    break;
+  case 5:
+    difficulty = Difficulty::kDifficultyInsane;
+    break;
+  case 0: /* XXX: what is the exact meaning of DIFF 0? */
+  case 1:
+  default:
+    difficulty = Difficulty::kDifficultyEasy;
+    break;
+  }
+  cdat->type = type;
+  cdat->key = info.keycount;
+  cdat->difficulty = difficulty;
+  cdat->level = info.level;
+  cdat->judgediff = info.difficulty;
+  cdat->modified_date = static_cast<int>(modified_time);
+  cdat->notecount = info.notecount;
+  cdat->length_ms = info.length_ms;
+  cdat->is_longnote = info.is_longnote;
+  cdat->is_backspin = 0; // TODO
+  cdat->bpm_max = info.bpm_max;
+  cdat->bpm_min = info.bpm_min;
+  cdat->song = sdat;
+  return cdat;
+}
+
+/**
+ * @brief
+ * Reads metadata of BMS/PMS chart in a single pass over lines,
+ * without building note/timing data of rparser.
+ * Notes and BPM changes are counted while reading channel lines,
+ * and only tempo events are kept to get length of the chart.
+ * #RANDOM is not evaluated; only "#IF 1" blocks are read.
+ */
+class BmsMetaScanner
 {
 public:
-  SongListUpdateTask(const std::string &path) :
-    fullpath_(path), is_aborted_(false)
+  BmsMetaScanner(ChartScanInfo &info) : info_(info) {}
+
+  void Scan(const char *p, size_t len, bool is_pms)
   {
-    // separate songpath and chartname, if necessary.
-    if (path.find('|') != std::string::npos)
+    const char *end = p + len;
+
+    // encoding is detected per file, as rparser does:
+    // UTF-8 if it has BOM or is valid UTF-8, otherwise Shift_JIS.
+    if (len >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0)
     {
-      Split(path, '|', filepath_, chartname_);
+      is_utf8_ = true;
+      p += 3;
     }
-    else
+    else is_utf8_ = IsValidUtf8(p, end);
+
+    while (p < end)
     {
-      filepath_ = path;
+      const char *eol = p;
+      while (eol < end && *eol != '\n' && *eol != '\r') ++eol;
+      if (eol - p > 1 && *p == '#')
+        ReadLine(p + 1, eol);
+      p = eol + 1;
     }
+    Finish(is_pms);
   }
 
-  virtual void run()
+private:
+  struct TempoEvent
   {
-    std::vector<ChartMetaData*> cdat_list;
-    ChartMetaData *cdat, *cdat_prev;
-    SongMetaData* sdat;
+    double beat;
+    double bpm;       // new bpm, or 0 if stop
+    double stop_beat; // stop length in beats
+  };
+
+  ChartScanInfo &info_;
+  double bpm_ = 130.0;
+  double bpm_min_ = 0, bpm_max_ = 0;
+  std::unordered_map<int, double> bpm_table_, stop_table_;
+  std::unordered_map<int, double> measure_len_;
+  // channel data is read after all lines, as measure length may come later
+  struct ObjectEvent { int measure; double pos; int type; int value; };
+  std::vector<ObjectEvent> tempo_objs_;
+  int last_measure_ = 0;
+  double last_pos_ = 0;
+  int lnobj_ = 0;
+  int ln_state_[2][10] = { { 0 } };
+  unsigned lane_mask_ = 0;
+  int skip_depth_ = 0, if_depth_ = 0;
+  bool is_utf8_ = false;
+
+  static int Base36(char c)
+  {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'Z') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'z') return c - 'a' + 10;
+    return 0;
+  }
+
+  static int Base36(const char *p) { return Base36(p[0]) * 36 + Base36(p[1]); }
+
+  static int Hex(const char *p)
+  {
+    auto h = [](char c) {
+      if (c >= '0' && c <= '9') return c - '0';
+      if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+      if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+      return 0;
+    };
+    return h(p[0]) * 16 + h(p[1]);
+  }
+
+  static bool IsCommand(const char *p, const char *end, const char *cmd, const char **value)
+  {
+    size_t n = strlen(cmd);
+    if ((size_t)(end - p) < n || strnicmp(p, cmd, n) != 0)
+      return false;
+    *value = p + n;
+    while (*value < end && (**value == ' ' || **value == '\t')) ++*value;
+    return true;
+  }
+
+  static bool IsValidUtf8(const char *p, const char *end)
+  {
+    const unsigned char *s = (const unsigned char*)p;
+    const unsigned char *e = (const unsigned char*)end;
+    while (s < e)
+    {
+      int n;
+      if (*s < 0x80) n = 0;
+      else if ((*s & 0xE0) == 0xC0 && *s >= 0xC2) n = 1;
+      else if ((*s & 0xF0) == 0xE0) n = 2;
+      else if ((*s & 0xF8) == 0xF0 && *s <= 0xF4) n = 3;
+      else return false;
+      if (e - s <= n) return false;  /* truncated */
+      for (int i = 1; i <= n; ++i)
+        if ((s[i] & 0xC0) != 0x80) return false;
+      s += n + 1;
+    }
+    return true;
+  }
+
+  std::string Text(const char *p, const char *end) const
+  {
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t')) --end;
+    if (is_utf8_)
+      return std::string(p, end - p);
+    return rutil::ConvertEncoding(std::string(p, end - p), rutil::E_UTF8, rutil::E_SHIFT_JIS);
+  }
+
+  /* numbers are parsed from bounded copy, as file buffer isn't terminated. */
+  static int ToInt(const char *p, const char *end)
+  {
+    char buf[32];
+    size_t len = std::min((size_t)(end - p), sizeof(buf) - 1);
+    memcpy(buf, p, len);
+    buf[len] = 0;
+    return (int)strtol(buf, nullptr, 10);
+  }
+
+  static double ToDouble(const char *p, const char *end)
+  {
+    char buf[64];
+    size_t len = std::min((size_t)(end - p), sizeof(buf) - 1);
+    memcpy(buf, p, len);
+    buf[len] = 0;
+    return strtod(buf, nullptr);
+  }
+
+  void UpdateBpm(double bpm)
+  {
+    if (bpm <= 0) return;
+    if (bpm_min_ == 0 || bpm < bpm_min_) bpm_min_ = bpm;
+    if (bpm > bpm_max_) bpm_max_ = bpm;
+  }
+
+  void ReadLine(const char *p, const char *end)
+  {
+    const char *v;
+
+    // control flow (only first branch is used)
+    if (IsCommand(p, end, "IF", &v)) {
+      ++if_depth_;
+      if (skip_depth_ == 0 && ToInt(v, end) != 1)
+        skip_depth_ = if_depth_;
+      return;
+    }
+    if (IsCommand(p, end, "ENDIF", &v)) {
+      if (skip_depth_ == if_depth_) skip_depth_ = 0;
+      if (if_depth_ > 0) --if_depth_;
+      return;
+    }
+    if (skip_depth_ > 0) return;
+
+    // channel line: #mmmcc:data
+    if (end - p > 6 && p[5] == ':' && isdigit(p[0]) && isdigit(p[1]) && isdigit(p[2]))
+    {
+      ReadChannel((p[0] - '0') * 100 + (p[1] - '0') * 10 + (p[2] - '0'),
+                  Base36(p + 3), p + 6, end);
+      return;
+    }
 
-    cdat = cdat_prev = nullptr;
-    sdat = nullptr;
+    if (IsCommand(p, end, "TITLE", &v)) info_.title = Text(v, end);
+    else if (IsCommand(p, end, "SUBTITLE", &v)) info_.subtitle = Text(v, end);
+    else if (IsCommand(p, end, "SUBARTIST", &v)) info_.subartist = Text(v, end);
+    else if (IsCommand(p, end, "ARTIST", &v)) info_.artist = Text(v, end);
+    else if (IsCommand(p, end, "GENRE", &v)) info_.genre = Text(v, end);
+    else if (IsCommand(p, end, "PLAYLEVEL", &v)) info_.level = ToInt(v, end);
+    else if (IsCommand(p, end, "DIFFICULTY", &v)) info_.difficulty = ToInt(v, end);
+    else if (IsCommand(p, end, "LNOBJ", &v) && end - v >= 2) lnobj_ = Base36(v);
+    else if (IsCommand(p, end, "STOP", &v) && end - v > 3)
+      stop_table_[Base36(v)] = ToDouble(v + 2, end);
+    else if (IsCommand(p, end, "BPM", &v))
+    {
+      if (end - v > 3 && v[2] == ' ')
+        bpm_table_[Base36(v)] = ToDouble(v + 2, end); // #BPMxx
+      else if (end - v > 0 && v[0] != ' ')
+      {
+        double bpm = ToDouble(v, end);     // #BPM
+        if (bpm > 0) bpm_ = bpm;
+      }
+    }
+  }
 
-    // check is aborted..?
-    if (is_aborted_)
+  void ReadChannel(int measure, int channel, const char *p, const char *end)
+  {
+    if (channel == 2)
+    {
+      // measure length
+      measure_len_[measure] = ToDouble(p, end);
       return;
+    }
+
+    size_t count = (end - p) / 2;
+    for (size_t i = 0; i < count; ++i)
+    {
+      const char *obj = p + i * 2;
+      if (obj[0] == '0' && obj[1] == '0') continue;
+      double pos = (double)i / count;
+      int value = Base36(obj);
+
+      // last object time: any sound/note object
+      if (measure > last_measure_ || (measure == last_measure_ && pos > last_pos_))
+      {
+        last_measure_ = measure;
+        last_pos_ = pos;
+      }
+
+      int ch_hi = channel / 36, ch_lo = channel % 36;
+      if (channel == 3)
+        tempo_objs_.push_back({ measure, pos, 0, Hex(obj) });
+      else if (channel == 8)
+        tempo_objs_.push_back({ measure, pos, 1, value });
+      else if (channel == 9)
+        tempo_objs_.push_back({ measure, pos, 2, value });
+      else if ((ch_hi == 1 || ch_hi == 2) && ch_lo >= 1 && ch_lo <= 9)
+      {
+        // playable note (1P: 1x, 2P: 2x)
+        lane_mask_ |= 1u << ((ch_hi - 1) * 10 + ch_lo);
+        if (lnobj_ && value == lnobj_)
+          info_.is_longnote = 1;  // end of longnote; already counted
+        else
+          info_.notecount++;
+      }
+      else if ((ch_hi == 5 || ch_hi == 6) && ch_lo >= 1 && ch_lo <= 9)
+      {
+        // longnote channel: start/end pairs, counted as one note
+        lane_mask_ |= 1u << ((ch_hi - 5) * 10 + ch_lo);
+        int &st = ln_state_[ch_hi - 5][ch_lo];
+        if (st == 0) info_.notecount++;
+        st = !st;
+        info_.is_longnote = 1;
+      }
+    }
+  }
+
+  double MeasureLength(int measure) const
+  {
+    auto it = measure_len_.find(measure);
+    return (it != measure_len_.end() && it->second > 0) ? it->second : 1.0;
+  }
 
-    // attempt song loading.
+  void Finish(bool is_pms)
+  {
+    // beat position of each measure
+    std::vector<double> measure_beat(last_measure_ + 2, 0);
+    for (int m = 0; m <= last_measure_; ++m)
+      measure_beat[m + 1] = measure_beat[m] + MeasureLength(m) * 4;
+    auto beat_of = [&](int measure, double pos) {
+      if (measure > last_measure_) measure = last_measure_;
+      return measure_beat[measure] + pos * MeasureLength(measure) * 4;
+    };
+
+    std::vector<TempoEvent> tempo;
+    UpdateBpm(bpm_);
+    for (auto &o : tempo_objs_)
+    {
+      double beat = beat_of(o.measure, o.pos);
+      if (o.type == 0 || o.type == 1)
+      {
+        double bpm = o.value;
+        if (o.type == 1) {
+          auto it = bpm_table_.find(o.value);
+          if (it == bpm_table_.end()) continue;
+          bpm = it->second;
+        }
+        UpdateBpm(bpm);
+        tempo.push_back({ beat, bpm, 0 });
+      }
+      else
+      {
+        auto it = stop_table_.find(o.value);
+        if (it != stop_table_.end())
+          tempo.push_back({ beat, 0, it->second / 48.0 });  // 1/192 measure
+      }
+    }
+    std::stable_sort(tempo.begin(), tempo.end(),
+      [](const TempoEvent &a, const TempoEvent &b) { return a.beat < b.beat; });
+
+    // time of last object
+    double last_beat = beat_of(last_measure_, last_pos_);
+    double bpm = bpm_, beat = 0, time = 0;
+    for (auto &e : tempo)
+    {
+      if (e.beat > last_beat) break;
+      time += (e.beat - beat) * 60.0 / bpm;
+      beat = e.beat;
+      if (e.bpm > 0) bpm = e.bpm;
+      else time += e.stop_beat * 60.0 / bpm;
+    }
+    time += (last_beat - beat) * 60.0 / bpm;
+    info_.length_ms = static_cast<int>(time * 1000);
+    info_.bpm_min = (int)bpm_min_;
+    info_.bpm_max = (int)bpm_max_;
+
+    // key count from used lanes (scratch: 6, foot pedal: 7)
+    bool is_7key = lane_mask_ & ((1u << 8) | (1u << 9) | (1u << 18) | (1u << 19));
+    bool is_double = lane_mask_ & (0x3FEu << 10);
+    if (is_pms) {
+      info_.charttype = rparser::CHARTTYPE::Popn;
+      info_.keycount = 9;
+    }
+    else {
+      info_.charttype = is_double ? rparser::CHARTTYPE::IIDXDP : rparser::CHARTTYPE::IIDXSP;
+      info_.keycount = (is_7key ? 7 : 5) * (is_double ? 2 : 1);
+    }
+  }
+};
+
+/**
+ * @brief
+ * Metadata-only scan of song folder which contains only BMS/PMS charts.
+ * @return false if song is not suitable for fast scan (e.g. archive,
+ *         other chart formats) so it should be scanned by rparser.
+ */
+static bool ScanSongMetaFast(const std::string &filepath, const std::string &chartname,
+                             std::vector<ChartScanInfo> &infos, size_t &bytes)
+{
+  static const char *kBmsExt[] = { "bms", "bme", "bml", "pms", 0 };
+  static const char *kOtherExt[] = {
+    "bmson", "osu", "sm", "ssc", "dtx", "gda", "vos", "ojn", "ojm", 0 };
+  std::vector<DirItem> dir;
+  std::vector<std::string> files;
+
+  if (!IsDirectory(filepath) || !GetDirectoryItems(filepath, dir))
+    return false;
+  for (auto &d : dir) {
+    if (!d.is_file) continue;
+    std::string ext = Lower(GetExtension(d.filename));
+    for (auto **e = kOtherExt; *e; ++e)
+      if (ext == *e) return false;
+    for (auto **e = kBmsExt; *e; ++e) {
+      if (ext == *e && (chartname.empty() || d.filename == chartname)) {
+        files.push_back(d.filename);
+        break;
+      }
+    }
+  }
+  if (files.empty())
+    return false;
+
+  for (auto &fn : files) {
+    rutil::FileData data;
+    rutil::ReadFileData(filepath + "/" + fn, data);
+    if (data.IsEmpty())
+      continue;
+    bytes += data.len;
+
+    ChartScanInfo info;
+    info.filename = fn;
+    info.hash = GetMD5Hash(data.p, data.len);
+    BmsMetaScanner scanner(info);
+    scanner.Scan(reinterpret_cast<const char*>(data.p), data.len,
+                 Lower(GetExtension(fn)) == "pms");
+    infos.push_back(std::move(info));
+  }
+  return !infos.empty();
+}
+
+void SongScanPipeline::ParseSong(const SongScanRequest &req, SongScanResult &out,
+                                 bool is_fast_scan)
+{
+  std::string filepath, chartname;
+  std::vector<ChartScanInfo> infos;
+  SongMetaData *sdat;
+
+  // separate songpath and chartname, if necessary.
+  if (req.path.find('|') != std::string::npos)
+    Split(req.path, '|', filepath, chartname);
+  else
+    filepath = req.path;
+
+  // attempt metadata-only scan first, then full song loading.
+  if (!is_fast_scan || !ScanSongMetaFast(filepath, chartname, infos, out.bytes))
+  {
     SongAuto song = std::make_shared<rparser::Song>();
-    if (!song->Open(filepath_))
+    if (!song->Open(filepath))
     {
       // Actually this is not a song that this program can read,
       // but is necessary to be cached to prevent parsing it next time again.
-      // So don't return here, call PushChart(..) with unknown type,
-      // and invoke FinishSongLoading().
-      Logger::Error("Songlist read failure: %s", fullpath_.c_str());
+      Logger::Error("Songlist read failure: %s", req.path.c_str());
 
-      // TODO: call PushChart(..) with unknown type
+      // TODO: commit song with unknown type
+      return;
     }
-    else
+
+    for (unsigned i = 0; i < song->GetChartCount(); ++i)
     {
-      SONGLIST->StartSongLoading(filepath_);
-      sdat = new SongMetaData();
-      sdat->modified_time = 0;
-      sdat->count = 0;
-      sdat->chart = nullptr;
-      sdat->path = filepath_;
-      sdat->type = Gamemode::kGamemodeNone;
-
-      for (unsigned i = 0; i < song->GetChartCount(); ++i)
-      {
-        rparser::Chart* c = nullptr;
-        int type;
-        int difficulty;
+      rparser::Chart* c = nullptr;
+      if (chartname.empty()) {
+        c = song->GetChart(i);
+      }
+      else {
+        c = song->GetChart(chartname);
+        if (!c) break;
+        i = INT_MAX; // kind of trick to exit for loop instantly
+      }
+      ChartScanInfo info;
+      ReadChartScanInfo(c, info);
 
-        cdat = new ChartMetaData();
-        if (chartname_.empty()) {
-          c = song->GetChart(i);
-        }
-        else {
-          c = song->GetChart(chartname_);
-          if (!c) break;
-          i = INT_MAX; // kind of trick to exit for loop instantly
-        }
-        c->Update();
-        auto &meta = c->GetMetaData();
-        cdat->songpath = filepath_;
-        cdat->chartpath = c->GetFilename();
-        cdat->id = c->GetHash();
-        // TODO: automatically extract subtitle from title
-        cdat->title = meta.title;
-        cdat->subtitle = meta.subtitle;
-        cdat->artist = meta.artist;
-        cdat->subartist = meta.subartist;
-        cdat->genre = meta.genre;
-        switch (c->GetChartType())
+      const char *p;
+      size_t len = 0;
+      if (song->GetDirectory() &&
+          song->GetDirectory()->GetFile(info.filename, &p, len))
+        out.bytes += len;
+
+      infos.push_back(std::move(info));
+    }
+  }
+
+  SONGLIST->StartSongLoading(filepath);
+  sdat = SONGLIST->NewSong();
+  sdat->modified_time = req.modified_time;
+  sdat->count = 0;
+  sdat->chart = nullptr;
+  sdat->path = filepath;
+  sdat->type = Gamemode::kGamemodeNone;
+  out.song = sdat;
+
+  for (auto &info : infos)
+    out.charts.push_back(CreateChartMetaData(info, sdat, req.modified_time));
+}
+
+// ------------------------- class SongDirWatcher
+
+#if defined(__linux__)
+/**
+ * @brief
+ * Watches song library directory (and each song folder in it) by inotify,
+ * and reports changed song paths to SongList.
+ * Events are collected until library is quiet for a while,
+ * as copying a song pack generates lots of events.
+ */
+class SongDirWatcher
+{
+public:
+  SongDirWatcher(const std::string &song_dir)
+    : song_dir_(song_dir), fd_(-1), is_running_(false) {}
+  ~SongDirWatcher() { Stop(); }
+
+  bool Start()
+  {
+    if (is_running_) return true;
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd_ < 0 || !AddWatch(song_dir_, std::string()))
+    {
+      Logger::Warn("Song watcher: cannot watch %s", song_dir_.c_str());
+      if (fd_ >= 0) close(fd_);
+      fd_ = -1;
+      return false;
+    }
+
+    std::vector<DirItem> dir;
+    GetDirectoryItems(song_dir_, dir);
+    for (auto &d : dir)
+    {
+      if (d.is_file || d.filename == "." || d.filename == "..")
+        continue;
+      std::string path = song_dir_ + "/" + d.filename;
+      if (!AddWatch(path, path))
+        break;  /* watch limit reached; library root is still watched. */
+    }
+    Logger::Info("Song watcher: watching %zu directories", wd_path_.size());
+
+    is_running_ = true;
+    thread_ = std::thread([this] { Run(); });
+    return true;
+  }
+
+  void Stop()
+  {
+    if (!is_running_) return;
+    is_running_ = false;
+    thread_.join();
+    close(fd_);
+    fd_ = -1;
+    wd_path_.clear();
+  }
+
+private:
+  static constexpr uint32_t kWatchMask =
+    IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE;
+  static constexpr double kQuietTime = 1.0;
+
+  std::string song_dir_;
+  int fd_;
+  std::atomic<bool> is_running_;
+  std::thread thread_;
+
+  // watch descriptor -> song path (empty for library root)
+  std::unordered_map<int, std::string> wd_path_;
+
+  bool AddWatch(const std::string &dirpath, const std::string &songpath)
+  {
+    int wd = inotify_add_watch(fd_, dirpath.c_str(), kWatchMask);
+    if (wd < 0)
+    {
+      Logger::Warn("Song watcher: failed to watch %s (%s)",
+        dirpath.c_str(), strerror(errno));
+      return false;
+    }
+    wd_path_[wd] = songpath;
+    return true;
+  }
+
+  void Run()
+  {
+    struct pollfd pfd = { fd_, POLLIN, 0 };
+    alignas(struct inotify_event) char buf[4096];
+    std::unordered_set<std::string> changed;
+    double last_event_time = 0;
+
+    while (is_running_)
+    {
+      // timeout to check exit condition.
+      if (poll(&pfd, 1, 100) > 0 && (pfd.revents & POLLIN))
+      {
+        ssize_t len;
+        while ((len = read(fd_, buf, sizeof(buf))) > 0)
         {
-        case rparser::CHARTTYPE::IIDXSP:
-        case rparser::CHARTTYPE::IIDXDP:
-          type = Gamemode::kGamemodeIIDX;
-          break;
-        case rparser::CHARTTYPE::Popn:
-          type = Gamemode::kGamemodePopn;
-          break;
-        default:
-          type = Gamemode::kGamemodeNone;
+          for (char *p = buf; p < buf + len;)
+          {
+            auto *ev = reinterpret_cast<struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + ev->len;
+            ProcessEvent(*ev, changed);
+          }
         }
-        switch (meta.difficulty)
+        last_event_time = Timer::GetUncachedSystemTime();
+      }
+
+      if (!changed.empty() &&
+          Timer::GetUncachedSystemTime() - last_event_time > kQuietTime)
+      {
+        SONGLIST->QueueChangedSongs(
+          std::vector<std::string>(changed.begin(), changed.end()));
+        changed.clear();
+      }
+    }
+  }
+
+  void ProcessEvent(const struct inotify_event &ev,
+                    std::unordered_set<std::string> &changed)
+  {
+    if (ev.mask & IN_IGNORED)
+    {
+      wd_path_.erase(ev.wd);
+      return;
+    }
+    auto it = wd_path_.find(ev.wd);
+    if (it == wd_path_.end())
+      return;
+
+    if (!it->second.empty())
+    {
+      // file changed in song folder
+      changed.insert(it->second);
+      return;
+    }
+
+    // song folder (or song file) changed in library root
+    if (ev.len == 0) return;
+    std::string path = song_dir_ + "/" + ev.name;
+    if ((ev.mask & IN_ISDIR) && (ev.mask & (IN_CREATE | IN_MOVED_TO)))
+      AddWatch(path, path);
+    changed.insert(path);
+  }
+};
+#elif defined(_WIN32)
+/**
+ * @brief
+ * Watches song library directory (with its subtree) by ReadDirectoryChangesW,
+ * and reports changed song paths to SongList.
+ * Events are collected until library is quiet for a while,
+ * as copying a song pack generates lots of events.
+ */
+class SongDirWatcher
+{
+public:
+  SongDirWatcher(const std::string &song_dir)
+    : song_dir_(song_dir), dir_(INVALID_HANDLE_VALUE), event_(NULL),
+      is_running_(false) {}
+  ~SongDirWatcher() { Stop(); }
+
+  bool Start()
+  {
+    if (is_running_) return true;
+    std::wstring wpath;
+    rutil::DecodeToWStr(song_dir_, wpath, rutil::E_UTF8);
+    dir_ = CreateFileW(wpath.c_str(), FILE_LIST_DIRECTORY,
+      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+      OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    event_ = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (dir_ == INVALID_HANDLE_VALUE || !event_)
+    {
+      Logger::Warn("Song watcher: cannot watch %s", song_dir_.c_str());
+      Close();
+      return false;
+    }
+    Logger::Info("Song watcher: watching %s", song_dir_.c_str());
+
+    is_running_ = true;
+    thread_ = std::thread([this] { Run(); });
+    return true;
+  }
+
+  void Stop()
+  {
+    if (!is_running_) return;
+    is_running_ = false;
+    thread_.join();
+    Close();
+  }
+
+private:
+  static constexpr DWORD kNotifyFilter =
+    FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
+    FILE_NOTIFY_CHANGE_LAST_WRITE;
+  static constexpr double kQuietTime = 1.0;
+
+  std::string song_dir_;
+  HANDLE dir_;
+  HANDLE event_;
+  std::atomic<bool> is_running_;
+  std::thread thread_;
+
+  void Close()
+  {
+    if (dir_ != INVALID_HANDLE_VALUE) CloseHandle(dir_);
+    if (event_) CloseHandle(event_);
+    dir_ = INVALID_HANDLE_VALUE;
+    event_ = NULL;
+  }
+
+  void Run()
+  {
+    alignas(DWORD) char buf[16384];
+    OVERLAPPED ov;
+    bool is_pending = false;
+    std::unordered_set<std::string> changed;
+    double last_event_time = 0;
+
+    while (is_running_)
+    {
+      if (!is_pending)
+      {
+        memset(&ov, 0, sizeof(ov));
+        ov.hEvent = event_;
+        if (!ReadDirectoryChangesW(dir_, buf, sizeof(buf), TRUE,
+                                   kNotifyFilter, NULL, &ov, NULL))
         {
-        case 2:
-          difficulty = Difficulty::kDifficultyNormal;
-          break;
-        case 3:
-          difficulty = Difficulty::kDifficultyHard;
-          break;
-        case 4:
-          difficulty = Difficulty::kDifficultyEx;
-          break;
-        case 5:
-          difficulty = Difficulty::kDifficultyInsane;
-          break;
-        case 0: /* XXX: what is the exact meaning of DIFF 0? */
-        case 1:
-        default:
-          difficulty = Difficulty::kDifficultyEasy;
+          Logger::Warn("Song watcher: stopped watching %s (error %u)",
+            song_dir_.c_str(), (unsigned)GetLastError());
           break;
         }
-        cdat->type = type;
-        cdat->key = c->GetKeycount();
-        cdat->difficulty = difficulty;
-        cdat->level = meta.level;
-        cdat->judgediff = meta.difficulty;
-        cdat->modified_date = 0; // TODO
-        cdat->notecount = static_cast<int>(c->GetScoreableNoteCount());
-        cdat->length_ms = static_cast<int>(c->GetSongLastObjectTime() * 1000);
-        cdat->is_longnote = c->HasLongnote();
-        cdat->is_backspin = 0; // TODO
-        cdat->bpm_max = (int)c->GetTimingSegmentData().GetMaxBpm();
-        cdat->bpm_min = (int)c->GetTimingSegmentData().GetMinBpm();
-
-        cdat_list.push_back(cdat);
-        sdat->count++;
+        is_pending = true;
       }
 
-      // make linked-list between charts by ascending.
-      // TODO: sort by difficulty/level
-      if (sdat->count > 0) {
-        cdat_prev = cdat_list.back();
-        for (auto* c : cdat_list) {
-          c->prev = cdat_prev;
-          cdat_prev->next = c;
-          if (!SONGLIST->PushChart(c)) {
-            cdat_prev->next = cdat_prev;
-            sdat->count--;
-            delete c;
-            continue;
-          }
-          cdat_prev = c;
+      // timeout to check exit condition.
+      DWORD len = 0;
+      if (WaitForSingleObject(event_, 100) == WAIT_OBJECT_0)
+      {
+        is_pending = false;
+        if (GetOverlappedResult(dir_, &ov, &len, FALSE))
+        {
+          if (len == 0)
+            Logger::Warn("Song watcher: too many changes, some are missed.");
+          ProcessEvents(buf, len, changed);
         }
+        last_event_time = Timer::GetUncachedSystemTime();
       }
 
-      // append song data into songlist
-      if (sdat->count > 0) {
-        cdat_list.back()->next = cdat_list.front();
-        sdat->chart = cdat_list.front();
-        sdat->type = sdat->chart->type;
-        SONGLIST->PushSong(sdat);
+      if (!changed.empty() &&
+          Timer::GetUncachedSystemTime() - last_event_time > kQuietTime)
+      {
+        SONGLIST->QueueChangedSongs(
+          std::vector<std::string>(changed.begin(), changed.end()));
+        changed.clear();
       }
-      else delete sdat;
     }
 
-    SONGLIST->FinishSongLoading();
+    // cancel read request before buffer is gone.
+    if (is_pending)
+    {
+      DWORD len;
+      CancelIoEx(dir_, &ov);
+      GetOverlappedResult(dir_, &ov, &len, TRUE);
+    }
   }
 
-  virtual void abort()
+  void ProcessEvents(const char *buf, DWORD len,
+                     std::unordered_set<std::string> &changed)
   {
-    is_aborted_ = true;
-  }
+    for (DWORD offset = 0; offset < len;)
+    {
+      auto *info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(buf + offset);
+      std::wstring name(info->FileName, info->FileNameLength / sizeof(WCHAR));
+
+      // first path component is song folder (or song file) in library root.
+      size_t sep = name.find(L'\\');
+      if (sep != std::wstring::npos)
+        name.resize(sep);
+      if (!name.empty())
+      {
+        std::string path;
+        rutil::EncodeFromWStr(name, path, rutil::E_UTF8);
+        changed.insert(song_dir_ + "/" + path);
+      }
 
-private:
-  std::string fullpath_;
-  std::string filepath_;
-  std::string chartname_;
-  bool is_aborted_;
+      if (info->NextEntryOffset == 0) break;
+      offset += info->NextEntryOffset;
+    }
+  }
+};
+#else
+/**
+ * @brief
+ * No directory watching API is used on this platform;
+ * song library is only checked at startup (SongList::Update()),
+ * and Start() fails so that SongList keeps no watcher.
+ */
+class SongDirWatcher
+{
+public:
+  SongDirWatcher(const std::string &) {}
+  bool Start() { return false; }
 };
+#endif
+
+// ------------------------- class MetaStringPool
+
+const char* MetaStringPool::Intern(const char* s)
+{
+  return Intern(std::string(s));
+}
+
+const char* MetaStringPool::Intern(const std::string& s)
+{
+  std::lock_guard<std::mutex> lock(lock_);
+  return strings_.insert(s).first->c_str();
+}
 
 // ----------------------------- class SongList
 
 SongList::SongList()
-  : is_loaded_(false)
+  : is_loaded_(false), is_changed_(false), revision_(1),
+    search_revision_(0), search_song_count_(0), is_search_building_(false)
 {
   song_dir_ = "./songs";
   song_db_ = "./system/song.db";
   Clear();
 }
 
-SongList::~SongList() { Clear(); }
+SongList::~SongList()
+{
+  // stop watcher, scanner and indexer first, as they refer SONGLIST.
+  watcher_.reset();
+  scanner_.reset();
+  if (search_task_.valid())
+    search_task_.wait();
+  Clear();
+}
 
 void SongList::Initialize()
 {
@@ -277,66 +1279,116 @@ void SongList::Cleanup()
 
 bool SongList::LoadFromDatabase(const std::string& path)
 {
-  sqlite3* db = 0;
-  char* errmsg = nullptr;
-  int rc = sqlite3_open(song_db_.c_str(), &db);
-  if (rc) {
+  sqlite3* db = OpenDatabase();
+  sqlite3_stmt *stmt = nullptr;
+  size_t orphan_count = 0;
+  int rc;
+  if (!db) {
     Logger::Warn("Cannot open song database, regarding as database file is missing.");
     return false;
   }
-  else {
-    // Load all cached songs
-    rc = sqlite3_exec(db,
-      "SELECT path, type, modified_date "
-      "from songs;",
-      &SongList::sql_songlist_callback, this, &errmsg);
-    if (rc != SQLITE_OK) {
-      Logger::Error("Failed to query song table from database, maybe corrupted? (%s)", errmsg);
-      sqlite3_free(errmsg);
-      sqlite3_close(db);
-      Clear();
-      return false;
-    }
 
-    // Load all cached charts
-    rc = sqlite3_exec(db,
-      "SELECT id, title, subtitle, artist, subartist, genre, "
-      "songpath, chartpath, type, key, level, judgediff, modified_date, "
-      "notecount, length_ms, bpm_max, bpm_min, is_longnote, is_backspin "
-      "from charts;",
-      &SongList::sql_chartlist_callback, this, &errmsg);
-    if (rc != SQLITE_OK) {
-      Logger::Error("Failed to query chart table from database, maybe corrupted? (%s)", errmsg);
-      sqlite3_free(errmsg);
-      sqlite3_close(db);
-      Clear();
-      return false;
+  auto column_str = [](sqlite3_stmt *st, int i) {
+    const char *v = reinterpret_cast<const char*>(sqlite3_column_text(st, i));
+    return v ? v : "";
+  };
+
+  std::lock_guard<std::mutex> lock(loading_mutex_);
+
+  // Load all cached songs
+  rc = sqlite3_prepare_v2(db,
+    "SELECT path, type, modified_date from songs;", -1, &stmt, nullptr);
+  while (rc == SQLITE_OK && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    rc = SQLITE_OK;
+    SongMetaData* song = song_arena_.Alloc();
+    song->path = column_str(stmt, 0);
+    song->type = sqlite3_column_int(stmt, 1);
+    song->modified_time = sqlite3_column_int64(stmt, 2);
+    song->count = 0;
+    song->chart = nullptr;
+    if (!song_index_.emplace(song->path, song).second) {
+      song_arena_.Free(song);
+      continue;
     }
+    songs_.push_back(song);
+  }
+  sqlite3_finalize(stmt);
+  stmt = nullptr;
+  if (rc != SQLITE_DONE) {
+    Logger::Error("Failed to query song table from database, maybe corrupted? (%s)",
+      sqlite3_errmsg(db));
     sqlite3_close(db);
+    Clear();
+    return false;
   }
 
-  // Link chart to song (fill in-memory attributes)
-  for (auto* c : charts_) {
-    auto* song = FindSong(c->songpath);
-    if (!song) {
-      // XXX: mismatched chart should be deleted from array?
-      Logger::Error("Failed to find songs matching with chart %s (%s)",
-                    c->chartpath.c_str(), c->songpath.c_str());
+  // Load all cached charts,
+  // and link chart to song (fill in-memory attributes) at once.
+  rc = sqlite3_prepare_v2(db,
+    "SELECT id, title, subtitle, artist, subartist, genre, "
+    "songpath, chartpath, type, key, level, judgediff, modified_date, "
+    "notecount, length_ms, bpm_max, bpm_min, is_longnote, is_backspin "
+    "from charts;", -1, &stmt, nullptr);
+  while (rc == SQLITE_OK && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    rc = SQLITE_OK;
+    const char *songpath = column_str(stmt, 6);
+    auto it = song_index_.find(songpath);
+    if (it == song_index_.end()) {
+      // remove mismatched chart from database at next save.
+      dirty_songs_.insert(songpath);
+      orphan_count++;
       continue;
     }
-    c->song = song;
+    SongMetaData *song = it->second;
+
+    ChartMetaData *chart = chart_arena_.Alloc();
+    chart->id = column_str(stmt, 0);
+    chart->title = column_str(stmt, 1);
+    chart->subtitle = column_str(stmt, 2);
+    chart->artist = string_pool_.Intern(column_str(stmt, 3));
+    chart->subartist = string_pool_.Intern(column_str(stmt, 4));
+    chart->genre = string_pool_.Intern(column_str(stmt, 5));
+    chart->songpath = song->path;
+    chart->chartpath = column_str(stmt, 7);
+    chart->type = sqlite3_column_int(stmt, 8);
+    chart->key = sqlite3_column_int(stmt, 9);
+    chart->level = sqlite3_column_int(stmt, 10);
+    chart->judgediff = sqlite3_column_int(stmt, 11);
+    chart->modified_date = sqlite3_column_int(stmt, 12);
+    chart->notecount = sqlite3_column_int(stmt, 13);
+    chart->length_ms = sqlite3_column_int(stmt, 14);
+    chart->bpm_max = sqlite3_column_int(stmt, 15);
+    chart->bpm_min = sqlite3_column_int(stmt, 16);
+    chart->is_longnote = sqlite3_column_int(stmt, 17);
+    chart->is_backspin = sqlite3_column_int(stmt, 18);
+
+    // append to the end of chart ring of the song
+    chart->song = song;
     if (song->chart == nullptr) {
-      song->chart = c;
-      c->prev = c->next = c;
+      song->chart = chart;
+      chart->prev = chart->next = chart;
     }
     else {
-      c->next = song->chart;
-      c->prev = song->chart->prev;
-      song->chart->next = c;
-      song->chart->prev->next = c;
+      chart->next = song->chart;
+      chart->prev = song->chart->prev;
+      song->chart->prev->next = chart;
+      song->chart->prev = chart;
     }
     song->count++;
+    charts_.push_back(chart);
+    chart_index_.emplace(chart->id, chart);
+  }
+  sqlite3_finalize(stmt);
+  if (rc != SQLITE_DONE) {
+    Logger::Error("Failed to query chart table from database, maybe corrupted? (%s)",
+      sqlite3_errmsg(db));
+    sqlite3_close(db);
+    Clear();
+    return false;
   }
+  sqlite3_close(db);
+  if (orphan_count > 0)
+    Logger::Warn("Failed to find songs matching with %u charts.", orphan_count);
 
   // Logging
   if (PrefValue<bool>("log_songlist") == true) {
@@ -345,9 +1397,12 @@ bool SongList::LoadFromDatabase(const std::string& path)
     for (auto* s : songs_) {
       i = 0;
       auto* chart = s->chart;
-      Logger::Info("Song: %s (%d, %lu)", s->path, s->type, s->modified_time);
+      Logger::Info("Song: %s (%d, %lld)", s->path.c_str(), s->type,
+        (long long)s->modified_time);
+      if (!chart) continue;
       do {
-        Logger::Info("[%u] %s (%d)", i, chart->title, chart->difficulty);
+        Logger::Info("[%u] %s (%d)", i, chart->title.c_str(), chart->difficulty);
+        chart = chart->next;
         ++i;
       } while (chart != s->chart);
       cnt += i;
@@ -358,45 +1413,57 @@ bool SongList::LoadFromDatabase(const std::string& path)
   return true;
 }
 
-bool SongList::CreateDatabase(sqlite3 *db)
+sqlite3 *SongList::OpenDatabase()
 {
-  char* errmsg;
-  int rc;
+  sqlite3 *db = nullptr;
+  sqlite3_stmt *stmt = nullptr;
+  int version = 0;
 
-  // Delete all records and tables
-  rc = sqlite3_exec(db, "DROP TABLE songs;",
-    &SongList::sql_dummy_callback, this, &errmsg);
-  if (rc != SQLITE_OK)
-  {
-    // drop table might be failed, ignore.
-    sqlite3_free(errmsg);
+  if (sqlite3_open(song_db_.c_str(), &db) != SQLITE_OK) {
+    sqlite3_close(db);
+    return nullptr;
   }
+  sqlite3_busy_timeout(db, 1000);
 
-  rc = sqlite3_exec(db, "DROP TABLE charts;",
-    &SongList::sql_dummy_callback, this, &errmsg);
-  if (rc != SQLITE_OK)
-  {
-    // drop table might be failed, ignore.
-    sqlite3_free(errmsg);
+  // WAL journal makes commit a single sequential write without
+  // rewriting whole database file.
+  sqlite3_exec(db, "PRAGMA journal_mode=WAL;", nullptr, nullptr, nullptr);
+  sqlite3_exec(db, "PRAGMA synchronous=NORMAL;", nullptr, nullptr, nullptr);
+
+  if (sqlite3_prepare_v2(db, "PRAGMA user_version;", -1, &stmt, nullptr) == SQLITE_OK) {
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+      version = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+  }
+  if (version != kSongDatabaseVersion) {
+    Logger::Info("Song database version mismatch (%d), recreating database.", version);
+    if (!CreateDatabase(db)) {
+      sqlite3_close(db);
+      return nullptr;
+    }
   }
 
-  // Create tables
-  rc = sqlite3_exec(db, "CREATE TABLE songs("
+  return db;
+}
+
+bool SongList::CreateDatabase(sqlite3 *db)
+{
+  char* errmsg;
+  int rc;
+
+  // Delete all records and tables, then create tables.
+  // charts are keyed by path, as chart id (hash) may be shared by copied charts.
+  std::string sql =
+    "BEGIN;"
+    "DROP TABLE IF EXISTS songs;"
+    "DROP TABLE IF EXISTS charts;"
+    "CREATE TABLE songs("
     "path CHAR(1024) PRIMARY KEY,"
     "type INT,"
     "modified_date INT"
-    ");",
-    &SongList::sql_dummy_callback, this, &errmsg);
-  if (rc != SQLITE_OK)
-  {
-    Logger::Error("Failed SQL: %s", errmsg);
-    sqlite3_free(errmsg);
-    sqlite3_close(db);
-    return false;
-  }
-
-  rc = sqlite3_exec(db, "CREATE TABLE charts("
-    "id CHAR(128) PRIMARY KEY,"
+    ");"
+    "CREATE TABLE charts("
+    "id CHAR(128),"
     "title CHAR(128),"
     "subtitle CHAR(128),"
     "artist CHAR(128),"
@@ -414,14 +1481,19 @@ bool SongList::CreateDatabase(sqlite3 *db)
     "bpm_max INT,"
     "bpm_min INT,"
     "is_longnote INT,"
-    "is_backspin INT"
-    ");",
+    "is_backspin INT,"
+    "PRIMARY KEY (songpath, chartpath)"
+    ");";
+  sql += format_string("PRAGMA user_version=%d;", kSongDatabaseVersion);
+  sql += "COMMIT;";
+
+  rc = sqlite3_exec(db, sql.c_str(),
     &SongList::sql_dummy_callback, this, &errmsg);
   if (rc != SQLITE_OK)
   {
     Logger::Error("Failed SQL: %s", errmsg);
     sqlite3_free(errmsg);
-    sqlite3_close(db);
+    sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
     return false;
   }
 
@@ -430,14 +1502,176 @@ bool SongList::CreateDatabase(sqlite3 *db)
 
 void SongList::Load()
 {
+  watcher_.reset();
+  scanner_.reset();
+  if (search_task_.valid())
+    search_task_.wait();
   Clear();
   is_loaded_ = true;    /* consider all song is loaded in initial state. */
 
-  // attempt to load DB
-  LoadFromDatabase(song_db_);
+  // attempt to load DB (or recreate it if --reloadsong)
+  double t_start = Timer::GetUncachedSystemTime();
+  if (GAME->is_reload_song()) {
+    Logger::Info("Reloading whole song library.");
+    sqlite3 *db = OpenDatabase();
+    if (db) {
+      CreateDatabase(db);
+      sqlite3_close(db);
+    }
+  }
+  else if (LoadFromDatabase(song_db_)) {
+    Logger::Info("Songlist loaded from database: song %u, chart %u (%.1lf ms)",
+      songs_.size(), charts_.size(),
+      (Timer::GetUncachedSystemTime() - t_start) * 1000.0);
+  }
 
   // check directories for new/deleted songs
   Update();
+
+  // watch library for songs added/removed while running
+  if (PrefValue<int>("songwatch", 1).get()) {
+    watcher_.reset(new SongDirWatcher(song_dir_));
+    if (!watcher_->Start())
+      watcher_.reset();
+  }
+}
+
+void SongList::QueueChangedSongs(const std::vector<std::string>& paths)
+{
+  std::lock_guard<std::mutex> lock(loading_mutex_);
+  changed_songs_.insert(changed_songs_.end(), paths.begin(), paths.end());
+}
+
+void SongList::ProcessChanges()
+{
+  std::unordered_set<std::string> paths;
+  std::vector<SongScanRequest> reqs;
+  bool send_event = false;
+  bool build_search = false;
+
+  {
+    std::lock_guard<std::mutex> lock(loading_mutex_);
+
+    // SongListChanged event is processed since previous call,
+    // so no one refers removed metadata now, except search indexer.
+    if (!is_search_building_) {
+      for (auto* c : retired_charts_)
+        chart_arena_.Free(c);
+      for (auto* s : retired_songs_)
+        song_arena_.Free(s);
+      retired_charts_.clear();
+      retired_songs_.clear();
+    }
+
+    send_event = is_changed_;
+    is_changed_ = false;
+
+    // wait for loading songs to be finished.
+    if (is_loaded_ && !changed_songs_.empty()) {
+      paths.insert(changed_songs_.begin(), changed_songs_.end());
+      changed_songs_.clear();
+
+      RemoveSongs(paths);
+      send_event = true;
+
+      for (auto& path : paths) {
+        struct stat result;
+        dirty_songs_.insert(path);
+        if (stat(path.c_str(), &result) != 0)
+          continue;   /* deleted */
+        reqs.push_back({ path, (int64_t)result.st_mtime });
+        total_inval_size_++;
+        is_loaded_ = false;
+      }
+      Logger::Info("Song library changed: %u path(s), reloading %u song(s)",
+        paths.size(), reqs.size());
+    }
+
+    // rebuild search index when loading is done.
+    if (is_loaded_ && !is_search_building_ &&
+        (search_revision_ != revision_ || search_song_count_ != songs_.size())) {
+      is_search_building_ = true;
+      build_search = true;
+    }
+  }
+
+  if (!paths.empty() && reqs.empty())
+    Save();
+  if (!reqs.empty())
+    StartScan(std::move(reqs));
+  if (build_search)
+    search_task_ = TASKMAN->EnqueueFunction([this] { BuildSearchIndex(); }, kTaskBackground);
+  if (send_event)
+    EVENTMAN->SendEvent("SongListChanged");
+}
+
+/**
+ * @brief
+ * Build search index of current song list, in background task.
+ * Song list wheel is notified with SongListChanged when it's done.
+ */
+void SongList::BuildSearchIndex()
+{
+  double t_start = Timer::GetUncachedSystemTime();
+  std::vector<ChartMetaData*> charts;
+  uint32_t revision = 0;
+  size_t song_count = 0;
+  GetChartListCopy(charts, revision, song_count);
+
+  auto index = std::make_shared<SongSearchIndex>();
+  for (size_t i = 0; i < charts.size(); ++i)
+    index->AddChart((uint32_t)i, charts[i]);
+  index->Build();
+  Logger::Info("Song search index built: chart %u, document %u (%.1lf ms)",
+    charts.size(), index->doc_count(),
+    (Timer::GetUncachedSystemTime() - t_start) * 1000.0);
+
+  std::lock_guard<std::mutex> lock(loading_mutex_);
+  search_index_ = index;
+  search_revision_ = revision;
+  search_song_count_ = song_count;
+  is_search_building_ = false;
+  is_changed_ = true;
+}
+
+std::shared_ptr<const SongSearchIndex> SongList::GetSearchIndex(uint32_t &revision)
+{
+  std::lock_guard<std::mutex> lock(loading_mutex_);
+  revision = search_revision_;
+  return search_index_;
+}
+
+/* @warn loading_mutex_ should be locked before calling this function */
+void SongList::RemoveSongs(const std::unordered_set<std::string>& paths)
+{
+  std::unordered_set<SongMetaData*> removed;
+  for (auto& path : paths) {
+    auto it = song_index_.find(path);
+    if (it == song_index_.end()) continue;
+    removed.insert(it->second);
+    retired_songs_.push_back(it->second);
+    song_index_.erase(it);
+  }
+  if (removed.empty())
+    return;
+  revision_++;
+
+  songs_.erase(std::remove_if(songs_.begin(), songs_.end(),
+    [&removed](SongMetaData* s) { return removed.count(s) > 0; }), songs_.end());
+  charts_.erase(std::remove_if(charts_.begin(), charts_.end(),
+    [this, &removed](ChartMetaData* c) {
+      if (removed.count(c->song) == 0)
+        return false;
+      auto range = chart_index_.equal_range(c->id);
+      for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == c) {
+          chart_index_.erase(it);
+          break;
+        }
+      }
+      retired_charts_.push_back(c);
+      return true;
+    }), charts_.end());
 }
 
 /**
@@ -447,228 +1681,324 @@ void SongList::Load()
  */
 void SongList::Update()
 {
-  /* (path, timestamp) key */
-  std::map<std::string, int> mod_dir;
-  std::map<std::string, int> mod_db;
   std::vector<SongInvalidateData> songcheck;
+  std::unordered_map<std::string, size_t> songcheck_index;
+  std::unordered_set<SongMetaData*> songs_invalid;
   std::vector<DirItem> dir;
-  std::vector<Task*> tasklist;
-  std::vector<ChartMetaData*> charts_valid, charts_invalid;
+  std::vector<SongScanRequest> reqs;
+  std::vector<ChartMetaData*> charts_valid;
   std::vector<SongMetaData*> songs_valid;
-  ChartMetaData* curr_chart = nullptr;
+  size_t charts_invalid_count = 0;
+  double t_start = Timer::GetUncachedSystemTime();
 
   // 1. attempt to read file/folder list in directory
   if (!GetDirectoryItems(song_dir_, dir)) {
     Logger::Error("SongList: Failed to generate songlist. make sure song library path exists.");
     return;
   }
+  songcheck.reserve(dir.size());
+  songcheck_index.reserve(dir.size());
   for (auto& d : dir) {
+    if (d.filename == "." || d.filename == "..")
+      continue;
     SongInvalidateData s;
     s.songpath = song_dir_ + "/" + d.filename;
     s.modified_date = d.timestamp_modified;
     s.hit_count = 0;
+    songcheck_index[s.songpath] = songcheck.size();
     songcheck.push_back(s);
   }
 
+  loading_mutex_.lock();
+
   // 2.
-  // mark hit count for cached charts to check a song is a new one.
-  // and also check if chart is valid(not deleted) one.
-  // if invalid, it should be removed from array.
-  for (auto* c : charts_) {
-    int marked = 0;
-    for (auto &check : songcheck) {
-      if (c->songpath == check.songpath &&
-          c->modified_date == check.modified_date) {
-        marked++;
-        check.hit_count++;
-        break;
-      }
+  // a cached song is valid only if its (path, modified time) matches
+  // with the one in directory. mark hit count to check a song is new one.
+  songs_valid.reserve(songs_.size());
+  for (auto* s : songs_) {
+    auto it = songcheck_index.find(s->path);
+    if (s->count > 0 && it != songcheck_index.end() &&
+        songcheck[it->second].modified_date == s->modified_time) {
+      songcheck[it->second].hit_count++;
+      songs_valid.push_back(s);
     }
-    if (marked > 0)
-      charts_valid.push_back(c);
-    else
-      charts_invalid.push_back(c);
-    curr_chart = c;
-  }
-
-  for (auto* c : charts_invalid) {
-    c->next->prev = c->prev;
-    c->prev->next = c->next;
-    if (c->song->chart == c) {
-      c->song->chart = c->next;
+    else {
+      songs_invalid.insert(s);
+      dirty_songs_.insert(s->path);
     }
-    c->song->count--;
-    delete c;
   }
 
-  for (auto* s : songs_) {
-    if (s->count == 0)
-      delete s;
-    else
-      songs_valid.push_back(s);
+  // 3.
+  // charts belong to invalid (or missing) song are removed from array.
+  // no need to unlink chart ring as whole ring of the song is deleted.
+  charts_valid.reserve(charts_.size());
+  for (auto* c : charts_) {
+    if (c->song && songs_invalid.find(c->song) == songs_invalid.end())
+      charts_valid.push_back(c);
+    else {
+      if (!c->song)
+        dirty_songs_.insert(c->songpath);
+      chart_arena_.Free(c);
+      charts_invalid_count++;
+    }
   }
+  for (auto* s : songs_invalid)
+    song_arena_.Free(s);
 
   Logger::Info("Check for cached charts: Valid [%u], Invalid [%u]",
-    charts_valid.size(), charts_invalid.size());
+    charts_valid.size(), charts_invalid_count);
   Logger::Info("New song directories found [%u]", songcheck.size());
 
   charts_.swap(charts_valid);
   songs_.swap(songs_valid);
+  RebuildIndex();
+  revision_++;
 
   // from now,
   // * charts_ : contains all confirmed chart lists (don't need to be reloaded)
   // * songcheck : hit_count == 0 if song is new, which means need to be (re)loaded.
 
-  // 3. Now create all invalidate song list into Task
+  // 4. Now request scan of all invalidated songs
   is_loaded_ = true;
   for (auto &check : songcheck) {
     if (check.hit_count == 0) {
-      Task* t = new SongListUpdateTask(check.songpath);
-      tasklist.push_back(t);
+      dirty_songs_.insert(check.songpath);
+      reqs.push_back({ check.songpath, check.modified_date });
       total_inval_size_++;
       is_loaded_ = false;   /* Song is not loaded yet in this state! */
     }
   }
-  for (auto *t : tasklist)
-    TASKMAN->EnqueueTask(t);
 
   Logger::Info("Songlist reload status: File found(song) %u, "
-               "Cache found(song) %u, Validate(song) %u",
-    dir.size(), songs_.size(), total_inval_size_);
-}
-
-int SongList::sql_songlist_callback(void* _self, int argc, char** argv, char** colnames)
-{
-  SongList* self = static_cast<SongList*>(_self);
-  SongMetaData* song = new SongMetaData();
-
-  song->path = argv[0];
-  song->type = atoi(argv[1]);
-  song->modified_time = atoi(argv[2]);
-  song->count = 0;
-  song->chart = nullptr;
+               "Cache found(song) %u, Validate(song) %u (%.1lf ms)",
+    songcheck.size(), songs_.size(), total_inval_size_,
+    (Timer::GetUncachedSystemTime() - t_start) * 1000.0);
+  loading_mutex_.unlock();
 
-  self->PushSong(song);
-  return 0; /* normal return */
+  // if nothing to load, save deleted songs instantly.
+  if (reqs.empty())
+    Save();
+  else
+    StartScan(std::move(reqs));
 }
 
-int SongList::sql_chartlist_callback(void *_self, int argc, char **argv, char **colnames)
+/**
+ * @brief
+ * Writes changed songs (dirty_songs_) into database in a single transaction.
+ * Charts of changed song are deleted and inserted again;
+ * song which is not exist in songlist anymore is deleted.
+ */
+void SongList::Save()
 {
-  SongList *self = static_cast<SongList*>(_self);
-  ChartMetaData *chart = new ChartMetaData();
+  std::vector<std::string> paths;
+  std::vector<SongMetaData> songs;
+  std::vector<ChartMetaData> charts;
+  double t_start = Timer::GetUncachedSystemTime();
 
-  chart->id = argv[0];
-  chart->title = argv[1];
-  chart->subtitle = argv[2];
-  chart->artist = argv[3];
-  chart->subartist = argv[4];
-  chart->genre = argv[5];
-  chart->songpath = argv[6];
-  chart->chartpath = argv[7];
-  chart->type = atoi(argv[8]);
-  chart->key = atoi(argv[9]);
-  chart->level = atoi(argv[10]);
-  chart->judgediff = atoi(argv[11]);
-  chart->modified_date = atoi(argv[12]);
-  chart->notecount = atoi(argv[13]);
-  chart->length_ms = atoi(argv[14]);
-  chart->bpm_max = atoi(argv[15]);
-  chart->bpm_min = atoi(argv[16]);
-  chart->is_longnote = atoi(argv[17]);
-  chart->is_backspin = atoi(argv[18]);
-  chart->song = nullptr;
-  chart->next = chart->prev = nullptr;
-
-  if (!self->PushChart(chart))
-    delete chart; /* if duplicated then delete */
-
-  return 0; /* normal return */
-}
+  // copy changed data first, so database is written without lock.
+  {
+    std::lock_guard<std::mutex> lock(loading_mutex_);
+    if (dirty_songs_.empty())
+      return;
+    paths.assign(dirty_songs_.begin(), dirty_songs_.end());
+    dirty_songs_.clear();
+    for (const auto& path : paths) {
+      auto it = song_index_.find(path);
+      if (it == song_index_.end())
+        continue;
+      const SongMetaData *song = it->second;
+      songs.push_back(*song);
+      const ChartMetaData *c = song->chart;
+      if (!c) continue;
+      do {
+        charts.push_back(*c);
+        c = c->next;
+      } while (c != song->chart);
+    }
+  }
 
-void SongList::Save()
-{
-  sqlite3 *db = 0;
-  char* errmsg;
-  int rc = sqlite3_open(song_db_.c_str(), &db);
-  if (rc) {
-    std::cout << "Cannot save song database." << std::endl;
+  sqlite3 *db = OpenDatabase();
+  if (!db) {
+    Logger::Error("Cannot save song database.");
+    std::lock_guard<std::mutex> lock(loading_mutex_);
+    dirty_songs_.insert(paths.begin(), paths.end());
+    return;
   }
-  else
-  {
-    CreateDatabase(db);
-    for (const auto* s : songs_)
-    {
-      std::string sql = format_string(
-        "INSERT INTO songs VALUES ("
-        "'%s', %d, %d"
-        ");",
-        s->path.c_str(), s->type, s->modified_time
-      );
-      sqlite3_exec(db, sql.c_str(),
-        &SongList::sql_dummy_callback, this, &errmsg);
-      if (rc != SQLITE_OK)
-      {
-        Logger::Error("Failed SQL: %s", errmsg);
-        sqlite3_free(errmsg);
-        sqlite3_close(db);
-        return;
-      }
+
+  const char *sql_list[] = {
+    "DELETE FROM charts WHERE songpath=?;",
+    "DELETE FROM songs WHERE path=?;",
+    "INSERT OR REPLACE INTO songs VALUES (?, ?, ?);",
+    "INSERT OR REPLACE INTO charts VALUES ("
+    "?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);"
+  };
+  enum { kDeleteCharts, kDeleteSong, kInsertSong, kInsertChart, kStmtCount };
+  sqlite3_stmt *stmt[kStmtCount] = { nullptr };
+  bool is_success = true;
+  int rc = sqlite3_exec(db, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr);
+  for (int i = 0; i < kStmtCount && rc == SQLITE_OK; ++i)
+    rc = sqlite3_prepare_v2(db, sql_list[i], -1, &stmt[i], nullptr);
+
+  auto exec_stmt = [&rc](sqlite3_stmt *st) {
+    if (rc == SQLITE_OK && sqlite3_step(st) != SQLITE_DONE)
+      rc = SQLITE_ERROR;
+    sqlite3_reset(st);
+    sqlite3_clear_bindings(st);
+  };
+  auto bind_str = [](sqlite3_stmt *st, int i, const std::string &v) {
+    sqlite3_bind_text(st, i, v.c_str(), static_cast<int>(v.size()), SQLITE_STATIC);
+  };
+
+  if (rc == SQLITE_OK) {
+    // delete all charts & song of changed path
+    for (const auto& path : paths) {
+      bind_str(stmt[kDeleteCharts], 1, path);
+      exec_stmt(stmt[kDeleteCharts]);
+      bind_str(stmt[kDeleteSong], 1, path);
+      exec_stmt(stmt[kDeleteSong]);
     }
-    for (const auto *s : charts_)
-    {
-      std::string sql = format_string(
-        "INSERT INTO charts VALUES ("
-        "'%s', '%s', '%s', '%s', '%s',"
-        "'%s', '%s', '%s',"
-        "%d, %d, %d, %d, %d, "
-        "%d, %d, %d, %d, %d, %d"
-        ");",
-        s->id.c_str(), s->title.c_str(), s->subtitle.c_str(), s->artist.c_str(), s->subartist.c_str(),
-        s->genre.c_str(), s->songpath.c_str(), s->chartpath.c_str(),
-        s->type, s->key, s->level, s->judgediff, s->modified_date,
-        s->notecount, s->length_ms, s->bpm_max, s->bpm_min, s->is_longnote, s->is_backspin
-      );
-      sqlite3_exec(db, sql.c_str(),
-        &SongList::sql_dummy_callback, this, &errmsg);
-      if (rc != SQLITE_OK)
-      {
-        Logger::Error("Failed SQL: %s", errmsg);
-        sqlite3_free(errmsg);
-        sqlite3_close(db);
-        return;
-      }
+    for (const auto& song : songs) {
+      bind_str(stmt[kInsertSong], 1, song.path);
+      sqlite3_bind_int(stmt[kInsertSong], 2, song.type);
+      sqlite3_bind_int64(stmt[kInsertSong], 3, song.modified_time);
+      exec_stmt(stmt[kInsertSong]);
     }
-    sqlite3_close(db);
+    for (const auto& c : charts) {
+      sqlite3_stmt *st = stmt[kInsertChart];
+      bind_str(st, 1, c.id);
+      bind_str(st, 2, c.title);
+      bind_str(st, 3, c.subtitle);
+      sqlite3_bind_text(st, 4, c.artist, -1, SQLITE_STATIC);
+      sqlite3_bind_text(st, 5, c.subartist, -1, SQLITE_STATIC);
+      sqlite3_bind_text(st, 6, c.genre, -1, SQLITE_STATIC);
+      bind_str(st, 7, c.songpath);
+      bind_str(st, 8, c.chartpath);
+      sqlite3_bind_int(st, 9, c.type);
+      sqlite3_bind_int(st, 10, c.key);
+      sqlite3_bind_int(st, 11, c.level);
+      sqlite3_bind_int(st, 12, c.judgediff);
+      sqlite3_bind_int(st, 13, c.modified_date);
+      sqlite3_bind_int(st, 14, c.notecount);
+      sqlite3_bind_int(st, 15, c.length_ms);
+      sqlite3_bind_int(st, 16, c.bpm_max);
+      sqlite3_bind_int(st, 17, c.bpm_min);
+      sqlite3_bind_int(st, 18, c.is_longnote);
+      sqlite3_bind_int(st, 19, c.is_backspin);
+      exec_stmt(st);
+    }
+  }
+
+  if (rc == SQLITE_OK)
+    rc = sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+  if (rc != SQLITE_OK) {
+    Logger::Error("Failed to save song database (%s)", sqlite3_errmsg(db));
+    sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+    is_success = false;
+  }
+  for (int i = 0; i < kStmtCount; ++i)
+    sqlite3_finalize(stmt[i]);
+  sqlite3_close(db);
+
+  if (!is_success) {
+    // retry at next save.
+    std::lock_guard<std::mutex> lock(loading_mutex_);
+    dirty_songs_.insert(paths.begin(), paths.end());
+    return;
   }
+
+  Logger::Info("Song database saved: changed song %u, chart %u (%.1lf ms)",
+    paths.size(), charts.size(),
+    (Timer::GetUncachedSystemTime() - t_start) * 1000.0);
 }
 
 void SongList::Clear()
 {
+  revision_++;
   total_inval_size_ = 0;
   load_count_ = 0;
-  for (auto* c : charts_)
-    delete c;
   charts_.clear();
   songs_.clear();
+  song_index_.clear();
+  chart_index_.clear();
+  dirty_songs_.clear();
+  changed_songs_.clear();
+  retired_songs_.clear();
+  retired_charts_.clear();
+  song_arena_.Clear();
+  chart_arena_.Clear();
 }
 
 void SongList::LoadFileIntoChartList(const std::string& songpath, const std::string& chartname)
 {
   // check a file is already exists
-  for (const auto *c : charts_) {
-    if (c->songpath == songpath) {
-      if (chartname.empty() || c->chartpath == chartname)
-        return; /* chart already exists */
+  {
+    std::lock_guard<std::mutex> lock(loading_mutex_);
+    auto it = song_index_.find(songpath);
+    if (it != song_index_.end()) {
+      if (chartname.empty())
+        return; /* song already exists */
+      ChartMetaData *c = it->second->chart;
+      do {
+        if (c->chartpath == chartname)
+          return; /* chart already exists */
+        c = c->next;
+      } while (c != it->second->chart);
     }
+    dirty_songs_.insert(songpath);
+    total_inval_size_++;
   }
 
-  // make load task
+  // make scan request
   std::string path = songpath;
   if (!chartname.empty())
     path += "|" + chartname;
   is_loaded_ = false;
-  Task* t = new SongListUpdateTask(path);
-  TASKMAN->EnqueueTask(t);
+  std::vector<SongScanRequest> reqs;
+  reqs.push_back({ path, 0 });
+  StartScan(std::move(reqs));
+}
+
+bool SongList::AddSong(SongMetaData* song, const std::vector<ChartMetaData*>& charts)
+{
+  std::lock_guard<std::mutex> lock(loading_mutex_);
+  if (song_index_.find(song->path) != song_index_.end()) {
+    for (auto *c : charts) DeleteChart(c);
+    DeleteSong(song);
+    return false;
+  }
+
+  song->count = 0;
+  song->chart = nullptr;
+  for (auto *c : charts) {
+    if (!PushChart(c)) {
+      DeleteChart(c);
+      continue;
+    }
+    LinkChart(song, c);
+  }
+  if (song->count == 0) {
+    DeleteSong(song);
+    return false;
+  }
+  song->type = song->chart->type;
+  PushSong(song);
+  dirty_songs_.insert(song->path);
+  return true;
+}
+
+void SongList::SetSongDirectory(const std::string& song_dir, const std::string& song_db)
+{
+  song_dir_ = song_dir;
+  song_db_ = song_db;
+}
+
+SongMetaData* SongList::ParseSong(const std::string& songpath, bool is_fast_scan,
+                                  std::vector<ChartMetaData*>& charts)
+{
+  SongScanResult result;
+  SongScanPipeline::ParseSong({ songpath, 0 }, result, is_fast_scan);
+  charts.swap(result.charts);
+  return result.song;
 }
 
 int SongList::sql_dummy_callback(void*, int argc, char **argv, char **colnames)
@@ -691,6 +2021,7 @@ bool SongList::is_loaded() const
 
 std::string SongList::get_loading_filename() const
 {
+  std::lock_guard<std::mutex> lock(loading_mutex_);
   return current_loading_file_;
 }
 
@@ -698,18 +2029,24 @@ size_t SongList::song_count() const { return songs_.size(); }
 size_t SongList::chart_count() const { return charts_.size(); }
 
 
+SongMetaData* SongList::NewSong() { return song_arena_.Alloc(); }
+ChartMetaData* SongList::NewChart() { return chart_arena_.Alloc(); }
+void SongList::DeleteSong(SongMetaData* p) { song_arena_.Free(p); }
+void SongList::DeleteChart(ChartMetaData* p) { chart_arena_.Free(p); }
+const char* SongList::InternString(const std::string& s) { return string_pool_.Intern(s); }
+
 SongMetaData* SongList::FindSong(const std::string& path)
 {
-  for (auto* song : songs_)
-    if (song->path == path) return song;
-  return nullptr;
+  std::lock_guard<std::mutex> lock(loading_mutex_);
+  auto it = song_index_.find(path);
+  return it != song_index_.end() ? it->second : nullptr;
 }
 
 ChartMetaData* SongList::FindChart(const std::string& id)
 {
-  for (auto* c : charts_)
-    if (c->id == id) return c;
-  return nullptr;
+  std::lock_guard<std::mutex> lock(loading_mutex_);
+  auto it = chart_index_.find(id);
+  return it != chart_index_.end() ? it->second : nullptr;
 }
 
 const std::vector<SongMetaData*>& SongList::GetSongList() const
@@ -722,14 +2059,34 @@ const std::vector<ChartMetaData*>& SongList::GetChartList() const
   return charts_;
 }
 
-bool SongList::PushChart(ChartMetaData *p)
+bool SongList::GetChartListCopy(std::vector<ChartMetaData*> &charts,
+                                uint32_t &revision, size_t &song_count)
 {
   std::lock_guard<std::mutex> lock(loading_mutex_);
-  
+  const bool is_append = revision == revision_ && song_count <= songs_.size();
+  charts.clear();
+  for (size_t i = is_append ? song_count : 0; i < songs_.size(); ++i) {
+    const SongMetaData* song = songs_[i];
+    ChartMetaData* c = song->chart;
+    while (c) {
+      charts.push_back(c);
+      c = c->next;
+      if (c == song->chart) break;
+    }
+  }
+  revision = revision_;
+  song_count = songs_.size();
+  return is_append;
+}
+
+/* @warn loading_mutex_ should be locked before calling this function */
+bool SongList::PushChart(ChartMetaData *p)
+{
   // check duplication
-  for (const auto* chart : charts_) {
-    if (chart->id == p->id &&
-        chart->songpath == p->songpath &&
+  auto range = chart_index_.equal_range(p->id);
+  for (auto it = range.first; it != range.second; ++it) {
+    const auto* chart = it->second;
+    if (chart->songpath == p->songpath &&
         chart->chartpath == p->chartpath)
     {
       Logger::Warn("Song data is already exists (%s, %s)",
@@ -739,13 +2096,47 @@ bool SongList::PushChart(ChartMetaData *p)
   }
 
   charts_.push_back(p);
+  chart_index_.emplace(p->id, p);
   return true;
 }
 
+/* @brief make linked-list between charts by ascending. */
+void SongList::LinkChart(SongMetaData* song, ChartMetaData* c)
+{
+  // TODO: sort by difficulty/level
+  c->song = song;
+  if (song->chart == nullptr) {
+    song->chart = c;
+    c->prev = c->next = c;
+  }
+  else {
+    c->next = song->chart;
+    c->prev = song->chart->prev;
+    song->chart->prev->next = c;
+    song->chart->prev = c;
+  }
+  song->count++;
+}
+
+/* @warn loading_mutex_ should be locked before calling this function */
 void SongList::PushSong(SongMetaData* p)
 {
   // Warning: this method must be called on non-duplicated song object
   songs_.push_back(p);
+  song_index_.emplace(p->path, p);
+}
+
+/* @warn loading_mutex_ should be locked before calling this function */
+void SongList::RebuildIndex()
+{
+  song_index_.clear();
+  chart_index_.clear();
+  song_index_.reserve(songs_.size());
+  chart_index_.reserve(charts_.size());
+  for (auto* s : songs_)
+    song_index_.emplace(s->path, s);
+  for (auto* c : charts_)
+    chart_index_.emplace(c->id, c);
 }
 
 void SongList::StartSongLoading(const std::string &name)
@@ -754,19 +2145,54 @@ void SongList::StartSongLoading(const std::string &name)
   current_loading_file_ = name;
 }
 
-/* @warn This function should be thread-safe */
-void SongList::FinishSongLoading()
+void SongList::StartScan(std::vector<SongScanRequest> &&reqs)
+{
+  if (!scanner_)
+    scanner_.reset(new SongScanPipeline());
+  scanner_->Add(std::move(reqs));
+}
+
+/**
+ * @brief
+ * Push scanned songs into songlist. Called from scan pipeline.
+ * @return whether all requested songs are loaded.
+ */
+bool SongList::CommitSongs(std::vector<SongScanResult> &results)
 {
   std::lock_guard<std::mutex> lock(loading_mutex_);
-  load_count_++;
-  if (load_count_ == total_inval_size_)
-  {
-    is_loaded_ = true;
-    Save();
-    EVENTMAN->SendEvent("SongListLoaded");
+  for (auto &r : results) {
+    load_count_++;
+    SongMetaData *sdat = r.song;
+    if (!sdat) continue;
+
+    // charts of single chart loading are appended to existing song.
+    auto it = song_index_.find(sdat->path);
+    SongMetaData *song = it != song_index_.end() ? it->second : sdat;
+    if (song != sdat && !r.charts.empty())
+      revision_++;
+
+    for (auto *c : r.charts) {
+      if (!PushChart(c)) {
+        DeleteChart(c);
+        continue;
+      }
+      LinkChart(song, c);
+    }
+
+    if (song != sdat || sdat->count == 0)
+      DeleteSong(sdat);
+    else {
+      sdat->type = sdat->chart->type;
+      PushSong(sdat);
+    }
   }
-}
 
+  if (load_count_ != total_inval_size_)
+    return false;
+  is_loaded_ = true;
+  is_changed_ = true;
+  return true;
+}
 
 SongList *SONGLIST = nullptr;
 
@@ -1,12 +1,15 @@
 #pragma once
 
 #include "TaskPool.h"
+#include "SongSearch.h"
 #include <string>
 #include <memory>
 #include <vector>
 #include <mutex>
 #include <list>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace rparser { class Song; class Chart; }
 
@@ -17,6 +20,10 @@ namespace rhythmus
 
 struct ChartMetaData;
 struct SongMetaData;
+class SongDirWatcher;
+class SongScanPipeline;
+struct SongScanRequest;
+struct SongScanResult;
 
 enum Difficulty
 {
@@ -44,6 +51,72 @@ enum Sorttype
 const char* SorttypeToString(int gamemode);
 int StringToSorttype(const char* s);
 
+/**
+ * @brief
+ * Block-allocated storage for song/chart metadata.
+ * Objects are placed contiguously in allocation order (e.g. database rows)
+ * and freed objects are reused; pointers are never invalidated.
+ */
+template <typename T>
+class MetaDataArena
+{
+public:
+  MetaDataArena() : used_(kBlockSize) {}
+
+  T* Alloc()
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!free_.empty()) {
+      T* p = free_.back();
+      free_.pop_back();
+      *p = T();
+      return p;
+    }
+    if (used_ == kBlockSize) {
+      blocks_.emplace_back(new T[kBlockSize]());
+      used_ = 0;
+    }
+    return &blocks_.back()[used_++];
+  }
+
+  void Free(T* p)
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    free_.push_back(p);
+  }
+
+  /* @warn all allocated objects are invalidated. */
+  void Clear()
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    blocks_.clear();
+    free_.clear();
+    used_ = kBlockSize;
+  }
+
+private:
+  static constexpr size_t kBlockSize = 4096;
+  std::mutex lock_;
+  std::vector<std::unique_ptr<T[]> > blocks_;
+  std::vector<T*> free_;
+  size_t used_;
+};
+
+/**
+ * @brief
+ * Interned string storage for repeating metadata (artist, genre).
+ * Returned pointer is valid until the pool is destroyed.
+ */
+class MetaStringPool
+{
+public:
+  const char* Intern(const char* s);
+  const char* Intern(const std::string& s);
+private:
+  std::mutex lock_;
+  std::unordered_set<std::string> strings_;
+};
+
 /* @brief song data cached in database */
 struct SongMetaData
 {
@@ -63,9 +136,9 @@ struct ChartMetaData
   std::string id;
   std::string title;
   std::string subtitle;
-  std::string artist;
-  std::string subartist;
-  std::string genre;
+  const char* artist = "";      // interned
+  const char* subartist = "";   // interned
+  const char* genre = "";       // interned
   std::string songpath;
   std::string chartpath;
   int type;
@@ -105,17 +178,73 @@ public:
   static void Initialize();
   static void Cleanup();
 
+  SongMetaData* NewSong();
+  ChartMetaData* NewChart();
+  void DeleteSong(SongMetaData* p);
+  void DeleteChart(ChartMetaData* p);
+  const char* InternString(const std::string& s);
+
   void Load();
   void Update();
   void Save();
   void Clear();
 
+  /* @brief Load cached songs from database. (part of Load()) */
+  bool LoadFromDatabase(const std::string& path);
+
+  /* @brief Set song library directory and database file. (before Load()) */
+  void SetSongDirectory(const std::string& song_dir, const std::string& song_db);
+
+  /**
+   * @brief
+   * Add parsed song into song list (e.g. synthetic songs of benchmark).
+   * Song is written into database by next Save().
+   * @return false if song already exists or has no chart;
+   *         metadata is freed in that case.
+   */
+  bool AddSong(SongMetaData* song, const std::vector<ChartMetaData*>& charts);
+
+  /**
+   * @brief
+   * Apply library changes found by directory watcher.
+   * Must be called in main thread, before events are flushed.
+   * Sends SongListChanged event when song list is modified.
+   */
+  void ProcessChanges();
+
+  /* @brief Queue changed song paths (thread-safe) */
+  void QueueChangedSongs(const std::vector<std::string>& paths);
+
   SongMetaData* FindSong(const std::string& path);
   ChartMetaData* FindChart(const std::string& id);
 
   const std::vector<SongMetaData*> &GetSongList() const;
   const std::vector<ChartMetaData *> &GetChartList() const;
 
+  /**
+   * @brief
+   * Copy charts grouped by song in song list order,
+   * safe while songs are being loaded.
+   * Only charts of songs added after previous copy are given
+   * if songs of previous copy are not modified since then.
+   * @param revision    revision of previous copy (0 if none), updated.
+   * @param song_count  song count of previous copy, updated.
+   * @return false if whole song list is copied.
+   */
+  bool GetChartListCopy(std::vector<ChartMetaData*> &charts,
+                        uint32_t &revision, size_t &song_count);
+
+  /**
+   * @brief
+   * Text search index of song list, built in background
+   * when song list is loaded or changed.
+   * Chart id of index is position in GetChartListCopy() order,
+   * so it's valid only while revision is same.
+   * @param revision  revision of song list the index is built from.
+   * @return nullptr if index is not built yet.
+   */
+  std::shared_ptr<const SongSearchIndex> GetSearchIndex(uint32_t &revision);
+
   /**
    * @brief
    * Load a song file into song list if file not exist in songlist.
@@ -125,6 +254,16 @@ public:
     const std::string& chartname = std::string()
   );
 
+  /**
+   * @brief
+   * Parse song into metadata without adding it to song list
+   * (e.g. checking fast scan with full parsing).
+   * Returned metadata should be freed with DeleteSong() / DeleteChart().
+   * @param is_fast_scan  read BMS/PMS metadata without rparser if possible.
+   */
+  SongMetaData* ParseSong(const std::string& songpath, bool is_fast_scan,
+                          std::vector<ChartMetaData*>& charts);
+
   double get_progress() const;
   bool is_loaded() const;
   std::string get_loading_filename() const;
@@ -132,14 +271,55 @@ public:
   size_t song_count() const;
   size_t chart_count() const;
 
-  friend class SongListUpdateTask;
+  friend class SongScanPipeline;
 
 private:
   std::vector<SongMetaData*> songs_;
   std::vector<ChartMetaData*> charts_;
 
+  // index for O(1) lookup / duplication check (guarded by loading_mutex_)
+  // chart id is hash of chart file, so it may be shared by copied charts.
+  std::unordered_map<std::string, SongMetaData*> song_index_;
+  std::unordered_multimap<std::string, ChartMetaData*> chart_index_;
+
+  // song paths changed after last Save() (guarded by loading_mutex_)
+  std::unordered_set<std::string> dirty_songs_;
+
+  // metadata storage
+  MetaDataArena<SongMetaData> song_arena_;
+  MetaDataArena<ChartMetaData> chart_arena_;
+  MetaStringPool string_pool_;
+
+  // songs changed in library (guarded by loading_mutex_)
+  std::vector<std::string> changed_songs_;
+  bool is_changed_;
+
+  // increased when songs are removed or existing song is modified,
+  // not when songs are appended. (guarded by loading_mutex_)
+  uint32_t revision_;
+
+  // search index and song list state it's built from.
+  // (guarded by loading_mutex_)
+  std::shared_ptr<const SongSearchIndex> search_index_;
+  uint32_t search_revision_;
+  size_t search_song_count_;
+  bool is_search_building_;
+  TaskFuture search_task_;
+
+  // removed metadata, freed at next ProcessChanges() after
+  // SongListChanged event is processed,
+  // and search index is not being built. (main thread only)
+  std::vector<SongMetaData*> retired_songs_;
+  std::vector<ChartMetaData*> retired_charts_;
+
+  // library directory watcher
+  std::unique_ptr<SongDirWatcher> watcher_;
+
+  // library scan threads, created when songs need to be scanned
+  std::unique_ptr<SongScanPipeline> scanner_;
+
   // songs to load
-  std::mutex loading_mutex_;
+  mutable std::mutex loading_mutex_;
   std::string current_loading_file_;
   int total_inval_size_;
   int load_count_;
@@ -153,15 +333,18 @@ private:
 
   // sqlite handler
   static int sql_dummy_callback(void*, int argc, char **argv, char **colnames);
-  static int sql_chartlist_callback(void*, int argc, char** argv, char** colnames);
-  static int sql_songlist_callback(void*, int argc, char** argv, char** colnames);
 
-  bool LoadFromDatabase(const std::string& path);
+  sqlite3 *OpenDatabase();
   bool CreateDatabase(sqlite3 *db);
   bool PushChart(ChartMetaData* p);
   void PushSong(SongMetaData* p);
+  static void LinkChart(SongMetaData* song, ChartMetaData* c);
+  void RebuildIndex();
+  void RemoveSongs(const std::unordered_set<std::string>& paths);
+  void BuildSearchIndex();
   void StartSongLoading(const std::string &name);
-  void FinishSongLoading();
+  void StartScan(std::vector<SongScanRequest> &&reqs);
+  bool CommitSongs(std::vector<SongScanResult> &results);
 };
 
 extern SongList *SONGLIST;
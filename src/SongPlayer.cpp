@@ -16,7 +16,8 @@ namespace rhythmus
 SongPlayer::SongPlayer() :
   song_(nullptr), playlist_index_(0), state_(SongPlayerState::STOPPED),
   load_count_(0), total_count_(0), load_callback_(load_count_),
-  load_progress_(.0), play_progress_(.0),
+  load_progress_(.0), load_start_time_(.0), resource_bound_(false),
+  play_progress_(.0),
   load_bga_(true), play_after_loading_(false), action_after_playing_(1)
 {
   memset(sessions_, 0, sizeof(sessions_));
@@ -80,6 +81,10 @@ bool SongPlayer::LoadNext()
   load_count_ = 0;
   total_count_ = 0;
   load_progress_ = 0;
+  load_start_time_ = Timer::GetUncachedSystemTime();
+  resource_bound_ = false;
+  load_futures_.clear();
+  load_future_ = TaskFuture();
   auto *pctx = GetSongPlayinfo();
   ++playlist_index_;
 
@@ -99,6 +104,7 @@ bool SongPlayer::LoadNext()
     song_ = nullptr;
     return false;
   }
+  song_path_ = path;
 
   /* Create empty player if none exists
    * XXX: should delete when play is over? */
@@ -122,6 +128,9 @@ bool SongPlayer::LoadNext()
   }
   END_EACH_PLAYER();
 
+  load_future_ = TaskFuture::when_all(load_futures_);
+  load_futures_.clear();
+
   return true;
 }
 
@@ -172,12 +181,18 @@ void SongPlayer::Stop()
 
   // Cancel loading & release resources
   // Sound playing is also canceled.
+  // Resources still being loaded are released by its loader task.
   for (auto *img : image_arr_)
     IMAGEMAN->Unload(img);
-  for (auto *snd : sound_arr_)
-    snd->Unload();  // automatically calls SOUNDMAN->Unload(sounddata)
+  for (auto *snd : sound_arr_) {
+    snd->Unload();
+    delete snd;
+  }
+  for (auto *sd : sounddata_arr_)
+    if (sd) SOUNDMAN->Unload(sd);
   image_arr_.clear();
   sound_arr_.clear();
+  sounddata_arr_.clear();
 
   // Go back to first song of the playlist
   playlist_index_ = 0;
@@ -224,7 +239,9 @@ void SongPlayer::Update(float delta)
       load_progress_ = load_count_ / (double)total_count_;
     }
     // if done, check play immediate after loading.
-    if (load_progress_ >= 1.0) {
+    if (load_future_.is_ready()) {
+      load_progress_ = 1.0;
+      FinishResourceLoading();
       if (play_after_loading_)
         Play();
       else
@@ -325,33 +342,55 @@ void SongPlayer::LoadResourceFromChart(rparser::Chart &c, unsigned session)
   for (auto it = bgm_map.begin(); it != bgm_map.end(); ++it)
     bgm_fn_[session][it->first] = it->second;
 
-  /* read resources */
-  const char *fn, *p;
+  /* read resources
+   * resources are named with song path, as resource cache is shared
+   * with other songs which may have resources of same filename. */
+  std::string name;
+  const char *p;
   size_t len;
   for (unsigned i = 0; i < kMaxChannelCount; ++i) {
     if (!bga_fn_[session][i].empty()) {
-      fn = bga_fn_[session][i].c_str();
+      name = song_path_ + '/' + bga_fn_[session][i];
       if (dir->GetFile(bga_fn_[session][i], &p, len) && len > 0) {
-        bga_[session][i] = IMAGEMAN->LoadAsync(p, len, fn, &load_callback_);
+        bga_[session][i] = IMAGEMAN->LoadAsync(p, len, name.c_str(), &load_callback_);
         image_arr_.push_back(bga_[session][i]);
+        load_futures_.push_back(bga_[session][i]->get_load_future());
         total_count_++;
       }
     }
     if (!bgm_fn_[session][i].empty()) {
       Sound *s;
-      fn = bgm_fn_[session][i].c_str();
+      name = song_path_ + '/' + bgm_fn_[session][i];
       if (dir->GetFile(bgm_fn_[session][i], &p, len) && len > 0) {
         s = new Sound();
-        // TODO: Add LoadAsync() method to Sound object
-        s->Load(SOUNDMAN->LoadAsync(p, len, fn, &load_callback_));
+        // Sound is bound to its data after loading is done.
+        // (see FinishResourceLoading())
         bgm_[session][i] = s;
         sound_arr_.push_back(s);
+        sounddata_arr_.push_back(SOUNDMAN->LoadAsync(p, len, name.c_str(), &load_callback_));
+        if (sounddata_arr_.back())
+          load_futures_.push_back(sounddata_arr_.back()->get_load_future());
         total_count_++;
       }
     }
   }
 }
 
+void SongPlayer::FinishResourceLoading()
+{
+  if (resource_bound_) return;
+  resource_bound_ = true;
+
+  for (size_t i = 0; i < sound_arr_.size(); ++i) {
+    if (sound_arr_[i]->is_loaded() || !sounddata_arr_[i]) continue;
+    if (sounddata_arr_[i]->is_empty()) continue;
+    sound_arr_[i]->Load(sounddata_arr_[i]);
+  }
+
+  Logger::Info("Song resource loaded: %u objects in %.0lf ms.",
+    total_count_, (Timer::GetUncachedSystemTime() - load_start_time_) * 1000);
+}
+
 #if 0
 void SongPlayer::PrepareResourceListFromSong()
 {
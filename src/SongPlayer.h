@@ -113,6 +113,9 @@ public:
 private:
   rparser::Song *song_;
 
+  /* path of the loaded song (prefix of resource names) */
+  std::string song_path_;
+
   /* currently playing sessions. */
   PlaySession *sessions_[kMaxPlaySession];
 
@@ -144,6 +147,9 @@ private:
   /* sound objects to load */
   std::vector<Sound*> sound_arr_;
 
+  /* sound data for each sound object (bound to Sound after loading) */
+  std::vector<SoundData*> sounddata_arr_;
+
   /* current state of SongPlayer */
   SongPlayerState state_;
 
@@ -155,6 +161,18 @@ private:
   /* load progress */
   double load_progress_;
 
+  /* loader task futures of the resources (collected while loading chart) */
+  std::vector<TaskFuture> load_futures_;
+
+  /* done when all resources are loaded */
+  TaskFuture load_future_;
+
+  /* time when resource loading started (for load time measurement) */
+  double load_start_time_;
+
+  /* is loaded resources bound to objects? */
+  bool resource_bound_;
+
   /* play progress */
   double play_progress_;
 
@@ -172,6 +190,7 @@ private:
   int action_after_playing_;
 
   void LoadResourceFromChart(rparser::Chart &c, unsigned session);
+  void FinishResourceLoading();
   bool IsChartPath(const std::string &path);
 };
 
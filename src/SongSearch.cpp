@@ -0,0 +1,413 @@
+#include "SongSearch.h"
+#include "Song.h"
+#include "Util.h"
+#include <algorithm>
+#include <cstring>
+
+namespace rhythmus
+{
+
+// halfwidth katakana (U+FF61 ~ U+FF9F) to fullwidth
+static const char32_t kHalfwidthKana[] = {
+  0x3002, 0x300C, 0x300D, 0x3001, 0x30FB, 0x30F2, 0x30A1, 0x30A3,
+  0x30A5, 0x30A7, 0x30A9, 0x30E3, 0x30E5, 0x30E7, 0x30C3, 0x30FC,
+  0x30A2, 0x30A4, 0x30A6, 0x30A8, 0x30AA, 0x30AB, 0x30AD, 0x30AF,
+  0x30B1, 0x30B3, 0x30B5, 0x30B7, 0x30B9, 0x30BB, 0x30BD, 0x30BF,
+  0x30C1, 0x30C4, 0x30C6, 0x30C8, 0x30CA, 0x30CB, 0x30CC, 0x30CD,
+  0x30CE, 0x30CF, 0x30D2, 0x30D5, 0x30D8, 0x30DB, 0x30DE, 0x30DF,
+  0x30E0, 0x30E1, 0x30E2, 0x30E4, 0x30E6, 0x30E8, 0x30E9, 0x30EA,
+  0x30EB, 0x30EC, 0x30ED, 0x30EF, 0x30F3, 0x309B, 0x309C
+};
+
+static bool IsVoicableKana(char32_t c)
+{
+  // KA ~ TO row (except small TSU)
+  if (c >= 0x30AB && c <= 0x30C2) return (c - 0x30AB) % 2 == 0;
+  if (c >= 0x30C4 && c <= 0x30C8) return (c - 0x30C4) % 2 == 0;
+  return false;
+}
+
+static bool IsHaRowKana(char32_t c)
+{
+  return c >= 0x30CF && c <= 0x30DD && (c - 0x30CF) % 3 == 0;
+}
+
+static char32_t FoldCodepoint(char32_t c)
+{
+  if (c < 0x80)
+  {
+    if (c >= 'A' && c <= 'Z') return c + ('a' - 'A');
+    return c;
+  }
+  // fullwidth ASCII
+  if (c >= 0xFF01 && c <= 0xFF5E)
+    return FoldCodepoint(c - 0xFEE0);
+  if (c == 0x3000) return ' ';
+  if (c >= 0xFF61 && c <= 0xFF9F)
+    return kHalfwidthKana[c - 0xFF61];
+  // Latin-1, Greek, Cyrillic uppercase
+  if (c >= 0xC0 && c <= 0xDE && c != 0xD7) return c + 0x20;
+  if (c >= 0x391 && c <= 0x3A9 && c != 0x3A2) return c + 0x20;
+  if (c >= 0x410 && c <= 0x42F) return c + 0x20;
+  if (c >= 0x400 && c <= 0x40F) return c + 0x50;
+  return c;
+}
+
+void SongSearchIndex::Fold(const std::string& s, std::u32string& out)
+{
+  const unsigned char *p = (const unsigned char*)s.c_str();
+  const unsigned char *end = p + s.size();
+
+  while (p < end)
+  {
+    char32_t c = *p;
+    int len = 1;
+    if (c >= 0xF0 && end - p >= 4) {
+      c = ((c & 0x07) << 18) | ((p[1] & 0x3F) << 12) | ((p[2] & 0x3F) << 6) | (p[3] & 0x3F);
+      len = 4;
+    }
+    else if (c >= 0xE0 && end - p >= 3) {
+      c = ((c & 0x0F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+      len = 3;
+    }
+    else if (c >= 0xC0 && end - p >= 2) {
+      c = ((c & 0x1F) << 6) | (p[1] & 0x3F);
+      len = 2;
+    }
+    p += len;
+    if (c == 0) continue;
+
+    // halfwidth voiced sound mark is merged into previous kana
+    if ((c == 0xFF9E || c == 0xFF9F) && !out.empty())
+    {
+      char32_t &prev = out.back();
+      if (c == 0xFF9E && (IsVoicableKana(prev) || IsHaRowKana(prev))) {
+        prev++;
+        continue;
+      }
+      if (c == 0xFF9E && prev == 0x30A6) {
+        prev = 0x30F4;
+        continue;
+      }
+      if (c == 0xFF9F && IsHaRowKana(prev)) {
+        prev += 2;
+        continue;
+      }
+    }
+
+    out.push_back(FoldCodepoint(c));
+  }
+}
+
+static void AppendUTF8(char32_t c, std::string& out)
+{
+  char buf[6];
+  unsigned size;
+  ConvertUTF32ToUTF8(c, buf, &size);
+  out.append(buf, size);
+}
+
+static inline uint64_t GramKey(const char32_t *p, size_t n)
+{
+  uint64_t key = 0;
+  for (size_t i = 0; i < n; ++i)
+    key |= (uint64_t)p[i] << (21 * i);
+  return key;
+}
+
+/* title, subtitle, artist, genre */
+static const size_t kFieldCount = 4;
+
+/* trigram postings intersected before verifying candidates.
+ * verifying a field costs about same as intersecting it with a posting,
+ * so intersecting more (broad) postings only makes broad queries slower. */
+static const size_t kMaxIntersect = 2;
+
+/* @brief keep items of sorted v which also exist in sorted list. */
+static void IntersectSorted(std::vector<uint32_t>& v, const std::vector<uint32_t>& list)
+{
+  size_t n = 0, i = 0;
+  for (uint32_t x : v)
+  {
+    // gallop from previous position, then binary search in the last step.
+    size_t step = 1;
+    while (i + step < list.size() && list[i + step] < x)
+    {
+      i += step;
+      step *= 2;
+    }
+    i = std::lower_bound(list.begin() + i,
+      list.begin() + std::min(i + step + 1, list.size()), x) - list.begin();
+    if (i == list.size()) break;
+    if (list[i] == x) v[n++] = x;
+  }
+  v.resize(n);
+}
+
+SongSearchIndex::SongSearchIndex()
+{
+  Clear();
+}
+
+void SongSearchIndex::Clear()
+{
+  text_.clear();
+  field_text_offset_.assign(1, 0);
+  field_docs_.clear();
+  field_doc_offset_.assign(1, 0);
+  doc_fields_.clear();
+  charts_.clear();
+  doc_chart_offset_.assign(1, 0);
+  postings_.clear();
+  field_index_.clear();
+  doc_index_.clear();
+  doc_charts_.clear();
+}
+
+uint32_t SongSearchIndex::AddField(const char* s)
+{
+  std::u32string text;
+  Fold(s, text);
+
+  auto ii = field_index_.find(text);
+  if (ii != field_index_.end())
+    return ii->second;
+
+  uint32_t field = (uint32_t)field_index_.size();
+  for (char32_t c : text)
+    AppendUTF8(c, text_);
+  field_text_offset_.push_back((uint32_t)text_.size());
+  AddGrams(field, text.data(), text.size());
+  field_index_.emplace(std::move(text), field);
+  return field;
+}
+
+void SongSearchIndex::AddChart(uint32_t id, const ChartMetaData* chart)
+{
+  const char* fields[kFieldCount] = {
+    chart->title.c_str(), chart->subtitle.c_str(), chart->artist, chart->genre
+  };
+  // field ids of the document, used as key
+  std::u32string key;
+
+  for (const char* f : fields)
+    key.push_back((char32_t)AddField(f));
+
+  auto ii = doc_index_.find(key);
+  if (ii != doc_index_.end())
+  {
+    doc_charts_[ii->second].push_back(id);
+    return;
+  }
+
+  doc_index_.emplace(key, (uint32_t)doc_charts_.size());
+  doc_charts_.emplace_back(1, id);
+  doc_fields_.insert(doc_fields_.end(), key.begin(), key.end());
+}
+
+void SongSearchIndex::Build()
+{
+  charts_.clear();
+  doc_chart_offset_.assign(1, 0);
+  for (const auto &ids : doc_charts_)
+  {
+    charts_.insert(charts_.end(), ids.begin(), ids.end());
+    doc_chart_offset_.push_back((uint32_t)charts_.size());
+  }
+
+  // documents of each field, by counting sort (so sorted by document).
+  // a document may appear twice in a field if its fields have same text.
+  const size_t field_count = field_text_offset_.size() - 1;
+  std::vector<uint32_t> pos;
+  field_doc_offset_.assign(field_count + 1, 0);
+  for (uint32_t f : doc_fields_)
+    field_doc_offset_[f + 1]++;
+  for (size_t i = 0; i < field_count; ++i)
+    field_doc_offset_[i + 1] += field_doc_offset_[i];
+  pos.assign(field_doc_offset_.begin(), field_doc_offset_.end() - 1);
+  field_docs_.resize(doc_fields_.size());
+  for (size_t i = 0; i < doc_fields_.size(); ++i)
+    field_docs_[pos[doc_fields_[i]]++] = (uint32_t)(i / kFieldCount);
+
+  std::unordered_map<std::u32string, uint32_t>().swap(field_index_);
+  std::unordered_map<std::u32string, uint32_t>().swap(doc_index_);
+  std::vector<std::vector<uint32_t> >().swap(doc_charts_);
+}
+
+void SongSearchIndex::AddGrams(uint32_t field, const char32_t* text, size_t len)
+{
+  // fields are added in increasing order,
+  // so checking last item is enough to avoid duplication.
+  for (size_t i = 0; i < len; ++i)
+  {
+    for (size_t n = 1; n <= 3 && i + n <= len; ++n)
+    {
+      auto &posting = postings_[GramKey(text + i, n)];
+      if (posting.empty() || posting.back() != field)
+        posting.push_back(field);
+    }
+  }
+}
+
+bool SongSearchIndex::Contains(uint32_t field, const std::string& q) const
+{
+  // folded text is stored as UTF-8,
+  // which is safe to compare byte-by-byte for substring.
+  const char *p = text_.data() + field_text_offset_[field];
+  const char *end = text_.data() + field_text_offset_[field + 1];
+  const size_t len = q.size();
+
+  while (end - p >= (ptrdiff_t)len)
+  {
+    p = (const char*)memchr(p, q[0], end - p - len + 1);
+    if (!p) return false;
+    if (memcmp(p, q.data(), len) == 0) return true;
+    ++p;
+  }
+  return false;
+}
+
+/* @brief fields containing query longer than trigram. */
+void SongSearchIndex::SearchFields(const std::u32string& q, const std::string& utf8,
+                                   std::vector<uint32_t>& fields) const
+{
+  // intersect rarest trigram postings, then verify.
+  const std::vector<uint32_t>* lists[kMaxIntersect];
+  size_t list_count = 0;
+
+  fields.clear();
+  for (size_t i = 0; i + 3 <= q.size(); ++i)
+  {
+    auto ii = postings_.find(GramKey(&q[i], 3));
+    if (ii == postings_.end())
+      return;
+    if (list_count < kMaxIntersect)
+      lists[list_count++] = &ii->second;
+    else
+    {
+      // keep rarest lists only
+      auto *l = std::max_element(lists, lists + list_count,
+        [](const std::vector<uint32_t>* a, const std::vector<uint32_t>* b)
+        { return a->size() < b->size(); });
+      if (ii->second.size() < (*l)->size())
+        *l = &ii->second;
+    }
+  }
+
+  std::sort(lists, lists + list_count,
+    [](const std::vector<uint32_t>* a, const std::vector<uint32_t>* b)
+    { return a->size() < b->size(); });
+  fields.assign(lists[0]->begin(), lists[0]->end());
+  for (size_t i = 1; i < list_count && !fields.empty(); ++i)
+    IntersectSorted(fields, *lists[i]);
+
+  size_t n = 0;
+  for (uint32_t field : fields)
+  {
+    if (Contains(field, utf8))
+      fields[n++] = field;
+  }
+  fields.resize(n);
+}
+
+/* @brief chart ids of documents containing matched fields. */
+void SongSearchIndex::CollectCharts(Query& state) const
+{
+  auto &docs = state.docs;
+  auto &result = state.result;
+  const size_t doc_count = doc_chart_offset_.size() - 1;
+  size_t total = 0;
+
+  // result may have all charts; reserve so push_back won't reallocate.
+  result.clear();
+  result.reserve(charts_.size());
+  auto add_doc = [this, &result](uint32_t doc) {
+    for (uint32_t i = doc_chart_offset_[doc]; i < doc_chart_offset_[doc + 1]; ++i)
+      result.push_back(charts_[i]);
+  };
+
+  for (uint32_t field : state.fields)
+    total += field_doc_offset_[field + 1] - field_doc_offset_[field];
+
+  if (total * 8 < doc_count)
+  {
+    // narrow query: merge documents of matched fields
+    docs.clear();
+    for (uint32_t field : state.fields)
+    {
+      docs.insert(docs.end(),
+        field_docs_.begin() + field_doc_offset_[field],
+        field_docs_.begin() + field_doc_offset_[field + 1]);
+    }
+    std::sort(docs.begin(), docs.end());
+    docs.erase(std::unique(docs.begin(), docs.end()), docs.end());
+    for (uint32_t doc : docs)
+      add_doc(doc);
+  }
+  else
+  {
+    // broad query: mark matched fields, then scan all documents in order
+    auto &mask = state.field_mask;
+    mask.assign(field_doc_offset_.size() - 1, 0);
+    for (uint32_t field : state.fields)
+      mask[field] = 1;
+    const uint32_t *f = doc_fields_.data();
+    for (uint32_t doc = 0; doc < doc_count; ++doc, f += kFieldCount)
+    {
+      if (mask[f[0]] | mask[f[1]] | mask[f[2]] | mask[f[3]])
+        add_doc(doc);
+    }
+  }
+}
+
+const std::vector<uint32_t>& SongSearchIndex::Search(const std::string& query,
+                                                     Query& state) const
+{
+  auto &fields = state.fields;
+  std::u32string q;
+  Fold(query, q);
+  state.utf8.clear();
+  for (char32_t c : q)
+    AppendUTF8(c, state.utf8);
+
+  if (q.empty())
+  {
+    fields.clear();
+  }
+  else if (q.size() <= 3)
+  {
+    // n-gram posting itself is the result
+    auto ii = postings_.find(GramKey(q.data(), q.size()));
+    if (ii == postings_.end())
+      fields.clear();
+    else
+      fields.assign(ii->second.begin(), ii->second.end());
+  }
+  else if (state.text.size() >= 3 && q.size() > state.text.size() &&
+           q.compare(0, state.text.size(), state.text) == 0)
+  {
+    // narrow previous result
+    size_t n = 0;
+    for (uint32_t field : fields)
+    {
+      if (Contains(field, state.utf8))
+        fields[n++] = field;
+    }
+    fields.resize(n);
+  }
+  else
+  {
+    SearchFields(q, state.utf8, fields);
+  }
+  state.text.swap(q);
+
+  CollectCharts(state);
+  return state.result;
+}
+
+size_t SongSearchIndex::doc_count() const
+{
+  return doc_fields_.size() / kFieldCount;
+}
+
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+namespace rhythmus
+{
+
+struct ChartMetaData;
+
+/**
+ * @brief
+ * In-memory n-gram index for searching charts by text
+ * (title, subtitle, artist, genre).
+ * Text is case/width folded before indexing. Distinct text of a field
+ * (e.g. an artist name) is indexed once, and charts with same fields
+ * (e.g. difficulties of a song) share a single document.
+ * Index is not modified by Search(), so built index can be shared
+ * between threads; each searcher keeps its own Query state.
+ */
+class SongSearchIndex
+{
+public:
+  /* @brief Last query and matched documents of a searcher,
+   * kept for incremental search. Reset it when index is changed. */
+  struct Query
+  {
+    std::u32string text;
+    std::string utf8;
+    std::vector<uint32_t> fields;
+    std::vector<uint32_t> docs;
+    std::vector<uint8_t> field_mask;
+    std::vector<uint32_t> result;
+  };
+
+  SongSearchIndex();
+
+  void Clear();
+
+  /* @brief Add chart to index. id is given by caller (e.g. index of chart list) */
+  void AddChart(uint32_t id, const ChartMetaData* chart);
+
+  /* @brief Finish adding charts. Must be called before Search(). */
+  void Build();
+
+  /**
+   * @brief
+   * Search charts containing query text. Returned chart ids are not sorted.
+   * If query extends previous query (typing incrementally),
+   * previous result is narrowed down instead of searching again.
+   */
+  const std::vector<uint32_t>& Search(const std::string& query, Query& state) const;
+
+  size_t doc_count() const;
+
+  /* @brief Convert UTF-8 string into case/width folded codepoints. */
+  static void Fold(const std::string& s, std::u32string& out);
+
+private:
+  // folded text of distinct fields in UTF-8
+  std::string text_;
+  std::vector<uint32_t> field_text_offset_;
+  // documents containing each field (sorted, built by Build())
+  std::vector<uint32_t> field_docs_;
+  std::vector<uint32_t> field_doc_offset_;
+  // fields of each document (kFieldCount per document)
+  std::vector<uint32_t> doc_fields_;
+  // chart ids of documents
+  std::vector<uint32_t> charts_;
+  std::vector<uint32_t> doc_chart_offset_;
+
+  // 1~3-gram to fields containing it (sorted, no duplication)
+  std::unordered_map<uint64_t, std::vector<uint32_t> > postings_;
+
+  // used while adding charts; released by Build()
+  std::unordered_map<std::u32string, uint32_t> field_index_;
+  std::unordered_map<std::u32string, uint32_t> doc_index_;
+  std::vector<std::vector<uint32_t> > doc_charts_;
+
+  uint32_t AddField(const char* s);
+  bool Contains(uint32_t field, const std::string& q) const;
+  void AddGrams(uint32_t field, const char32_t* text, size_t len);
+  void SearchFields(const std::u32string& q, const std::string& utf8,
+                    std::vector<uint32_t>& fields) const;
+  void CollectCharts(Query& state) const;
+};
+
+}
@@ -16,6 +16,7 @@
 #include <thread>
 #include <mutex>
 #include <chrono>
+#include <fstream>
 
 namespace rhythmus
 {
@@ -302,7 +303,7 @@ rmixer::Mixer& SoundDriver::getMixer()
 
 // ---------------------------- class SoundData
 
-SoundData::SoundData() : sound_(nullptr), result_(0) {}
+SoundData::SoundData() : sound_(nullptr), result_(0), source_size_(0) {}
 
 SoundData::~SoundData()
 {
@@ -325,6 +326,8 @@ bool SoundData::Load(const std::string &path)
     sound_ = nullptr;
   }
   else {
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    source_size_ = f ? (size_t)f.tellg() : 0;
     result_ = 0;
   }
   return sound_ != nullptr;
@@ -341,6 +344,7 @@ bool SoundData::Load(const char *p, size_t len, const char *name_opt)
     sound_ = nullptr;
   }
   else {
+    source_size_ = len;
     result_ = 0;
   }
   return sound_ != nullptr;
@@ -375,6 +379,13 @@ bool SoundData::is_empty() const
   return sound_ == nullptr;
 }
 
+size_t SoundData::get_memory_size() const
+{
+  // XXX: decoded PCM is bigger than source data in most case,
+  // but it's enough for relative comparison.
+  return sound_ ? source_size_ : 0;
+}
+
 
 // -------------------------------- class Sound
 
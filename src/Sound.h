@@ -54,10 +54,14 @@ public:
   int get_result() const;
   rmixer::Sound *get_sound();
   bool is_empty() const;
+  virtual size_t get_memory_size() const;
 
 private:
   rmixer::Sound *sound_;
   int result_;
+
+  /* size of source data (used as approximated memory size) */
+  size_t source_size_;
 };
 
 /* @brief Sound object which is used for playing sound. */
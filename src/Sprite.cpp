@@ -174,8 +174,13 @@ void Sprite::doRender()
   Point imgsize;
 
   // If not loaded or hide, then not draw
-  if (!img_ || !img_->is_loaded() || !IsVisible())
+  if (!img_ || !IsVisible())
     return;
+  if (!img_->is_loaded()) {
+    // visible but texture not uploaded yet; upload it first.
+    img_->RequestUpload();
+    return;
+  }
 
   // calculate texture crop area
   imgsize = Point{ (float)img_->get_width(), (float)img_->get_height() };
@@ -202,6 +207,13 @@ void Sprite::doRender()
     texcrop.w = texcrop.y + h;
   }
 
+  // bitmap stored from bottom scanline; flip texture coordinate.
+  if (img_->is_bottom_up())
+  {
+    texcrop.y = 1.0f - texcrop.y;
+    texcrop.w = 1.0f - texcrop.w;
+  }
+
   BaseObject::FillVertexInfo(vi);
   vi[0].t = Point{ texcrop.x, texcrop.y };
   vi[1].t = Point{ texcrop.z, texcrop.y };
@@ -72,7 +72,7 @@ protected:
   int frame_;
 
   // resource id
-  int *res_id_;
+  const int *res_id_;
 
   // blending mode
   int blending_;
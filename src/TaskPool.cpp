@@ -1,24 +1,162 @@
 #include "TaskPool.h"
+#include "Setting.h"
 #include "Error.h"
 #include "common.h"
 
 namespace rhythmus
 {
 
-unsigned __task_id = 1;
+std::atomic<unsigned> __task_id(1);
+
+/* @brief Task which runs a function. */
+class FunctionTask : public Task
+{
+public:
+  FunctionTask(std::function<void()> fn) : fn_(fn) {}
+  virtual void run() { if (fn_) fn_(); }
+  virtual void abort() {}
+
+private:
+  std::function<void()> fn_;
+};
+
+// -------------------------- class TaskPromise
+
+TaskPromise::TaskPromise() : is_done_(false), is_aborted_(false) {}
+
+void TaskPromise::set_done(bool aborted)
+{
+  std::vector<std::function<void(bool)> > continuations;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (is_done_) return;
+    is_aborted_ = aborted;
+    is_done_ = true;
+    continuations.swap(continuations_);
+  }
+  done_cond_.notify_all();
+  for (auto &fn : continuations)
+    fn(aborted);
+}
+
+bool TaskPromise::is_done() const
+{
+  return is_done_;
+}
+
+bool TaskPromise::is_aborted() const
+{
+  return is_done_ && is_aborted_;
+}
+
+void TaskPromise::wait()
+{
+  if (is_done_) return;
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cond_.wait(lock, [this] { return (bool)this->is_done_; });
+}
+
+void TaskPromise::on_done(std::function<void(bool)> fn)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!is_done_) {
+      continuations_.push_back(fn);
+      return;
+    }
+  }
+  fn(is_aborted_);
+}
+
+// --------------------------- class TaskFuture
+
+TaskFuture::TaskFuture() {}
+
+TaskFuture::TaskFuture(const std::shared_ptr<TaskPromise> &promise)
+  : promise_(promise) {}
+
+bool TaskFuture::valid() const
+{
+  return (bool)promise_;
+}
+
+bool TaskFuture::is_ready() const
+{
+  return !promise_ || promise_->is_done();
+}
+
+bool TaskFuture::is_aborted() const
+{
+  return promise_ && promise_->is_aborted();
+}
+
+void TaskFuture::wait() const
+{
+  if (promise_) promise_->wait();
+}
+
+TaskFuture TaskFuture::then(std::function<void()> fn, TaskPriority priority) const
+{
+  auto next = std::make_shared<TaskPromise>();
+  auto run_next = [next, fn, priority](bool aborted) {
+    if (aborted || !TASKMAN) {
+      next->set_done(true);
+      return;
+    }
+    Task* task = new FunctionTask(fn);
+    task->promise_ = next;
+    TASKMAN->EnqueueTask(task, priority);
+  };
+  if (promise_)
+    promise_->on_done(run_next);
+  else
+    run_next(false);
+  return TaskFuture(next);
+}
+
+TaskFuture TaskFuture::when_all(const std::vector<TaskFuture> &futures)
+{
+  auto all = std::make_shared<TaskPromise>();
+  auto remain = std::make_shared<std::atomic<size_t> >(futures.size() + 1);
+  auto aborted = std::make_shared<std::atomic<bool> >(false);
+  auto on_done = [all, remain, aborted](bool is_aborted) {
+    if (is_aborted) *aborted = true;
+    if (--*remain == 0)
+      all->set_done(*aborted);
+  };
+  for (auto &f : futures) {
+    if (f.promise_)
+      f.promise_->on_done(on_done);
+    else
+      on_done(false);
+  }
+  // for the case of empty futures.
+  on_done(false);
+  return TaskFuture(all);
+}
 
 // --------------------------------- class Task
 
 Task::Task()
-  : id_(__task_id++), status_(0), current_thread_(nullptr), callback_(nullptr)
+  : id_(__task_id++), status_(kTaskNotStarted), priority_(kTaskInteractive),
+    current_thread_(nullptr), callback_(nullptr),
+    promise_(std::make_shared<TaskPromise>())
 {
 }
 
 Task::Task(bool is_async_task)
-  : id_(__task_id++), status_(0), current_thread_(nullptr), callback_(nullptr)
+  : id_(__task_id++), status_(kTaskNotStarted), priority_(kTaskInteractive),
+    current_thread_(nullptr), callback_(nullptr),
+    promise_(std::make_shared<TaskPromise>())
 {
 }
 
+Task::~Task()
+{
+  // task deleted without being run (e.g. never enqueued).
+  promise_->set_done(true);
+}
+
 void Task::run_task()
 {
   _run_state();
@@ -29,19 +167,15 @@ void Task::run_task()
 void Task::abort_task()
 {
   abort();
+  promise_->set_done(true);
   _finish_state();
 }
 
 void Task::wait()
 {
-  // use spinlock to prevent hang.
-  // (e.g. set conditional_variable before wait() is called)
-  // XXX: is there better way to wait without spinlock?
   if (is_finished()) return;
-  while (this->status_ < 2)
-    _sleep(10);
-  //std::unique_lock<std::mutex> l(mutex_);
-  //task_done_cond_.wait(l, [this] { return this->status_ >= 2; });
+  std::shared_ptr<TaskPromise> promise(promise_);
+  promise->wait();
 }
 
 void Task::set_callback(ITaskCallback *callback)
@@ -49,53 +183,124 @@ void Task::set_callback(ITaskCallback *callback)
   callback_ = callback;
 }
 
+void Task::set_priority(TaskPriority priority)
+{
+  priority_ = priority;
+}
+
+TaskFuture Task::get_future()
+{
+  return TaskFuture(promise_);
+}
+
 unsigned Task::get_task_id() const
 {
   return id_;
 }
 
+TaskPriority Task::get_priority() const
+{
+  return priority_;
+}
+
 bool Task::is_started() const
 {
-  return status_ >= 1;
+  return status_ >= kTaskRunning;
 }
 
 bool Task::is_finished() const
 {
-  return status_ >= 2;
+  return status_ >= kTaskFinished;
 }
 
 void Task::_run_state()
 {
-  status_ = 1;
+  status_ = kTaskRunning;
 }
 
 void Task::_finish_state()
 {
-  status_ = 2;
+  int s = status_.exchange(kTaskFinished);
+  if (s == kTaskFinished) return;
   current_thread_ = nullptr;
-  task_done_cond_.notify_all();
   if (callback_) callback_->run();
+  promise_->set_done();
 }
 
-//---------------------------- class TaskThread
+// ---------------------------- class TaskDeque
 
-TaskThread::TaskThread(TaskPool *pool)
-  : is_running_(true), current_task_(nullptr), pool_(pool)
+TaskDeque::TaskDeque() : top_(0), bottom_(0)
 {
+  for (auto &t : buffer_) t = nullptr;
 }
 
-TaskThread::TaskThread(TaskThread&& t) noexcept
+bool TaskDeque::Push(Task* task)
 {
-  TaskThread::operator=(std::move(t));
+  int64_t b = bottom_.load(std::memory_order_relaxed);
+  int64_t t = top_.load(std::memory_order_acquire);
+  if (b - t >= kCapacity)
+    return false;
+  buffer_[b % kCapacity].store(task, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  bottom_.store(b + 1, std::memory_order_relaxed);
+  return true;
 }
 
-TaskThread& TaskThread::operator=(TaskThread&& t) noexcept
+Task* TaskDeque::Pop()
+{
+  int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+  bottom_.store(b, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t t = top_.load(std::memory_order_relaxed);
+  if (t > b) {
+    // empty deque
+    bottom_.store(b + 1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  Task* task = buffer_[b % kCapacity].load(std::memory_order_relaxed);
+  if (t == b) {
+    // last item; race with thieves.
+    if (!top_.compare_exchange_strong(t, t + 1,
+          std::memory_order_seq_cst, std::memory_order_relaxed))
+      task = nullptr;
+    bottom_.store(b + 1, std::memory_order_relaxed);
+  }
+  return task;
+}
+
+Task* TaskDeque::Steal()
+{
+  int64_t t = top_.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t b = bottom_.load(std::memory_order_acquire);
+  if (t >= b)
+    return nullptr;
+  Task* task = buffer_[t % kCapacity].load(std::memory_order_relaxed);
+  if (!top_.compare_exchange_strong(t, t + 1,
+        std::memory_order_seq_cst, std::memory_order_relaxed))
+    return nullptr;
+  return task;
+}
+
+bool TaskDeque::Contains(const Task* task) const
+{
+  // XXX: only a snapshot; deque may be modified while checking.
+  int64_t t = top_.load(std::memory_order_acquire);
+  int64_t b = bottom_.load(std::memory_order_acquire);
+  for (; t < b; ++t)
+    if (buffer_[t % kCapacity].load(std::memory_order_relaxed) == task)
+      return true;
+  return false;
+}
+
+//---------------------------- class TaskThread
+
+/* worker of current thread (nullptr if not a worker thread) */
+thread_local TaskThread* tCurrentWorker = nullptr;
+
+TaskThread::TaskThread(TaskPool *pool, size_t index)
+  : is_running_(true), current_task_(nullptr), pool_(pool), index_(index)
 {
-  thread_ = std::move(t.thread_);
-  is_running_ = t.is_running_;
-  current_task_ = std::move(t.current_task_);
-  pool_ = t.pool_;
-  return *this;
 }
 
 TaskThread::~TaskThread()
@@ -108,7 +313,6 @@ void TaskThread::exit()
   if (is_running_) {
     is_running_ = false;
     abort();
-    current_task_ = nullptr;
     if (thread_.joinable())
       thread_.join();
   }
@@ -117,41 +321,62 @@ void TaskThread::exit()
 void TaskThread::run()
 {
   thread_ = std::thread([this] {
+    tCurrentWorker = this;
     for (; this->is_running_;) {
-      this->current_task_ = this->pool_->DequeueTask();
-      if (!this->current_task_)
+      Task* task = this->pool_->DequeueTask(this);
+      if (!task)
         break;
+      bool is_lowprio = task->get_priority() != kTaskInteractive;
 
       // mark as running state
-      this->current_task_->current_thread_ = this;
+      {
+        std::lock_guard<std::mutex> lock(current_task_mutex_);
+        task->current_thread_ = this;
+        this->current_task_ = task;
+      }
 
       // run
-      this->current_task_->run_task();
+      task->run_task();
 
       // mark as finished state and delete task
-      delete this->current_task_;
-      this->current_task_ = nullptr;
+      {
+        std::lock_guard<std::mutex> lock(current_task_mutex_);
+        this->current_task_ = nullptr;
+      }
+      this->pool_->FinishTask(task, is_lowprio);
+    }
+    // abort tasks pushed to own deque while halting,
+    // otherwise they never run and WaitAllTask() hangs.
+    for (int p = kTaskInteractive; p < kTaskPriorityCount; ++p) {
+      Task* task;
+      while ((task = this->deque_[p].Pop())) {
+        this->pool_->queued_count_[p]--;
+        this->pool_->RejectTask(task);
+      }
     }
+    tCurrentWorker = nullptr;
   });
 }
 
 void TaskThread::abort()
 {
-  if (current_task_)
-    current_task_->abort_task();
-}
-
-void TaskThread::set_task(Task* task)
-{
-  current_task_ = task;
+  // only signal running task to stop;
+  // task is finished and deleted by worker itself.
+  std::lock_guard<std::mutex> lock(current_task_mutex_);
+  Task* task = current_task_;
+  if (task)
+    task->abort();
 }
 
 bool TaskThread::is_idle() const { return current_task_ == nullptr; }
 
 // ----------------------------- class TaskPool
 
-TaskPool::TaskPool(size_t size) : pool_size_(0), stop_(false)
+TaskPool::TaskPool(size_t size)
+  : pool_size_(0), stop_(false), lowprio_running_(0), lowprio_limit_(0),
+    active_count_(0)
 {
+  for (auto &c : queued_count_) c = 0;
   SetPoolSize(size);
 }
 
@@ -162,8 +387,13 @@ TaskPool::~TaskPool()
 
 void TaskPool::Initialize()
 {
-  // TODO: load preference from setting
-  TASKMAN = new TaskPool(4);
+  // use hardware concurrency if thread count is not set.
+  int size = PrefValue<int>("maxthreadcount", 0).get();
+  if (size <= 0)
+    size = (int)std::thread::hardware_concurrency();
+  if (size <= 0)
+    size = 4;
+  TASKMAN = new TaskPool((size_t)size);
 }
 
 void TaskPool::Destroy()
@@ -180,11 +410,13 @@ void TaskPool::SetPoolSize(size_t size)
   // before re-allocating, cancel all task (if exists)
   ClearTaskPool();
 
-  for (size_t i = 0; i < size; ++i) {
-    TaskThread *tt = new TaskThread(this);
-    worker_pool_.push_back(tt);
+  // reserve a worker for interactive task.
+  lowprio_limit_ = size > 1 ? (int)size - 1 : 1;
+
+  for (size_t i = 0; i < size; ++i)
+    worker_pool_.push_back(new TaskThread(this, i));
+  for (auto* tt : worker_pool_)
     tt->run();
-  }
 
   pool_size_ = size;
 }
@@ -197,53 +429,176 @@ size_t TaskPool::GetPoolSize() const
 unsigned TaskPool::EnqueueTask(Task* task)
 {
   R_ASSERT(task != nullptr);
+  return EnqueueTask(task, task->get_priority());
+}
+
+unsigned TaskPool::EnqueueTask(Task* task, TaskPriority priority)
+{
+  R_ASSERT(task != nullptr);
+  R_ASSERT(priority < kTaskPriorityCount);
+  unsigned id = task->get_task_id();
+  task->priority_ = priority;
+  active_count_++;
+
+  // push to worker's own deque if possible (no lock),
+  // otherwise push to shared queue.
   // if new task is added after AbortAllTask() while Destroy(),
-  // then TASKMAN hangs. To prevent it, Don't enqueue new task while halting.
-  // such case may occur when running task enqueue new task during destruction.
-  if (stop_) {
-    task->abort();
-    task->_finish_state();
-    delete task;
+  // then it never runs and its future never completes.
+  // To prevent it, Don't enqueue new task while halting:
+  // stop_ is checked under the queue lock which ClearTaskPool() sets it,
+  // and tasks pushed to worker deque are aborted by the worker on exit.
+  TaskThread* worker = tCurrentWorker;
+  bool is_queued = worker && worker->pool_ == this && !stop_
+                   && worker->deque_[priority].Push(task);
+  if (!is_queued) {
+    std::lock_guard<std::mutex> lock(task_pool_mutex_);
+    if (!stop_) {
+      task_pool_[priority].push_back(task);
+      is_queued = true;
+    }
+  }
+  if (!is_queued) {
+    RejectTask(task);
     return 0;
   }
-  std::lock_guard<std::mutex> lock(task_pool_mutex_);
-  task_pool_.push_back(task);
-  task_pool_cond_.notify_one();
-  return task->get_task_id();
+  queued_count_[priority]++;
+
+  // wake up a sleeping worker.
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+  }
+  task_cond_.notify_one();
+  return id;
 }
 
+TaskFuture TaskPool::EnqueueFunction(std::function<void()> fn, TaskPriority priority)
+{
+  Task* task = new FunctionTask(fn);
+  TaskFuture future = task->get_future();
+  EnqueueTask(task, priority);
+  return future;
+}
+
+/* @warn task is deleted by worker, so don't use task after Await(). */
 void TaskPool::Await(Task* task)
 {
+  TaskFuture future = task->get_future();
   EnqueueTask(task);
-  if (stop_) return;
-  task->wait();
+  future.wait();
+}
+
+Task* TaskPool::FetchTask(TaskThread* worker, int priority)
+{
+  Task* task = nullptr;
+
+  // 1. own deque (LIFO, cache-friendly)
+  if (worker && (task = worker->deque_[priority].Pop()))
+    return task;
+
+  // 2. shared queue (FIFO)
+  {
+    std::lock_guard<std::mutex> lock(task_pool_mutex_);
+    auto &q = task_pool_[priority];
+    if (!q.empty()) {
+      task = q.front();
+      q.pop_front();
+      return task;
+    }
+  }
+
+  // 3. steal from other workers (FIFO)
+  size_t start = worker ? worker->index_ + 1 : 0;
+  for (size_t i = 0; i < worker_pool_.size(); ++i) {
+    auto* victim = worker_pool_[(start + i) % worker_pool_.size()];
+    if (victim == worker) continue;
+    if ((task = victim->deque_[priority].Steal()))
+      return task;
+  }
+
+  return nullptr;
+}
+
+bool TaskPool::HasFetchableTask() const
+{
+  if (queued_count_[kTaskInteractive] > 0)
+    return true;
+  if (lowprio_running_ >= lowprio_limit_)
+    return false;
+  for (int p = kTaskInteractive + 1; p < kTaskPriorityCount; ++p)
+    if (queued_count_[p] > 0) return true;
+  return false;
+}
+
+Task* TaskPool::DequeueTask(TaskThread* worker)
+{
+  for (;;) {
+    if (stop_)
+      return nullptr;
+
+    // fetch task by priority order.
+    for (int p = kTaskInteractive; p < kTaskPriorityCount; ++p) {
+      if (queued_count_[p] <= 0) continue;
+      bool is_lowprio = p != kTaskInteractive;
+      if (is_lowprio && ++lowprio_running_ > lowprio_limit_) {
+        // all other workers are busy with low priority task.
+        lowprio_running_--;
+        break;
+      }
+      Task* task = FetchTask(worker, p);
+      if (task) {
+        queued_count_[p]--;
+        return task;
+      }
+      if (is_lowprio) lowprio_running_--;
+    }
+
+    // wait until new task is registered
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    task_cond_.wait(lock,
+      [this] { return this->stop_ || this->HasFetchableTask(); }
+    );
+  }
+}
+
+void TaskPool::RejectTask(Task* task)
+{
+  task->abort_task();
   delete task;
+  if (--active_count_ == 0) {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    idle_cond_.notify_all();
+  }
 }
 
-Task* TaskPool::DequeueTask()
+void TaskPool::FinishTask(Task* task, bool is_lowprio)
 {
-  std::unique_lock<std::mutex> lock(task_pool_mutex_);
-  // wait until new task is registered
-  task_pool_cond_.wait(lock,
-    [this] { return this->stop_ || !this->task_pool_.empty(); }
-  );
-  // if thread need to be cleared, exit.
-  if (stop_)
-    return nullptr;
-  // fetch task
-  auto task = task_pool_.front();
-  task_pool_.pop_front();
-  return task;
+  delete task;
+  if (is_lowprio) {
+    lowprio_running_--;
+    // low priority task may be waiting for a free worker.
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    task_cond_.notify_all();
+  }
+  if (--active_count_ == 0) {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    idle_cond_.notify_all();
+  }
 }
 
 bool TaskPool::IsRunning(const Task* task)
 {
-  std::unique_lock<std::mutex> lock(task_pool_mutex_);
   if (!task) return false;
-  for (const auto t : task_pool_)
-    if (t == task) return true;
-  for (auto* worker : worker_pool_)
+  {
+    std::lock_guard<std::mutex> lock(task_pool_mutex_);
+    for (auto &q : task_pool_)
+      for (const auto t : q)
+        if (t == task) return true;
+  }
+  for (auto* worker : worker_pool_) {
     if (worker->current_task_ == task) return true;
+    for (auto &d : worker->deque_)
+      if (d.Contains(task)) return true;
+  }
   return false;
 }
 
@@ -251,11 +606,15 @@ void TaskPool::ClearTaskPool()
 {
   // abort all running tasks
   // and notify all waiting thread to exit
-  stop_ = true;
+  {
+    std::lock_guard<std::mutex> lock(task_pool_mutex_);
+    stop_ = true;
+  }
   AbortAllTask();
-  for (auto* t : task_pool_) delete t;
-  task_pool_.clear();
-  task_pool_cond_.notify_all();
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    task_cond_.notify_all();
+  }
   // all thread is done, clear threads.
   for (auto* wthr : worker_pool_) {
     wthr->exit();
@@ -269,38 +628,48 @@ void TaskPool::ClearTaskPool()
 
 void TaskPool::AbortAllTask()
 {
-  {
-    std::unique_lock<std::mutex> lock(task_pool_mutex_);
-    for (auto* wthr : worker_pool_)
-      wthr->abort();
-    for (auto* t : task_pool_) {
-      t->abort_task();
-    }
-  }
+  AbortQueuedTask();
+
+  // signal running tasks to stop.
+  for (auto* wthr : worker_pool_)
+    wthr->abort();
+
   WaitAllTask();
 }
 
-void TaskPool::WaitAllTask()
+void TaskPool::AbortQueuedTask()
 {
-  {
-    std::unique_lock<std::mutex> lock(task_pool_mutex_);
-    while (!task_pool_.empty()) {
-      task_pool_.back()->wait();
+  // abort and remove all queued tasks.
+  for (int p = kTaskInteractive; p < kTaskPriorityCount; ++p) {
+    std::list<Task*> tasks;
+    {
+      std::lock_guard<std::mutex> lock(task_pool_mutex_);
+      tasks.swap(task_pool_[p]);
+    }
+    for (auto* wthr : worker_pool_) {
+      Task* t;
+      while ((t = wthr->deque_[p].Steal()))
+        tasks.push_back(t);
+    }
+    for (auto* t : tasks) {
+      queued_count_[p]--;
+      RejectTask(t);
     }
   }
-  for (auto *wthr : worker_pool_) {
-    if (wthr->current_task_)
-      wthr->current_task_->wait();
-  }
-  // XXX: waiting main thread is impossible, so just ignore it.
+}
+
+void TaskPool::WaitAllTask()
+{
+  // XXX: waiting from worker thread will hang, so just ignore it.
+  if (tCurrentWorker && tCurrentWorker->pool_ == this)
+    return;
+  std::unique_lock<std::mutex> lock(sleep_mutex_);
+  idle_cond_.wait(lock, [this] { return this->active_count_ <= 0; });
 }
 
 bool TaskPool::is_idle() const
 {
-  if (!task_pool_.empty()) return false;
-  for (auto *tt : worker_pool_)
-    if (!tt->is_idle()) return false;
-  return true;
+  return active_count_ == 0;
 }
 
 TaskPool* TASKMAN;
@@ -10,6 +10,9 @@
 #include <vector>
 #include <list>
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
 #include <condition_variable>
 
 namespace rhythmus
@@ -22,6 +25,74 @@ public:
   virtual void run() = 0;
 };
 
+/* @brief Priority class of a task.
+ * Task with higher priority (lower value) is always fetched first. */
+enum TaskPriority
+{
+  kTaskInteractive, /* e.g. scene load, resources of the current song */
+  kTaskBackground,  /* e.g. song DB scan */
+  kTaskIdle,        /* e.g. thumbnail or preview prefetch */
+  kTaskPriorityCount,
+};
+
+class TaskPromise;
+
+/* @brief Result of async task, which can be waited or chained.
+ * Future is still valid after the task object is deleted. */
+class TaskFuture
+{
+public:
+  TaskFuture();
+  explicit TaskFuture(const std::shared_ptr<TaskPromise> &promise);
+
+  bool valid() const;
+  bool is_ready() const;
+  bool is_aborted() const;
+  void wait() const;
+
+  /* @brief enqueue function as a task after this future is done.
+   * @warn continuation is not executed if this future is aborted. */
+  TaskFuture then(std::function<void()> fn,
+                  TaskPriority priority = kTaskInteractive) const;
+
+  /* @brief future which is done when all given futures are done. */
+  static TaskFuture when_all(const std::vector<TaskFuture> &futures);
+
+private:
+  std::shared_ptr<TaskPromise> promise_;
+};
+
+/* @brief Shared completion state of a task. */
+class TaskPromise
+{
+public:
+  TaskPromise();
+  void set_done(bool aborted = false);
+  bool is_done() const;
+  bool is_aborted() const;
+  void wait();
+
+  /* @brief call function when done.
+   * Called instantly if already done, otherwise called from the thread
+   * which finishes the promise. parameter is whether it is aborted. */
+  void on_done(std::function<void(bool)> fn);
+
+private:
+  std::atomic<bool> is_done_;
+  bool is_aborted_;
+  std::mutex mutex_;
+  std::condition_variable done_cond_;
+  std::vector<std::function<void(bool)> > continuations_;
+};
+
+/* @brief Task status */
+enum TaskStatus
+{
+  kTaskNotStarted,
+  kTaskRunning,
+  kTaskFinished,
+};
+
 /* @brief A task which is used for execution */
 class Task
 {
@@ -29,6 +100,7 @@ public:
   // constructor for temporary task
   Task();
   explicit Task(bool is_async_task);
+  virtual ~Task();
 
   virtual void run() = 0;
   virtual void abort() = 0;
@@ -36,33 +108,39 @@ public:
   void abort_task();
   void wait();
   void set_callback(ITaskCallback *callback);
+  void set_priority(TaskPriority priority);
+
+  /* @brief get future of this task.
+   * @warn task is deleted by worker after finished,
+   *       so get future before the task is enqueued. */
+  TaskFuture get_future();
 
   unsigned get_task_id() const;
+  TaskPriority get_priority() const;
   bool is_started() const;
   bool is_finished() const;
 
   friend class TaskPool;
   friend class TaskThread;
+  friend class TaskFuture;
 
 private:
   /* identifier for task. */
   unsigned id_;
 
-  /* task status
-   * 0: not run
-   * 1: running
-   * 2: finished
-   */
-  int status_;
+  /* task status (TaskStatus) */
+  std::atomic<int> status_;
+
+  /* priority class of this task */
+  TaskPriority priority_;
 
   /* owner of this task */
   TaskThread *current_thread_;
 
   ITaskCallback *callback_;
 
-  /* condition variable for task is done */
-  std::condition_variable task_done_cond_;
-  std::mutex mutex_;
+  /* completion state shared with futures */
+  std::shared_ptr<TaskPromise> promise_;
 
   void _run_state();
   void _finish_state();
@@ -70,30 +148,57 @@ private:
 
 using TaskAuto = std::shared_ptr<Task>;
 
+/* @brief Fixed-size lock-free work-stealing deque (Chase-Lev).
+ * Only the owner thread may call Push() and Pop(),
+ * while any thread may call Steal(). */
+class TaskDeque
+{
+public:
+  TaskDeque();
+  TaskDeque(const TaskDeque&) = delete;
+  bool Push(Task* task);
+  Task* Pop();
+  Task* Steal();
+  bool Contains(const Task* task) const;
+
+private:
+  static constexpr int64_t kCapacity = 1024;
+  std::atomic<int64_t> top_;
+  std::atomic<int64_t> bottom_;
+  std::atomic<Task*> buffer_[kCapacity];
+};
+
 class TaskThread
 {
 public:
-  TaskThread(TaskPool *pool);
+  TaskThread(TaskPool *pool, size_t index);
   TaskThread(const TaskThread&) = delete;
-  TaskThread(TaskThread&&) noexcept;
-  TaskThread& operator=(TaskThread&&) noexcept;
   ~TaskThread();
   void run();
   void exit();
   void abort();
-  void set_task(Task* task);
   bool is_idle() const;
 
   friend class TaskPool;
-  friend class TaskThread;
 
 private:
   std::thread thread_;
-  bool is_running_;
-  Task* current_task_;
+  std::atomic<bool> is_running_;
+  std::atomic<Task*> current_task_;
+  std::mutex current_task_mutex_;
   TaskPool *pool_;
+  size_t index_;
+
+  /* tasks enqueued by this worker, per priority. */
+  TaskDeque deque_[kTaskPriorityCount];
 };
 
+/* @brief Work-stealing thread pool.
+ * Task enqueued from worker thread is pushed to its own deque,
+ * otherwise it's pushed to shared queue of its priority.
+ * Idle workers steal tasks from other workers' deques.
+ * Background/idle tasks cannot occupy all workers,
+ * so interactive task is always started without waiting them. */
 class TaskPool
 {
 public:
@@ -104,27 +209,51 @@ public:
   size_t GetPoolSize() const;
   void ClearTaskPool();
   unsigned EnqueueTask(Task* task);
+  unsigned EnqueueTask(Task* task, TaskPriority priority);
+  TaskFuture EnqueueFunction(std::function<void()> fn,
+                             TaskPriority priority = kTaskInteractive);
   void Await(Task* task);
-  Task* DequeueTask();
+  Task* DequeueTask(TaskThread* worker);
   bool IsRunning(const Task* task);
 
   void AbortAllTask();
   void WaitAllTask();
   bool is_idle() const;
 
+  friend class TaskThread;
+
 private:
   TaskPool(size_t size = 0);
   ~TaskPool();
 
   size_t pool_size_;
   std::vector<TaskThread*> worker_pool_;
-  bool stop_;
+  std::atomic<bool> stop_;
 
-  /* @brief task pool which needs to be retrieved later.
-   * enqueue task with duplicated name in task pool is not allowed. */
-  std::list<Task*> task_pool_;
+  /* @brief shared task queue for tasks enqueued from non-worker thread. */
+  std::list<Task*> task_pool_[kTaskPriorityCount];
   std::mutex task_pool_mutex_;
-  std::condition_variable task_pool_cond_;
+
+  /* queued (not started) task count per priority. */
+  std::atomic<int> queued_count_[kTaskPriorityCount];
+
+  /* workers running background/idle task, and its limit. */
+  std::atomic<int> lowprio_running_;
+  int lowprio_limit_;
+
+  /* queued or running task count. */
+  std::atomic<int> active_count_;
+
+  /* used for sleeping workers and waiting all tasks done. */
+  std::mutex sleep_mutex_;
+  std::condition_variable task_cond_;
+  std::condition_variable idle_cond_;
+
+  Task* FetchTask(TaskThread* worker, int priority);
+  bool HasFetchableTask() const;
+  void FinishTask(Task* task, bool is_lowprio);
+  void AbortQueuedTask();
+  void RejectTask(Task* task);
 };
 
 extern TaskPool* TASKMAN;
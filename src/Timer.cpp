@@ -1,6 +1,8 @@
 #include "Timer.h"
+#include "Game.h"
 #include "common.h"
 #include <GLFW/glfw3.h>
+#include <chrono>
 
 namespace rhythmus
 {
@@ -80,8 +82,19 @@ uint32_t Timer::GetDeltaTimeInMillisecond() const
   return static_cast<uint32_t>(GetDeltaTime() * 1000);
 }
 
+/* time since first call, used when GLFW is not available. */
+static double GetSteadyClockTime()
+{
+  using namespace std::chrono;
+  static const steady_clock::time_point start_time = steady_clock::now();
+  return duration<double>(steady_clock::now() - start_time).count();
+}
+
 double Timer::GetUncachedSystemTime()
 {
+  // GLFW is not initialized in headless mode.
+  if (GAME && GAME->is_headless())
+    return GetSteadyClockTime();
   return glfwGetTime();
 }
 
@@ -98,7 +111,8 @@ void Timer::Update()
 
 void Timer::Initialize()
 {
-  glfwSetTime(0);
+  if (!GAME->is_headless())
+    glfwSetTime(0);
   SystemTimer().Start();
 }
 
@@ -64,7 +64,8 @@ bool GetDirectoryItems(const std::string& dirpath, std::vector<DirItem>& out, bo
         std::string fn;
         std::wstring wfn = curr_dir_name + ffd.cFileName;
         struct _stat result;
-        stat(wfn.c_str(), &result);
+        if (_wstat((wpath + L"\\" + ffd.cFileName).c_str(), &result) != 0)
+          result.st_mtime = 0;
         rutil::EncodeFromWStr(wfn, fn, rutil::E_UTF8);
         out.push_back({
           fn, is_file, result.st_mtime
@@ -122,7 +123,8 @@ bool GetDirectoryItems(const std::string& path, std::vector<DirItem>& out, bool
       }
       std::string fn = curr_dir_name + std::string(dirp->d_name);
       struct stat result;
-      stat(fn.c_str(), &result);
+      if (stat((curr_dir + "/" + dirp->d_name).c_str(), &result) != 0)
+        result.st_mtime = 0;
       out.push_back({
         fn, is_file, result.st_mtime
         });
@@ -404,6 +406,76 @@ void ConvertUTF32ToUTF8(uint32_t input, char* output, unsigned* length)
   }
 }
 
+std::string GetMD5Hash(const void *p, size_t len)
+{
+  static const uint32_t K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a,
+    0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+    0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340,
+    0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+    0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+    0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+    0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92,
+    0xffeff47d, 0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+    0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391 };
+  static const int R[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21 };
+  uint32_t h[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+  const uint8_t *data = static_cast<const uint8_t*>(p);
+
+  // last block(s) with padding and bit length
+  uint8_t tail[128];
+  size_t tail_len = len % 64;
+  size_t tail_size = (tail_len < 56) ? 64 : 128;
+  memset(tail, 0, sizeof(tail));
+  memcpy(tail, data + len - tail_len, tail_len);
+  tail[tail_len] = 0x80;
+  uint64_t bits = (uint64_t)len * 8;
+  for (int i = 0; i < 8; ++i)
+    tail[tail_size - 8 + i] = (uint8_t)(bits >> (8 * i));
+
+  size_t full_len = len - tail_len;
+  for (size_t off = 0; off < full_len + tail_size; off += 64)
+  {
+    const uint8_t *b = off < full_len ? data + off : tail + (off - full_len);
+    uint32_t w[16];
+    for (int i = 0; i < 16; ++i)
+      w[i] = b[i * 4] | (b[i * 4 + 1] << 8) | (b[i * 4 + 2] << 16) | ((uint32_t)b[i * 4 + 3] << 24);
+    uint32_t a = h[0], bb = h[1], c = h[2], d = h[3];
+    for (int i = 0; i < 64; ++i)
+    {
+      uint32_t f;
+      int g;
+      if (i < 16) { f = (bb & c) | (~bb & d); g = i; }
+      else if (i < 32) { f = (d & bb) | (~d & c); g = (5 * i + 1) % 16; }
+      else if (i < 48) { f = bb ^ c ^ d; g = (3 * i + 5) % 16; }
+      else { f = c ^ (bb | ~d); g = (7 * i) % 16; }
+      uint32_t t = d;
+      d = c;
+      c = bb;
+      uint32_t x = a + f + K[i] + w[g];
+      bb = bb + ((x << R[i]) | (x >> (32 - R[i])));
+      a = t;
+    }
+    h[0] += a; h[1] += bb; h[2] += c; h[3] += d;
+  }
+
+  static const char *hex = "0123456789abcdef";
+  std::string r(32, '0');
+  for (int i = 0; i < 16; ++i)
+  {
+    uint8_t v = (uint8_t)(h[i / 4] >> (8 * (i % 4)));
+    r[i * 2] = hex[v >> 4];
+    r[i * 2 + 1] = hex[v & 15];
+  }
+  return r;
+}
+
 #if WIN32
 std::string GetUtf8FromWString(const std::wstring& wstring)
 {
@@ -415,12 +487,37 @@ std::string GetUtf8FromWString(const std::wstring& wstring)
 
 // -------------------------------- CommandArgs
 
+CommandArgs::CommandArgs()
+  : sep_(','), len_(0), trim_(true) { memset(args_, 0, sizeof(args_)); }
+
 CommandArgs::CommandArgs(const std::string &argv)
   : sep_(','), len_(0), trim_(true) { Parse(argv); }
 
 CommandArgs::CommandArgs(const std::string &argv, size_t arg_count, bool fit_size)
   : sep_(','), len_(0), trim_(true) { Parse(argv, arg_count, true); }
 
+/* argument pointers refer to internal string, so they need to be rebased
+ * when copied. (pre-parsed arguments are stored in compiled commands) */
+CommandArgs::CommandArgs(const CommandArgs &args) { *this = args; }
+
+CommandArgs& CommandArgs::operator=(const CommandArgs &args)
+{
+  if (this == &args) return *this;
+  s_ = args.s_;
+  sep_ = args.sep_;
+  len_ = args.len_;
+  trim_ = args.trim_;
+  const char *src = args.s_.c_str();
+  for (size_t i = 0; i < kMaxCommandArgs; ++i)
+  {
+    if (args.args_[i] >= src && args.args_[i] <= src + args.s_.size())
+      args_[i] = s_.c_str() + (args.args_[i] - src);
+    else
+      args_[i] = args.args_[i];
+  }
+  return *this;
+}
+
 void CommandArgs::Parse(const std::string &argv)
 {
   Parse(argv, kMaxCommandArgs, false);
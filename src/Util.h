@@ -90,6 +90,9 @@ size_t FindUtf8FirstByteReversed(const std::string &s);
 
 void ConvertUTF32ToUTF8(uint32_t u32, char *out, unsigned *len);
 
+/* @brief MD5 digest of data as lowercase hex string (same as chart hash). */
+std::string GetMD5Hash(const void *p, size_t len);
+
 #if WIN32
 std::string GetUtf8FromWString(const std::wstring& wstring);
 #endif
@@ -100,9 +103,11 @@ constexpr size_t kMaxCommandArgs = 128;
 class CommandArgs
 {
 public:
-  CommandArgs() = default;
+  CommandArgs();
   CommandArgs(const std::string &argv);
   CommandArgs(const std::string &argv, size_t arg_count, bool fit_size);
+  CommandArgs(const CommandArgs &args);
+  CommandArgs& operator=(const CommandArgs &args);
 
   void Parse(const std::string &argv);
   void Parse(const std::string &argv, size_t arg_count, bool fit_size);
@@ -19,7 +19,7 @@ private:
 
   float value_;
 
-  float *val_ptr_;
+  const float *val_ptr_;
 
   Sprite bar_;
 
@@ -46,6 +46,8 @@ void Line::doRender()
   GRAPHIC->SetTexture(0, 0);
   GRAPHIC->SetBlendMode(1);
 #if 0
+  // draw batched quads first, as line is drawn directly.
+  GRAPHIC->FlushBatch();
   glLineWidth(width_);
   glColor4ui(color_.r, color_.g, color_.b, color_.a);
   glBegin(GL_LINES);
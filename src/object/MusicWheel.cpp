@@ -4,6 +4,8 @@
 #include "Player.h"
 #include "Setting.h"
 #include "rparser.h"
+#include "Logger.h"
+#include "Timer.h"
 #include "common.h"
 
 namespace rhythmus
@@ -74,14 +76,21 @@ void MusicWheelData::SetFromChart(const ChartMetaData* chart)
   title = chart->title;
   level = chart->level;
   diff = chart->difficulty;
+  songpath = chart->songpath;
+  UpdatePlayRecord();
+}
+
+/* @brief refresh clear lamp / rate from playrecord of current player. */
+void MusicWheelData::UpdatePlayRecord()
+{
   clear = ClearTypes::kClearNone;
   rate = .0;
-  songpath = chart->songpath;
+  if (chart_ == nullptr) return;
 
-  auto* playrecord = PlayerManager::GetPlayer()->GetPlayRecord(id_);
-  if (playrecord) {
-    clear = playrecord->clear_type;
-    rate = playrecord->rate();
+  auto* summary = PlayerManager::GetPlayer()->GetPlayRecordSummary(id_);
+  if (summary) {
+    clear = summary->clear_type;
+    rate = summary->rate;
   }
 }
 
@@ -153,7 +162,8 @@ bool MusicWheelData::IsRandom() const { return is_random_; }
 
 // ----------------------------- MusicWheelItem
 
-MusicWheelItem::MusicWheelItem()
+MusicWheelItem::MusicWheelItem() :
+  bar_type_(kBarUnknown), level_type_(kBarUnknown), level_value_(0)
 {
   for (size_t i = 0; i < NUM_SELECT_BAR_TYPES; ++i)
     AddChild(&background_[i]);
@@ -215,46 +225,59 @@ static const bool _type_to_disp_level[] = {
 void MusicWheelItem::LoadFromData(void *d)
 {
   MusicWheelData *data = static_cast<MusicWheelData*>(d);
-  unsigned item_type = (unsigned)MusicWheelDataType::None;
-  
-  // TODO: if data is nullptr, then clear all data and set as empty item
+  int bar_type = kBarHidden;
+  int level_type = kBarHidden;
+
+  WheelItem::LoadFromData(d);
+
+  // wrappers are recycled while scrolling,
+  // so only update the parts changed from previous data.
   if (data == nullptr)
   {
     title_.Hide();
-    for (size_t i = 0; i < NUM_SELECT_BAR_TYPES; ++i)
-      background_[i].Hide();
-    for (size_t i = 0; i < NUM_LEVEL_TYPES; ++i)
-      level_[i].Hide();
-    return;
   }
-
-  item_type = (unsigned)data->get_type();
-  title_.SetText(data->title);
-  title_.Show();
-
-  for (size_t i = 0; i < NUM_SELECT_BAR_TYPES; ++i)
+  else
   {
-    if (i == _type_to_baridx[item_type])
-      background_[i].Show();
-    else
-      background_[i].Hide();
+    unsigned item_type = (unsigned)data->get_type();
+    bar_type = _type_to_baridx[item_type];
+    if (_type_to_disp_level[item_type] && data->diff >= 0 && data->diff < NUM_LEVEL_TYPES)
+      level_type = data->diff;
+    title_.SetText(data->title);
+    title_.Show();
   }
 
-  for (size_t i = 0; i < NUM_LEVEL_TYPES; ++i)
+  if (bar_type_ != bar_type)
   {
-    if (i == data->diff && _type_to_disp_level[item_type])
+    for (int i = 0; i < NUM_SELECT_BAR_TYPES; ++i)
     {
-      level_[i].Show();
-      level_[i].SetNumber(data->level);
+      if (i == bar_type)
+        background_[i].Show();
+      else if (bar_type_ == kBarUnknown || i == bar_type_)
+        background_[i].Hide();
     }
-    else
+    bar_type_ = bar_type;
+  }
+
+  if (level_type_ != level_type || (level_type != kBarHidden && level_value_ != data->level))
+  {
+    for (int i = 0; i < NUM_LEVEL_TYPES; ++i)
     {
-      level_[i].Hide();
-      // XXX: kind of trick
-      // LR0 event causes level in not hidden state,
-      // so make it empty string instead of hidden.
-      level_[i].SetText(std::string());
+      if (i == level_type)
+      {
+        level_[i].Show();
+        level_[i].SetNumber(data->level);
+      }
+      else if (level_type_ == kBarUnknown || i == level_type_)
+      {
+        level_[i].Hide();
+        // XXX: kind of trick
+        // LR0 event causes level in not hidden state,
+        // so make it empty string instead of hidden.
+        level_[i].SetText(std::string());
+      }
     }
+    level_type_ = level_type;
+    level_value_ = level_type != kBarHidden ? data->level : 0;
   }
 }
 
@@ -282,6 +305,9 @@ void MusicWheelItem::doRender()
 
 // --------------------------- class MusicWheel
 
+/* section showing search result; shown only while searching. */
+static const char kSearchSectionId[] = "search";
+
 MusicWheel::MusicWheel() :
   info_title(KEYPOOL->GetString("MusicWheelTitle")),
   info_subtitle(KEYPOOL->GetString("MusicWheelSubTitle")),
@@ -316,7 +342,8 @@ MusicWheel::MusicWheel() :
   info_gd(KEYPOOL->GetInt("MusicWheelGD")),
   info_bd(KEYPOOL->GetInt("MusicWheelBD")),
   info_pr(KEYPOOL->GetInt("MusicWheelPR")),
-  info_musicwheelpos(KEYPOOL->GetFloat("MusicWheelPos"))
+  info_musicwheelpos(KEYPOOL->GetFloat("MusicWheelPos")),
+  info_search(KEYPOOL->GetString("MusicWheelSearch"))
 {
   set_name("MusicWheel");
   sort_.type = 0;
@@ -325,10 +352,19 @@ MusicWheel::MusicWheel() :
   filter_.difficulty = 0;
   filter_.invalidate = true;
   item_per_chart_ = true;
+  index_invalidate_ = true;
+  index_revision_ = 0;
+  index_song_count_ = 0;
+  search_invalidate_ = false;
 
   for (size_t i = 0; i < Sorttype::kSortEnd; ++i)
     sort_.avail_type[i] = 1;
 
+  // rebuild items when songs are added/removed from library
+  SubscribeTo("SongListChanged");
+  // update clear lamp / rate of a chart when it is played
+  SubscribeTo("PlayRecordChanged");
+
 #if 0
   set_display_count(24);
   set_focus_max_index(12);
@@ -346,6 +382,9 @@ void MusicWheel::Load(const MetricGroup &metric)
 {
   /* create section datas */
   data_sections_.clear();
+  data_sections_.push_back(
+    MusicWheelData(MusicWheelDataType::Folder, kSearchSectionId, "Search", true)
+  );
   data_sections_.push_back(
     MusicWheelData(MusicWheelDataType::Folder, "all_songs", "All Songs", true)
   );
@@ -389,6 +428,9 @@ void MusicWheel::InitializeLR2()
 
   /* create section datas */
   data_sections_.clear();
+  data_sections_.push_back(
+    MusicWheelData(MusicWheelDataType::Folder, kSearchSectionId, "Search", true)
+  );
   data_sections_.push_back(
     MusicWheelData(MusicWheelDataType::Folder, "all_songs", "All Songs", true)
   );
@@ -404,6 +446,9 @@ void MusicWheel::InitializeLR2()
   sort_.type = PrefValue<int>("sortmode").get();
   sort_.invalidate = true;
 
+  /* search word is typed into LR2 text 30 */
+  info_search = KEYPOOL->GetString("S30");
+
   {
     for (size_t i = 0; i < Sorttype::kSortEnd; ++i)
       sort_.avail_type[i] = 0;
@@ -440,28 +485,28 @@ void MusicWheel::OnSelectChange(const void *data, int direction)
   // update KeyPool
   auto* songinfo = d->GetChart();
   if (songinfo) {
-    *info_title = songinfo->title;
-    *info_subtitle = songinfo->subtitle;
-    *info_fulltitle = songinfo->title + " " + songinfo->subtitle;
-    *info_genre = songinfo->genre;
-    *info_artist = songinfo->artist;
-    *info_diff = songinfo->difficulty;
-    *info_bpmmax = songinfo->bpm_max;
-    *info_bpmmin = songinfo->bpm_min;
-    *info_level = songinfo->level;
+    info_title.set(songinfo->title);
+    info_subtitle.set(songinfo->subtitle);
+    info_fulltitle.set(songinfo->title + " " + songinfo->subtitle);
+    info_genre.set(songinfo->genre);
+    info_artist.set(songinfo->artist);
+    info_diff.set(songinfo->difficulty);
+    info_bpmmax.set(songinfo->bpm_max);
+    info_bpmmin.set(songinfo->bpm_min);
+    info_level.set(songinfo->level);
   }
   else {
-    *info_title = "";
-    *info_subtitle = "";
-    *info_fulltitle = "";
-    *info_genre = "";
-    *info_artist = "";
-    *info_diff = 0;
-    *info_bpmmax = 0;
-    *info_bpmmin = 0;
-    *info_level = 0;
+    info_title.set("");
+    info_subtitle.set("");
+    info_fulltitle.set("");
+    info_genre.set("");
+    info_artist.set("");
+    info_diff.set(0);
+    info_bpmmax.set(0);
+    info_bpmmin.set(0);
+    info_level.set(0);
   }
-  *info_itemtype = (int)d->get_type();
+  info_itemtype.set((int)d->get_type());
 
 
   /* TODO: Song difficulty existence
@@ -469,40 +514,56 @@ void MusicWheel::OnSelectChange(const void *data, int direction)
   int diff_type[5] = { 2, 2, -1, 2 ,3 };
   uint32_t levels[5] = { 3, 6, 9, 11, 12 };
    */
-  *info_difftype_1 = 1;
-  *info_difftype_2 = 2;
-  *info_difftype_3 = 2;
-  *info_difftype_4 = 4;
-  *info_difftype_5 = 5;
-  *info_difflv_1 = 2;
-  *info_difflv_2 = 3;
-  *info_difflv_3 = 8;
-  *info_difflv_4 = 11;
-  *info_difflv_5 = 12;
+  info_difftype_1.set(1);
+  info_difftype_2.set(2);
+  info_difftype_3.set(2);
+  info_difftype_4.set(4);
+  info_difftype_5.set(5);
+  info_difflv_1.set(2);
+  info_difflv_2.set(3);
+  info_difflv_3.set(8);
+  info_difflv_4.set(11);
+  info_difflv_5.set(12);
 
 
   // Load matching playrecord
   auto *playrecord = PlayerManager::GetPlayer()->GetPlayRecord(d->get_id());
   if (playrecord)
   {
-    *info_score = 100000;
-    *info_exscore = 1234;
-    *info_totalnote = 3000;
-    *info_maxcombo = 1000;
-    *info_playcount = 2;
-    *info_clearcount = 1;
-    *info_failcount = 1;
-    *info_cleartype = 2;
-    *info_pg = 1000;
-    *info_gr = 234;
-    *info_gd = 0;
-    *info_bd = 0;
-    *info_pr = 0;
+    info_score.set(playrecord->score);
+    info_exscore.set(playrecord->exscore());
+    info_totalnote.set(playrecord->total_note);
+    info_maxcombo.set(playrecord->maxcombo);
+    info_playcount.set(playrecord->playcount);
+    info_clearcount.set(playrecord->clearcount);
+    info_failcount.set(playrecord->failcount);
+    info_cleartype.set(playrecord->clear_type);
+    info_pg.set(playrecord->pg);
+    info_gr.set(playrecord->gr);
+    info_gd.set(playrecord->gd);
+    info_bd.set(playrecord->bd);
+    info_pr.set(playrecord->pr);
+  }
+  else
+  {
+    info_score.set(0);
+    info_exscore.set(0);
+    info_totalnote.set(0);
+    info_maxcombo.set(0);
+    info_playcount.set(0);
+    info_clearcount.set(0);
+    info_failcount.set(0);
+    info_cleartype.set(0);
+    info_pg.set(0);
+    info_gr.set(0);
+    info_gd.set(0);
+    info_bd.set(0);
+    info_pr.set(0);
   }
 
 
   // update pos
-  *info_musicwheelpos = static_cast<float>(data_index_ * 100.0 / size());
+  info_musicwheelpos.set(static_cast<float>(data_index_ * 100.0 / size()));
 
 
   // send event
@@ -550,68 +611,227 @@ void MusicWheel::NavigateRight()
   OnSelectChange(get_selected_data(0), 0);
 }
 
+/**
+ * @brief
+ * Index charts of song list into data_charts_.
+ * Songs appended since previous build are indexed incrementally,
+ * otherwise (songs removed or modified) index is built from scratch.
+ * @return false if index is rebuilt, which invalidates chart data.
+ */
+bool MusicWheel::BuildChartIndex()
+{
+  double start_time = Timer::GetUncachedSystemTime();
+  std::vector<ChartMetaData*> charts;
+  bool is_append = SONGLIST->GetChartListCopy(
+    charts, index_revision_, index_song_count_);
+  const size_t first = is_append ? data_charts_.size() : 0;
+  size_t words;
+
+  index_invalidate_ = false;
+  if (!is_append) {
+    data_charts_.clear();
+    chart_index_.clear();
+    for (size_t i = 0; i < Sorttype::kSortEnd; ++i)
+      sort_index_[i].clear();
+    filter_song_.clear();
+    for (auto &bits : filter_gamemode_) bits.clear();
+    for (auto &bits : filter_difficulty_) bits.clear();
+    filter_key_.clear();
+  }
+
+  // reserve first, so MusicWheelData pointer is stable while building.
+  // charts are grouped by song, so add backptr for selecting next difficulty
+  // from previous chart of same song.
+  data_charts_.reserve(first + charts.size());
+  chart_index_.reserve(first + charts.size());
+  MusicWheelData* prev_chart = nullptr;
+  for (auto* c : charts) {
+    if (prev_chart && prev_chart->GetChart()->song == c->song)
+      prev_chart->SetNextChartId(c->id);
+    chart_index_.emplace(c->id, (uint32_t)data_charts_.size());
+    data_charts_.emplace_back(c);
+    prev_chart = &data_charts_.back();
+  }
+
+  // build filter bitsets of new charts
+  words = (data_charts_.size() + 63) / 64;
+  auto set_bit = [words](std::vector<uint64_t> &bits, size_t i) {
+    if (bits.size() < words) bits.resize(words, 0);
+    bits[i / 64] |= (1ull << (i % 64));
+  };
+  auto grow = [words](std::vector<uint64_t> &bits) {
+    if (!bits.empty()) bits.resize(words, 0);
+  };
+  grow(filter_song_);
+  for (auto &bits : filter_gamemode_) grow(bits);
+  for (auto &bits : filter_difficulty_) grow(bits);
+  for (auto &bits : filter_key_) grow(bits);
+  for (size_t i = first; i < data_charts_.size(); ++i) {
+    const ChartMetaData* c = data_charts_[i].GetChart();
+    int gamemode = c->song ? c->song->type : Gamemode::kGamemodeNone;
+    if (i == first || data_charts_[i - 1].GetChart()->song != c->song)
+      set_bit(filter_song_, i);
+    if (gamemode >= 0 && gamemode < Gamemode::kGamemodeEnd)
+      set_bit(filter_gamemode_[gamemode], i);
+    if (c->difficulty >= 0 && c->difficulty < Difficulty::kDifficultyEnd)
+      set_bit(filter_difficulty_[c->difficulty], i);
+    if (c->key > 0) {
+      if ((size_t)c->key >= filter_key_.size())
+        filter_key_.resize(c->key + 1);
+      set_bit(filter_key_[c->key], i);
+    }
+  }
+  filter_mask_.assign(words, 0);
+  // keep previous search result of existing charts until index is ready.
+  if (is_append)
+    search_mask_.resize(words, 0);
+  else
+    search_mask_.assign(words, 0);
+  search_invalidate_ = true;
+
+  Logger::Info("MusicWheel: indexed %zu of %zu charts (%.1lf ms)",
+    charts.size(), data_charts_.size(),
+    (Timer::GetUncachedSystemTime() - start_time) * 1000.0);
+  return is_append;
+}
+
+/* @brief sort charts added after previous sort, then merge them. */
+void MusicWheel::BuildSortIndex(int sort)
+{
+  auto &index = sort_index_[sort];
+  const size_t first = index.size();
+  index.resize(data_charts_.size());
+  for (size_t i = first; i < index.size(); ++i)
+    index[i] = (uint32_t)i;
+
+  // stable, so charts with same key keep song list order.
+  // (merge is also stable, and new charts are after existing ones.)
+  const auto &d = data_charts_;
+  auto sort_merge = [&index, first](auto comp) {
+    std::stable_sort(index.begin() + first, index.end(), comp);
+    std::inplace_merge(index.begin(), index.begin() + first, index.end(), comp);
+  };
+  switch (sort)
+  {
+  case Sorttype::kNoSort:
+    break;
+  case Sorttype::kSortByLevel:
+    sort_merge([&d](uint32_t a, uint32_t b) { return d[a].level < d[b].level; });
+    break;
+  case Sorttype::kSortByTitle:
+    sort_merge([&d](uint32_t a, uint32_t b) { return d[a].title < d[b].title; });
+    break;
+  case Sorttype::kSortByClear:
+    sort_merge([&d](uint32_t a, uint32_t b) { return d[a].clear < d[b].clear; });
+    break;
+  case Sorttype::kSortByRate:
+    sort_merge([&d](uint32_t a, uint32_t b) { return d[a].rate < d[b].rate; });
+    break;
+  default:
+    R_ASSERT(0);
+  }
+}
+
+void MusicWheel::UpdateFilterMask()
+{
+  const size_t words = filter_mask_.size();
+
+  // if a filter has no chart, its bitset is empty and nothing passes.
+  auto and_bits = [this, words](const std::vector<uint64_t> *bits) {
+    if (!bits || bits->empty()) {
+      std::fill(filter_mask_.begin(), filter_mask_.end(), 0);
+      return;
+    }
+    for (size_t w = 0; w < words; ++w)
+      filter_mask_[w] &= (*bits)[w];
+  };
+
+  std::fill(filter_mask_.begin(), filter_mask_.end(), ~0ull);
+  if (!item_per_chart_)
+    and_bits(&filter_song_);
+  if (filter_.gamemode != Gamemode::kGamemodeNone) {
+    and_bits(filter_.gamemode > 0 && filter_.gamemode < Gamemode::kGamemodeEnd ?
+      &filter_gamemode_[filter_.gamemode] : nullptr);
+  }
+  if (filter_.key != 0) {
+    and_bits(filter_.key > 0 && (size_t)filter_.key < filter_key_.size() ?
+      &filter_key_[filter_.key] : nullptr);
+  }
+  if (filter_.difficulty != Difficulty::kDifficultyNone) {
+    and_bits(filter_.difficulty > 0 && filter_.difficulty < Difficulty::kDifficultyEnd ?
+      &filter_difficulty_[filter_.difficulty] : nullptr);
+  }
+}
+
+void MusicWheel::UpdateSearchMask()
+{
+  if (search_query_.empty()) {
+    std::fill(search_mask_.begin(), search_mask_.end(), 0);
+    return;
+  }
+
+  // index is built from same chart list order with data_charts_,
+  // so its chart ids are valid if song list revision is same.
+  // (song list may have more songs appended than data_charts_)
+  // if index is not built yet, SongListChanged is sent when it's done;
+  // previous search result is kept until then.
+  uint32_t revision;
+  auto index = SONGLIST->GetSearchIndex(revision);
+  if (!index || revision != index_revision_) return;
+  if (index != search_index_)
+  {
+    search_index_ = index;
+    search_state_ = SongSearchIndex::Query();
+  }
+
+  std::fill(search_mask_.begin(), search_mask_.end(), 0);
+  for (uint32_t idx : search_index_->Search(search_query_, search_state_))
+  {
+    if (idx < data_charts_.size())
+      search_mask_[idx / 64] |= (1ull << (idx % 64));
+  }
+}
+
 void MusicWheel::RebuildData()
 {
   std::string previous_selection;
+  const MusicWheelData* previous_data = nullptr;
+  size_t previous_index = (size_t)-1;
 
   // clear wheel items and store previously selected item here.
   // previously selected item will be used to focus item
   // after section open/close.
-  if (!data_.empty())
-    previous_selection = get_selected_data(0)->get_id();
+  if (!data_.empty()) {
+    previous_data = get_selected_data(0);
+    previous_selection = previous_data->get_id();
+  }
   else if (!current_section_.empty())
     previous_selection = current_section_;
   ClearData();
 
-  // filter songs -- invalidates chart data
-  if (filter_.invalidate) {
-    std::vector<const SongMetaData*> songlist;
-    std::vector<const ChartMetaData*> chartlist;
-    size_t i = 0;
-    bool pass_filter;
-
-    filter_.invalidate = false;
-    data_charts_.clear(); // TODO: free memory; ClearMusicWheelData()
-
-    // song filtering: gamemode
-    for (const auto *song : SONGLIST->GetSongList()) {
-      pass_filter = true;
-
-      switch (filter_.gamemode) {
-        case Gamemode::kGamemodeNone:
-          break;
-        default:
-          pass_filter = (song->type == filter_.gamemode);
-          break;
-      }
+  // chart selected previously, by pointer if chart data is alive
+  if (previous_data && !data_charts_.empty() &&
+      previous_data >= &data_charts_.front() &&
+      previous_data <= &data_charts_.back())
+    previous_index = previous_data - &data_charts_.front();
+
+  // build chart index -- invalidates chart data unless appended
+  if (index_invalidate_ || data_charts_.empty()) {
+    if (!BuildChartIndex())
+      previous_index = (size_t)-1;
+    filter_.invalidate = true;
+  }
 
-      if (pass_filter) songlist.push_back(song);
-    }
+  if (previous_index == (size_t)-1) {
+    auto ii = chart_index_.find(previous_selection);
+    if (ii != chart_index_.end())
+      previous_index = ii->second;
+  }
 
-    // chart filtering: key, difficulty
-    for (const auto* song : songlist) {
-      ChartMetaData* c = song->chart;
-      MusicWheelData* prev_chart = nullptr;
-      while (c) {
-        pass_filter = (filter_.key == 0 || c->key == filter_.key);
-        pass_filter &= (filter_.difficulty == Difficulty::kDifficultyNone ||
-          c->difficulty == filter_.difficulty);
-
-        // XXX: is chartlist necessary?
-        if (!pass_filter) chartlist.push_back(c);
-
-        // add backptr for selecting next difficulty
-        if (prev_chart) {
-          prev_chart->SetNextChartId(c->id);
-        }
-        data_charts_.push_back(MusicWheelData(c));
-        prev_chart = &data_charts_.back();
-
-        if (!item_per_chart_) break;
-        c = c->next;
-        if (c == song->chart) break;
-      }
-    }
+  // filter songs
+  if (filter_.invalidate) {
+    filter_.invalidate = false;
+    UpdateFilterMask();
 
     // XXX: need to send in sort invalidation
     KEYPOOL->GetInt("difficulty").set(filter_.difficulty);
@@ -620,63 +840,41 @@ void MusicWheel::RebuildData()
     EVENTMAN->SendEvent("SongFilterChanged");
   }
 
-  // sort data object
-  if (sort_.invalidate)
-  {
-    sort_.invalidate = false;
-    switch (sort_.type)
-    {
-    case Sorttype::kNoSort:
-      break;
-    case Sorttype::kSortByLevel:
-      std::sort(data_charts_.begin(), data_charts_.end(),
-        [](const MusicWheelData &a, const MusicWheelData &b) {
-        return a.level < b.level;
-      });
-      break;
-    case Sorttype::kSortByTitle:
-      std::sort(data_charts_.begin(), data_charts_.end(),
-        [](const MusicWheelData &a, const MusicWheelData &b) {
-        return a.title < b.title;
-      });
-      break;
-    case Sorttype::kSortByClear:
-      std::sort(data_charts_.begin(), data_charts_.end(),
-        [](const MusicWheelData &a, const MusicWheelData &b) {
-        return a.clear < b.clear;
-      });
-      break;
-    case Sorttype::kSortByRate:
-      std::sort(data_charts_.begin(), data_charts_.end(),
-        [](const MusicWheelData &a, const MusicWheelData &b) {
-        return a.rate < b.rate;
-      });
-      break;
-    default:
-      R_ASSERT(0);
-    }
+  // search songs
+  if (search_invalidate_) {
+    search_invalidate_ = false;
+    UpdateSearchMask();
   }
 
+  // sort data object (sort index is reused until chart index is rebuilt)
+  sort_.invalidate = false;
+  if (sort_index_[sort_.type].size() != data_charts_.size())
+    BuildSortIndex(sort_.type);
+
   // add songs & default sections/items
+  data_index_ = 0;
   for (size_t i = 0; i < data_sections_.size(); ++i)
   {
+    const bool is_search = data_sections_[i].get_id() == kSearchSectionId;
+    if (is_search && search_query_.empty())
+      continue;
+    if (data_sections_[i].get_id() == previous_selection)
+      data_index_ = data_.size();
     AddData(&data_sections_[i]);
     if (data_sections_[i].get_id() == current_section_)
     {
       // TODO: filtering once again by section type/name
-      for (auto &d : data_charts_)
-        AddData(&d);
-    }
-  }
-  
-  // re-select previous selection
-  data_index_ = 0;
-  for (size_t i = 0; i < data_.size(); ++i)
-  {
-    if (static_cast<MusicWheelData*>(data_[i].p)->get_id() == previous_selection)
-    {
-      data_index_ = i;
-      break;
+      for (uint32_t idx : sort_index_[sort_.type])
+      {
+        uint64_t mask = filter_mask_[idx / 64];
+        if (is_search)
+          mask &= search_mask_[idx / 64];
+        if (((mask >> (idx % 64)) & 1) == 0)
+          continue;
+        if (idx == previous_index)
+          data_index_ = data_.size();
+        AddData(&data_charts_[idx]);
+      }
     }
   }
 
@@ -684,18 +882,33 @@ void MusicWheel::RebuildData()
   RebuildItems();
 }
 
-void MusicWheel::RebuildDataContent(WheelItemData &data)
+bool MusicWheel::OnEvent(const EventMessage &msg)
 {
-  // create from MusicWheel.item data
-  // so metric must be alive after object initialization
-  if (!data.content)
+  static const int kSongListChanged = EventManager::GetEventID("SongListChanged");
+  static const int kPlayRecordChanged = EventManager::GetEventID("PlayRecordChanged");
+  if (msg.GetEventID() == kSongListChanged)
   {
-    MusicWheelItem *item = new MusicWheelItem();
-    item->set_name("MusicWheelItem");
-    item->LoadFromName();
-    item->set_parent(this);
-    data.content = item;
+    // song metadata previously indexed might be removed.
+    index_invalidate_ = true;
+    filter_.invalidate = true;
+    sort_.invalidate = true;
+    RebuildData();
+  }
+  else if (msg.GetEventID() == kPlayRecordChanged)
+  {
+    auto ii = chart_index_.find(msg.content());
+    if (ii != chart_index_.end())
+    {
+      // permutations sorted by clear lamp / rate are stale now,
+      // so rebuild them when used (at once if currently sorted by them).
+      data_charts_[ii->second].UpdatePlayRecord();
+      sort_index_[Sorttype::kSortByClear].clear();
+      sort_index_[Sorttype::kSortByRate].clear();
+      if (sort_.type == Sorttype::kSortByClear || sort_.type == Sorttype::kSortByRate)
+        RebuildData();
+    }
   }
+  return Wheel::OnEvent(msg);
 }
 
 WheelItem *MusicWheel::CreateWheelWrapper()
@@ -785,6 +998,36 @@ int MusicWheel::GetDifficultyFilter() const
   return filter_.difficulty;
 }
 
+void MusicWheel::Search(const std::string &query)
+{
+  if (query == search_query_) return;
+  search_query_ = query;
+  search_invalidate_ = true;
+
+  // open search section while searching
+  for (auto &section : data_sections_)
+  {
+    if (section.get_id() == kSearchSectionId)
+      section.SetAsSection("Search: " + query);
+  }
+  if (!search_query_.empty())
+    current_section_ = kSearchSectionId;
+  else if (current_section_ == kSearchSectionId)
+    current_section_.clear();
+
+  RebuildData();
+  OnSelectChange(get_selected_data(0), 0);
+}
+
+void MusicWheel::doUpdate(double delta)
+{
+  Wheel::doUpdate(delta);
+
+  // search incrementally as search word is typed
+  if (*info_search != search_query_)
+    Search(*info_search);
+}
+
 // -------------------------------------------------------------------- Loaders
 
 class LR2CSVMusicWheelHandlers
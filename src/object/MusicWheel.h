@@ -6,8 +6,12 @@
 #include "Text.h"
 #include "Number.h"
 #include "KeyPool.h"
+#include "SongSearch.h"
 #include <memory>
 #include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
 
 namespace rhythmus
 {
@@ -25,6 +29,7 @@ public:
   void SetFromChart(const ChartMetaData* chart);
   void SetAsSection(const std::string& name);
   void SetRandom(bool is_random);
+  void UpdatePlayRecord();
   const ChartMetaData* GetChart() const;
   void NextChart();
   void SetNextChartId(const std::string& id);
@@ -71,6 +76,12 @@ private:
   Number level_[NUM_LEVEL_TYPES];
   Text title_;
 
+  /* currently displayed state, to skip unchanged parts when rebound */
+  enum { kBarUnknown = -2, kBarHidden = -1 };
+  int bar_type_;
+  int level_type_;
+  int level_value_;
+
   virtual void doUpdate(double delta);
   virtual void doRender();
 };
@@ -92,7 +103,7 @@ public:
   virtual void NavigateLeft();
   virtual void NavigateRight();
   virtual void RebuildData();
-  virtual void RebuildDataContent(WheelItemData &data);
+  virtual bool OnEvent(const EventMessage &msg);
   virtual WheelItem *CreateWheelWrapper();
 
   void OpenSection(const std::string &section);
@@ -106,6 +117,7 @@ public:
   int GetSort() const;
   int GetGamemode() const;
   int GetDifficultyFilter() const;
+  void Search(const std::string &query);
 
   friend class MusicWheelItem;
 
@@ -126,11 +138,42 @@ private:
   /* display item per chart. if not, per song. */
   bool item_per_chart_;
 
-  /* filtered items */
+  /* chart items of whole song list, rebuilt only when song list changes.
+   * filtered/sorted items refer to this by index. */
   std::vector<MusicWheelData> data_charts_;
   /* section items (created by default) */
   std::vector<MusicWheelData> data_sections_;
 
+  /* data_charts_ index permutation per sort type (built when first used) */
+  std::vector<uint32_t> sort_index_[Sorttype::kSortEnd];
+  /* filter bitsets of data_charts_ (bit per chart) */
+  std::vector<uint64_t> filter_gamemode_[Gamemode::kGamemodeEnd];
+  std::vector<uint64_t> filter_difficulty_[Difficulty::kDifficultyEnd];
+  std::vector<std::vector<uint64_t> > filter_key_;
+  std::vector<uint64_t> filter_song_;   // first chart of each song
+  /* charts passing current filter */
+  std::vector<uint64_t> filter_mask_;
+  /* chart id to data_charts_ index, for re-selection */
+  std::unordered_map<std::string, uint32_t> chart_index_;
+  bool index_invalidate_;
+  /* song list revision / song count indexed into data_charts_ */
+  uint32_t index_revision_;
+  size_t index_song_count_;
+
+  /* text search index of song list (built by SongList in background),
+   * and search state of this wheel */
+  std::shared_ptr<const SongSearchIndex> search_index_;
+  SongSearchIndex::Query search_state_;
+  bool search_invalidate_;
+  std::string search_query_;
+  /* charts matching search query */
+  std::vector<uint64_t> search_mask_;
+
+  bool BuildChartIndex();
+  void BuildSortIndex(int sort);
+  void UpdateFilterMask();
+  void UpdateSearchMask();
+
   /* Keypools updated by MusicWheel object */
   KeyData<std::string> info_title;
   KeyData<std::string> info_subtitle;
@@ -166,6 +209,9 @@ private:
   KeyData<int> info_bd;
   KeyData<int> info_pr;
   KeyData<float> info_musicwheelpos;
+  KeyData<std::string> info_search;
+
+  virtual void doUpdate(double delta);
 };
 
 }
\ No newline at end of file
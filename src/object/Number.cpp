@@ -15,7 +15,7 @@ namespace rhythmus
 Number::Number() :
   img_(nullptr), font_(nullptr), blending_(0), tvi_glyphs_(nullptr),
   cycle_count_(0), cycle_time_(0), cycle_curr_time_(0), val_ptr_(nullptr),
-  keta_(1), resize_to_box_(false)
+  val_id_(0), keta_(1), resize_to_box_(false)
 {
   set_xy_as_center_ = true;
   memset(&value_params_, 0, sizeof(value_params_));
@@ -91,6 +91,12 @@ void Number::SetGlyphFromImage(const std::string &path, const Rect &imgcoord,
       tvi.vi[1].t /= texsize;
       tvi.vi[2].t /= texsize;
       tvi.vi[3].t /= texsize;
+      if (img_->is_bottom_up())
+      {
+        // bitmap stored from bottom scanline; flip texture coordinate.
+        for (int k = 0; k < 4; ++k)
+          tvi.vi[k].t.y = 1.0f - tvi.vi[k].t.y;
+      }
       tvi.vi[0].c = Vector4(1.0f, 1.0f, 1.0f, 1.0f);
       tvi.vi[1].c = Vector4(1.0f, 1.0f, 1.0f, 1.0f);
       tvi.vi[2].c = Vector4(1.0f, 1.0f, 1.0f, 1.0f);
@@ -179,6 +185,7 @@ void Number::SetResourceId(const std::string &id)
   /* set value instantly */
   KeyData<int> kdata = KEYPOOL->GetInt(id);
   val_ptr_ = &*kdata;
+  val_id_ = kdata.id();
   Refresh();
 }
 
@@ -388,6 +395,10 @@ void Number::doUpdate(double delta)
 {
   bool updated = false;
 
+  // refresh only if bound value is changed.
+  if (val_ptr_ && KEYPOOL->IsIntChanged(val_id_))
+    Refresh();
+
   // update current number (rolling effect)
   if (value_params_.time > 0)
   {
@@ -72,7 +72,8 @@ private:
   char num_chrs[256];
 
   // reference to value (if necessary)
-  int *val_ptr_;
+  const int *val_ptr_;
+  size_t val_id_;
 
   // width multiply (for LR2 specification)
   int keta_;
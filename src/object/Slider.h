@@ -41,7 +41,7 @@ private:
 
   float maxvalue_;
   float value_;
-  float *val_ptr_;
+  const float *val_ptr_;
 
   bool editable_;
 
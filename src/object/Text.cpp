@@ -15,8 +15,8 @@ RHYTHMUS_NAMESPACE_BEGIN
 Text::Text()
   : font_(nullptr),
     text_fitting_(TextFitting::kTextFitNone), set_xy_aligncenter_(false),
-    use_height_as_font_height_(false), autosize_(false), blending_(0),
-    res_id_(nullptr), do_line_breaking_(true)
+    use_height_as_font_height_(false), editable_(false), autosize_(false), blending_(0),
+    res_id_(nullptr), res_key_id_(0), do_line_breaking_(true)
 {
   set_xy_as_center_ = true;
   alignment_attrs_.sx = alignment_attrs_.sy = 1.0f;
@@ -29,9 +29,9 @@ Text::Text(const Text &text) : BaseObject(text), font_(nullptr),
   text_fitting_(text.text_fitting_),
   text_alignment_(text.text_alignment_), set_xy_aligncenter_(text.set_xy_aligncenter_),
   use_height_as_font_height_(text.use_height_as_font_height_),
-  alignment_attrs_(text.alignment_attrs_),
+  alignment_attrs_(text.alignment_attrs_), editable_(text.editable_),
   autosize_(text.autosize_), blending_(text.blending_), counter_(text.counter_),
-  res_id_(text.res_id_), do_line_breaking_(text.do_line_breaking_)
+  res_id_(text.res_id_), res_key_id_(text.res_key_id_), do_line_breaking_(text.do_line_breaking_)
 {
   text_render_ctx_.drawsize = Vector2(0, 0);
   text_render_ctx_.width = 0;
@@ -57,6 +57,7 @@ void Text::Load(const MetricGroup &m)
 
   // Load autosize first before loading text.
   m.get_safe("autosize", autosize_);
+  m.get_safe("editable", editable_);
 
   if (m.exist("path"))
   {
@@ -172,6 +173,7 @@ void Text::SetTextResource(const std::string &resname)
 {
   KeyData<std::string> kdata = KEYPOOL->GetString(resname);
   res_id_ = &*kdata;
+  res_key_id_ = kdata.id();
 }
 
 // @warn
@@ -323,6 +325,11 @@ void Text::SetLR2StyleText(bool v)
   use_height_as_font_height_ = v;
 }
 
+void Text::SetEditable(bool editable)
+{
+  editable_ = editable;
+}
+
 void Text::OnText(uint32_t codepoint)
 {
   if (!editable_) return;
@@ -345,7 +352,7 @@ void Text::OnText(uint32_t codepoint)
   }
 
   if (res_id_)
-    *res_id_ = text_;
+    KEYPOOL->SetString(res_key_id_, text_);
 
   // clear and update text vertex
   text_render_ctx_.textvertex.clear();
@@ -374,6 +381,10 @@ void Text::OnAnimation(DrawProperty &frame)
 
 void Text::doUpdate(double delta)
 {
+  // refresh only if bound text is changed.
+  if (res_id_ && KEYPOOL->IsStringChanged(res_key_id_))
+    Refresh();
+
   // hook animation position for LR2
   // (TODO)
 }
@@ -501,7 +512,10 @@ public:
 
     /* editable (focusable) */
     if (ctx->get_int(5) > 0)
+    {
       o->SetFocusable(true);
+      o->SetEditable(true);
+    }
 
     /* TODO: panel */
   }
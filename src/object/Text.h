@@ -36,6 +36,7 @@ public:
   void SetLineBreaking(bool enable_line_break);
   void SetTextAlignment(float x, float y);
   void SetLR2StyleText(bool v);
+  void SetEditable(bool editable);
 
   virtual void OnText(uint32_t codepoint);
 
@@ -102,7 +103,8 @@ private:
   // internal counter for updating Text object intervally.
   unsigned counter_;
 
-  std::string *res_id_;
+  const std::string *res_id_;
+  size_t res_key_id_;
 
   // is line-breaking enabled?
   bool do_line_breaking_;
@@ -137,7 +137,7 @@ Wheel::~Wheel()
 
 void Wheel::Load(const MetricGroup &metric)
 {
-  unsigned wheelwrappersize = 30;
+  int wrapper_count = 0;
 
   // Load itemview attributes
   BaseObject::Load(metric);
@@ -145,7 +145,7 @@ void Wheel::Load(const MetricGroup &metric)
   metric.get_safe("itemtype", item_type_);
   metric.get_safe("itemheight", item_height_);
   metric.get_safe("itemcountauto", set_item_count_auto_);
-  metric.get_safe("itemcount", (int&)wheelwrappersize);
+  metric.get_safe("itemcount", wrapper_count);
   if (!set_item_count_auto_)
     metric.get_safe("itemcount", item_count_);
   else
@@ -159,7 +159,11 @@ void Wheel::Load(const MetricGroup &metric)
     set_item_center_index((unsigned)center_index);
   }
 
-  SetWheelWrapperCount(wheelwrappersize);
+  // wrappers are recycled for visible items,
+  // with margin for items scrolling in/out.
+  // theme may request more wrappers by itemcount (e.g. bars of LR2 skin).
+  SetWheelWrapperCount(std::max(
+    (unsigned)std::max(wrapper_count, 0), item_count_ + kWheelItemMargin));
   const MetricGroup *itemmetric = metric.get_group("item");
   if (itemmetric) {
     for (auto *item : items_)
@@ -273,11 +277,15 @@ void Wheel::RebuildItems()
       // hide looping item
       item->Hide();
     }
-    else if (item->is_empty() || item->get_dataindex() != item_index)
+    else
     {
-      WheelItemData &data = data_[item_index];
-      RebuildDataContent(data);
-      item->LoadFromWheelData(data);
+      // rebind wrapper only if data is changed.
+      if (item->is_empty() || item->get_dataindex() != item_index)
+      {
+        WheelItemData &data = data_[item_index];
+        RebuildDataContent(data);
+        item->LoadFromWheelData(data);
+      }
       item->set_itemindex(selindex);
       item->set_focus(data_index_ == item_index_raw);
       item->Show();